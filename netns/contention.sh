@@ -0,0 +1,208 @@
+#!/bin/sh
+# PCC flows with the CPUs that take their ACKs under load, on a test bed made
+# with testbed.sh up. Every cell of the matrix of RPS (off, on) and load
+# (none, user, softirq, both) runs the flows for some trials:
+#
+#   contention.sh [options]
+#
+# options:
+#   --cpus LIST       CPUs the pccperf sender and sink and the load run on (default 0)
+#   --rps-cpus LIST   CPUs RPS steers the receive processing of the sender to
+#                     when it is on (default every other online CPU)
+#   --loads L         comma separated loads to run (default none,user,softirq,both)
+#   --rps R           comma separated RPS settings to run (default off,on)
+#   -P flows          flows of every run (default 1)
+#   -t seconds        length of a run (default 20)
+#   -w seconds        warmup left out of the results (default 5)
+#   -r trials         runs of every cell (default 5)
+#   -o file           append the results to file with pccresults.py
+#
+# The user load is a busy loop on every CPU of --cpus, the softirq load a
+# flood of small UDP datagrams from the receiver to the sender, sent from a
+# process pinned to the same CPUs so the veth receive of the flood runs
+# there, in the softirq the ACKs of the flows are processed in. With RPS on,
+# the sender's veth hands its receive processing to --rps-cpus.
+#
+# Every run leaves the pccperf log and a line with the PCC counters of the
+# sender namespace it moved, and the softirq time of all CPUs, in
+# /tmp/pcc-contention/rps_<rps>_<load>.<trial>.log:
+#
+#   contention decisions D inconclusive I monitors M overruns O equilibrium_left E softirq_s S duration_s T
+#
+# Compare two builds of the module with:
+#   contention.sh -o base.csv; (load the new module) contention.sh -o new.csv
+#   ../tools/pccresults.py compare base.csv new.csv
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+PCCPERF=$DIR/../tools/pccperf
+PCCRESULTS=$DIR/../tools/pccresults.py
+STATE=/tmp/pcc-contention
+SND=pcc-snd
+RCV=pcc-rcv
+PORT=9100
+FLOOD_PORT=9
+
+CPUS=0
+RPS_CPUS=
+LOADS=none,user,softirq,both
+RPS=off,on
+FLOWS=1
+DURATION=20
+WARMUP=5
+TRIALS=5
+OUT=
+
+parse_options() {
+	while [ $# -gt 0 ]; do
+		case "$1" in
+			--cpus) CPUS=$2; shift ;;
+			--rps-cpus) RPS_CPUS=$2; shift ;;
+			--loads) LOADS=$2; shift ;;
+			--rps) RPS=$2; shift ;;
+			-P) FLOWS=$2; shift ;;
+			-t) DURATION=$2; shift ;;
+			-w) WARMUP=$2; shift ;;
+			-r) TRIALS=$2; shift ;;
+			-o) OUT=$2; shift ;;
+			*) echo "unknown option $1" >&2; sed -n '2,35p' "$0" >&2; exit 1 ;;
+		esac
+		shift
+	done
+}
+
+# the CPUs of a list like 0,2-3 one per line
+cpu_list() {
+	echo "$1" | tr ',' '\n' | awk -F- '{ for (c = $1; c <= ($2 == "" ? $1 : $2); c++) print c }'
+}
+
+# hex mask of a CPU list, as rps_cpus takes it (up to 64 CPUs)
+cpu_mask() {
+	mask=0
+	for c in $(cpu_list "$1"); do
+		mask=$((mask | (1 << c)))
+	done
+	printf '%x\n' $mask
+}
+
+# every online CPU not in the list $1
+other_cpus() {
+	cpu_list "$(cat /sys/devices/system/cpu/online)" | grep -vxF "$(cpu_list "$1")" | paste -sd, -
+}
+
+set_rps() {
+	mask=0
+	[ "$1" = on ] && mask=$(cpu_mask "$RPS_CPUS")
+	for q in $(ip netns exec $SND sh -c 'ls -d /sys/class/net/snd0/queues/rx-*'); do
+		ip netns exec $SND sh -c "echo $mask > $q/rps_cpus"
+	done
+}
+
+start_load() {
+	: > $STATE/load.pids
+	if [ "$1" = user ] || [ "$1" = both ]; then
+		for c in $(cpu_list "$CPUS"); do
+			taskset -c "$c" sh -c 'while :; do :; done' &
+			echo $! >> $STATE/load.pids
+		done
+	fi
+	if [ "$1" = softirq ] || [ "$1" = both ]; then
+		for c in $(cpu_list "$CPUS"); do
+			taskset -c "$c" ip netns exec $RCV python3 -c '
+import socket
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.connect(("10.10.1.1", '$FLOOD_PORT'))
+while True:
+    try:
+        s.send(b"x" * 18)
+    except OSError:
+        pass
+' &
+			echo $! >> $STATE/load.pids
+		done
+	fi
+}
+
+stop_load() {
+	for pid in $(cat $STATE/load.pids); do
+		kill "$pid" 2>/dev/null
+		wait "$pid" 2>/dev/null
+	done
+	: > $STATE/load.pids
+}
+
+# the counters of the sender namespace as "name value"
+pcc_counters() {
+	ip netns exec $SND cat /proc/net/pcc
+}
+
+# softirq seconds of all CPUs so far
+softirq_seconds() {
+	awk -v hz="$(getconf CLK_TCK)" '$1 == "cpu" { printf "%.2f\n", $8 / hz }' /proc/stat
+}
+
+# one run of the flows, the log with the counter line at the end to $1
+run_flows() {
+	pcc_counters > $STATE/counters.before
+	softirq_start=$(softirq_seconds)
+	start=$(date +%s.%N)
+	taskset -c "$CPUS" ip netns exec $SND "$PCCPERF" -c 10.10.2.2 -p $PORT -P "$FLOWS" -t "$DURATION" \
+		-i 1000 > "$1" 2>&1
+	end=$(date +%s.%N)
+	softirq_end=$(softirq_seconds)
+	pcc_counters > $STATE/counters.after
+	awk -v softirq_start="$softirq_start" -v softirq_end="$softirq_end" -v start="$start" -v end="$end" '
+		FNR == NR { before[$1] = $2; next }
+		{ moved[$1] = $2 - before[$1] }
+		END {
+			printf "contention decisions %d inconclusive %d monitors %d overruns %d equilibrium_left %d softirq_s %.2f duration_s %.2f\n",
+				moved["decisions_up"] + moved["decisions_down"] + moved["decisions_inconclusive"],
+				moved["decisions_inconclusive"], moved["monitors"], moved["monitor_overruns"],
+				moved["equilibrium_left"], softirq_end - softirq_start, end - start
+		}
+	' $STATE/counters.before $STATE/counters.after >> "$1"
+}
+
+main() {
+	parse_options "$@"
+	if [ ! -x "$PCCPERF" ]; then
+		echo "$PCCPERF not found, run make in $DIR/../tools" >&2
+		exit 1
+	fi
+	if ! ip netns exec $SND test -r /proc/net/pcc; then
+		echo "no /proc/net/pcc in $SND, run testbed.sh up and load the module" >&2
+		exit 1
+	fi
+	[ -n "$RPS_CPUS" ] || RPS_CPUS=$(other_cpus "$CPUS")
+	if [ -z "$RPS_CPUS" ]; then
+		echo "no CPU left for RPS, rps_on runs like rps_off" >&2
+	fi
+	mkdir -p $STATE
+	: > $STATE/load.pids
+	trap 'stop_load; kill $sink 2>/dev/null; set_rps off; exit 1' INT TERM
+	taskset -c "$CPUS" ip netns exec $RCV "$PCCPERF" -s -p $PORT > $STATE/sink.log 2>&1 &
+	sink=$!
+	sleep 1
+	for rps in $(echo "$RPS" | tr ',' ' '); do
+		set_rps "$rps"
+		for load in $(echo "$LOADS" | tr ',' ' '); do
+			trial=1
+			while [ $trial -le "$TRIALS" ]; do
+				log=$STATE/rps_${rps}_$load.$trial.log
+				start_load "$load"
+				sleep 1
+				run_flows "$log"
+				stop_load
+				echo "rps_${rps}_$load trial $trial: $(grep '^summary cpu' "$log") $(tail -n 1 "$log")"
+				if [ -n "$OUT" ]; then
+					"$PCCRESULTS" record -s contention -n "rps_${rps}_$load" -r $trial -w "$WARMUP" \
+						-o "$OUT" "$log"
+				fi
+				trial=$((trial + 1))
+			done
+		done
+	done
+	set_rps off
+	kill $sink 2>/dev/null
+}
+
+main "$@"
@@ -0,0 +1,217 @@
+/*
+ * impair: a tc-BPF link impairment for the netns test bed.
+ * Attached on the egress of a router veth in front of an fq qdisc, it emulates
+ * a bottleneck link without netem/tbf:
+ *  - rate limit: a virtual FIFO queue serializes packets at rate_bps, and the
+ *    departure time is set as the skb EDT (skb->tstamp) which fq enforces.
+ *    Packets that would wait more than queue_limit_us in the queue are dropped.
+ *  - delay: delay_us is added to the departure time.
+ *  - loss: random (loss_ppm, in parts per million) and/or fixed (every
+ *    loss_every packets).
+ *  - capacity schedule: when schedule_len is set, the rate comes from
+ *    impair_schedule_map, one rate per schedule_slot_us slot, taken at the
+ *    time the packet starts serialization. Zero rate slots are outages, the
+ *    packet waits for the next slot with capacity. The schedule holds its
+ *    last slot, or repeats with schedule_repeat (traces). Writing a new
+ *    schedule_epoch restarts the schedule from the next packet.
+ * The only per-packet shared state is the queue tail, under one spin lock.
+ *
+ * Requires fq on the device (it honours skb->tstamp) and kernel 5.3+, for the
+ * bounded retry and outage loops (bpf_spin_lock alone would need 5.1).
+ */
+
+#include <linux/bpf.h>
+#include <linux/pkt_cls.h>
+#include <bpf/bpf_helpers.h>
+
+#define NSEC_PER_SEC (1000000000ULL)
+#define NSEC_PER_USEC (1000ULL)
+#define IMPAIR_SCHEDULE_SLOTS (65536)
+#define IMPAIR_MAX_OUTAGE_SLOTS (16)
+#define IMPAIR_MAX_RETRIES (4)
+
+struct impair_config {
+	__u64 rate_bps;					//bottleneck rate, 0 for no rate limit
+	__u32 delay_us;					//one way delay added to every packet
+	__u32 queue_limit_us;			//max queueing delay before tail drop, 0 for no limit
+	__u32 loss_ppm;					//random loss in parts per million
+	__u32 loss_every;				//drop every n-th packet, 0 for no fixed loss
+	__u32 schedule_slot_us;			//length of a schedule slot
+	__u32 schedule_len;				//slots in the schedule, 0 to use rate_bps
+	__u32 schedule_repeat;			//1 to repeat the schedule, 0 to hold the last slot
+	__u32 schedule_epoch;			//changed by userspace to restart the schedule
+};
+
+struct impair_state {
+	struct bpf_spin_lock lock;
+	__u64 queue_tail_ns;			//time the last queued packet finishes serialization
+	__u64 packets;					//packets seen
+	__u64 bytes;					//bytes passed
+	__u64 loss_drops;				//packets dropped by the loss model
+	__u64 queue_drops;				//packets dropped by a full queue
+	__u64 schedule_start_ns;		//time the schedule started
+	__u32 schedule_epoch;			//epoch of the running schedule
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, __u32);
+	__type(value, struct impair_config);
+	__uint(pinning, LIBBPF_PIN_BY_NAME);
+} impair_config_map SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, __u32);
+	__type(value, struct impair_state);
+	__uint(pinning, LIBBPF_PIN_BY_NAME);
+} impair_state_map SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, IMPAIR_SCHEDULE_SLOTS);
+	__type(key, __u32);
+	__type(value, __u64);
+	__uint(pinning, LIBBPF_PIN_BY_NAME);
+} impair_schedule_map SEC(".maps");
+
+/** rate of the schedule slot holding t, and the end of that slot */
+static __always_inline __u64 schedule_rate(struct impair_config *cfg, struct impair_state *st, __u64 t,
+	__u64 *slot_end)
+{
+	__u64 slot_ns = (__u64)cfg->schedule_slot_us * NSEC_PER_USEC;
+	__u64 slot, elapsed = t > st->schedule_start_ns ? t - st->schedule_start_ns : 0;
+	__u64 *rate;
+	__u32 key;
+
+	if (slot_ns == 0) {
+		slot_ns = NSEC_PER_USEC;
+	}
+	slot = elapsed / slot_ns;
+	*slot_end = st->schedule_start_ns + (slot + 1) * slot_ns;
+	if (slot >= cfg->schedule_len) {
+		slot = cfg->schedule_repeat ? slot % cfg->schedule_len : cfg->schedule_len - 1;
+	}
+	key = slot;
+	rate = bpf_map_lookup_elem(&impair_schedule_map, &key);
+	return rate ? *rate : 0;
+}
+
+SEC("tc")
+int impair(struct __sk_buff *skb)
+{
+	__u32 key = 0;
+	struct impair_config *cfg = bpf_map_lookup_elem(&impair_config_map, &key);
+	struct impair_state *st = bpf_map_lookup_elem(&impair_state_map, &key);
+	__u64 now = bpf_ktime_get_ns();
+	__u64 departure = now;
+	__u64 packets;
+	int drop = 0;
+
+	if (!cfg || !st) {
+		return TC_ACT_OK;
+	}
+
+	packets = __sync_fetch_and_add(&st->packets, 1) + 1;
+	if (cfg->loss_every != 0 && packets % cfg->loss_every == 0) {
+		drop = 1;
+	}
+	if (cfg->loss_ppm != 0 && bpf_get_prandom_u32() % 1000000 < cfg->loss_ppm) {
+		drop = 1;
+	}
+	if (drop) {
+		__sync_fetch_and_add(&st->loss_drops, 1);
+		return TC_ACT_SHOT;
+	}
+
+	if (cfg->schedule_len != 0 && st->schedule_epoch != cfg->schedule_epoch) {
+		//racing cpus all set about the same start
+		st->schedule_start_ns = now;
+		st->schedule_epoch = cfg->schedule_epoch;
+	}
+
+	if (cfg->schedule_len == 0 && cfg->rate_bps != 0) {
+		__u64 tx_ns = (__u64)skb->len * 8 * NSEC_PER_SEC / cfg->rate_bps;
+		__u64 start;
+
+		bpf_spin_lock(&st->lock);
+		start = st->queue_tail_ns > now ? st->queue_tail_ns : now;
+		if (cfg->queue_limit_us != 0 && start - now > cfg->queue_limit_us * NSEC_PER_USEC) {
+			drop = 1;
+		} else {
+			st->queue_tail_ns = start + tx_ns;
+		}
+		bpf_spin_unlock(&st->lock);
+
+		if (drop) {
+			__sync_fetch_and_add(&st->queue_drops, 1);
+			return TC_ACT_SHOT;
+		}
+		departure = start + tx_ns;
+	} else if (cfg->schedule_len != 0) {
+		__u64 tail, start, rate = 0, slot_end;
+		int committed = 0, i, j;
+
+		//the schedule lookups can't run under the lock, so the tail is read, the
+		//departure computed and then committed only if the tail did not move
+		for (i = 0; i < IMPAIR_MAX_RETRIES && !committed; i++) {
+			bpf_spin_lock(&st->lock);
+			tail = st->queue_tail_ns;
+			bpf_spin_unlock(&st->lock);
+
+			start = tail > now ? tail : now;
+			for (j = 0; j < IMPAIR_MAX_OUTAGE_SLOTS; j++) {
+				rate = schedule_rate(cfg, st, start, &slot_end);
+				if (rate != 0) {
+					break;
+				}
+				start = slot_end;
+			}
+			if (rate == 0 || (cfg->queue_limit_us != 0 && start - now > cfg->queue_limit_us * NSEC_PER_USEC)) {
+				drop = 1;
+				break;
+			}
+			departure = start + (__u64)skb->len * 8 * NSEC_PER_SEC / rate;
+
+			bpf_spin_lock(&st->lock);
+			if (st->queue_tail_ns == tail) {
+				st->queue_tail_ns = departure;
+				committed = 1;
+			}
+			bpf_spin_unlock(&st->lock);
+		}
+
+		//a lost race is no reason to drop: queue behind the tail under the
+		//lock at the rate of the last lookup, off by at most a slot boundary
+		if (!committed && !drop) {
+			__u64 tx_ns = (__u64)skb->len * 8 * NSEC_PER_SEC / rate;
+
+			bpf_spin_lock(&st->lock);
+			start = st->queue_tail_ns > now ? st->queue_tail_ns : now;
+			if (cfg->queue_limit_us != 0 && start - now > cfg->queue_limit_us * NSEC_PER_USEC) {
+				drop = 1;
+			} else {
+				st->queue_tail_ns = start + tx_ns;
+			}
+			bpf_spin_unlock(&st->lock);
+			departure = start + tx_ns;
+		}
+
+		if (drop) {
+			__sync_fetch_and_add(&st->queue_drops, 1);
+			return TC_ACT_SHOT;
+		}
+	}
+
+	departure += cfg->delay_us * NSEC_PER_USEC;
+	//never move a packet earlier than a timestamp already set by the stack
+	if (departure > skb->tstamp) {
+		skb->tstamp = departure;
+	}
+	__sync_fetch_and_add(&st->bytes, skb->len);
+	return TC_ACT_OK;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Capacity schedules for the netns test bed, in the same formats as sim/pccsim:
+    step:<mbit>@<sec>,<mbit>@<sec>,...
+    sine:<min_mbit>:<max_mbit>:<period_sec>
+    <file>  a Mahimahi trace, one line per 1500 byte delivery opportunity
+            holding its millisecond timestamp, repeated after its last line
+
+    schedule.py load <schedule> [--slot-us N]
+        writes the schedule into the impair bpf maps, it starts with the next packet
+    schedule.py track <schedule> <pccperf output> [--window-ms N] [--offset-s N]
+        reports how pccperf flows (run with a short -i) tracked the capacity:
+        utilization, queueing delay and the time to react to capacity changes
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# where testbed.sh has tc pin the impair maps
+PIN_DIR = os.environ.get('IMPAIR_PIN_DIR', '/run/pcc-testbed/bpf/tc/globals')
+MAX_SLOTS = 65536
+MTU = 1500
+CONFIG_SCHEDULE_OFFSET = 24  # offset of schedule_slot_us in struct impair_config
+REACT_MARGIN = 0.15
+CHANGE_THRESHOLD = 0.3
+
+
+class Schedule(object):
+    def __init__(self, spec, slot_us):
+        self.repeat = False
+        if spec.startswith('step:'):
+            steps = []
+            for part in spec[5:].split(','):
+                mbit, sec = part.split('@')
+                steps.append((float(sec), float(mbit) * 1e6))
+            self.slot_us = max(slot_us, int(math.ceil(steps[-1][0] * 1e6 / (MAX_SLOTS - 1))))
+            n = int(steps[-1][0] * 1e6 / self.slot_us) + 1
+            self.rates = []
+            for i in range(n):
+                t = i * self.slot_us / 1e6
+                self.rates.append(next(r for s, r in reversed(steps) if s <= t) if t >= steps[0][0] else steps[0][1])
+        elif spec.startswith('sine:'):
+            lo, hi, period = [float(x) for x in spec[5:].split(':')]
+            self.slot_us = max(slot_us, int(math.ceil(period * 1e6 / MAX_SLOTS)))
+            n = int(period * 1e6 / self.slot_us)
+            self.rates = [(lo + (hi - lo) * (1 + math.sin(2 * math.pi * i / n)) / 2) * 1e6 for i in range(n)]
+            self.repeat = True
+        else:
+            with open(spec) as f:
+                stamps = [int(line) for line in f if line.strip()]
+            period_ms = max(stamps[-1], 1)
+            self.slot_us = max(slot_us, int(math.ceil(period_ms * 1000.0 / MAX_SLOTS)))
+            n = int(math.ceil(period_ms * 1000.0 / self.slot_us))
+            counts = [0] * n
+            for ms in stamps:
+                counts[min(int(ms * 1000 / self.slot_us), n - 1)] += 1
+            self.rates = [c * MTU * 8 * 1e6 / self.slot_us for c in counts]
+            self.repeat = True
+
+    def rate_at(self, t):
+        slot = int(t * 1e6 / self.slot_us)
+        if slot >= len(self.rates):
+            slot = slot % len(self.rates) if self.repeat else len(self.rates) - 1
+        return self.rates[slot]
+
+    def mean_rate(self, t0, t1):
+        steps = max(int((t1 - t0) * 1e6 / self.slot_us), 1)
+        return sum(self.rate_at(t0 + (t1 - t0) * (i + 0.5) / steps) for i in range(steps)) / steps
+
+
+def le(value, size):
+    return ' '.join(str((int(value) >> (8 * i)) & 255) for i in range(size))
+
+
+def load(args):
+    sched = Schedule(args.schedule, args.slot_us)
+    with tempfile.NamedTemporaryFile('w', suffix='.batch') as batch:
+        for i, rate in enumerate(sched.rates):
+            batch.write('map update pinned %s/impair_schedule_map key %s value %s\n' %
+                        (PIN_DIR, le(i, 4), le(rate, 8)))
+        batch.flush()
+        subprocess.check_call(['bpftool', 'batch', 'file', batch.name])
+
+    out = subprocess.check_output(['bpftool', '-j', 'map', 'lookup', 'pinned',
+                                   PIN_DIR + '/impair_config_map', 'key', '0', '0', '0', '0'])
+    value = [int(b, 16) for b in json.loads(out)['value']]
+    epoch = int(time.time()) & 0xffffffff
+    fields = [sched.slot_us, len(sched.rates), int(sched.repeat), epoch]
+    for i, field in enumerate(fields):
+        off = CONFIG_SCHEDULE_OFFSET + 4 * i
+        value[off:off + 4] = [(field >> (8 * j)) & 255 for j in range(4)]
+    subprocess.check_call(['bpftool', 'map', 'update', 'pinned', PIN_DIR + '/impair_config_map',
+                           'key', '0', '0', '0', '0', 'value'] + [str(b) for b in value])
+    print('loaded %d slots of %d us%s' % (len(sched.rates), sched.slot_us, ', repeating' if sched.repeat else ''))
+
+
+FLOW_LINE = re.compile(r'^\s*([\d.]+) flow\s+(\d+) goodput\s+([\d.]+) Mbit/s rtt\s+(\d+) us.*'
+                       r'pcc_rate\s+([\d.]+) Mbit/s')
+
+
+def track(args):
+    sched = Schedule(args.schedule, 1000)
+    samples = {}
+    with open(args.log) as f:
+        for line in f:
+            m = FLOW_LINE.match(line)
+            if not m:
+                continue
+            t = round(float(m.group(1)) + args.offset_s, 3)
+            s = samples.setdefault(t, [0.0, 0.0, []])
+            s[0] += float(m.group(3)) * 1e6
+            s[1] += float(m.group(5)) * 1e6
+            s[2].append(int(m.group(4)))
+    if not samples:
+        sys.exit('no pccperf flow lines in %s' % args.log)
+
+    times = sorted(samples)
+    base_rtt = min(min(samples[t][2]) for t in times)
+    util, qdelay = [], []
+    for prev, t in zip([0.0] + times, times):
+        cap = sched.mean_rate(prev, t)
+        if cap > 0:
+            util.append(samples[t][0] / cap)
+        qdelay.extend((r - base_rtt) / 1000.0 for r in samples[t][2])
+    qdelay.sort()
+    print('utilization %.4f' % (sum(util) / len(util)))
+    print('qdelay_mean_ms %.3f' % (sum(qdelay) / len(qdelay)))
+    print('qdelay_p95_ms %.3f' % qdelay[int(0.95 * (len(qdelay) - 1))])
+
+    # capacity changes between windows, and the time until the pcc rate follows
+    win = args.window_ms / 1000.0
+    end = times[-1]
+    reacts = {True: [], False: []}
+    events = {True: 0, False: 0}
+    w = 1
+    while (w + 1) * win <= end:
+        prev_cap, cap = sched.mean_rate((w - 1) * win, w * win), sched.mean_rate(w * win, (w + 1) * win)
+        if prev_cap == 0 or abs(cap - prev_cap) / prev_cap < CHANGE_THRESHOLD:
+            w += 1
+            continue
+        up = cap > prev_cap
+        nxt = w + 1
+        while (nxt + 1) * win <= end and abs(sched.mean_rate(nxt * win, (nxt + 1) * win) - cap) / cap < CHANGE_THRESHOLD:
+            nxt += 1
+        events[up] += 1
+        for t in times:
+            if t < w * win or t >= nxt * win:
+                continue
+            rate = samples[t][1]
+            if (up and rate >= cap * (1 - REACT_MARGIN)) or (not up and rate <= cap * (1 + REACT_MARGIN)):
+                reacts[up].append((t - w * win) * 1000)
+                print('# change at %.3f s: %.3f -> %.3f Mbit/s, reacted in %.1f ms' %
+                      (w * win, prev_cap / 1e6, cap / 1e6, reacts[up][-1]))
+                break
+        else:
+            print('# change at %.3f s: %.3f -> %.3f Mbit/s, did not react' % (w * win, prev_cap / 1e6, cap / 1e6))
+        w = nxt
+    for up, name in ((False, 'down'), (True, 'up')):
+        r = reacts[up]
+        print('react_%s_events %d\nreact_%s_reacted %d\nreact_%s_ms %.1f' %
+              (name, events[up], name, len(r), name, sum(r) / len(r) if r else 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='cmd')
+    p = sub.add_parser('load')
+    p.add_argument('schedule')
+    p.add_argument('--slot-us', type=int, default=1000)
+    p = sub.add_parser('track')
+    p.add_argument('schedule')
+    p.add_argument('log')
+    p.add_argument('--window-ms', type=float, default=100)
+    p.add_argument('--offset-s', type=float, default=0)
+    args = parser.parse_args()
+    if args.cmd == 'load':
+        load(args)
+    elif args.cmd == 'track':
+        track(args)
+    else:
+        parser.print_help()
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
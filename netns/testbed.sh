@@ -0,0 +1,225 @@
+#!/bin/sh
+# netns test bed: sender -> router -> receiver on veth pairs, with the
+# bottleneck emulated on the router egress towards the receiver.
+#
+#   testbed.sh up [options]    create the namespaces and the bottleneck
+#   testbed.sh set [options]   change the bottleneck of a running test bed
+#   testbed.sh stats           print the bottleneck counters
+#   testbed.sh down            remove the namespaces
+#
+# options:
+#   --rate-mbit N      bottleneck rate (0 for unlimited)
+#   --delay-us N       one way delay
+#   --queue-us N       max queueing delay before tail drop
+#   --loss-ppm N       random loss, parts per million
+#   --loss-every N     drop every N-th packet
+#   --impair bpf|netem bpf uses impair.bpf.o (default for up), netem uses netem+tbf.
+#                      set and stats keep what the running test bed was made with
+#   --schedule S       capacity schedule or Mahimahi trace (bpf only), see schedule.py
+#   --rev-rate-mbit N  rate of the ack path, router egress towards the sender (0 for unlimited)
+#   --rev-queue-us N   max queueing delay of the ack path before tail drop
+#
+# run the benchmark with:
+#   ip netns exec pcc-rcv ../tools/pccperf -s &
+#   ip netns exec pcc-snd ../tools/pccperf -c 10.10.2.2
+# QUIC flows, the module running in the sender process:
+#   ip netns exec pcc-rcv ../quic/pccquic -s &
+#   ip netns exec pcc-snd ../quic/pccquic -c 10.10.2.2
+# and with a capacity schedule:
+#   testbed.sh set --schedule step:100@0,20@10,100@20
+#   ip netns exec pcc-snd ../tools/pccperf -c 10.10.2.2 -t 30 -i 10 > run.log
+#   ./schedule.py track step:100@0,20@10,100@20 run.log
+# and with the ack path congested by traffic the other way:
+#   testbed.sh set --rate-mbit 100 --rev-rate-mbit 10
+#   ip netns exec pcc-snd ../tools/pccperf -s -p 9200 &
+#   ip netns exec pcc-rcv ../tools/pccperf -c 10.10.1.1 -p 9200 -t 40 &
+#   ip netns exec pcc-snd ../tools/pccperf -c 10.10.2.2 -t 30
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+SND=pcc-snd
+RTR=pcc-rtr
+RCV=pcc-rcv
+BPF_OBJ=$DIR/impair.bpf.o
+# a bpffs of our own outside /sys: ip netns exec remounts /sys, so tc in the
+# router namespace and bpftool out here would each see another bpffs there
+BPF_MNT=/run/pcc-testbed/bpf
+PIN_DIR=$BPF_MNT/tc/globals
+
+RATE_MBIT=1000
+DELAY_US=10000
+QUEUE_US=20000
+LOSS_PPM=0
+LOSS_EVERY=0
+IMPAIR=bpf
+IMPAIR_SET=
+SCHEDULE=
+REV_RATE_MBIT=0
+REV_QUEUE_US=20000
+
+parse_options() {
+	while [ $# -gt 0 ]; do
+		case "$1" in
+			--rate-mbit) RATE_MBIT=$2; shift ;;
+			--delay-us) DELAY_US=$2; shift ;;
+			--queue-us) QUEUE_US=$2; shift ;;
+			--loss-ppm) LOSS_PPM=$2; shift ;;
+			--loss-every) LOSS_EVERY=$2; shift ;;
+			--impair) IMPAIR=$2; IMPAIR_SET=1; shift ;;
+			--schedule) SCHEDULE=$2; shift ;;
+			--rev-rate-mbit) REV_RATE_MBIT=$2; shift ;;
+			--rev-queue-us) REV_QUEUE_US=$2; shift ;;
+			*) echo "unknown option $1" >&2; exit 1 ;;
+		esac
+		shift
+	done
+}
+
+# prints $1 as $2 little endian bytes, for bpftool
+le() {
+	v=$1
+	i=0
+	while [ $i -lt $2 ]; do
+		printf '%d ' $((v & 255))
+		v=$((v >> 8))
+		i=$((i + 1))
+	done
+}
+
+link() {
+	ip link add "$3" netns "$1" type veth peer name "$4" netns "$2"
+	ip -n "$1" link set "$3" up
+	ip -n "$2" link set "$4" up
+}
+
+bpf_mount() {
+	mkdir -p $BPF_MNT
+	mountpoint -q $BPF_MNT || mount -t bpf bpf $BPF_MNT
+}
+
+# attaches the impairment to egress of device $2 in namespace $1
+impair_attach() {
+	if [ "$IMPAIR" = "netem" ]; then
+		ip netns exec "$1" tc qdisc replace dev "$2" root handle 1: netem \
+			delay "${DELAY_US}us" loss "$(awk "BEGIN {print $LOSS_PPM / 10000}")%" limit 100000
+		if [ "$RATE_MBIT" -gt 0 ]; then
+			ip netns exec "$1" tc qdisc replace dev "$2" parent 1: handle 2: tbf \
+				rate "${RATE_MBIT}mbit" burst 64kb latency "${QUEUE_US}us"
+		fi
+		return
+	fi
+
+	if [ ! -f "$BPF_OBJ" ]; then
+		echo "$BPF_OBJ not found, run make in $DIR" >&2
+		exit 1
+	fi
+	# fq enforces the departure time the program sets, its horizon must cover the delay
+	ip netns exec "$1" tc qdisc replace dev "$2" root fq horizon 10s horizon_drop $(fq_limits)
+	ip netns exec "$1" tc qdisc add dev "$2" clsact
+	# tc pins the maps under $TC_BPF_MNT/tc/globals
+	bpf_mount
+	ip netns exec "$1" env TC_BPF_MNT=$BPF_MNT tc filter add dev "$2" egress bpf direct-action obj "$BPF_OBJ" sec tc
+	impair_set
+}
+
+# the ack path, a tbf on the router egress towards the sender. The delay
+# stays on the forward path only, the ack path just queues and drops.
+reverse_set() {
+	if [ "$REV_RATE_MBIT" -gt 0 ]; then
+		ip netns exec $RTR tc qdisc replace dev rtr0 root tbf \
+			rate "${REV_RATE_MBIT}mbit" burst 16kb latency "${REV_QUEUE_US}us"
+	else
+		ip netns exec $RTR tc qdisc del dev rtr0 root 2>/dev/null
+	fi
+}
+
+# fq holds every packet until its departure time, so a flow keeps a whole
+# rate * (delay + queue) in it. Its limits must fit that, or fq drops packets
+# the emulated queue would have passed. Sized for full sized packets with a
+# factor of 4 for smaller ones, and never below the fq defaults.
+fq_limits() {
+	rate=$RATE_MBIT
+	[ "$rate" -gt 0 ] || rate=10000
+	packets=$((rate * 1000000 / 8 * (DELAY_US + QUEUE_US) / 1000000 / 1500 * 4))
+	flow_limit=$((packets > 100 ? packets : 100))
+	limit=$((packets > 10000 ? packets : 10000))
+	echo "flow_limit $flow_limit limit $limit"
+}
+
+# the impairment the running test bed was made with, unless --impair was given
+impair_detect() {
+	[ -n "$IMPAIR_SET" ] && return
+	if ip netns exec $RTR tc qdisc show dev rtr1 | grep -q netem; then
+		IMPAIR=netem
+	else
+		IMPAIR=bpf
+	fi
+}
+
+# writes the options into the config map of the bpf impairment
+impair_set() {
+	if [ "$IMPAIR" = "netem" ]; then
+		impair_attach $RTR rtr1
+		return
+	fi
+	ip netns exec $RTR tc qdisc change dev rtr1 root fq horizon 10s horizon_drop $(fq_limits)
+	bpftool map update pinned $PIN_DIR/impair_config_map key 0 0 0 0 value \
+		$(le $((RATE_MBIT * 1000000)) 8) $(le "$DELAY_US" 4) $(le "$QUEUE_US" 4) \
+		$(le "$LOSS_PPM" 4) $(le "$LOSS_EVERY" 4) $(le 0 16)
+	if [ -n "$SCHEDULE" ]; then
+		IMPAIR_PIN_DIR=$PIN_DIR python3 "$DIR/schedule.py" load "$SCHEDULE"
+	fi
+}
+
+up() {
+	ip netns add $SND
+	ip netns add $RTR
+	ip netns add $RCV
+
+	link $SND $RTR snd0 rtr0
+	link $RTR $RCV rtr1 rcv0
+	ip -n $SND addr add 10.10.1.1/24 dev snd0
+	ip -n $RTR addr add 10.10.1.2/24 dev rtr0
+	ip -n $RTR addr add 10.10.2.1/24 dev rtr1
+	ip -n $RCV addr add 10.10.2.2/24 dev rcv0
+	ip -n $SND route add default via 10.10.1.2
+	ip -n $RCV route add default via 10.10.2.1
+	ip netns exec $RTR sysctl -qw net.ipv4.ip_forward=1
+
+	# pcc paces through fq, like start_sender.sh does for the physical test bed
+	ip netns exec $SND tc qdisc replace dev snd0 root fq
+	ip netns exec $SND sysctl -qw net.ipv4.tcp_wmem="4096 87380 67108864"
+	ip netns exec $RCV sysctl -qw net.ipv4.tcp_rmem="4096 87380 67108864"
+
+	impair_attach $RTR rtr1
+	reverse_set
+}
+
+down() {
+	ip netns del $SND 2>/dev/null
+	ip netns del $RTR 2>/dev/null
+	ip netns del $RCV 2>/dev/null
+	rm -f $PIN_DIR/impair_config_map $PIN_DIR/impair_state_map $PIN_DIR/impair_schedule_map
+	if mountpoint -q $BPF_MNT; then
+		umount $BPF_MNT
+	fi
+}
+
+stats() {
+	ip netns exec $RTR tc -s qdisc show dev rtr0 | grep -A 2 tbf
+	if [ "$IMPAIR" = "netem" ]; then
+		ip netns exec $RTR tc -s qdisc show dev rtr1
+		return
+	fi
+	bpftool map dump pinned $PIN_DIR/impair_state_map
+}
+
+cmd=$1
+[ $# -gt 0 ] && shift
+parse_options "$@"
+case "$cmd" in
+	up) up ;;
+	set) impair_detect; impair_set; reverse_set ;;
+	stats) impair_detect; stats ;;
+	down) down ;;
+	*) sed -n '2,36p' "$0"; exit 1 ;;
+esac
@@ -0,0 +1,370 @@
+#!/bin/sh
+# multi-bottleneck netns scenarios: a chain of routers pt-r0 .. pt-rH where the
+# link from pt-r(i-1) to pt-ri is bottleneck hop i (netem delay/loss and a tbf
+# rate on the egress of pt-r(i-1)). Every flow has its own sender pt-sF and
+# receiver pt-dF namespaces, attached to the routers it starts and ends at.
+#
+#   topology.sh up parking-lot|dumbbell|multipath [options]
+#   topology.sh run [-t seconds] [-w warmup_seconds] [-C congestion]
+#   topology.sh report [-w warmup_seconds]
+#   topology.sh bench parking-lot|dumbbell|multipath [options] [-t seconds] [-w warmup] [-C cc]
+#   topology.sh down
+#
+# scenarios:
+#   parking-lot  flow 0 crosses all H hops, flow i (1..H) crosses hop i only
+#   dumbbell     N flows cross the one hop, flow f has f * rtt-spread-us more
+#                delay on its ACK path so the flows see different RTTs
+#   multipath    flow 0 is a multipath transfer, one TCP subflow over each of
+#                the P disjoint paths with the same SO_MARK, path p being hop p
+#                from pt-rp to pt-r(P+p). N single path flows share the
+#                bottleneck of path 1 with it. Load the module with coupling=1
+#                to couple the subflows
+#
+# options (hop values take a comma separated list, one per hop, the last
+# value repeats):
+#   --hops H             hops of the parking lot (default 3)
+#   --flows N            flows of the dumbbell (default 4)
+#   --rate-mbit R        bottleneck rate
+#   --delay-us D         one way delay of a hop
+#   --queue-us Q         max queueing delay of a hop
+#   --loss-ppm L         random loss of a hop, parts per million
+#   --rtt-spread-us S    extra ACK delay step between dumbbell flows
+#   --paths P            paths of the multipath connection (default 2)
+#   --competitors N      single path flows on path 1 of multipath (default 1)
+#
+# run prints per flow goodput and retransmissions, the utilization of each hop
+# and the Jain fairness index over all flows and over the flows of each hop.
+# For multipath the multipath flow counts on every hop, the multipath line has the
+# utilization of all paths together and its share of path 1 against the
+# single path flows, which is 1 / (N + 1) when it is fair to them. The share
+# is taken from the bytes the path 1 bottleneck sent during the whole run,
+# headers included.
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+PCCPERF=$DIR/../tools/pccperf
+STATE=/tmp/pcc-topology
+PORT=9000
+
+HOPS=3
+FLOWS=4
+RATE_MBIT=100
+DELAY_US=5000
+QUEUE_US=20000
+LOSS_PPM=0
+RTT_SPREAD_US=0
+PATHS=2
+COMPETITORS=1
+DURATION=30
+WARMUP=5
+CONGESTION=pcc
+
+parse_options() {
+	while [ $# -gt 0 ]; do
+		case "$1" in
+			--hops) HOPS=$2; shift ;;
+			--flows) FLOWS=$2; shift ;;
+			--rate-mbit) RATE_MBIT=$2; shift ;;
+			--delay-us) DELAY_US=$2; shift ;;
+			--queue-us) QUEUE_US=$2; shift ;;
+			--loss-ppm) LOSS_PPM=$2; shift ;;
+			--rtt-spread-us) RTT_SPREAD_US=$2; shift ;;
+			--paths) PATHS=$2; shift ;;
+			--competitors) COMPETITORS=$2; shift ;;
+			-t) DURATION=$2; shift ;;
+			-w) WARMUP=$2; shift ;;
+			-C) CONGESTION=$2; shift ;;
+			*) echo "unknown option $1" >&2; exit 1 ;;
+		esac
+		shift
+	done
+}
+
+# prints entry $2 of the comma separated list $1, the last one when the list is shorter
+hop_value() {
+	echo "$1" | awk -F, -v i="$2" '{ print (i <= NF) ? $i : $NF }'
+}
+
+link() {
+	ip link add "$3" netns "$1" type veth peer name "$4" netns "$2"
+	ip -n "$1" link set "$3" up
+	ip -n "$2" link set "$4" up
+}
+
+# hop $1: the egress of pt-r(hop-1) towards pt-r(hop), or of the router $2
+hop_impair() {
+	rate=$(hop_value "$RATE_MBIT" "$1")
+	delay=$(hop_value "$DELAY_US" "$1")
+	queue=$(hop_value "$QUEUE_US" "$1")
+	loss=$(hop_value "$LOSS_PPM" "$1")
+	ns=${2:-pt-r$(($1 - 1))}
+	ip netns exec $ns tc qdisc replace dev "b$1" root handle 1: netem \
+		delay "${delay}us" loss "$(awk "BEGIN {print $loss / 10000}")%" limit 100000
+	if [ "$rate" -gt 0 ]; then
+		ip netns exec $ns tc qdisc replace dev "b$1" parent 1: handle 2: tbf \
+			rate "${rate}mbit" burst 64kb latency "${queue}us"
+	fi
+	echo "hop $1 $rate $ns" >> $STATE/topology
+}
+
+# flow $1 from router $2 to router $3, recorded as crossing the hops after $4 up to $5
+# (the routers by default)
+add_flow() {
+	f=$1
+	ip netns add pt-s$f
+	ip netns add pt-d$f
+	link pt-s$f pt-r$2 eth0 s$f
+	link pt-d$f pt-r$3 eth0 d$f
+	ip -n pt-s$f addr add 10.40.$f.1/24 dev eth0
+	ip -n pt-r$2 addr add 10.40.$f.254/24 dev s$f
+	ip -n pt-d$f addr add 10.50.$f.1/24 dev eth0
+	ip -n pt-r$3 addr add 10.50.$f.254/24 dev d$f
+	ip -n pt-s$f route add default via 10.40.$f.254
+	ip -n pt-d$f route add default via 10.50.$f.254
+
+	# pcc paces through fq, like start_sender.sh does for the physical test bed
+	ip netns exec pt-s$f tc qdisc replace dev eth0 root fq
+	ip netns exec pt-s$f sysctl -qw net.ipv4.tcp_wmem="4096 87380 67108864"
+	ip netns exec pt-d$f sysctl -qw net.ipv4.tcp_rmem="4096 87380 67108864"
+	echo "flow $f ${4:-$2} ${5:-$3}" >> $STATE/topology
+}
+
+# routes on every router towards the subnet $1 of a host attached to router $2
+route_host() {
+	r=0
+	while [ $r -le $HOPS ]; do
+		if [ $r -lt $2 ]; then
+			ip -n pt-r$r route add "$1" via 10.30.$((r + 1)).2
+		elif [ $r -gt $2 ]; then
+			ip -n pt-r$r route add "$1" via 10.30.$r.1
+		fi
+		r=$((r + 1))
+	done
+}
+
+# flow 0 over P paths: pt-s0 has eth$p to the path router pt-rp and pt-d0 has
+# eth$p to pt-r(P+p), subflow p goes to the address of pt-d0 on path p
+up_multipath() {
+	ip netns add pt-s0
+	ip netns add pt-d0
+	ip netns exec pt-d0 sysctl -qw net.ipv4.conf.all.rp_filter=0
+	p=1
+	while [ $p -le $PATHS ]; do
+		ip netns add pt-r$p
+		ip netns add pt-r$((PATHS + p))
+		ip netns exec pt-r$p sysctl -qw net.ipv4.ip_forward=1
+		ip netns exec pt-r$((PATHS + p)) sysctl -qw net.ipv4.ip_forward=1
+		link pt-r$p pt-r$((PATHS + p)) b$p a$p
+		ip -n pt-r$p addr add 10.30.$p.1/24 dev b$p
+		ip -n pt-r$((PATHS + p)) addr add 10.30.$p.2/24 dev a$p
+		hop_impair $p pt-r$p
+
+		link pt-s0 pt-r$p eth$p s0
+		ip -n pt-s0 addr add 10.41.$p.1/24 dev eth$p
+		ip -n pt-r$p addr add 10.41.$p.254/24 dev s0
+		ip -n pt-s0 rule add from 10.41.$p.1 table $((100 + p))
+		ip -n pt-s0 route add default via 10.41.$p.254 dev eth$p table $((100 + p))
+		ip netns exec pt-s0 tc qdisc replace dev eth$p root fq
+
+		link pt-d0 pt-r$((PATHS + p)) eth$p d0
+		ip -n pt-d0 addr add 10.51.$p.1/24 dev eth$p
+		ip -n pt-r$((PATHS + p)) addr add 10.51.$p.254/24 dev d0
+		ip -n pt-d0 route add 10.41.$p.0/24 via 10.51.$p.254 dev eth$p
+
+		ip -n pt-r$p route add 10.51.0.0/16 via 10.30.$p.2
+		ip -n pt-r$((PATHS + p)) route add 10.41.0.0/16 via 10.30.$p.1
+		# the receiver takes the subflows of every path on any of its addresses
+		ip -n pt-r$((PATHS + p)) route add 10.51.0.0/16 via 10.51.$p.1
+		ip -n pt-s0 route add 10.51.$p.0/24 via 10.41.$p.254 dev eth$p
+		p=$((p + 1))
+	done
+	ip -n pt-s0 route add default via 10.41.1.254
+	ip netns exec pt-s0 sysctl -qw net.ipv4.tcp_wmem="4096 87380 67108864"
+	ip netns exec pt-d0 sysctl -qw net.ipv4.tcp_rmem="4096 87380 67108864"
+	echo "flow 0 0 $PATHS multipath" >> $STATE/topology
+	echo "paths $PATHS" >> $STATE/topology
+
+	f=1
+	while [ $f -le $COMPETITORS ]; do
+		add_flow $f 1 $((PATHS + 1)) 0 1
+		ip -n pt-r1 route add 10.50.$f.0/24 via 10.30.1.2
+		ip -n pt-r$((PATHS + 1)) route add 10.40.$f.0/24 via 10.30.1.1
+		f=$((f + 1))
+	done
+}
+
+up() {
+	scenario=$1
+	shift
+	parse_options "$@"
+	case "$scenario" in
+		parking-lot) ;;
+		dumbbell) HOPS=1 ;;
+		multipath) HOPS=$PATHS ;;
+		*) echo "unknown scenario $scenario" >&2; exit 1 ;;
+	esac
+	mkdir -p $STATE
+	: > $STATE/topology
+	if [ "$scenario" = "multipath" ]; then
+		up_multipath
+		return
+	fi
+
+	r=0
+	while [ $r -le $HOPS ]; do
+		ip netns add pt-r$r
+		ip netns exec pt-r$r sysctl -qw net.ipv4.ip_forward=1
+		r=$((r + 1))
+	done
+	i=1
+	while [ $i -le $HOPS ]; do
+		link pt-r$((i - 1)) pt-r$i b$i a$i
+		ip -n pt-r$((i - 1)) addr add 10.30.$i.1/24 dev b$i
+		ip -n pt-r$i addr add 10.30.$i.2/24 dev a$i
+		hop_impair $i
+		i=$((i + 1))
+	done
+
+	if [ "$scenario" = "parking-lot" ]; then
+		add_flow 0 0 $HOPS
+		i=1
+		while [ $i -le $HOPS ]; do
+			add_flow $i $((i - 1)) $i
+			i=$((i + 1))
+		done
+	else
+		f=0
+		while [ $f -lt $FLOWS ]; do
+			add_flow $f 0 1
+			if [ "$RTT_SPREAD_US" -gt 0 ] && [ $f -gt 0 ]; then
+				ip netns exec pt-r0 tc qdisc replace dev s$f root netem delay "$((f * RTT_SPREAD_US))us" limit 100000
+			fi
+			f=$((f + 1))
+		done
+	fi
+	awk '$1 == "flow"' $STATE/topology | while read -r _ f src dst; do
+		route_host 10.40.$f.0/24 "$src"
+		route_host 10.50.$f.0/24 "$dst"
+	done
+}
+
+run() {
+	parse_options "$@"
+	if [ ! -x "$PCCPERF" ]; then
+		echo "$PCCPERF not found, run make in $DIR/../tools" >&2
+		exit 1
+	fi
+	flows=$(awk '$1 == "flow" { print $2 }' $STATE/topology)
+	paths=$(awk '$1 == "paths" { print $2 }' $STATE/topology)
+	for f in $flows; do
+		ip netns exec pt-d$f "$PCCPERF" -s -p $PORT > $STATE/sink$f.log 2>&1 &
+		echo $! > $STATE/sink$f.pid
+	done
+	sleep 1
+	hop_bytes > $STATE/hop_bytes
+	start=$(date +%s.%N)
+	senders=
+	rm -f $STATE/flow*.log
+	for f in $flows; do
+		if [ -n "$paths" ] && [ $f -eq 0 ]; then
+			# the subflows share a mark, the key the module couples them by
+			p=1
+			while [ $p -le "$paths" ]; do
+				ip netns exec pt-s0 "$PCCPERF" -c 10.51.$p.1 -p $PORT -t "$DURATION" -i 1000 \
+					-C "$CONGESTION" -k 1 > $STATE/flow0.$p.log 2>&1 &
+				senders="$senders $!"
+				p=$((p + 1))
+			done
+			continue
+		fi
+		ip netns exec pt-s$f "$PCCPERF" -c 10.50.$f.1 -p $PORT -t "$DURATION" -i 1000 \
+			-C "$CONGESTION" > $STATE/flow$f.log 2>&1 &
+		senders="$senders $!"
+	done
+	for pid in $senders; do
+		wait "$pid"
+	done
+	hop_bytes "$(date +%s.%N)" "$start" >> $STATE/hop_bytes
+	for f in $flows; do
+		kill "$(cat $STATE/sink$f.pid)" 2>/dev/null
+	done
+	report
+}
+
+# bytes sent by every bottleneck so far as hop, bytes and the optional time $1 and start time $2
+hop_bytes() {
+	awk '$1 == "hop" { print $2, $4 }' $STATE/topology | while read -r h ns; do
+		echo "$h $(ip netns exec "$ns" cat /sys/class/net/b$h/statistics/tx_bytes) $1 $2"
+	done
+}
+
+# per flow means after the warmup, hop utilization and fairness
+report() {
+	touch $STATE/hop_bytes
+	for f in $(awk '$1 == "flow" { print $2 }' $STATE/topology); do
+		# a multipath flow has a log per subflow, its goodput is their sum
+		awk -v f="$f" -v warmup="$WARMUP" '
+			FNR == 1 && n { goodput += sum / n; sum = n = 0 }
+			FNR == 1 { retrans += last; last = 0 }
+			$2 == "flow" && $1 > warmup { sum += $5; n++; last = $14 }
+			END { goodput += n ? sum / n : 0; printf "flow %d goodput_mbit %.3f retrans %d\n", f, goodput, retrans + last }
+		' $(ls $STATE/flow$f.log $STATE/flow$f.*.log 2>/dev/null)
+	done > $STATE/flows
+	cat $STATE/flows
+	awk '
+		FNR == NR && $1 == "flow" { src[$2] = $3; dst[$2] = $4; multipath[$2] = ($5 == "multipath") }
+		FNR == NR && $1 == "hop" { rate[$2] = $3; hops++ }
+		FNR == NR && $1 == "paths" { paths = $2 }
+		FILENAME ~ /hop_bytes$/ {
+			if (NF == 2) { bytes[$1] = -$2 } else { bytes[$1] += $2; hop_mbit[$1] = bytes[$1] * 8 / (($3 - $4) * 1e6) }
+			next
+		}
+		FNR != NR { goodput[$2] = $4; all += $4; all2 += $4 * $4; n++ }
+		END {
+			for (h = 1; h <= hops; h++) {
+				sum = sum2 = m = 0
+				for (f in goodput) {
+					if (src[f] < h && dst[f] >= h) {
+						sum += goodput[f]; sum2 += goodput[f] * goodput[f]; m++
+					}
+				}
+				printf "hop %d utilization %.4f jain_fairness %.4f flows %d\n", h,
+					(rate[h] > 0 ? sum / rate[h] : 0), (sum2 > 0 ? sum * sum / (m * sum2) : 0), m
+			}
+			printf "jain_fairness %.4f\n", (all2 > 0 ? all * all / (n * all2) : 0)
+			if (paths) {
+				capacity = path1 = mp = 0
+				for (h = 1; h <= hops; h++) {
+					capacity += rate[h]
+				}
+				for (f in goodput) {
+					if (multipath[f]) {
+						mp += goodput[f]
+					} else {
+						path1 += goodput[f]
+					}
+				}
+				printf "multipath goodput_mbit %.3f paths_utilization %.4f path1_share %.4f\n", mp,
+					(capacity > 0 ? all / capacity : 0),
+					(hop_mbit[1] > path1 ? (hop_mbit[1] - path1) / hop_mbit[1] : 0)
+			}
+		}
+	' $STATE/topology $STATE/hop_bytes $STATE/flows
+}
+
+down() {
+	for ns in $(ip netns list | awk '/^pt-[rsd][0-9]+/ { print $1 }'); do
+		ip netns del "$ns"
+	done
+	rm -rf $STATE
+}
+
+cmd=$1
+[ $# -gt 0 ] && shift
+case "$cmd" in
+	up) up "$@" ;;
+	run) run "$@" ;;
+	report) parse_options "$@"; report ;;
+	bench) up "$@" && run; down ;;
+	down) down ;;
+	*) sed -n '2,40p' "$0"; exit 1 ;;
+esac
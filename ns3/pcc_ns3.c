@@ -0,0 +1,156 @@
+/*
+ * The shim side of the ns-3 adapter: maps the state ns-3 gives at every ack
+ * to the shim socket and makes the callbacks the kernel makes, in the order
+ * pccsim makes them.
+ */
+
+#include "kshim/kshim.h"
+#include "pcc_ns3.h"
+
+//the module reads timespecs, keep the clock away from 0 like pccsim does
+#define PCC_NS3_EPOCH_NS (1600000000ULL * NSEC_PER_SEC)
+#define PCC_NS3_INITIAL_CWND (10)
+
+struct pcc_ns3_sock {
+	struct tcp_sock tp;
+};
+
+struct tcp_congestion_ops *pcc_module_ops(void);
+
+static struct sock *sk_of(struct pcc_ns3_sock *ps)
+{
+	return (struct sock *)&ps->tp;
+}
+
+static void sync_tcp_sock(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st)
+{
+	struct tcp_sock *tp = &ps->tp;
+	struct tcp_sack_block blocks[PCC_NS3_MAX_SACKS];
+	int i, j, n = st->nsacks < PCC_NS3_MAX_SACKS ? st->nsacks : PCC_NS3_MAX_SACKS;
+
+	kshim_now_ns = PCC_NS3_EPOCH_NS + st->now_ns;
+	tp->snd_una = st->snd_una;
+	tp->snd_nxt = st->snd_nxt;
+	tp->advmss = st->mss;
+	tp->mss_cache = st->mss;
+	tp->srtt_us = st->srtt_us << 3;
+	tp->packets_out = st->packets_out;
+	tp->sacked_out = st->sacked_out;
+	tp->lost_out = st->lost_out;
+	tp->data_segs_out = st->data_segs_out;
+	tp->total_retrans = st->total_retrans;
+	tp->bytes_acked = st->bytes_acked;
+
+	//the kernel keeps the received sack blocks sorted by sequence
+	memset(blocks, 0, sizeof(blocks));
+	for (i = 0; i < n; i++) {
+		blocks[i].start_seq = st->sacks[i][0];
+		blocks[i].end_seq = st->sacks[i][1];
+	}
+	for (i = 0; i < n; i++) {
+		for (j = i + 1; j < n; j++) {
+			if (before(blocks[j].start_seq, blocks[i].start_seq)) {
+				struct tcp_sack_block tmp = blocks[i];
+				blocks[i] = blocks[j];
+				blocks[j] = tmp;
+			}
+		}
+	}
+	memcpy(tp->recv_sack_cache, blocks, sizeof(blocks));
+}
+
+struct pcc_ns3_sock *pcc_ns3_create(const struct pcc_ns3_state *st, uint32_t saddr, uint32_t daddr,
+	uint16_t sport, uint16_t dport)
+{
+	struct pcc_ns3_sock *ps = calloc(1, sizeof(*ps));
+
+	if (!ps) {
+		return NULL;
+	}
+	ps->tp.snd_cwnd = PCC_NS3_INITIAL_CWND;
+	ps->tp.inet_conn.icsk_inet.sk.sk_family = AF_INET;
+	ps->tp.inet_conn.icsk_inet.inet_saddr = saddr;
+	ps->tp.inet_conn.icsk_inet.inet_daddr = daddr;
+	ps->tp.inet_conn.icsk_inet.inet_sport = sport;
+	ps->tp.inet_conn.icsk_inet.inet_dport = dport;
+	sync_tcp_sock(ps, st);
+	pcc_module_ops()->init(sk_of(ps));
+	return ps;
+}
+
+void pcc_ns3_release(struct pcc_ns3_sock *ps)
+{
+	if (!ps) {
+		return;
+	}
+	pcc_module_ops()->release(sk_of(ps));
+	free(ps);
+}
+
+void pcc_ns3_ack(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st, const struct pcc_ns3_sample *sample)
+{
+	struct tcp_congestion_ops *ops = pcc_module_ops();
+	struct ack_sample as;
+	struct rate_sample rs;
+
+	sync_tcp_sock(ps, st);
+	memset(&as, 0, sizeof(as));
+	as.pkts_acked = sample->pkts_acked;
+	as.rtt_us = sample->rtt_us;
+	as.in_flight = sample->in_flight;
+	memset(&rs, 0, sizeof(rs));
+	rs.rtt_us = sample->rtt_us;
+	rs.delivered = sample->delivered;
+	rs.interval_us = sample->interval_us;
+	rs.losses = sample->losses;
+	rs.acked_sacked = sample->pkts_acked;
+	rs.prior_in_flight = sample->in_flight;
+	rs.is_app_limited = sample->is_app_limited;
+
+	if (ops->in_ack_event) {
+		ops->in_ack_event(sk_of(ps), 0);
+	}
+	if (sample->pkts_acked && ops->pkts_acked) {
+		ops->pkts_acked(sk_of(ps), &as);
+	}
+	if (ops->cong_control) {
+		ops->cong_control(sk_of(ps), &rs);
+	}
+}
+
+void pcc_ns3_loss(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st)
+{
+	sync_tcp_sock(ps, st);
+	pcc_module_ops()->ssthresh(sk_of(ps));
+}
+
+void pcc_ns3_set_state(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st, int state)
+{
+	struct tcp_congestion_ops *ops = pcc_module_ops();
+
+	sync_tcp_sock(ps, st);
+	ps->tp.inet_conn.icsk_ca_state = state;
+	if (ops->set_state) {
+		ops->set_state(sk_of(ps), state);
+	}
+}
+
+uint64_t pcc_ns3_pacing_rate(const struct pcc_ns3_sock *ps)
+{
+	return ps->tp.inet_conn.icsk_inet.sk.sk_pacing_rate;
+}
+
+uint32_t pcc_ns3_cwnd(const struct pcc_ns3_sock *ps)
+{
+	return ps->tp.snd_cwnd;
+}
+
+int pcc_ns3_param_set(const char *name, const char *value)
+{
+	return kshim_param_set(name, value);
+}
+
+void pcc_ns3_seed(uint64_t seed)
+{
+	kshim_seed(seed);
+}
@@ -0,0 +1,71 @@
+#ifndef _PCC_NS3_H_
+#define _PCC_NS3_H_
+
+/*
+ * C interface of the PCC module built against the kernel shim, for the ns-3
+ * congestion ops adapter. Every socket gets a handle holding the shim socket
+ * the module keeps its state in, and the adapter feeds it what ns-3 knows at
+ * every ack, in the kernel's units.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCC_NS3_MAX_SACKS (4)
+
+struct pcc_ns3_sock;
+
+/* the sender's side of a connection, as the kernel's tcp_sock would have it */
+struct pcc_ns3_state {
+	uint64_t now_ns;					//simulation time
+	uint32_t snd_una;
+	uint32_t snd_nxt;
+	uint32_t mss;
+	uint32_t srtt_us;
+	uint32_t packets_out;
+	uint32_t sacked_out;
+	uint32_t lost_out;
+	uint32_t data_segs_out;				//segments sent, retransmissions included
+	uint32_t total_retrans;
+	uint64_t bytes_acked;
+	int nsacks;
+	uint32_t sacks[PCC_NS3_MAX_SACKS][2];	//start and end sequence of the sack blocks of the ack
+};
+
+/* what an ack delivered, the ack_sample and rate_sample of the kernel in one */
+struct pcc_ns3_sample {
+	uint32_t pkts_acked;
+	int32_t rtt_us;						//-1 if the ack gives no sample
+	uint32_t in_flight;
+	int32_t delivered;					//segments delivered over the interval
+	int64_t interval_us;
+	int losses;
+	int is_app_limited;
+};
+
+/** a new socket with its 4-tuple (network order) and the module's init called */
+struct pcc_ns3_sock *pcc_ns3_create(const struct pcc_ns3_state *st, uint32_t saddr, uint32_t daddr,
+	uint16_t sport, uint16_t dport);
+void pcc_ns3_release(struct pcc_ns3_sock *ps);
+/** an ack: in_ack_event, pkts_acked if it acked anything, then cong_control */
+void pcc_ns3_ack(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st, const struct pcc_ns3_sample *sample);
+/** entering recovery or loss, the module's ssthresh */
+void pcc_ns3_loss(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st);
+/** a congestion state change, numbered as the kernel's tcp_ca_state */
+void pcc_ns3_set_state(struct pcc_ns3_sock *ps, const struct pcc_ns3_state *st, int state);
+/** pacing rate the module set, bytes per second */
+uint64_t pcc_ns3_pacing_rate(const struct pcc_ns3_sock *ps);
+/** congestion window the module set, segments */
+uint32_t pcc_ns3_cwnd(const struct pcc_ns3_sock *ps);
+/** sets a module parameter, returns -1 if it is unknown or bad */
+int pcc_ns3_param_set(const char *name, const char *value);
+void pcc_ns3_seed(uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
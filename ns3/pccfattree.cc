@@ -0,0 +1,195 @@
+/*
+ * A k-ary fat-tree of k^3/4 hosts with flows arriving as a Poisson process
+ * at a fraction of the host link rate, sizes drawn from the web search
+ * distribution, between random pairs of hosts.
+ *
+ *   ./pccfattree --k=4 --load=0.5 --flows=2000 --ecmp
+ */
+
+#include <cstdio>
+
+#include "ns3/point-to-point-module.h"
+
+#include "scenario.h"
+
+using namespace ns3;
+
+//web search flow sizes: bytes, cumulative probability
+static const double websearch_cdf[][2] = {
+	{ 6000, 0.15 }, { 13000, 0.2 }, { 19000, 0.3 }, { 33000, 0.4 }, { 53000, 0.53 },
+	{ 133000, 0.6 }, { 667000, 0.7 }, { 1333000, 0.8 }, { 3333000, 0.9 }, { 6667000, 0.97 },
+	{ 20000000, 1.0 },
+};
+
+static const uint64_t SMALL_FLOW_BYTES = 100000;
+static const uint64_t LARGE_FLOW_BYTES = 10000000;
+
+struct FatTree {
+	NodeContainer hosts, edges, aggs, cores;
+	std::vector<Ipv4Address> hostAddr;
+	std::vector<uint32_t> hostEdge;			//index of the edge switch of every host
+};
+
+static void
+Connect (PointToPointHelper &p2p, Ipv4AddressHelper &addr, const PccScenarioConfig &cfg, PccQueueStats &stats,
+	Ptr<Node> a, Ptr<Node> b, bool watchA, Ipv4Address *addrB)
+{
+	NetDeviceContainer devices = p2p.Install (a, b);
+	QueueDiscContainer queues = PccInstallQueues (cfg, devices);
+	Ipv4InterfaceContainer ifs = addr.Assign (devices);
+
+	addr.NewNetwork ();
+	//switch egress queues: both ends of switch links, the switch end of host links
+	if (watchA) {
+		stats.Watch (queues.Get (0));
+	}
+	stats.Watch (queues.Get (1));
+	if (addrB) {
+		*addrB = ifs.GetAddress (1);
+	}
+}
+
+static void
+FlowDone (const PccScenarioConfig *cfg, PccFlow *flow)
+{
+	if (cfg->verbose) {
+		printf ("flow %u bytes %llu fct_ms %.3f\n", flow->id, (unsigned long long)flow->bytes,
+			(flow->end - flow->start).GetSeconds () * 1000);
+	}
+}
+
+int
+main (int argc, char *argv[])
+{
+	PccScenarioConfig cfg;
+	uint32_t k = 4, nflows = 1000;
+	double load = 0.5, limitS = 10;
+	std::string rate = "10Gbps", delay = "1us";
+	bool ecmp = false;
+	CommandLine cmd;
+
+	PccAddOptions (cmd, cfg);
+	cmd.AddValue ("k", "ports per switch, even", k);
+	cmd.AddValue ("load", "offered load, fraction of the host link rate", load);
+	cmd.AddValue ("flows", "flows to start", nflows);
+	cmd.AddValue ("rate", "rate of every link", rate);
+	cmd.AddValue ("delay", "one way delay of every link", delay);
+	cmd.AddValue ("ecmp", "spread flows over equal cost paths", ecmp);
+	cmd.AddValue ("limit", "simulated seconds at most", limitS);
+	cmd.Parse (argc, argv);
+	if (k < 2 || k % 2) {
+		NS_FATAL_ERROR ("k must be even");
+	}
+	PccSetup (cfg);
+	if (ecmp) {
+		Config::SetDefault ("ns3::Ipv4GlobalRouting::RandomEcmpRouting", BooleanValue (true));
+	}
+
+	FatTree ft;
+	uint32_t half = k / 2;
+	ft.hosts.Create (k * half * half);
+	ft.edges.Create (k * half);
+	ft.aggs.Create (k * half);
+	ft.cores.Create (half * half);
+	ft.hostAddr.resize (ft.hosts.GetN ());
+	ft.hostEdge.resize (ft.hosts.GetN ());
+
+	InternetStackHelper stack;
+	stack.InstallAll ();
+
+	PointToPointHelper p2p;
+	p2p.SetDeviceAttribute ("DataRate", StringValue (rate));
+	p2p.SetChannelAttribute ("Delay", StringValue (delay));
+	p2p.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("1p"));
+
+	Ipv4AddressHelper addr ("10.0.0.0", "255.255.255.252");
+	PccQueueStats stats;
+
+	for (uint32_t pod = 0; pod < k; pod++) {
+		for (uint32_t e = 0; e < half; e++) {
+			uint32_t edge = pod * half + e;
+
+			for (uint32_t h = 0; h < half; h++) {
+				uint32_t host = edge * half + h;
+
+				Connect (p2p, addr, cfg, stats, ft.hosts.Get (host), ft.edges.Get (edge), false, nullptr);
+				//the host is the first end, its address is the other side's peer
+				ft.hostAddr[host] = ft.hosts.Get (host)->GetObject<Ipv4> ()->GetAddress (1, 0).GetLocal ();
+				ft.hostEdge[host] = edge;
+			}
+			for (uint32_t a = 0; a < half; a++) {
+				Connect (p2p, addr, cfg, stats, ft.edges.Get (edge), ft.aggs.Get (pod * half + a), true, nullptr);
+			}
+		}
+		//aggregation switch a of every pod goes to cores a*half .. a*half+half-1
+		for (uint32_t a = 0; a < half; a++) {
+			for (uint32_t c = 0; c < half; c++) {
+				Connect (p2p, addr, cfg, stats, ft.aggs.Get (pod * half + a), ft.cores.Get (a * half + c), true,
+					nullptr);
+			}
+		}
+	}
+	Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+	Ptr<EmpiricalRandomVariable> sizes = CreateObject<EmpiricalRandomVariable> ();
+	Ptr<ExponentialRandomVariable> gaps = CreateObject<ExponentialRandomVariable> ();
+	Ptr<UniformRandomVariable> pick = CreateObject<UniformRandomVariable> ();
+	DataRate lineRate (rate);
+	Time hopDelay (delay);
+	double meanBytes = 0, prevBytes = 0, prevProb = 0;
+
+	sizes->SetInterpolate (true);
+	sizes->CDF (0, 0);
+	for (const auto &point : websearch_cdf) {
+		sizes->CDF (point[0], point[1]);
+		meanBytes += (point[0] + prevBytes) / 2 * (point[1] - prevProb);
+		prevBytes = point[0];
+		prevProb = point[1];
+	}
+	//arrivals over all hosts so each host link carries load on average
+	gaps->SetAttribute ("Mean", DoubleValue (meanBytes * 8 / (lineRate.GetBitRate () * load * ft.hosts.GetN ())));
+
+	std::vector<PccFlow> flows (nflows);
+	std::vector<PccFlow *> all;
+	Time at = MilliSeconds (1);
+
+	for (uint32_t i = 0; i < nflows; i++) {
+		PccFlow &flow = flows[i];
+		uint32_t src = pick->GetInteger (0, ft.hosts.GetN () - 1);
+		uint32_t dst = pick->GetInteger (0, ft.hosts.GetN () - 2);
+		uint32_t hops;
+
+		if (dst >= src) {
+			dst++;
+		}
+		if (ft.hostEdge[src] == ft.hostEdge[dst]) {
+			hops = 2;
+		} else if (ft.hostEdge[src] / half == ft.hostEdge[dst] / half) {
+			hops = 4;
+		} else {
+			hops = 6;
+		}
+		at += Seconds (gaps->GetValue ());
+		flow.id = i;
+		flow.src = ft.hosts.Get (src);
+		flow.dst = ft.hosts.Get (dst);
+		flow.dstAddr = ft.hostAddr[dst];
+		flow.port = 5000 + i;
+		flow.bytes = std::max<uint64_t> ((uint64_t)sizes->GetValue (), 1);
+		flow.start = at;
+		//store and forward at every hop, then the ack back
+		flow.ideal = hopDelay * hops * 2 + lineRate.CalculateBytesTxTime (flow.bytes) +
+			lineRate.CalculateBytesTxTime (cfg.mss) * (hops - 1);
+		all.push_back (&flow);
+		PccStartFlow (cfg, &flow, MakeBoundCallback (&FlowDone, (const PccScenarioConfig *)&cfg));
+	}
+	Simulator::Stop (Seconds (limitS));
+	Simulator::Run ();
+	stats.Finish ();
+
+	printf ("cc %s\nk %u\nhosts %u\nload %.3f\necmp %d\n", cfg.cc.c_str (), k, ft.hosts.GetN (), load, ecmp);
+	PccPrintFcts (all, SMALL_FLOW_BYTES, LARGE_FLOW_BYTES);
+	stats.Print ("");
+	Simulator::Destroy ();
+	return 0;
+}
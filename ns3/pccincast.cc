@@ -0,0 +1,157 @@
+/*
+ * Incast: every sender sends a block to one receiver through a switch at the
+ * same time, the next round starting when the last block of this one
+ * arrived. The switch port to the receiver is where the queue builds.
+ *
+ *   ./pccincast --senders=64 --bytes=65536 --rounds=20 --buffer=128000
+ */
+
+#include <cstdio>
+#include <numeric>
+
+#include "ns3/point-to-point-module.h"
+
+#include "scenario.h"
+
+using namespace ns3;
+
+struct Incast {
+	PccScenarioConfig cfg;
+	std::vector<PccFlow> flows;
+	std::vector<PccFlow *> all;
+	std::vector<double> qcts;
+	Time roundStart;
+	Time think;
+	uint32_t round;
+	uint32_t rounds;
+	uint32_t pending;
+	uint16_t port;
+};
+
+static void StartRound (Incast *in);
+
+static void
+FlowDone (Incast *in, PccFlow *flow)
+{
+	if (in->cfg.verbose) {
+		printf ("round %u flow %u fct_ms %.3f\n", in->round, flow->id, (flow->end - flow->start).GetSeconds () * 1000);
+	}
+	if (--in->pending > 0) {
+		return;
+	}
+	in->qcts.push_back ((Simulator::Now () - in->roundStart).GetSeconds () * 1000);
+	if (++in->round < in->rounds) {
+		Simulator::Schedule (in->think, &StartRound, in);
+	} else {
+		Simulator::Stop ();
+	}
+}
+
+static void
+StartRound (Incast *in)
+{
+	size_t senders = in->flows.size () / in->rounds;
+	size_t i;
+
+	in->roundStart = Simulator::Now ();
+	in->pending = senders;
+	for (i = 0; i < senders; i++) {
+		PccFlow *flow = &in->flows[in->round * senders + i];
+
+		//a new port each round, so no sink sees two flows
+		flow->port = in->port++;
+		flow->start = Simulator::Now ();
+		PccStartFlow (in->cfg, flow, MakeBoundCallback (&FlowDone, in));
+	}
+}
+
+int
+main (int argc, char *argv[])
+{
+	Incast in;
+	uint32_t senders = 32, rounds = 10;
+	uint64_t bytes = 65536;
+	std::string rate = "10Gbps", delay = "10us";
+	double thinkMs = 0, limitS = 60;
+	CommandLine cmd;
+
+	PccAddOptions (cmd, in.cfg);
+	cmd.AddValue ("senders", "senders per round", senders);
+	cmd.AddValue ("bytes", "bytes every sender sends per round", bytes);
+	cmd.AddValue ("rounds", "rounds", rounds);
+	cmd.AddValue ("rate", "rate of every link", rate);
+	cmd.AddValue ("delay", "one way delay of every link", delay);
+	cmd.AddValue ("think", "pause between rounds, ms", thinkMs);
+	cmd.AddValue ("limit", "simulated seconds at most", limitS);
+	cmd.Parse (argc, argv);
+	PccSetup (in.cfg);
+
+	NodeContainer hosts, sw, receiver;
+	hosts.Create (senders);
+	sw.Create (1);
+	receiver.Create (1);
+
+	InternetStackHelper stack;
+	stack.InstallAll ();
+
+	PointToPointHelper p2p;
+	p2p.SetDeviceAttribute ("DataRate", StringValue (rate));
+	p2p.SetChannelAttribute ("Delay", StringValue (delay));
+	//the queue discs hold the packets, the devices only one
+	p2p.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("1p"));
+
+	Ipv4AddressHelper addr ("10.1.0.0", "255.255.255.252");
+	PccQueueStats stats;
+	NetDeviceContainer down = p2p.Install (sw.Get (0), receiver.Get (0));
+	QueueDiscContainer downQueues = PccInstallQueues (in.cfg, down);
+	Ipv4InterfaceContainer downIf = addr.Assign (down);
+
+	addr.NewNetwork ();
+	stats.Watch (downQueues.Get (0));
+	for (uint32_t i = 0; i < senders; i++) {
+		NetDeviceContainer up = p2p.Install (hosts.Get (i), sw.Get (0));
+
+		PccInstallQueues (in.cfg, up);
+		addr.Assign (up);
+		addr.NewNetwork ();
+	}
+	Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+	DataRate lineRate (rate);
+	Time hopDelay (delay);
+	//two hops out and the ack back, and the block at line rate
+	Time ideal = hopDelay * 4 + lineRate.CalculateBytesTxTime (bytes);
+
+	in.flows.resize (senders * rounds);
+	for (uint32_t r = 0; r < rounds; r++) {
+		for (uint32_t i = 0; i < senders; i++) {
+			PccFlow &flow = in.flows[r * senders + i];
+
+			flow.id = r * senders + i;
+			flow.src = hosts.Get (i);
+			flow.dst = receiver.Get (0);
+			flow.dstAddr = downIf.GetAddress (1);
+			flow.bytes = bytes;
+			flow.ideal = ideal;
+			in.all.push_back (&flow);
+		}
+	}
+	in.round = 0;
+	in.rounds = rounds;
+	in.think = MilliSeconds (thinkMs);
+	in.port = 5000;
+	Simulator::Schedule (MilliSeconds (1), &StartRound, &in);
+	Simulator::Stop (Seconds (limitS));
+	Simulator::Run ();
+	stats.Finish ();
+
+	printf ("cc %s\nsenders %u\nbytes %llu\nrounds_done %zu\n", in.cfg.cc.c_str (), senders,
+		(unsigned long long)bytes, in.qcts.size ());
+	printf ("qct_mean_ms %.3f\n", in.qcts.empty () ? 0 :
+		std::accumulate (in.qcts.begin (), in.qcts.end (), 0.0) / in.qcts.size ());
+	printf ("qct_p99_ms %.3f\n", PccPercentile (in.qcts, 99));
+	PccPrintFcts (in.all, 0, 0);
+	stats.Print ("");
+	Simulator::Destroy ();
+	return 0;
+}
@@ -0,0 +1,304 @@
+/*
+ * Flows, queue occupancy and the summary of the ns-3 scenarios.
+ */
+
+#include "scenario.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+
+#include "ns3/applications-module.h"
+
+#include "tcp_pcc.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("PccScenario");
+
+//bytes written to the socket at once
+static const uint32_t PCC_WRITE_BYTES = 65536;
+static const uint32_t PCC_HIST_BUCKET = 1000;
+
+struct FlowContext {
+	PccScenarioConfig cfg;
+	PccFlow *flow;
+	Callback<void, PccFlow *> done;
+	bool closed;
+};
+
+//the contexts live as long as the simulation
+static std::vector<std::unique_ptr<FlowContext>> contexts;
+
+void
+PccAddOptions (CommandLine &cmd, PccScenarioConfig &cfg)
+{
+	cmd.AddValue ("cc", "congestion control: pcc, or an ns-3 congestion ops TypeId like ns3::TcpCubic", cfg.cc);
+	cmd.AddValue ("mss", "segment size, bytes", cfg.mss);
+	cmd.AddValue ("buffer", "switch egress queue, bytes", cfg.bufferBytes);
+	cmd.AddValue ("minRto", "minimum RTO, ms", cfg.minRtoMs);
+	cmd.AddValue ("pcc", "module parameters, name=value,...", cfg.pccParams);
+	cmd.AddValue ("verbose", "print every flow", cfg.verbose);
+}
+
+void
+PccSetup (const PccScenarioConfig &cfg)
+{
+	std::istringstream params (cfg.pccParams);
+	std::string param;
+
+	Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (cfg.mss));
+	Config::SetDefault ("ns3::TcpSocket::SndBufSize", UintegerValue (1 << 24));
+	Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue (1 << 24));
+	Config::SetDefault ("ns3::TcpSocketBase::Sack", BooleanValue (true));
+	Config::SetDefault ("ns3::TcpSocketBase::MinRto", TimeValue (MilliSeconds (cfg.minRtoMs)));
+	Config::SetDefault ("ns3::TcpSocketState::EnablePacing", BooleanValue (true));
+
+	while (std::getline (params, param, ',')) {
+		size_t eq = param.find ('=');
+
+		if (param.empty ()) {
+			continue;
+		}
+		if (eq == std::string::npos || !TcpPcc::SetParam (param.substr (0, eq), param.substr (eq + 1))) {
+			NS_FATAL_ERROR ("bad module parameter " << param);
+		}
+	}
+	TcpPcc::SetSeed (RngSeedManager::GetSeed () * 1000 + RngSeedManager::GetRun ());
+}
+
+QueueDiscContainer
+PccInstallQueues (const PccScenarioConfig &cfg, NetDeviceContainer devices)
+{
+	TrafficControlHelper tch;
+
+	tch.SetRootQueueDisc ("ns3::FifoQueueDisc", "MaxSize",
+		QueueSizeValue (QueueSize (QueueSizeUnit::BYTES, (uint32_t)cfg.bufferBytes)));
+	return tch.Install (devices);
+}
+
+static void
+SinkRx (FlowContext *ctx, Ptr<const Packet> p, const Address &from)
+{
+	PccFlow *flow = ctx->flow;
+
+	flow->received += p->GetSize ();
+	if (flow->received >= flow->bytes && flow->end.IsZero ()) {
+		flow->end = Simulator::Now ();
+		if (!ctx->done.IsNull ()) {
+			ctx->done (flow);
+		}
+	}
+}
+
+static void
+SenderFill (FlowContext *ctx, Ptr<Socket> socket, uint32_t available)
+{
+	PccFlow *flow = ctx->flow;
+
+	while (flow->sent < flow->bytes && socket->GetTxAvailable () > 0) {
+		uint32_t n = std::min<uint64_t> (std::min<uint64_t> (flow->bytes - flow->sent, socket->GetTxAvailable ()),
+			PCC_WRITE_BYTES);
+		int sent = socket->Send (Create<Packet> (n));
+
+		if (sent <= 0) {
+			break;
+		}
+		flow->sent += sent;
+	}
+	//the FIN goes after the data still in the buffer
+	if (flow->sent == flow->bytes && !ctx->closed) {
+		ctx->closed = true;
+		socket->Close ();
+	}
+}
+
+static void
+SenderConnected (FlowContext *ctx, Ptr<Socket> socket)
+{
+	SenderFill (ctx, socket, socket->GetTxAvailable ());
+}
+
+static void
+SenderFailed (FlowContext *ctx, Ptr<Socket> socket)
+{
+	NS_LOG_WARN ("flow " << ctx->flow->id << " could not connect");
+}
+
+static void
+SenderStart (FlowContext *ctx)
+{
+	PccFlow *flow = ctx->flow;
+	Ptr<Socket> socket = Socket::CreateSocket (flow->src, TcpSocketFactory::GetTypeId ());
+	Ptr<TcpSocketBase> tcp = DynamicCast<TcpSocketBase> (socket);
+
+	if (ctx->cfg.cc == "pcc") {
+		Ptr<TcpPcc> pcc = CreateObject<TcpPcc> ();
+		tcp->SetCongestionControlAlgorithm (pcc);
+		pcc->Attach (tcp);
+	} else {
+		ObjectFactory factory;
+		factory.SetTypeId (ctx->cfg.cc);
+		tcp->SetCongestionControlAlgorithm (factory.Create<TcpCongestionOps> ());
+	}
+	flow->socket = socket;
+	socket->Bind ();
+	socket->SetConnectCallback (MakeBoundCallback (&SenderConnected, ctx), MakeBoundCallback (&SenderFailed, ctx));
+	socket->SetSendCallback (MakeBoundCallback (&SenderFill, ctx));
+	socket->Connect (InetSocketAddress (flow->dstAddr, flow->port));
+}
+
+void
+PccStartFlow (const PccScenarioConfig &cfg, PccFlow *flow, Callback<void, PccFlow *> done)
+{
+	PacketSinkHelper sinkHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), flow->port));
+	ApplicationContainer sink = sinkHelper.Install (flow->dst);
+	FlowContext *ctx = new FlowContext { cfg, flow, done, false };
+
+	contexts.emplace_back (ctx);
+	flow->sent = 0;
+	flow->received = 0;
+	flow->end = Time (0);
+	sink.Start (Time (0));
+	sink.Get (0)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&SinkRx, ctx));
+	Simulator::Schedule (flow->start > Simulator::Now () ? flow->start - Simulator::Now () : Time (0),
+		&SenderStart, ctx);
+}
+
+void
+PccQueueStats::Watch (Ptr<QueueDisc> queue)
+{
+	uint32_t index = m_queues.size ();
+
+	m_queues.push_back (Watched { Simulator::Now (), Simulator::Now (), 0, 0, 0 });
+	queue->TraceConnectWithoutContext ("BytesInQueue", MakeBoundCallback (&PccQueueStats::BytesTrace, this, index));
+	queue->TraceConnectWithoutContext ("Drop", MakeCallback (&PccQueueStats::OnDrop, this));
+}
+
+void
+PccQueueStats::Account (Watched &w)
+{
+	double dt = (Simulator::Now () - w.last).GetSeconds ();
+	uint32_t bucket = w.bytes / PCC_HIST_BUCKET;
+
+	w.integral += w.bytes * dt;
+	if (bucket >= m_hist.size ()) {
+		m_hist.resize (bucket + 1, 0);
+	}
+	m_hist[bucket] += dt;
+	w.last = Simulator::Now ();
+}
+
+void
+PccQueueStats::BytesTrace (PccQueueStats *stats, uint32_t index, uint32_t oldValue, uint32_t newValue)
+{
+	Watched &w = stats->m_queues[index];
+
+	stats->Account (w);
+	w.bytes = newValue;
+	w.max = std::max (w.max, newValue);
+}
+
+void
+PccQueueStats::OnDrop (Ptr<const QueueDiscItem> item)
+{
+	m_drops++;
+}
+
+void
+PccQueueStats::Finish ()
+{
+	for (Watched &w : m_queues) {
+		Account (w);
+	}
+}
+
+void
+PccQueueStats::Print (const std::string &prefix) const
+{
+	double mean = 0, total = 0, seen = 0;
+	uint32_t max = 0;
+	size_t i;
+
+	for (const Watched &w : m_queues) {
+		double secs = (w.last - w.start).GetSeconds ();
+
+		mean += secs > 0 ? w.integral / secs : 0;
+		max = std::max (max, w.max);
+	}
+	for (i = 0; i < m_hist.size (); i++) {
+		total += m_hist[i];
+	}
+	//time weighted over all queues
+	for (i = 0; i < m_hist.size () && total > 0; i++) {
+		seen += m_hist[i];
+		if (seen >= total * 0.99) {
+			break;
+		}
+	}
+	printf ("%squeues %zu\n", prefix.c_str (), m_queues.size ());
+	printf ("%squeue_mean_kb %.3f\n", prefix.c_str (), m_queues.empty () ? 0 : mean / m_queues.size () / 1000);
+	printf ("%squeue_p99_kb %.3f\n", prefix.c_str (), total > 0 ? (double)(i + 1) * PCC_HIST_BUCKET / 1000 : 0);
+	printf ("%squeue_max_kb %.3f\n", prefix.c_str (), max / 1000.0);
+	printf ("%squeue_drops %llu\n", prefix.c_str (), (unsigned long long)m_drops);
+}
+
+double
+PccPercentile (std::vector<double> values, double pct)
+{
+	size_t index;
+
+	if (values.empty ()) {
+		return 0;
+	}
+	std::sort (values.begin (), values.end ());
+	index = (size_t)std::ceil (pct / 100 * values.size ());
+	return values[index > 0 ? index - 1 : 0];
+}
+
+static void
+PrintFctClass (const std::string &prefix, const std::vector<PccFlow *> &flows, uint64_t minBytes, uint64_t maxBytes)
+{
+	std::vector<double> fcts, slowdowns;
+	double fctSum = 0, slowdownSum = 0;
+	uint32_t total = 0;
+
+	for (const PccFlow *f : flows) {
+		double fct;
+
+		if (f->bytes < minBytes || f->bytes >= maxBytes) {
+			continue;
+		}
+		total++;
+		if (f->end.IsZero ()) {
+			continue;
+		}
+		fct = (f->end - f->start).GetSeconds () * 1000;
+		fcts.push_back (fct);
+		fctSum += fct;
+		slowdowns.push_back (fct / std::max (f->ideal.GetSeconds () * 1000, 1e-6));
+		slowdownSum += slowdowns.back ();
+	}
+	printf ("%sflows %u\n%scompleted %zu\n", prefix.c_str (), total, prefix.c_str (), fcts.size ());
+	printf ("%sfct_mean_ms %.3f\n", prefix.c_str (), fcts.empty () ? 0 : fctSum / fcts.size ());
+	printf ("%sfct_p50_ms %.3f\n%sfct_p99_ms %.3f\n%sfct_max_ms %.3f\n", prefix.c_str (), PccPercentile (fcts, 50),
+		prefix.c_str (), PccPercentile (fcts, 99), prefix.c_str (), PccPercentile (fcts, 100));
+	printf ("%sslowdown_mean %.3f\n%sslowdown_p99 %.3f\n", prefix.c_str (),
+		slowdowns.empty () ? 0 : slowdownSum / slowdowns.size (), prefix.c_str (), PccPercentile (slowdowns, 99));
+}
+
+void
+PccPrintFcts (const std::vector<PccFlow *> &flows, uint64_t smallBytes, uint64_t largeBytes)
+{
+	PrintFctClass ("", flows, 0, UINT64_MAX);
+	if (smallBytes) {
+		PrintFctClass ("small_", flows, 0, smallBytes);
+	}
+	if (largeBytes) {
+		PrintFctClass ("large_", flows, largeBytes, UINT64_MAX);
+	}
+}
+
+} // namespace ns3
@@ -0,0 +1,89 @@
+#ifndef PCC_SCENARIO_H
+#define PCC_SCENARIO_H
+
+/*
+ * What the ns-3 scenarios share: flows of a given size from one host to
+ * another, each with its own sink, timed from the first byte sent to the
+ * last byte received, and the occupancy of the switch queues. The summary
+ * is printed as pccsim prints its own, one "name value" per line.
+ */
+
+#include <string>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ns3/traffic-control-module.h"
+
+namespace ns3 {
+
+struct PccFlow {
+	uint32_t id;
+	Ptr<Node> src;
+	Ptr<Node> dst;
+	Ipv4Address dstAddr;
+	uint16_t port;
+	uint64_t bytes;
+	Time start;
+	Time end;						//zero until the sink got every byte
+	Time ideal;						//at line rate over an empty path
+	uint64_t sent;
+	uint64_t received;
+	Ptr<Socket> socket;
+};
+
+/* socket and queue defaults, and the congestion control of the flows */
+struct PccScenarioConfig {
+	std::string cc = "pcc";			//"pcc" or an ns-3 congestion ops TypeId
+	uint32_t mss = 1448;
+	uint64_t bufferBytes = 256000;	//every switch egress queue
+	uint32_t minRtoMs = 200;
+	std::string pccParams;			//name=value,... for the module
+	bool verbose = false;
+};
+
+/** adds the scenario options to the command line */
+void PccAddOptions (CommandLine &cmd, PccScenarioConfig &cfg);
+/** applies the socket defaults and the module parameters, exits on a bad one */
+void PccSetup (const PccScenarioConfig &cfg);
+/** a FIFO queue disc of the configured buffer on every device, before addresses are assigned */
+QueueDiscContainer PccInstallQueues (const PccScenarioConfig &cfg, NetDeviceContainer devices);
+
+/** starts the flow at its start time, the callback runs when its last byte arrives */
+void PccStartFlow (const PccScenarioConfig &cfg, PccFlow *flow, Callback<void, PccFlow *> done);
+
+/* time weighted occupancy of a set of queue discs */
+class PccQueueStats
+{
+public:
+	void Watch (Ptr<QueueDisc> queue);
+	void Finish ();
+	void Print (const std::string &prefix) const;
+
+private:
+	struct Watched {
+		Time start;
+		Time last;
+		uint32_t bytes;
+		double integral;			//bytes * seconds
+		uint32_t max;
+	};
+	static void BytesTrace (PccQueueStats *stats, uint32_t index, uint32_t oldValue, uint32_t newValue);
+	void OnDrop (Ptr<const QueueDiscItem> item);
+	void Account (Watched &w);
+
+	std::vector<Watched> m_queues;
+	std::vector<double> m_hist;		//seconds spent at every occupancy, 1 kB buckets, all queues
+	uint64_t m_drops = 0;
+};
+
+/** prints the flow completion times and slowdowns, of all flows and of the given size classes */
+void PccPrintFcts (const std::vector<PccFlow *> &flows, uint64_t smallBytes, uint64_t largeBytes);
+
+/** percentile of the values, pct from 0 to 100 */
+double PccPercentile (std::vector<double> values, double pct);
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * ns-3 congestion ops calling the PCC module through pcc_ns3.c: every ack
+ * becomes in_ack_event, pkts_acked and cong_control, entering recovery
+ * becomes ssthresh and state changes set_state, as in the kernel.
+ */
+
+#include "tcp_pcc.h"
+
+#include <arpa/inet.h>
+
+#include "ns3/inet-socket-address.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/tcp-option-sack.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TcpPcc");
+NS_OBJECT_ENSURE_REGISTERED (TcpPcc);
+
+//the window the module sets is in segments, and huge so it never limits
+static const uint32_t PCC_MAX_CWND_BYTES = 1U << 30;
+
+TypeId
+TcpPcc::GetTypeId (void)
+{
+	static TypeId tid = TypeId ("ns3::TcpPcc")
+		.SetParent<TcpCongestionOps> ()
+		.SetGroupName ("Internet")
+		.AddConstructor<TcpPcc> ();
+	return tid;
+}
+
+TcpPcc::TcpPcc ()
+	: m_sock (nullptr),
+	  m_socket (nullptr),
+	  m_attached (false),
+	  m_segsOut (0),
+	  m_retrans (0),
+	  m_bytesAcked (0),
+	  m_ackedSegs (0),
+	  m_rttUs (-1),
+	  m_nsacks (0)
+{
+}
+
+//a fork is a new connection, it gets a socket of its own in the module
+TcpPcc::TcpPcc (const TcpPcc &sock)
+	: TcpCongestionOps (sock),
+	  m_sock (nullptr),
+	  m_socket (nullptr),
+	  m_attached (false),
+	  m_segsOut (0),
+	  m_retrans (0),
+	  m_bytesAcked (0),
+	  m_ackedSegs (0),
+	  m_rttUs (-1),
+	  m_nsacks (0)
+{
+}
+
+TcpPcc::~TcpPcc ()
+{
+	pcc_ns3_release (m_sock);
+}
+
+std::string
+TcpPcc::GetName () const
+{
+	return "TcpPcc";
+}
+
+bool
+TcpPcc::SetParam (const std::string &name, const std::string &value)
+{
+	return pcc_ns3_param_set (name.c_str (), value.c_str ()) == 0;
+}
+
+void
+TcpPcc::SetSeed (uint64_t seed)
+{
+	pcc_ns3_seed (seed);
+}
+
+void
+TcpPcc::Attach (Ptr<TcpSocketBase> socket)
+{
+	m_socket = PeekPointer (socket);
+	m_attached = true;
+	socket->TraceConnectWithoutContext ("Tx", MakeCallback (&TcpPcc::OnTx, this));
+	socket->TraceConnectWithoutContext ("Rx", MakeCallback (&TcpPcc::OnRx, this));
+}
+
+void
+TcpPcc::OnTx (Ptr<const Packet> p, const TcpHeader &header, Ptr<const TcpSocketBase> socket)
+{
+	SequenceNumber32 seq = header.GetSequenceNumber ();
+
+	if (p->GetSize () == 0) {
+		return;
+	}
+	m_segsOut++;
+	if (m_segsOut > 1 && seq < m_highestSent) {
+		m_retrans++;
+	} else {
+		m_highestSent = seq + p->GetSize ();
+	}
+}
+
+void
+TcpPcc::OnRx (Ptr<const Packet> p, const TcpHeader &header, Ptr<const TcpSocketBase> socket)
+{
+	Ptr<const TcpOptionSack> sack;
+
+	if (!(header.GetFlags () & TcpHeader::ACK)) {
+		return;
+	}
+	m_nsacks = 0;
+	if (!header.HasOption (TcpOption::SACK)) {
+		return;
+	}
+	sack = DynamicCast<const TcpOptionSack> (header.GetOption (TcpOption::SACK));
+	for (const TcpOptionSack::SackBlock &block : sack->GetSackList ()) {
+		if (m_nsacks == PCC_NS3_MAX_SACKS) {
+			break;
+		}
+		m_sacks[m_nsacks][0] = block.first.GetValue ();
+		m_sacks[m_nsacks][1] = block.second.GetValue ();
+		m_nsacks++;
+	}
+}
+
+void
+TcpPcc::Fill (Ptr<const TcpSocketState> tcb, struct pcc_ns3_state *st)
+{
+	uint32_t mss = tcb->m_segmentSize;
+	uint64_t sacked = 0;
+	int i;
+
+	memset (st, 0, sizeof (*st));
+	if (tcb->m_lastAckedSeq > m_lastUna) {
+		m_bytesAcked += tcb->m_lastAckedSeq - m_lastUna;
+		m_lastUna = tcb->m_lastAckedSeq;
+	}
+	st->now_ns = Simulator::Now ().GetNanoSeconds ();
+	st->snd_una = tcb->m_lastAckedSeq.GetValue ();
+	st->snd_nxt = tcb->m_highTxMark.Get ().GetValue ();
+	st->mss = mss;
+	st->srtt_us = tcb->m_srtt.Get ().GetMicroSeconds ();
+	st->packets_out = tcb->m_bytesInFlight.Get () / mss;
+	st->bytes_acked = m_bytesAcked;
+	if (m_attached) {
+		st->data_segs_out = m_segsOut;
+		st->total_retrans = m_retrans;
+	} else {
+		st->data_segs_out = (tcb->m_highTxMark.Get () - m_isn) / mss;
+	}
+	st->nsacks = m_nsacks;
+	for (i = 0; i < m_nsacks; i++) {
+		st->sacks[i][0] = m_sacks[i][0];
+		st->sacks[i][1] = m_sacks[i][1];
+		sacked += m_sacks[i][1] - m_sacks[i][0];
+	}
+	//the module only uses the blocks when something is sacked
+	st->sacked_out = m_nsacks ? std::max<uint64_t> (sacked / mss, 1) : 0;
+}
+
+void
+TcpPcc::Apply (Ptr<TcpSocketState> tcb) const
+{
+	uint64_t rate = pcc_ns3_pacing_rate (m_sock);
+	uint64_t cwnd = (uint64_t)pcc_ns3_cwnd (m_sock) * tcb->m_segmentSize;
+
+	if (rate) {
+		DataRate pacing (rate * 8);
+		tcb->m_pacingRate = pacing < tcb->m_maxPacingRate ? pacing : tcb->m_maxPacingRate;
+	}
+	tcb->m_cWnd = std::min<uint64_t> (cwnd, PCC_MAX_CWND_BYTES);
+}
+
+void
+TcpPcc::Create (Ptr<const TcpSocketState> tcb)
+{
+	struct pcc_ns3_state st;
+	uint32_t saddr = 0, daddr = 0;
+	uint16_t sport = 0, dport = 0;
+	Address local, peer;
+
+	if (m_sock) {
+		return;
+	}
+	//the 4-tuple lets pcc/deadlines entries find the socket
+	if (m_socket && m_socket->GetSockName (local) == 0 && m_socket->GetPeerName (peer) == 0 &&
+		InetSocketAddress::IsMatchingType (local) && InetSocketAddress::IsMatchingType (peer)) {
+		saddr = htonl (InetSocketAddress::ConvertFrom (local).GetIpv4 ().Get ());
+		daddr = htonl (InetSocketAddress::ConvertFrom (peer).GetIpv4 ().Get ());
+		sport = htons (InetSocketAddress::ConvertFrom (local).GetPort ());
+		dport = htons (InetSocketAddress::ConvertFrom (peer).GetPort ());
+	}
+	m_isn = tcb->m_highTxMark.Get ();
+	m_lastUna = tcb->m_lastAckedSeq;
+	Fill (tcb, &st);
+	m_sock = pcc_ns3_create (&st, saddr, daddr, sport, dport);
+	NS_ABORT_MSG_IF (m_sock == nullptr, "could not allocate the PCC socket");
+}
+
+void
+TcpPcc::Init (Ptr<TcpSocketState> tcb)
+{
+	NS_LOG_FUNCTION (this << tcb);
+	//PCC sets a rate, the window only keeps the socket from sending forever
+	tcb->m_pacing = true;
+	Create (tcb);
+	Apply (tcb);
+}
+
+uint32_t
+TcpPcc::GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight)
+{
+	struct pcc_ns3_state st;
+
+	Create (tcb);
+	Fill (tcb, &st);
+	pcc_ns3_loss (m_sock, &st);
+	return PCC_MAX_CWND_BYTES;
+}
+
+void
+TcpPcc::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
+{
+	//the window is set by CongControl
+}
+
+void
+TcpPcc::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time &rtt)
+{
+	m_ackedSegs += segmentsAcked;
+	m_rttUs = rtt.IsStrictlyPositive () ? rtt.GetMicroSeconds () : -1;
+}
+
+void
+TcpPcc::CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState)
+{
+	struct pcc_ns3_state st;
+
+	if (!m_sock) {
+		return;
+	}
+	//ns-3 numbers the states as the kernel does
+	Fill (tcb, &st);
+	pcc_ns3_set_state (m_sock, &st, (int)newState);
+}
+
+bool
+TcpPcc::HasCongControl () const
+{
+	return true;
+}
+
+void
+TcpPcc::CongControl (Ptr<TcpSocketState> tcb, const TcpRateOps::TcpRateConnection &rc,
+	const TcpRateOps::TcpRateSample &rs)
+{
+	struct pcc_ns3_state st;
+	struct pcc_ns3_sample sample;
+
+	Create (tcb);
+	Fill (tcb, &st);
+	memset (&sample, 0, sizeof (sample));
+	sample.pkts_acked = m_ackedSegs;
+	sample.rtt_us = m_rttUs;
+	sample.in_flight = rs.m_priorInFlight / tcb->m_segmentSize;
+	sample.delivered = rs.m_delivered / (int32_t)tcb->m_segmentSize;
+	sample.interval_us = rs.m_interval.GetMicroSeconds ();
+	sample.losses = rs.m_bytesLoss / tcb->m_segmentSize;
+	sample.is_app_limited = rs.m_isAppLimited;
+	pcc_ns3_ack (m_sock, &st, &sample);
+	m_ackedSegs = 0;
+	m_rttUs = -1;
+	Apply (tcb);
+}
+
+Ptr<TcpCongestionOps>
+TcpPcc::Fork ()
+{
+	return CopyObject<TcpPcc> (this);
+}
+
+} // namespace ns3
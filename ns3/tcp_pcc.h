@@ -0,0 +1,75 @@
+#ifndef TCP_PCC_H
+#define TCP_PCC_H
+
+#include "ns3/tcp-congestion-ops.h"
+#include "ns3/tcp-header.h"
+#include "ns3/tcp-socket-base.h"
+
+#include "pcc_ns3.h"
+
+namespace ns3 {
+
+/**
+ * PCC as ns-3 congestion ops: the controller of pcc_pacing.c, built against
+ * the kernel shim, gets the callbacks the kernel would make and sets the
+ * pacing rate and the window of the socket.
+ *
+ * The congestion ops interface passes neither the sack blocks of an ack nor
+ * the segments sent, which the monitors need. Attach() the ops to their
+ * socket to take them from its Tx and Rx traces. Without it segments are
+ * counted by the highest sequence sent and losses are not found by monitor.
+ * The socket needs pacing (TcpSocketState::EnablePacing).
+ */
+class TcpPcc : public TcpCongestionOps
+{
+public:
+	static TypeId GetTypeId (void);
+
+	TcpPcc ();
+	TcpPcc (const TcpPcc &sock);
+	~TcpPcc () override;
+
+	std::string GetName () const override;
+	void Init (Ptr<TcpSocketState> tcb) override;
+	uint32_t GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight) override;
+	void IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked) override;
+	void PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time &rtt) override;
+	void CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState) override;
+	bool HasCongControl () const override;
+	void CongControl (Ptr<TcpSocketState> tcb, const TcpRateOps::TcpRateConnection &rc,
+		const TcpRateOps::TcpRateSample &rs) override;
+	Ptr<TcpCongestionOps> Fork () override;
+
+	/** takes the sack blocks and the segments sent from the socket's traces */
+	void Attach (Ptr<TcpSocketBase> socket);
+
+	/** sets a parameter of the module, for all sockets, false if it is unknown or bad */
+	static bool SetParam (const std::string &name, const std::string &value);
+	/** seeds the module's randomness, the decision making order */
+	static void SetSeed (uint64_t seed);
+
+private:
+	void Create (Ptr<const TcpSocketState> tcb);
+	void Fill (Ptr<const TcpSocketState> tcb, struct pcc_ns3_state *st);
+	void Apply (Ptr<TcpSocketState> tcb) const;
+	void OnTx (Ptr<const Packet> p, const TcpHeader &header, Ptr<const TcpSocketBase> socket);
+	void OnRx (Ptr<const Packet> p, const TcpHeader &header, Ptr<const TcpSocketBase> socket);
+
+	struct pcc_ns3_sock *m_sock;		//the module's socket, created at Init
+	TcpSocketBase *m_socket;			//the socket that owns these ops, if attached
+	bool m_attached;
+	uint32_t m_segsOut;					//data segments sent, from the Tx trace
+	uint32_t m_retrans;
+	SequenceNumber32 m_highestSent;
+	SequenceNumber32 m_isn;				//first sequence, counts segments when not attached
+	SequenceNumber32 m_lastUna;
+	uint64_t m_bytesAcked;
+	uint32_t m_ackedSegs;				//segments acked by the ack PktsAcked was called for
+	int32_t m_rttUs;
+	int m_nsacks;
+	uint32_t m_sacks[PCC_NS3_MAX_SACKS][2];
+};
+
+} // namespace ns3
+
+#endif
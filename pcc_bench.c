@@ -0,0 +1,285 @@
+/*
+ * PCC microbenchmarks: runs the hot functions of pcc_pacing.c on synthetic
+ * sockets inside the kernel, so they are measured with the kernel build flags
+ * (retpolines, the 64 bit fixed point code generation) they really run with.
+ *
+ *   insmod pcc_bench.ko
+ *   echo 1000000 > /sys/kernel/debug/pcc_bench/iterations
+ *   echo all > /sys/kernel/debug/pcc_bench/run     (or a benchmark name)
+ *   cat /sys/kernel/debug/pcc_bench/results
+ *
+ * benchmarks:
+ *   calc_utility   utility of one ended monitor with losses
+ *   sack           SACK attribution over all monitors with 4 unsorted SACK
+ *                  blocks, including restoring the monitors for the next op
+ *   monitor_scan   end of monitor checks over all active monitors
+ */
+
+#define PCC_BENCH
+#include "pcc_pacing.c"
+
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+#define BENCH_DEFAULT_ITERATIONS (1000000)
+#define BENCH_CHUNK (4096)
+#define BENCH_RESULTS_SIZE (1024)
+#define BENCH_BASE_SEQ (1000000)
+#define BENCH_MONITOR_SEGMENTS (100)
+#define BENCH_MSS (1448)
+
+struct pcc_bench {
+	const char *name;
+	void (*setup)(struct sock *sk);
+	void (*op)(struct sock *sk);
+};
+
+static u32 bench_iterations = BENCH_DEFAULT_ITERATIONS;
+static char bench_results[BENCH_RESULTS_SIZE];
+static size_t bench_results_len;
+static DEFINE_MUTEX(bench_lock);
+static struct dentry *bench_debugfs_dir;
+static u32 bench_saved_acked[NUMBER_OF_INTERVALS];
+static s64 bench_sink;
+
+/** a socket as pcc sees it after some time, with the monitor ring allocated */
+static struct sock *bench_socket(void)
+{
+	struct tcp_sock *tp = kzalloc(sizeof(struct tcp_sock), GFP_KERNEL);
+	struct sock *sk = (struct sock *)tp;
+	struct pcctcp *ca;
+
+	if (!tp) {
+		return NULL;
+	}
+	sk->sk_family = AF_INET;
+	//counted in the bench's own counters of the initial namespace
+	sock_net_set(sk, &init_net);
+	tp->advmss = BENCH_MSS;
+	tp->mss_cache = BENCH_MSS;
+	tp->srtt_us = 10000 << 3;
+	tp->snd_nxt = BENCH_BASE_SEQ;
+	tp->snd_una = BENCH_BASE_SEQ;
+
+	pcctcp_ops.init(sk);
+	ca = inet_csk_ca(sk);
+	init_pcc_struct(sk, ca);
+	if (!ca->pcc) {
+		kfree(tp);
+		return NULL;
+	}
+	return sk;
+}
+
+static void bench_socket_free(struct sock *sk)
+{
+	pcctcp_ops.release(sk);
+	kfree(tcp_sk(sk));
+}
+
+/** fills all monitors with consecutive, sent and partly acked sequence ranges */
+static void setup_monitors(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct pcctcp *ca = inet_csk_ca(sk);
+	int i;
+
+	for (i = 0; i < NUMBER_OF_INTERVALS; i++) {
+		struct monitor *mon = ca->pcc->monitor_intervals + i;
+
+		mon->valid = 1;
+		mon->state = PCC_STATE_RATE_ADJUSTMENT;
+		mon->start_time = current_kernel_time();
+		//long enough that no monitor ends during a run
+		mon->end_time = 3600000000UL;
+		mon->rate = 12500000;
+		mon->segments_sent = BENCH_MONITOR_SEGMENTS;
+		mon->snd_start_seq = BENCH_BASE_SEQ + i * BENCH_MONITOR_SEGMENTS * BENCH_MSS;
+		mon->snd_end_seq = mon->snd_start_seq + BENCH_MONITOR_SEGMENTS * BENCH_MSS;
+		mon->last_acked_seq = mon->snd_start_seq;
+		bench_saved_acked[i] = mon->last_acked_seq;
+	}
+	ca->pcc->current_interval = NUMBER_OF_INTERVALS - 1;
+	ca->pcc->snd_count = NUMBER_OF_INTERVALS * BENCH_MONITOR_SEGMENTS;
+	tp->data_segs_out = ca->pcc->snd_count;
+	tp->snd_nxt = BENCH_BASE_SEQ + NUMBER_OF_INTERVALS * BENCH_MONITOR_SEGMENTS * BENCH_MSS;
+}
+
+static void setup_calc_utility(struct sock *sk)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+
+	setup_monitors(sk);
+	ca->pcc->monitor_intervals[0].end_time = 10000;
+	ca->pcc->monitor_intervals[0].bytes_lost = 3 * BENCH_MSS;
+}
+
+static void op_calc_utility(struct sock *sk)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+
+	bench_sink += calc_utility(ca->pcc->monitor_intervals, sk);
+}
+
+static void setup_sack(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	//holes in four different monitors, unsorted as the receiver reports them
+	static const int sacked_monitors[4] = { 17, 3, 25, 10 };
+	int i;
+
+	setup_monitors(sk);
+	tp->sacked_out = 4;
+	for (i = 0; i < 4; i++) {
+		u32 start = BENCH_BASE_SEQ + (sacked_monitors[i] * BENCH_MONITOR_SEGMENTS + 10) * BENCH_MSS;
+
+		tp->recv_sack_cache[i].start_seq = start;
+		tp->recv_sack_cache[i].end_seq = start + 20 * BENCH_MSS;
+	}
+}
+
+static void op_sack(struct sock *sk)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+	int i;
+
+	for (i = 0; i < NUMBER_OF_INTERVALS; i++) {
+		ca->pcc->monitor_intervals[i].last_acked_seq = bench_saved_acked[i];
+		ca->pcc->monitor_intervals[i].bytes_lost = 0;
+	}
+	update_interval_with_received_acks(sk);
+}
+
+static void op_monitor_scan(struct sock *sk)
+{
+	check_end_of_monitor_interval(sk);
+}
+
+static const struct pcc_bench benches[] = {
+	{ "calc_utility", setup_calc_utility, op_calc_utility },
+	{ "sack", setup_sack, op_sack },
+	{ "monitor_scan", setup_monitors, op_monitor_scan },
+};
+
+/** runs one benchmark and appends its ns/op to the results */
+static int bench_run_one(const struct pcc_bench *bench, u32 iterations)
+{
+	struct sock *sk = bench_socket();
+	u64 elapsed = 0, start, ps_per_op;
+	u32 done = 0, i, chunk;
+
+	if (!sk) {
+		return -ENOMEM;
+	}
+	bench->setup(sk);
+	while (done < iterations) {
+		chunk = min_t(u32, iterations - done, BENCH_CHUNK);
+		start = ktime_get_ns();
+		for (i = 0; i < chunk; i++) {
+			bench->op(sk);
+		}
+		elapsed += ktime_get_ns() - start;
+		done += chunk;
+		cond_resched();
+	}
+	bench_socket_free(sk);
+
+	ps_per_op = div_u64(elapsed * 1000, iterations);
+	bench_results_len += scnprintf(bench_results + bench_results_len, sizeof(bench_results) - bench_results_len,
+		"%s %u iterations %llu.%03llu ns/op\n", bench->name, iterations,
+		div_u64(ps_per_op, 1000), ps_per_op % 1000);
+	return 0;
+}
+
+/** runs the named benchmark, or all of them */
+static int bench_run(const char *name)
+{
+	int i, err = -EINVAL;
+	u32 iterations = bench_iterations ? bench_iterations : 1;
+
+	mutex_lock(&bench_lock);
+	bench_results_len = 0;
+	bench_results[0] = '\0';
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		if (strcmp(name, "all") != 0 && strcmp(name, benches[i].name) != 0) {
+			continue;
+		}
+		err = bench_run_one(benches + i, iterations);
+		if (err) {
+			break;
+		}
+	}
+	mutex_unlock(&bench_lock);
+	return err;
+}
+
+static ssize_t bench_run_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+	char name[32];
+	size_t len = min_t(size_t, count, sizeof(name) - 1);
+	int err;
+
+	if (copy_from_user(name, buf, len)) {
+		return -EFAULT;
+	}
+	name[len] = '\0';
+	err = bench_run(strim(name));
+	return err ? err : count;
+}
+
+static ssize_t bench_results_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&bench_lock);
+	ret = simple_read_from_buffer(buf, count, ppos, bench_results, bench_results_len);
+	mutex_unlock(&bench_lock);
+	return ret;
+}
+
+static const struct file_operations bench_run_fops = {
+	.owner		= THIS_MODULE,
+	.write		= bench_run_write,
+	.llseek		= noop_llseek,
+};
+
+static const struct file_operations bench_results_fops = {
+	.owner		= THIS_MODULE,
+	.read		= bench_results_read,
+	.llseek		= default_llseek,
+};
+
+static int __init pcc_bench_init(void)
+{
+	int err;
+
+	bench_debugfs_dir = debugfs_create_dir("pcc_bench", NULL);
+	if (IS_ERR_OR_NULL(bench_debugfs_dir)) {
+		printk(KERN_ERR "[PCC] pcc_bench needs debugfs\n");
+		return -ENODEV;
+	}
+	err = register_pernet_subsys(&pcc_net_ops);
+	if (err) {
+		debugfs_remove_recursive(bench_debugfs_dir);
+		return err;
+	}
+	debugfs_create_u32("iterations", 0600, bench_debugfs_dir, &bench_iterations);
+	debugfs_create_file("run", 0200, bench_debugfs_dir, NULL, &bench_run_fops);
+	debugfs_create_file("results", 0400, bench_debugfs_dir, NULL, &bench_results_fops);
+	return 0;
+}
+
+static void __exit pcc_bench_exit(void)
+{
+	debugfs_remove_recursive(bench_debugfs_dir);
+	unregister_pernet_subsys(&pcc_net_ops);
+}
+
+module_init(pcc_bench_init);
+module_exit(pcc_bench_exit);
+
+MODULE_AUTHOR("Tomer Gilad");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("PCC TCP microbenchmarks");
+MODULE_VERSION("1.0");
@@ -0,0 +1,59 @@
+#ifndef _PCC_INFO_H_
+#define _PCC_INFO_H_
+
+/*
+ * Structures shared between the PCC module and userspace tools.
+ * Everything here is read by userspace, so only fixed size types are used.
+ */
+
+#include <linux/types.h>
+
+/* PCC info returned by getsockopt(TCP_CC_INFO) and by inet_diag.
+ * Must fit in union tcp_cc_info (20 bytes), rates are in bytes per second.
+ * inet_diag reports it under INET_DIAG_BBRINFO, as there is no PCC attribute.
+ * The base rate is the controller's estimate of what the path takes, an
+ * application can adapt to it. To be told when it moved, poll TCP_CC_INFO
+ * and compare pcc_rate_changes with the last value read: it counts the
+ * rate_notify_percent changes the pcc_rate_change tracepoint fires on, and a
+ * new value means the base rate is worth reading again.
+ */
+struct tcp_pcc_info {
+	__u32	pcc_rate_lo;			/* lower 32 bits of the base rate */
+	__u32	pcc_rate_hi;			/* upper 32 bits of the base rate */
+	__u32	pcc_actual_rate_lo;		/* lower 32 bits of the last measured rate */
+	__u32	pcc_actual_rate_hi;		/* upper 32 bits of the last measured rate */
+	__u8	pcc_state;				/* pcc_state_t of the connection */
+	__s8	pcc_direction;			/* last rate adjustment direction */
+	__u8	pcc_decision_attempts;	/* decision making attempts without a decision, saturates */
+	__u8	pcc_rate_changes;		/* base rate changes notified so far, wraps */
+};
+
+/* One record per ended monitor interval, read from <debugfs>/pcc/mi_records.
+ * Times are CLOCK_REALTIME (as pcap timestamps) in nanoseconds, sequences are
+ * the raw TCP sequences and addresses/ports are in network byte order.
+ */
+struct pcc_mi_record {
+	__u64	start_time_ns;			/* monitor start */
+	__u64	end_time_ns;			/* monitor ended (all its data was acked) */
+	__u64	rate;					/* rate limit of the monitor */
+	__u64	actual_rate;			/* rate measured for the monitor */
+	__s64	utility;				/* utility, 32.32 fixed point */
+	__u32	send_duration_us;		/* length of the sending period */
+	__u32	snd_start_seq;			/* first sequence sent in the monitor */
+	__u32	snd_end_seq;			/* last sequence sent in the monitor */
+	__u32	segments_sent;			/* segments sent, including retransmissions */
+	__u32	bytes_lost;				/* bytes counted as lost from sacks */
+	__u32	rtt_us;					/* last rtt while the monitor was active */
+	__u16	mss;					/* mss used to turn segments into bytes */
+	__u8	state;					/* pcc_state_t at the start of the monitor */
+	__u8	decision_making_id;		/* position in the decision making quartet */
+	__u8	index;					/* slot of the monitor in the ring */
+	__u8	family;					/* AF_INET or AF_INET6 */
+	__be16	sport;
+	__be16	dport;
+	__u8	pad[6];
+	__u8	saddr[16];				/* IPv4 uses the first 4 bytes */
+	__u8	daddr[16];
+};
+
+#endif
@@ -6,25 +6,58 @@
  */
 
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include <linux/module.h>
 #include <linux/math64.h>
 #include <linux/kernel.h>
 #include <linux/string.h>
 #include <linux/inet.h>
 #include <linux/proc_fs.h>
+#include <linux/inet_diag.h>
+#include <linux/debugfs.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/win_minmax.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/jhash.h>
 #include <net/tcp.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#ifdef CONFIG_SOCK_CGROUP_DATA
+#include <linux/cgroup.h>
+#endif
 
 #define FIXEDPT_BITS (64)
 #define FIXEDPT_WBITS (32)
 #include "fixedptc.h"
+#include "pcc_info.h"
+#ifdef PCC_BENCH
+//the tracepoints belong to pcc_pacing.ko, the measured copy only calls nothing
+#define trace_pcc_rate_change(...) do { } while (0)
+#else
+#define CREATE_TRACE_POINTS
+#include "pcc_trace.h"
+#endif
 
 
+//pcc_bench.c includes this file, it measures the code without the debug prints
+#ifndef PCC_BENCH
 #define DEBUG
+#endif
 
 #ifdef DEBUG
 #define DBG_PRINT(...) printk(__VA_ARGS__)
+//per ack and per monitor detail, only the sockets chosen for tracing print it
+#define PCC_TRACE(pcc, fmt, ...) do { \
+	if ((pcc)->trace) { \
+		printk(KERN_DEBUG "[PCC %08x] " fmt, (pcc)->trace_id, ##__VA_ARGS__); \
+	} \
+} while (0)
 #else
 #define DBG_PRINT(...)
+#define PCC_TRACE(pcc, fmt, ...)
 #endif
 
 #define DEFAULT_RATE_LIMIT (2000 * (1<<10))
@@ -35,6 +68,136 @@
 #define DEFAULT_TTL 1000
 #define MINIMUM_RATE (800000)
 #define INITIAL_RATE (1000000)
+#define MI_RECORDS_FIFO_SIZE (4096)
+#define COUPLING_GROUPS (256)
+#define COUPLING_SUBFLOWS (8)
+#define COUPLING_MIN_GAIN (50)
+#define DEADLINES_NUMBER (64)
+#define CHIRP_STEPS (32)
+#define CHIRP_MIN_QUEUE_US (200)
+#define CHIRP_LOSS_DIV (8)
+#define TELEMETRY_BUCKETS (32)
+#define CWR_PENALTY_PERMILLE (100)
+
+/*
+ * tunables, the defaults are the constants the controller was designed with.
+ * Every network namespace has its own: the module parameters are those of the
+ * initial namespace, a new namespace starts with their values at its creation
+ * and changes them in /proc/net/pcc.
+ */
+struct pcc_params {
+	int minimum_rate;
+	int step_percent;
+	int monitor_rtt_mult;
+	int monitor_rtt_div;
+	int monitor_expiry_rtts;
+	int loss_threshold_ppm;
+	int loss_slope;
+	int coupling;
+	int bw_model;
+	int bw_window_rtts;
+	int bw_bound_percent;
+	int equilibrium_decisions;
+	int equilibrium_probe_mis;
+	int equilibrium_change_percent;
+	int equilibrium_loss_ppm;
+	int deadline_margin_percent;
+	int deadline_max_gain;
+	int deadline_yield_percent;
+	int local_penalty_percent;
+	int startup_chirp;
+	int chirp_step_percent;
+	int chirp_segments;
+	int chirp_queue_percent;
+	int trace_sample;
+	int trace_port;
+	int trace_cgroup;
+	int rate_notify_percent;
+};
+
+static struct pcc_params pcc_defaults __read_mostly = {
+	.minimum_rate = MINIMUM_RATE,
+	.step_percent = 1,
+	.monitor_rtt_mult = 4,
+	.monitor_rtt_div = 3,
+	.monitor_expiry_rtts = 8,
+	.loss_threshold_ppm = 50000,
+	.loss_slope = 100,
+	.coupling = 0,
+	.bw_model = 0,
+	.bw_window_rtts = 10,
+	.bw_bound_percent = 25,
+	.equilibrium_decisions = 3,
+	.equilibrium_probe_mis = 50,
+	.equilibrium_change_percent = 20,
+	.equilibrium_loss_ppm = 10000,
+	.deadline_margin_percent = 20,
+	.deadline_max_gain = 4,
+	.deadline_yield_percent = 10,
+	.local_penalty_percent = 100,
+	.startup_chirp = 0,
+	.chirp_step_percent = 15,
+	.chirp_segments = 64,
+	.chirp_queue_percent = 2,
+	.trace_sample = 0,
+	.trace_port = 0,
+	.trace_cgroup = 0,
+	.rate_notify_percent = 10,
+};
+module_param_named(minimum_rate, pcc_defaults.minimum_rate, int, 0644);
+MODULE_PARM_DESC(minimum_rate, "lowest rate of a monitor interval, bytes per second");
+module_param_named(step_percent, pcc_defaults.step_percent, int, 0644);
+MODULE_PARM_DESC(step_percent, "rate change per decision attempt or adjustment try, percent");
+module_param_named(monitor_rtt_mult, pcc_defaults.monitor_rtt_mult, int, 0644);
+MODULE_PARM_DESC(monitor_rtt_mult, "monitor interval length is srtt * monitor_rtt_mult / monitor_rtt_div");
+module_param_named(monitor_rtt_div, pcc_defaults.monitor_rtt_div, int, 0644);
+MODULE_PARM_DESC(monitor_rtt_div, "monitor interval length is srtt * monitor_rtt_mult / monitor_rtt_div");
+module_param_named(monitor_expiry_rtts, pcc_defaults.monitor_expiry_rtts, int, 0644);
+MODULE_PARM_DESC(monitor_expiry_rtts, "srtts after its sending ended a monitor still waiting for acks is dropped, 0 never");
+module_param_named(loss_threshold_ppm, pcc_defaults.loss_threshold_ppm, int, 0644);
+MODULE_PARM_DESC(loss_threshold_ppm, "loss rate at the middle of the utility sigmoid, parts per million");
+module_param_named(loss_slope, pcc_defaults.loss_slope, int, 0644);
+MODULE_PARM_DESC(loss_slope, "steepness of the utility sigmoid around the loss threshold");
+module_param_named(coupling, pcc_defaults.coupling, int, 0644);
+MODULE_PARM_DESC(coupling, "couple rate increases of sockets with the same nonzero SO_MARK, the subflows of a multipath transfer: 0 off, 1 on");
+module_param_named(bw_model, pcc_defaults.bw_model, int, 0644);
+MODULE_PARM_DESC(bw_model, "1 to centre and bound probing around the max delivery rate and leave startup at it");
+module_param_named(bw_window_rtts, pcc_defaults.bw_window_rtts, int, 0644);
+MODULE_PARM_DESC(bw_window_rtts, "round trips the max delivery rate is kept for");
+module_param_named(bw_bound_percent, pcc_defaults.bw_bound_percent, int, 0644);
+MODULE_PARM_DESC(bw_bound_percent, "how far from the max delivery rate probing and rate adjustment may go, percent");
+module_param_named(equilibrium_decisions, pcc_defaults.equilibrium_decisions, int, 0644);
+MODULE_PARM_DESC(equilibrium_decisions, "inconclusive or reversing decisions in a row that enter the equilibrium state, 0 never enters it");
+module_param_named(equilibrium_probe_mis, pcc_defaults.equilibrium_probe_mis, int, 0644);
+MODULE_PARM_DESC(equilibrium_probe_mis, "monitor intervals in equilibrium between two probing rounds");
+module_param_named(equilibrium_change_percent, pcc_defaults.equilibrium_change_percent, int, 0644);
+MODULE_PARM_DESC(equilibrium_change_percent, "rtt or delivery rate change that ends equilibrium, percent");
+module_param_named(equilibrium_loss_ppm, pcc_defaults.equilibrium_loss_ppm, int, 0644);
+MODULE_PARM_DESC(equilibrium_loss_ppm, "loss rate increase that ends equilibrium, parts per million");
+module_param_named(deadline_margin_percent, pcc_defaults.deadline_margin_percent, int, 0644);
+MODULE_PARM_DESC(deadline_margin_percent, "how much faster than needed a flow with a deadline aims to send, percent");
+module_param_named(deadline_max_gain, pcc_defaults.deadline_max_gain, int, 0644);
+MODULE_PARM_DESC(deadline_max_gain, "largest gain of the rate steps of a flow behind its deadline, and inverse of the smallest");
+module_param_named(deadline_yield_percent, pcc_defaults.deadline_yield_percent, int, 0644);
+MODULE_PARM_DESC(deadline_yield_percent, "utility lost per goodput above what a flow needs for its deadline, percent");
+module_param_named(local_penalty_percent, pcc_defaults.local_penalty_percent, int, 0644);
+MODULE_PARM_DESC(local_penalty_percent, "weight of CWR entries (local qdisc drops, ECN), send queue growth and TSQ throttling in the utility, percent, 0 ignores them");
+module_param_named(startup_chirp, pcc_defaults.startup_chirp, int, 0644);
+MODULE_PARM_DESC(startup_chirp, "1 to probe in the start state with chirps of rising rate and leave it at the rate queueing delay started to grow at");
+module_param_named(chirp_step_percent, pcc_defaults.chirp_step_percent, int, 0644);
+MODULE_PARM_DESC(chirp_step_percent, "rate increase between two steps of a chirp, a step per ack, percent");
+module_param_named(chirp_segments, pcc_defaults.chirp_segments, int, 0644);
+MODULE_PARM_DESC(chirp_segments, "segments a chirp sends before it falls back to its base rate");
+module_param_named(chirp_queue_percent, pcc_defaults.chirp_queue_percent, int, 0644);
+MODULE_PARM_DESC(chirp_queue_percent, "rtt increase over the min rtt that shows a chirp queued, percent");
+module_param_named(trace_sample, pcc_defaults.trace_sample, int, 0644);
+MODULE_PARM_DESC(trace_sample, "trace per ack and per monitor detail of 1 in trace_sample sockets, chosen by a hash of the 4-tuple, 0 none");
+module_param_named(trace_port, pcc_defaults.trace_port, int, 0644);
+MODULE_PARM_DESC(trace_port, "also trace sockets with this local or remote port, 0 none");
+module_param_named(trace_cgroup, pcc_defaults.trace_cgroup, int, 0644);
+MODULE_PARM_DESC(trace_cgroup, "also trace sockets of the cgroup v2 with this inode number (ls -di), 0 none");
+module_param_named(rate_notify_percent, pcc_defaults.rate_notify_percent, int, 0644);
+MODULE_PARM_DESC(rate_notify_percent, "base rate change since the last pcc_rate_change event of a socket that fires the next, percent, 0 none");
 
 static void on_monitor_start(struct sock *sk, int index);
 
@@ -46,6 +209,7 @@ typedef enum {
 	PCC_STATE_DECISION_MAKING_4,
 	PCC_STATE_WAIT_FOR_DECISION,
 	PCC_STATE_RATE_ADJUSTMENT,
+	PCC_STATE_EQUILIBRIUM,
 } pcc_state_t;
 
 struct monitor {
@@ -56,15 +220,136 @@ struct monitor {
 	u32 snd_start_seq;				//first sequence to send in the monitor interval
 	u32 snd_end_seq;				//last sequence sent
 	u32 last_acked_seq;				//last sequence we know what happened (can be greater than snd_end_seq)
+	u32 progress_seq;				//last_acked_seq when the end checks last saw it move
+	u32 progress_us;				//usecs from the start when they did
 	int segments_sent;				//segments sent in the monitor interval
 	u32 bytes_lost;					//amount of bytes lost due to sacks
 	u64 rate;						//rate limit of the monitor
 	s64 utility;					//calculated utility of the monitor
 	u32 rtt;						//last rtt captured while this monitor was active
-	struct timespec start_time;		//timestamp of the start of the monitor
+	u32 rtt_min;					//smallest rtt sample of an ack for data sent in the monitor, 0 if none
+	u64 start_ns;					//ktime_get_ns() of the start of the monitor
+	u64 start_real_ns;				//ktime_get_real_ns() of the start for the record, 0 if no reader was attached
 	u64 actual_rate;				//actual rate data was sent in the monitor
+	u32 cwr_entries;				//times the socket entered CWR while sending
+	u32 tsq_throttled_us;			//time TSQ held the socket back while sending
+	int wmem_start;					//send queue memory when the monitor started
+	int wmem_end;					//send queue memory at the last ack while sending
+};
+
+
+/* what a subflow shares with the other subflows of its connection */
+struct coupled_subflow {
+	u8 used;
+	u64 rate;						//actual rate of the last ended monitor
+	s64 marginal;					//utility per unit of rate of the last ended monitor, fixed point
+};
+
+/* subflows of one transfer, their rate increases add up to those of a single flow */
+struct coupling_group {
+	unsigned long key;				//the mark of the subflows, 0 if the group is free
+	int members;
+	struct coupled_subflow subflows[COUPLING_SUBFLOWS];
+};
+
+/* a deadline written to /proc/net/pcc_deadlines, waiting for its socket to pick it up */
+struct pcc_deadline {
+	u8 used;
+	u8 family;
+	u8 saddr[16];
+	u8 daddr[16];
+	__be16 sport;
+	__be16 dport;
+	u64 bytes;						//bytes to be acked by the deadline
+	u64 deadline_ns;				//ktime_get_ns() of the deadline
+};
+
+/* counters of a network namespace, every cpu has its own and /proc/net/pcc shows their sum */
+enum {
+	PCC_MIB_SOCKETS,				//sockets PCC started on
+	PCC_MIB_ALLOC_FAILED,			//sockets PCC could not allocate its state for
+	PCC_MIB_MONITORS,				//monitors ended with a utility
+	PCC_MIB_MONITORS_LOSSY,			//of them, monitors that lost bytes
+	PCC_MIB_MONITOR_OVERRUNS,		//sending monitors that reached one still waiting for acks
+	PCC_MIB_MONITORS_EXPIRED,		//monitors dropped without a utility, their data not acked in time
+	PCC_MIB_STARTUP_EXITS,
+	PCC_MIB_DECISIONS_UP,
+	PCC_MIB_DECISIONS_DOWN,
+	PCC_MIB_DECISIONS_INCONCLUSIVE,
+	PCC_MIB_RATE_OVERFLOWS,			//rate adjustment steps that overflowed the rate
+	PCC_MIB_EQUILIBRIUM_ENTERED,
+	PCC_MIB_EQUILIBRIUM_LEFT,
+	PCC_MIB_CWR_ENTRIES,			//CWR entries, from refused transmits or ECN echoes
+	PCC_MIB_DEADLINES_MET,
+	PCC_MIB_DEADLINES_MISSED,
+	PCC_MIB_COUPLING_FULL,			//subflows left uncoupled as their group had no room
+	PCC_MIB_MI_RECORDS_DROPPED,		//monitor records no one read in time
+	PCC_MIB_RATE_CHANGES,			//pcc_rate_change events fired
+	PCC_MIB_MAX
+};
+
+static const char * const pcc_mib_names[PCC_MIB_MAX] = {
+	[PCC_MIB_SOCKETS] = "sockets",
+	[PCC_MIB_ALLOC_FAILED] = "alloc_failed",
+	[PCC_MIB_MONITORS] = "monitors",
+	[PCC_MIB_MONITORS_LOSSY] = "monitors_lossy",
+	[PCC_MIB_MONITOR_OVERRUNS] = "monitor_overruns",
+	[PCC_MIB_MONITORS_EXPIRED] = "monitors_expired",
+	[PCC_MIB_STARTUP_EXITS] = "startup_exits",
+	[PCC_MIB_DECISIONS_UP] = "decisions_up",
+	[PCC_MIB_DECISIONS_DOWN] = "decisions_down",
+	[PCC_MIB_DECISIONS_INCONCLUSIVE] = "decisions_inconclusive",
+	[PCC_MIB_RATE_OVERFLOWS] = "rate_overflows",
+	[PCC_MIB_EQUILIBRIUM_ENTERED] = "equilibrium_entered",
+	[PCC_MIB_EQUILIBRIUM_LEFT] = "equilibrium_left",
+	[PCC_MIB_CWR_ENTRIES] = "cwr_entries",
+	[PCC_MIB_DEADLINES_MET] = "deadlines_met",
+	[PCC_MIB_DEADLINES_MISSED] = "deadlines_missed",
+	[PCC_MIB_COUPLING_FULL] = "coupling_full",
+	[PCC_MIB_MI_RECORDS_DROPPED] = "mi_records_dropped",
+	[PCC_MIB_RATE_CHANGES] = "rate_changes",
 };
 
+struct pcc_mib {
+	unsigned long mibs[PCC_MIB_MAX];
+};
+
+/* what PCC keeps per network namespace */
+struct pcc_net {
+	struct pcc_mib __percpu *mib;
+	struct pcc_params *params;		//pcc_defaults in the initial namespace, own in the others
+	struct pcc_params own;
+	struct pcc_deadline deadlines[DEADLINES_NUMBER];	//written to this namespace's /proc/net/pcc_deadlines
+	int deadlines_pending;			//used deadlines, read without the lock to skip the search
+	spinlock_t deadlines_lock;
+	struct coupling_group *coupling_groups;	//COUPLING_GROUPS of them, marks only couple sockets of one namespace
+	spinlock_t coupling_lock;
+};
+
+#define PCC_INC_STATS(pn, field) this_cpu_inc((pn)->mib->mibs[field])
+
+/* histograms of how fast the sockets react, every cpu has its own and pcc/telemetry in debugfs shows their sum */
+enum {
+	PCC_HIST_DECISION_US,			//from the start of a decision round to its decision
+	PCC_HIST_CONVERGENCE_ROUNDS,	//decision rounds from the start or leaving equilibrium to entering it
+	PCC_HIST_CONVERGENCE_MS,		//time they took
+	PCC_HIST_OSCILLATION_PERMILLE,	//max - min actual rate of the monitors while converged, of their mean
+	PCC_HIST_MONITOR_OVERSHOOT_US,	//how long past its planned length a monitor's end was noticed
+	PCC_HIST_MAX
+};
+
+static const char * const pcc_hist_names[PCC_HIST_MAX] = {
+	[PCC_HIST_DECISION_US] = "decision_us",
+	[PCC_HIST_CONVERGENCE_ROUNDS] = "convergence_rounds",
+	[PCC_HIST_CONVERGENCE_MS] = "convergence_ms",
+	[PCC_HIST_OSCILLATION_PERMILLE] = "oscillation_permille",
+	[PCC_HIST_MONITOR_OVERSHOOT_US] = "monitor_overshoot_us",
+};
+
+//bucket 0 counts zeros, bucket b values from 2^(b-1) up to the next bucket's
+struct pcc_telemetry {
+	unsigned long hist[PCC_HIST_MAX][TELEMETRY_BUCKETS];
+};
 
 struct pccdata {
 	struct monitor monitor_intervals[NUMBER_OF_INTERVALS];		//all monitor intervals
@@ -72,6 +357,9 @@ struct pccdata {
 	u8 current_interval;										//index of the current (sending) interval
 	pcc_state_t state;											//current state
 	u64 snd_count;												//number of segments sent for the start of the connection
+	u64 check_ns;												//when the current monitor was last checked for its end
+	int check_segments;											//segments it had sent by then
+	u32 check_seq;												//and its end seq then
 	u32 last_rtt;												//last rtt measured
 	u64 next_rate;												//next base rate to send in
 	int direction;												//direction to advance rate in (-1 for lowering the rate, 1 for raising it)
@@ -79,6 +367,49 @@ struct pccdata {
 	int rate_adjustment_tries;									//number of monitor intervals with the rate adjustment state
 	int decision_directions[4];									//for decision making shuffle
 	u64 last_actual_rate;										//last actual rate sent data in
+	struct coupling_group *coupling;							//subflows coupled with this one, NULL if not coupled
+	int coupling_slot;											//index of this subflow in the group
+	struct minmax max_bw;										//max delivery rate over the window, bytes per ms
+	int last_decision;											//direction of the last decision, 0 if it was inconclusive
+	int equilibrium_votes;										//inconclusive or reversing decisions in a row
+	int equilibrium_mis;										//monitors sent since entering equilibrium or its last probe
+	u32 equilibrium_rtt;										//rtt when equilibrium was reached, 0 until measured
+	u64 equilibrium_delivered;									//delivery rate when equilibrium was reached
+	u32 equilibrium_loss_ppm;									//loss rate when equilibrium was reached
+	u64 deadline_ns;											//ktime_get_ns() of the deadline, 0 if the flow has none
+	u64 deadline_bytes;											//bytes to be acked by the deadline
+	u64 deadline_acked_start;									//bytes_acked when the deadline was set
+	u64 deadline_needed;										//rate that makes the deadline, bytes per second
+	u32 deadline_gain;											//rate increases scale by it, decreases by its inverse, per mille
+	u64 local_sample_ns;										//ktime_get_ns() of the last local signals sample
+	u64 chirp_start_ns;											//ktime_get_ns() the chirp started sending at, 0 if there is no chirp
+	u64 chirp_end_ns;											//when the chirp stopped sending, 0 while it sends
+	u32 chirp_start_seq;										//first sequence of the chirp
+	u32 chirp_end_seq;											//sequence after the last one of the chirp
+	u64 chirp_base;												//rate before and after the chirp
+	int chirp_steps;											//steps of the chirp so far
+	u64 chirp_rates[CHIRP_STEPS];								//rate of every step
+	u64 chirp_step_ns[CHIRP_STEPS];								//when every step started
+	u64 chirp_clear;											//highest step rate whose segments saw no queueing
+	int chirp_queued;											//queued rtt samples of the chirp in a row
+	u32 chirp_prev_rtt;											//last rtt sample of the chirp
+	u32 chirp_retrans;											//total_retrans when the chirp started
+	u32 min_rtt;												//lowest rtt seen in the start state
+	struct pcc_net *net;										//counters of the socket's namespace
+	const struct pcc_params *params;							//tunables of the socket's namespace
+	u8 trace;													//1 if the socket prints per ack and per monitor detail
+	u32 trace_id;												//hash of the 4-tuple, sampling picks by it and traces show it
+	u32 monitors;												//monitors ended with a utility, for the summary
+	u32 decisions;												//decisions made, for the summary
+	u32 expired;												//monitors expired, for the summary
+	u64 notified_rate;											//base rate of the last pcc_rate_change event
+	u8 rate_changes;											//pcc_rate_change events so far, for TCP_CC_INFO
+	u64 round_start_ns;											//ktime_get_ns() the decision round started at, 0 before the first
+	u8 converged;												//1 from entering equilibrium until a decision or a change moves it away
+	u32 converge_rounds;										//decision rounds since it started converging
+	u64 converge_start_ns;										//when it started converging, at the start or on leaving equilibrium
+	u64 osc_min_rate;											//lowest actual rate of the monitors since it converged
+	u64 osc_max_rate;											//highest
 };
 
 
@@ -88,6 +419,21 @@ struct pcctcp {
 	struct pccdata* pcc;
 };
 
+/* ended monitor intervals of all connections, read from debugfs as a binary stream */
+static DEFINE_KFIFO(mi_records_fifo, struct pcc_mi_record, MI_RECORDS_FIFO_SIZE);
+static DEFINE_SPINLOCK(mi_records_lock);
+static DECLARE_WAIT_QUEUE_HEAD(mi_records_wait);
+static u32 mi_records_dropped;
+static atomic_t mi_records_readers;
+static DEFINE_PER_CPU(struct pcc_telemetry, pcc_telemetry);
+static struct dentry *pcc_debugfs_dir;
+static unsigned int pcc_net_id __read_mostly;
+
+static struct pcc_net *pcc_net(const struct sock *sk)
+{
+	return net_generic(sock_net(sk), pcc_net_id);
+}
+
 static void shuffle_decision_directions(struct sock *sk)
 {
 	u32 random;
@@ -134,6 +480,406 @@ static void shuffle_decision_directions(struct sock *sk)
 	}
 }
 
+/**
+ * the key subflows are coupled by, the mark of the socket. MPTCP subflows
+ * can't be told apart here, the kernels with MPTCP lack the API this module
+ * is written against
+ */
+static unsigned long coupling_key(struct sock *sk)
+{
+	return sk->sk_mark;
+}
+
+/** adds the subflow to the group of its connection, it stays uncoupled if there is no room */
+static void coupling_join(struct sock *sk, struct pccdata *pcc)
+{
+	unsigned long key = pcc->params->coupling ? coupling_key(sk) : 0;
+	struct coupling_group *groups = pcc->net->coupling_groups, *group = NULL, *free_group = NULL;
+	int i;
+
+	pcc->coupling = NULL;
+	if (!key) {
+		return;
+	}
+
+	spin_lock_bh(&pcc->net->coupling_lock);
+	for (i = 0; i < COUPLING_GROUPS && !group; i++) {
+		if (groups[i].key == key) {
+			group = groups + i;
+		} else if (!groups[i].key && !free_group) {
+			free_group = groups + i;
+		}
+	}
+	if (!group) {
+		group = free_group;
+	}
+	if (group && group->members < COUPLING_SUBFLOWS) {
+		for (i = 0; group->subflows[i].used; i++);
+		memset(group->subflows + i, 0, sizeof(group->subflows[i]));
+		group->subflows[i].used = 1;
+		group->key = key;
+		group->members++;
+		pcc->coupling = group;
+		pcc->coupling_slot = i;
+	}
+	spin_unlock_bh(&pcc->net->coupling_lock);
+	if (!pcc->coupling) {
+		PCC_INC_STATS(pcc->net, PCC_MIB_COUPLING_FULL);
+	}
+}
+
+static void coupling_leave(struct pccdata *pcc)
+{
+	struct coupling_group *group = pcc->coupling;
+
+	if (!group) {
+		return;
+	}
+	spin_lock_bh(&pcc->net->coupling_lock);
+	group->subflows[pcc->coupling_slot].used = 0;
+	if (--group->members == 0) {
+		group->key = 0;
+	}
+	spin_unlock_bh(&pcc->net->coupling_lock);
+	pcc->coupling = NULL;
+}
+
+/** publishes the rate and utility of an ended monitor to the other subflows */
+static void coupling_update(struct pccdata *pcc, struct monitor *mon)
+{
+	struct coupled_subflow *subflow;
+
+	if (!pcc->coupling || mon->actual_rate == 0) {
+		return;
+	}
+	spin_lock_bh(&pcc->net->coupling_lock);
+	subflow = pcc->coupling->subflows + pcc->coupling_slot;
+	subflow->rate = mon->actual_rate;
+	subflow->marginal = div64_s64(mon->utility, mon->actual_rate);
+	spin_unlock_bh(&pcc->net->coupling_lock);
+}
+
+/**
+ * permille of a rate increase this subflow takes: its share of the connection
+ * rate, so all subflows together increase like one flow, scaled by how its
+ * marginal utility compares to the best path's. 1000 when not coupled.
+ */
+static u32 coupling_gain(struct pccdata *pcc)
+{
+	struct coupling_group *group = pcc->coupling;
+	struct coupled_subflow *subflow;
+	u64 total = 0, gain = 1000;
+	s64 best = 0;
+	int i;
+
+	if (!group) {
+		return gain;
+	}
+	spin_lock_bh(&pcc->net->coupling_lock);
+	for (i = 0; i < COUPLING_SUBFLOWS; i++) {
+		if (group->subflows[i].used) {
+			total += group->subflows[i].rate;
+			best = max_t(s64, best, group->subflows[i].marginal);
+		}
+	}
+	subflow = group->subflows + pcc->coupling_slot;
+	if (group->members > 1 && total > 0 && best > 0) {
+		gain = div64_u64(subflow->rate * 1000, total);
+		gain = subflow->marginal > 0 ? div64_u64(gain * subflow->marginal, best) : 0;
+	}
+	spin_unlock_bh(&pcc->net->coupling_lock);
+	return max_t(u32, gain, COUPLING_MIN_GAIN);
+}
+
+/** the max delivery rate in bytes per second, 0 if the bandwidth model is off or has no samples */
+static u64 pcc_max_bw(struct pccdata *pcc)
+{
+	return pcc->params->bw_model ? (u64)minmax_get(&pcc->max_bw) * 1000 : 0;
+}
+
+/** moves a rate into bw_bound_percent of the max delivery rate, if there is one */
+static u64 bound_by_bw(struct pccdata *pcc, u64 rate)
+{
+	u64 bw = pcc_max_bw(pcc);
+	u64 bound = div_u64(bw * pcc->params->bw_bound_percent, 100);
+
+	if (bw == 0) {
+		return rate;
+	}
+	return clamp_t(u64, rate, bw > bound ? bw - bound : 0, bw + bound);
+}
+
+/** feeds a delivery rate sample to the windowed max, app limited samples only raise it, like in BBR */
+static void update_max_bw(struct sock *sk, struct pccdata *pcc, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 now_ms = div_u64(ktime_get_ns(), NSEC_PER_MSEC);
+	u32 window_ms = max_t(u32, ((tp->srtt_us >> 3) * pcc->params->bw_window_rtts) / USEC_PER_MSEC, 1);
+	u64 bw;
+
+	if (rs->delivered <= 0 || rs->interval_us <= 0) {
+		return;
+	}
+	bw = div64_u64((u64)rs->delivered * tp->mss_cache * USEC_PER_MSEC, rs->interval_us);
+	if (rs->is_app_limited && bw < minmax_get(&pcc->max_bw)) {
+		return;
+	}
+	minmax_running_max(&pcc->max_bw, window_ms, now_ms, min_t(u64, bw, U32_MAX));
+}
+
+/** queues a deadline for the socket of its 4-tuple in the namespace, replacing an older one of the same 4-tuple */
+static int deadline_add(struct pcc_net *pn, const struct pcc_deadline *d)
+{
+	struct pcc_deadline *free_slot = NULL;
+	u64 now = ktime_get_ns();
+	int i;
+
+	spin_lock_bh(&pn->deadlines_lock);
+	for (i = 0; i < DEADLINES_NUMBER; i++) {
+		struct pcc_deadline *e = pn->deadlines + i;
+
+		//deadlines no socket picked up in time are dropped
+		if (e->used && now >= e->deadline_ns) {
+			e->used = 0;
+			WRITE_ONCE(pn->deadlines_pending, pn->deadlines_pending - 1);
+		}
+		if (e->used && e->family == d->family && e->sport == d->sport && e->dport == d->dport &&
+			!memcmp(e->saddr, d->saddr, sizeof(e->saddr)) && !memcmp(e->daddr, d->daddr, sizeof(e->daddr))) {
+			free_slot = e;
+			WRITE_ONCE(pn->deadlines_pending, pn->deadlines_pending - 1);
+			break;
+		}
+		if (!e->used && !free_slot) {
+			free_slot = e;
+		}
+	}
+	if (free_slot) {
+		*free_slot = *d;
+		free_slot->used = 1;
+		WRITE_ONCE(pn->deadlines_pending, pn->deadlines_pending + 1);
+	}
+	spin_unlock_bh(&pn->deadlines_lock);
+	return free_slot ? 0 : -ENOSPC;
+}
+
+/** takes the deadline written for this socket, if there is one */
+static void deadline_claim(struct sock *sk, struct pccdata *pcc)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	struct pcc_net *pn = pcc->net;
+	u8 saddr[16] = { 0 }, daddr[16] = { 0 };
+	int i;
+
+	//a stale count only costs a search or delays the claim to the next monitor
+	if (!READ_ONCE(pn->deadlines_pending)) {
+		return;
+	}
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6) {
+		memcpy(saddr, &sk->sk_v6_rcv_saddr, sizeof(struct in6_addr));
+		memcpy(daddr, &sk->sk_v6_daddr, sizeof(struct in6_addr));
+	} else
+#endif
+	{
+		memcpy(saddr, &inet->inet_saddr, sizeof(inet->inet_saddr));
+		memcpy(daddr, &inet->inet_daddr, sizeof(inet->inet_daddr));
+	}
+
+	spin_lock_bh(&pn->deadlines_lock);
+	for (i = 0; i < DEADLINES_NUMBER; i++) {
+		struct pcc_deadline *e = pn->deadlines + i;
+
+		if (!e->used || e->family != sk->sk_family || e->sport != inet->inet_sport ||
+			e->dport != inet->inet_dport || memcmp(e->saddr, saddr, sizeof(saddr)) ||
+			memcmp(e->daddr, daddr, sizeof(daddr))) {
+			continue;
+		}
+		pcc->deadline_ns = e->deadline_ns;
+		pcc->deadline_bytes = e->bytes;
+		pcc->deadline_acked_start = tcp_sk(sk)->bytes_acked;
+		e->used = 0;
+		WRITE_ONCE(pn->deadlines_pending, pn->deadlines_pending - 1);
+		PCC_TRACE(pcc, "deadline of %llu bytes in %llu ns\n", e->bytes, e->deadline_ns - ktime_get_ns());
+		break;
+	}
+	spin_unlock_bh(&pn->deadlines_lock);
+}
+
+/**
+ * updates how fast the flow has to deliver to make its deadline (plus the
+ * margin) and the gain of its rate adjustment steps: the needed rate over
+ * the base rate, within deadline_max_gain either way, so a flow behind
+ * takes bigger steps up and smaller ones down and a flow ahead the reverse
+ */
+static void deadline_update(struct sock *sk, struct pccdata *pcc)
+{
+	u64 now = ktime_get_ns();
+	u64 acked = tcp_sk(sk)->bytes_acked - pcc->deadline_acked_start;
+	u64 left_us, needed, gain;
+	int max_gain;
+
+	pcc->deadline_gain = 1000;
+	if (!pcc->deadline_ns) {
+		return;
+	}
+	if (acked >= pcc->deadline_bytes || now >= pcc->deadline_ns) {
+		PCC_TRACE(pcc, "deadline %s\n", acked >= pcc->deadline_bytes ? "met" : "missed");
+		PCC_INC_STATS(pcc->net, acked >= pcc->deadline_bytes ? PCC_MIB_DEADLINES_MET : PCC_MIB_DEADLINES_MISSED);
+		pcc->deadline_ns = 0;
+		return;
+	}
+
+	left_us = max_t(u64, div_u64(pcc->deadline_ns - now, NSEC_PER_USEC), 1);
+	needed = div64_u64((pcc->deadline_bytes - acked) * USEC_PER_SEC, left_us);
+	needed += div_u64(needed * pcc->params->deadline_margin_percent, 100);
+	pcc->deadline_needed = clamp_t(u64, needed, 1, S32_MAX);
+	gain = div64_u64(pcc->deadline_needed * 1000, max_t(u64, pcc->next_rate, 1));
+	max_gain = max_t(int, pcc->params->deadline_max_gain, 1);
+	pcc->deadline_gain = clamp_t(u64, gain, 1000 / max_gain, 1000 * max_gain);
+}
+
+/**
+ * the utility a monitor loses to congestion the sacks never show: every CWR
+ * entry (a refused transmit or an ECN echo, neither says how much was lost)
+ * costs a share of the rate, send queue growth counts like lost bytes, and
+ * while TSQ throttled the rate the monitor asked for beyond what it sent
+ * counts against it
+ */
+static fixedpt local_penalty(struct monitor *mon, struct sock *sk, fixedpt time, u64 length_us)
+{
+	const struct pcc_params *params = ((struct pcctcp *)inet_csk_ca(sk))->pcc->params;
+	u64 local = 0;
+	fixedpt penalty;
+
+	if (params->local_penalty_percent <= 0) {
+		return 0;
+	}
+	if (mon->wmem_end > mon->wmem_start) {
+		local += mon->wmem_end - mon->wmem_start;
+	}
+	penalty = fixedpt_div(fixedpt_fromint(local), time);
+	if (mon->cwr_entries) {
+		penalty += fixedpt_fromint(div_u64(mon->actual_rate * min_t(u32, mon->cwr_entries * CWR_PENALTY_PERMILLE, 1000), 1000));
+	}
+	if (mon->tsq_throttled_us && mon->actual_rate < mon->rate) {
+		penalty += fixedpt_fromint(div64_u64((mon->rate - mon->actual_rate) * min_t(u64, mon->tsq_throttled_us, length_us), length_us));
+	}
+	return fixedpt_div(fixedpt_mul(penalty, fixedpt_fromint(params->local_penalty_percent)), fixedpt_fromint(100));
+}
+
+/** starts a chirp from the base rate, its steps are taken as the acks come */
+static void chirp_begin(struct sock *sk, struct pccdata *pcc, u64 base)
+{
+	pcc->chirp_start_ns = ktime_get_ns();
+	pcc->chirp_end_ns = 0;
+	pcc->chirp_start_seq = tcp_sk(sk)->snd_nxt;
+	pcc->chirp_end_seq = 0;
+	pcc->chirp_base = base;
+	pcc->chirp_steps = 1;
+	pcc->chirp_rates[0] = base;
+	pcc->chirp_step_ns[0] = pcc->chirp_start_ns;
+	pcc->chirp_clear = 0;
+	pcc->chirp_queued = 0;
+	pcc->chirp_prev_rtt = 0;
+	pcc->chirp_retrans = tcp_sk(sk)->total_retrans;
+	PCC_TRACE(pcc, "chirp from %llu\n", base);
+}
+
+/** rate of the chirp step a segment sent at send_ns went out in */
+static u64 chirp_rate_at(struct pccdata *pcc, u64 send_ns)
+{
+	int i = pcc->chirp_steps - 1;
+
+	while (i > 0 && pcc->chirp_step_ns[i] > send_ns) {
+		i--;
+	}
+	return pcc->chirp_rates[i];
+}
+
+/** leaves the start state for decision making at the rate the chirps found */
+static void chirp_end_start(struct sock *sk, struct pccdata *pcc, u64 rate)
+{
+	pcc->next_rate = max_t(u64, rate, pcc->params->minimum_rate);
+	pcc->state = PCC_STATE_DECISION_MAKING_1;
+	pcc->decision_making_attempts = 1;
+	pcc->chirp_start_ns = 0;
+	pcc->monitor_intervals[pcc->current_interval].rate = pcc->next_rate;
+	sk->sk_pacing_rate = pcc->next_rate;
+	PCC_INC_STATS(pcc->net, PCC_MIB_STARTUP_EXITS);
+	PCC_TRACE(pcc, "end of start state after a chirp, setting rate to %llu\n", pcc->next_rate);
+}
+
+/**
+ * the start state with chirps: every ack raises the pacing rate by a step
+ * until the chirp sent chirp_segments, then it falls back to its base. The
+ * rtt of the chirp's segments tells which steps queued. The first queueing
+ * ends the start state at the highest step rate that did not queue, a chirp
+ * acked without queueing starts the next one from its top rate. A chirp with
+ * many losses ends it at the base rate.
+ */
+static void chirp_update(struct sock *sk, struct pccdata *pcc, s32 rtt_us)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u64 now = ktime_get_ns();
+	u64 send_ns, rate;
+	u32 queue_us;
+
+	if (!pcc->params->startup_chirp) {
+		pcc->chirp_start_ns = 0;
+	}
+	if (!pcc->chirp_start_ns) {
+		return;
+	}
+	if (rtt_us > 0) {
+		pcc->min_rtt = pcc->min_rtt ? min_t(u32, pcc->min_rtt, rtt_us) : rtt_us;
+		send_ns = now - (u64)rtt_us * NSEC_PER_USEC;
+		queue_us = max_t(u32, pcc->min_rtt * pcc->params->chirp_queue_percent / 100, CHIRP_MIN_QUEUE_US);
+		if (send_ns >= pcc->chirp_start_ns && (!pcc->chirp_end_ns || send_ns < pcc->chirp_end_ns)) {
+			//a step is clear if the rtt of its segments is at the min or falls, not growing
+			if (rtt_us <= pcc->min_rtt || rtt_us < pcc->chirp_prev_rtt) {
+				pcc->chirp_clear = max_t(u64, pcc->chirp_clear, chirp_rate_at(pcc, send_ns));
+			}
+			pcc->chirp_queued = rtt_us > pcc->min_rtt + queue_us ? pcc->chirp_queued + 1 : 0;
+			pcc->chirp_prev_rtt = rtt_us;
+		}
+	}
+
+	if (pcc->chirp_queued >= 2) {
+		chirp_end_start(sk, pcc, max_t(u64, pcc->chirp_clear, pcc->chirp_base));
+		return;
+	}
+	if (pcc->chirp_end_ns) {
+		if (before(tp->snd_una, pcc->chirp_end_seq)) {
+			return;
+		}
+		//a chirp that lost more than an eighth met a queue full before it, its rtts show nothing
+		if ((tp->total_retrans - pcc->chirp_retrans) * CHIRP_LOSS_DIV > pcc->params->chirp_segments) {
+			chirp_end_start(sk, pcc, pcc->chirp_base);
+			return;
+		}
+		pcc->next_rate = max_t(u64, pcc->chirp_clear, pcc->chirp_base);
+		chirp_begin(sk, pcc, pcc->next_rate);
+		sk->sk_pacing_rate = pcc->next_rate;
+		return;
+	}
+
+	//still sending, take the next step or fall back to the base
+	if (tp->snd_nxt - pcc->chirp_start_seq >= (u32)pcc->params->chirp_segments * tp->advmss) {
+		pcc->chirp_end_ns = now;
+		pcc->chirp_end_seq = tp->snd_nxt;
+		sk->sk_pacing_rate = pcc->chirp_base;
+		return;
+	}
+	rate = pcc->chirp_rates[pcc->chirp_steps - 1];
+	if (pcc->chirp_steps < CHIRP_STEPS) {
+		rate += div_u64(rate * pcc->params->chirp_step_percent, 100);
+		pcc->chirp_rates[pcc->chirp_steps] = rate;
+		pcc->chirp_step_ns[pcc->chirp_steps] = now;
+		pcc->chirp_steps++;
+	}
+	sk->sk_pacing_rate = rate;
+}
+
 /** inits a monitor interval and sets it as inactive */
 static void init_monitor(struct monitor * mon, struct sock *sk)
 {
@@ -141,20 +887,67 @@ static void init_monitor(struct monitor * mon, struct sock *sk)
 	struct pcctcp *ca = inet_csk_ca(sk);
 
 	mon->valid = 0;
-	mon->start_time = current_kernel_time();
-	mon->end_time = ((tp->srtt_us >> 3) * 4 )/ 3;
+	mon->start_ns = ktime_get_ns();
+	mon->start_real_ns = atomic_read(&mi_records_readers) ? ktime_get_real_ns() : 0;
+	mon->end_time = ((tp->srtt_us >> 3) * ca->pcc->params->monitor_rtt_mult) / max_t(int, ca->pcc->params->monitor_rtt_div, 1);
 	mon->snd_start_seq = tp->snd_nxt;
 	mon->snd_end_seq = 0;
 	mon->last_acked_seq = tp->snd_nxt;
+	mon->progress_seq = tp->snd_nxt;
+	mon->progress_us = 0;
 	mon->segments_sent = 0;
 	mon->bytes_lost = 0;
 	mon->rate = 0;
 	mon->utility = 0;
 	mon->decision_making_id = 0;
 	mon->rtt = ca->pcc->last_rtt;
+	mon->rtt_min = 0;
 	mon->state = ca->pcc->state;
+	mon->cwr_entries = 0;
+	mon->tsq_throttled_us = 0;
+	mon->wmem_start = sk_wmem_alloc_get(sk);
+	mon->wmem_end = mon->wmem_start;
+
+	PCC_TRACE(ca->pcc, "init monitor %d. end time is %u\n", ca->pcc->current_interval, mon->end_time);
+}
+
+/**
+ * hashes the 4-tuple, the same for the socket whenever it is hashed and
+ * computable from a capture, so a traced connection can be picked offline
+ */
+static u32 trace_hash(struct sock *sk)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	u32 saddr = (__force u32)inet->inet_saddr, daddr = (__force u32)inet->inet_daddr;
 
-	DBG_PRINT("init monitor %d. end time is %u\n", ca->pcc->current_interval, mon->end_time);
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6) {
+		saddr = ipv6_addr_hash(&sk->sk_v6_rcv_saddr);
+		daddr = ipv6_addr_hash(&sk->sk_v6_daddr);
+	}
+#endif
+	return jhash_3words(saddr, daddr, ((u32)ntohs(inet->inet_sport) << 16) | ntohs(inet->inet_dport), 0);
+}
+
+/** chooses whether the socket prints per ack and per monitor detail: 1 in trace_sample, or opted in by port or cgroup */
+static void trace_select(struct sock *sk, struct pccdata *pcc)
+{
+	const struct pcc_params *params = pcc->params;
+	struct inet_sock *inet = inet_sk(sk);
+
+	pcc->trace_id = trace_hash(sk);
+	if (params->trace_sample > 0 && pcc->trace_id % params->trace_sample == 0) {
+		pcc->trace = 1;
+	}
+	if (params->trace_port && (ntohs(inet->inet_sport) == params->trace_port ||
+		ntohs(inet->inet_dport) == params->trace_port)) {
+		pcc->trace = 1;
+	}
+#ifdef CONFIG_SOCK_CGROUP_DATA
+	if (params->trace_cgroup && sock_cgroup_ptr(&sk->sk_cgrp_data)->kn->ino == params->trace_cgroup) {
+		pcc->trace = 1;
+	}
+#endif
 }
 
 static void init_pcc_struct(struct sock *sk, struct pcctcp *ca)
@@ -166,13 +959,22 @@ static void init_pcc_struct(struct sock *sk, struct pcctcp *ca)
 	ca->pcc = kmalloc(sizeof(struct pccdata), GFP_KERNEL);
 	if (!ca->pcc) {
 		DBG_PRINT(KERN_ERR "could not allocate pcc data\n");
+		PCC_INC_STATS(pcc_net(sk), PCC_MIB_ALLOC_FAILED);
 		return;
 	}
 
-	DBG_PRINT("[PCC] initialized pcc struct");
 	memset(ca->pcc, 0, sizeof(struct pccdata));
+	ca->pcc->net = pcc_net(sk);
+	ca->pcc->params = ca->pcc->net->params;
+	trace_select(sk, ca->pcc);
+	PCC_TRACE(ca->pcc, "initialized pcc struct\n");
+	PCC_INC_STATS(ca->pcc->net, PCC_MIB_SOCKETS);
 	ca->pcc->next_rate = INITIAL_RATE;
+	ca->pcc->notified_rate = INITIAL_RATE;
+	ca->pcc->converge_start_ns = ktime_get_ns();
 	ca->pcc->last_actual_rate = INITIAL_RATE / 2;
+	ca->pcc->deadline_gain = 1000;
+	coupling_join(sk, ca->pcc);
 	sk->sk_pacing_rate = INITIAL_RATE;
 	init_monitor(&(ca->pcc->monitor_intervals[0]), sk);
 	on_monitor_start(sk, ca->pcc->current_interval);
@@ -206,17 +1008,25 @@ static s64 calc_utility(struct monitor * mon, struct sock *sk)
 	struct pcctcp *ca = inet_csk_ca(sk);
 	u64 sent = (mon->segments_sent) * tp->advmss;
 	u64 length_us = mon->end_time + 1;
+	u64 first_sent = mon->snd_end_seq - mon->snd_start_seq;
+	u64 lost = mon->bytes_lost;
 	fixedpt rate = fixedpt_mul(fixedpt_div(fixedpt_fromint(sent), fixedpt_fromint(length_us)), fixedpt_fromint(1000000));
 	mon->actual_rate = rate >> FIXEDPT_FBITS;
 	ca->pcc->last_actual_rate = rate >> FIXEDPT_FBITS;
-	fixedpt p = fixedpt_div(fixedpt_fromint(mon->bytes_lost), (fixedpt_fromint(sent)));
-	fixedpt utility;
+	fixedpt utility, needed;
 	fixedpt time = fixedpt_div(fixedpt_fromint(length_us), fixedpt_rconst(1000000));
 
 	if (mon->end_time == 0) {
 		DBG_PRINT("BUG: monitor end time is 0\n");
 	}
-	if (sent < mon->bytes_lost) {
+	// losses are the sack holes in the new data the monitor sent, its
+	// retransmissions only dilute them, so scale them to all it sent. Under
+	// ack loss or a congested ack path recovery runs long and most of what a
+	// monitor sends can be retransmissions.
+	if ((s32)first_sent > 0 && first_sent < sent) {
+		lost = min_t(u64, div64_u64(lost * sent, first_sent), sent);
+	}
+	if (sent < lost) {
 		DBG_PRINT("BUG: for some reason, lost more than sent\n");
 	}
 
@@ -224,17 +1034,22 @@ static s64 calc_utility(struct monitor * mon, struct sock *sk)
 		DBG_PRINT("BUG: actual rate is much bigger than limited rate. length_us = %llu, sent = %llu\n", length_us, sent);
 	}
 
-	utility = (rate - (fixedpt_mul(rate, fixedpt_pow(FIXEDPT_ONE + p, fixedpt_rconst(2.5)) - FIXEDPT_ONE) ));
 	//utility = mon->rate * 100 - mon->rate * ((sent + mon->bytes_lost) * (sent + mon->bytes_lost) * 100 / (sent * sent) - 100);
 	//utility = mon->snd_end_seq - mon->snd_start_seq;
 	//utility = fixedpt_div(fixedpt_fromint(mon->snd_end_seq - mon->snd_start_seq), time);
 	//utility = (fixedpt_div(fixedpt_fromint(sent - mon->bytes_lost), time) - fixedpt_div(fixedpt_mul(fixedpt_rconst(20), fixedpt_fromint(mon->bytes_lost)), time));
 	//utility = fixedpt_div(fixedpt_fromint(sent -mon->bytes_lost), time);
 	
-	utility = fixedpt_div(fixedpt_fromint(sent - mon->bytes_lost), time);
-	utility = fixedpt_mul(utility, FIXEDPT_ONE - fixedpt_div(FIXEDPT_ONE, FIXEDPT_ONE + fixedpt_exp(fixedpt_mul(fixedpt_fromint(-100), fixedpt_div(fixedpt_fromint(mon->bytes_lost), fixedpt_fromint(sent)) - fixedpt_rconst(0.05))))) - fixedpt_div(fixedpt_fromint(mon->bytes_lost), time);
+	utility = fixedpt_div(fixedpt_fromint(sent - lost), time);
+	//goodput beyond what a flow needs for its deadline costs utility, so it yields to the others
+	needed = fixedpt_fromint(ca->pcc->deadline_needed);
+	if (ca->pcc->deadline_ns && utility > needed && ca->pcc->state != PCC_STATE_START) {
+		utility = needed - fixedpt_div(fixedpt_mul(utility - needed, fixedpt_fromint(ca->pcc->params->deadline_yield_percent)), fixedpt_fromint(100));
+	}
+	utility = fixedpt_mul(utility, FIXEDPT_ONE - fixedpt_div(FIXEDPT_ONE, FIXEDPT_ONE + fixedpt_exp(fixedpt_mul(fixedpt_fromint(-ca->pcc->params->loss_slope), fixedpt_div(fixedpt_fromint(lost), fixedpt_fromint(sent)) - fixedpt_div(fixedpt_fromint(ca->pcc->params->loss_threshold_ppm), fixedpt_fromint(1000000)))))) - fixedpt_div(fixedpt_fromint(lost), time);
+	utility -= local_penalty(mon, sk, time, length_us);
 	rate = fixedpt_mul(fixedpt_div(fixedpt_fromint(sent), fixedpt_fromint(length_us)), fixedpt_rconst(1000000));
-	DBG_PRINT("[PCC] calculating utility: rate (limit): %llu, rate (actual): %llu, sent (by sequence): %llu, lost: %u, time: %u, utility: %d, sent segements: %d, sent (by segments): %u, state: %d\n", mon->rate, rate >> FIXEDPT_WBITS, mon->snd_end_seq - mon->snd_start_seq, mon->bytes_lost, length_us, (s32)(utility >> FIXEDPT_WBITS), mon->segments_sent,  (mon->segments_sent) * tp->advmss, mon->state);
+	PCC_TRACE(ca->pcc, "calculating utility: rate (limit): %llu, rate (actual): %llu, sent (by sequence): %llu, lost: %u (scaled %llu), time: %u, utility: %d, sent segements: %d, sent (by segments): %u, state: %d\n", mon->rate, rate >> FIXEDPT_WBITS, mon->snd_end_seq - mon->snd_start_seq, mon->bytes_lost, lost, length_us, (s32)(utility >> FIXEDPT_WBITS), mon->segments_sent,  (mon->segments_sent) * tp->advmss, mon->state);
 
 	return utility;
 }
@@ -245,66 +1060,100 @@ static void on_monitor_start(struct sock *sk, int index)
 	struct monitor * mon = ca->pcc->monitor_intervals + index;
 	u64 rate = ca->pcc->next_rate;
 	u8 should_update_base_rate = 0;
+	u64 step;
 
-	DBG_PRINT("[PCC] raw rate is %llu (interval %d)\n", rate, index);
+	PCC_TRACE(ca->pcc, "raw rate is %llu (interval %d)\n", rate, index);
 	switch (ca->pcc->state) {
 		case PCC_STATE_START:
 			//rate = ca->pcc->last_actual_rate * 2;
-			rate *= 2;
+			if (ca->pcc->params->startup_chirp) {
+				//the chirps raise the rate, not the monitors
+				if (!ca->pcc->chirp_start_ns) {
+					chirp_begin(sk, ca->pcc, rate);
+				}
+				should_update_base_rate = 1;
+				break;
+			}
+			rate += div_u64(rate * coupling_gain(ca->pcc), 1000);
 			ca->pcc->next_rate = rate;
 			should_update_base_rate = 1;
-			DBG_PRINT("[PCC] in start state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in start state (interval %d)\n", index);
 			break;
 		case PCC_STATE_DECISION_MAKING_1:
-			rate = rate + (ca->pcc->decision_making_attempts * 1 * (rate / 100));
+			//centre the trials between our rate and the delivery rate
+			if (pcc_max_bw(ca->pcc)) {
+				rate = bound_by_bw(ca->pcc, (rate + pcc_max_bw(ca->pcc)) / 2);
+				ca->pcc->next_rate = rate;
+			}
+			rate = rate + (ca->pcc->decision_making_attempts * ca->pcc->params->step_percent * (rate / 100));
 			ca->pcc->state = PCC_STATE_DECISION_MAKING_2;
+			ca->pcc->round_start_ns = ktime_get_ns();
 			mon->decision_making_id = 1;
-			DBG_PRINT("[PCC] in DM 1 state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in DM 1 state (interval %d)\n", index);
 
 			break;
 		case PCC_STATE_DECISION_MAKING_2:
-			rate = rate - (ca->pcc->decision_making_attempts * 1 * (rate / 100));
+			rate = rate - (ca->pcc->decision_making_attempts * ca->pcc->params->step_percent * (rate / 100));
 			ca->pcc->state = PCC_STATE_DECISION_MAKING_3;
 			mon->decision_making_id = 2;
-			DBG_PRINT("[PCC] in DM 2 state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in DM 2 state (interval %d)\n", index);
 			break;
 		case PCC_STATE_DECISION_MAKING_3:
-			rate = rate + (ca->pcc->decision_making_attempts * 1 * (rate / 100));
+			rate = rate + (ca->pcc->decision_making_attempts * ca->pcc->params->step_percent * (rate / 100));
 			ca->pcc->state = PCC_STATE_DECISION_MAKING_4;
 			mon->decision_making_id = 3;
-			DBG_PRINT("[PCC] in DM 3 state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in DM 3 state (interval %d)\n", index);
 			break;
 		case PCC_STATE_DECISION_MAKING_4:
-			rate = rate - (ca->pcc->decision_making_attempts * 1 * (rate / 100));
+			rate = rate - (ca->pcc->decision_making_attempts * ca->pcc->params->step_percent * (rate / 100));
 			ca->pcc->state = PCC_STATE_WAIT_FOR_DECISION;
 			mon->decision_making_id = 4;
-			DBG_PRINT("[PCC] in DM 4 state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in DM 4 state (interval %d)\n", index);
 			break;
 		case PCC_STATE_RATE_ADJUSTMENT:
-			rate = rate + ((rate / 100) * ca->pcc->direction * ca->pcc->rate_adjustment_tries * 1);
+			step = (rate / 100) * ca->pcc->rate_adjustment_tries * ca->pcc->params->step_percent;
+			if (ca->pcc->direction > 0) {
+				step = div_u64(step * coupling_gain(ca->pcc), 1000);
+				rate += div_u64(step * ca->pcc->deadline_gain, 1000);
+			} else {
+				rate -= div_u64(step * 1000, ca->pcc->deadline_gain);
+			}
 			if ((ca->pcc->direction > 0 && rate < ca->pcc->next_rate) || (ca->pcc->direction < 0 && rate > ca->pcc->next_rate))
 			{
-				DBG_PRINT("[PCC] overflow in rate adjustment." \
+				PCC_TRACE(ca->pcc, "overflow in rate adjustment." \
 					"rate came out as %llu, direction is %d, tries is: %d\n" \
-					"addition is %d", rate, ca->pcc->direction, ca->pcc->rate_adjustment_tries, 
+					"addition is %d\n", rate, ca->pcc->direction, ca->pcc->rate_adjustment_tries, 
 					((rate / 100) * ca->pcc->direction * ca->pcc->rate_adjustment_tries * 5));
 				//overflow detected
+				PCC_INC_STATS(ca->pcc->net, PCC_MIB_RATE_OVERFLOWS);
 				rate = ca->pcc->next_rate;
 				ca->pcc->rate_adjustment_tries = 1;
 
 			}
+			rate = bound_by_bw(ca->pcc, rate);
 			should_update_base_rate = 1;
 			ca->pcc->rate_adjustment_tries++;
-			DBG_PRINT("[PCC] in rate adjustment state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in rate adjustment state (interval %d)\n", index);
 			break;
 		case PCC_STATE_WAIT_FOR_DECISION:
-			DBG_PRINT("[PCC] in wait for decision state (interval %d)\n", index);
+			PCC_TRACE(ca->pcc, "in wait for decision state (interval %d)\n", index);
+			break;
+		case PCC_STATE_EQUILIBRIUM:
+			//hold the rate, and probe once in a while in case the optimum moved
+			if (++ca->pcc->equilibrium_mis >= ca->pcc->params->equilibrium_probe_mis) {
+				ca->pcc->state = PCC_STATE_DECISION_MAKING_1;
+				ca->pcc->decision_making_attempts = 1;
+				ca->pcc->equilibrium_mis = 0;
+				//one more inconclusive round returns to equilibrium
+				ca->pcc->equilibrium_votes = ca->pcc->params->equilibrium_decisions - 1;
+			}
+			PCC_TRACE(ca->pcc, "in equilibrium state (interval %d)\n", index);
 			break;
 	}
 
-	rate = max_t(u64, rate, MINIMUM_RATE);
+	rate = max_t(u64, rate, ca->pcc->params->minimum_rate);
 
-	DBG_PRINT("[PCC] rate is %llu (interval %d)\n", rate, index);
+	PCC_TRACE(ca->pcc, "rate is %llu (interval %d)\n", rate, index);
 
 	if (rate != 0) {
 		ca->pcc->monitor_intervals[index].rate = rate;
@@ -314,8 +1163,76 @@ static void on_monitor_start(struct sock *sk, int index)
 	}
 }
 
+/** adds a sample to a histogram of this cpu */
+static void telemetry_add(int hist, u64 value)
+{
+	this_cpu_inc(pcc_telemetry.hist[hist][min_t(int, fls64(value), TELEMETRY_BUCKETS - 1)]);
+}
+
+/** the socket entered equilibrium, counts what converging took unless it already was converged */
+static void telemetry_converged(struct pccdata *pcc)
+{
+	if (pcc->converged) {
+		return;
+	}
+	telemetry_add(PCC_HIST_CONVERGENCE_ROUNDS, pcc->converge_rounds);
+	telemetry_add(PCC_HIST_CONVERGENCE_MS, div_u64(ktime_get_ns() - pcc->converge_start_ns, NSEC_PER_MSEC));
+	pcc->converged = 1;
+	pcc->osc_min_rate = 0;
+	pcc->osc_max_rate = 0;
+}
+
+/** the socket is no longer converged, counts how far its rate swung while it was */
+static void telemetry_diverged(struct pccdata *pcc)
+{
+	if (!pcc->converged) {
+		return;
+	}
+	if (pcc->osc_max_rate) {
+		telemetry_add(PCC_HIST_OSCILLATION_PERMILLE,
+			div64_u64((pcc->osc_max_rate - pcc->osc_min_rate) * 2000, pcc->osc_max_rate + pcc->osc_min_rate));
+	}
+	pcc->converged = 0;
+	pcc->converge_rounds = 0;
+	pcc->converge_start_ns = ktime_get_ns();
+}
+
+/**
+ * counts inconclusive and reversing decisions, and enters the equilibrium state
+ * at the base rate of the round, not the trial rate a decision moved to,
+ * after equilibrium_decisions of them in a row
+ */
+static void vote_equilibrium(struct pccdata *pcc, int decision, u64 base_rate)
+{
+	if (decision == 0 || (pcc->last_decision != 0 && decision != pcc->last_decision)) {
+		pcc->equilibrium_votes++;
+	} else {
+		pcc->equilibrium_votes = 0;
+	}
+	pcc->last_decision = decision;
+	if (pcc->params->equilibrium_decisions <= 0 || pcc->equilibrium_votes < pcc->params->equilibrium_decisions) {
+		return;
+	}
+	pcc->next_rate = base_rate;
+	PCC_TRACE(pcc, "entering equilibrium at rate %llu\n", pcc->next_rate);
+	PCC_INC_STATS(pcc->net, PCC_MIB_EQUILIBRIUM_ENTERED);
+	pcc->state = PCC_STATE_EQUILIBRIUM;
+	pcc->decision_making_attempts = 0;
+	pcc->equilibrium_mis = 0;
+	pcc->equilibrium_rtt = 0;
+}
+
 static void make_decision(struct sock *sk, struct pccdata * pcc)
 {
+	u64 base_rate = pcc->next_rate;
+
+	pcc->decisions++;
+	if (pcc->round_start_ns) {
+		telemetry_add(PCC_HIST_DECISION_US, div_u64(ktime_get_ns() - pcc->round_start_ns, NSEC_PER_USEC));
+	}
+	if (!pcc->converged) {
+		pcc->converge_rounds++;
+	}
 	if ((pcc->decision_making_intervals[0].utility > pcc->decision_making_intervals[1].utility) &&
 		(pcc->decision_making_intervals[2].utility > pcc->decision_making_intervals[3].utility)) {
 		pcc->next_rate = pcc->decision_making_intervals[0].rate;
@@ -324,6 +1241,8 @@ static void make_decision(struct sock *sk, struct pccdata * pcc)
 		pcc->rate_adjustment_tries = 1;
 		memset(pcc->decision_making_intervals, 0, sizeof(pcc->decision_making_intervals));
 		pcc->decision_making_attempts = 0;
+		PCC_INC_STATS(pcc->net, PCC_MIB_DECISIONS_UP);
+		vote_equilibrium(pcc, 1, base_rate);
 
 	} else if ((pcc->decision_making_intervals[0].utility < pcc->decision_making_intervals[1].utility) &&
 		(pcc->decision_making_intervals[2].utility < pcc->decision_making_intervals[3].utility)) {
@@ -333,10 +1252,20 @@ static void make_decision(struct sock *sk, struct pccdata * pcc)
 		pcc->rate_adjustment_tries = 1;
 		memset(pcc->decision_making_intervals, 0, sizeof(pcc->decision_making_intervals));
 		pcc->decision_making_attempts = 0;
+		PCC_INC_STATS(pcc->net, PCC_MIB_DECISIONS_DOWN);
+		vote_equilibrium(pcc, -1, base_rate);
 
 	} else {
 		pcc->state = PCC_STATE_DECISION_MAKING_1;
 		pcc->decision_making_attempts++;
+		PCC_INC_STATS(pcc->net, PCC_MIB_DECISIONS_INCONCLUSIVE);
+		vote_equilibrium(pcc, 0, base_rate);
+	}
+	//a probe from equilibrium that found a direction moves the socket away
+	if (pcc->state == PCC_STATE_EQUILIBRIUM) {
+		telemetry_converged(pcc);
+	} else if (pcc->state == PCC_STATE_RATE_ADJUSTMENT) {
+		telemetry_diverged(pcc);
 	}
 }
 
@@ -346,6 +1275,106 @@ static inline u32 pcc_get_rate(struct sock * sk)
 	return ca->pcc->monitor_intervals[ca->pcc->current_interval].rate;
 }
 
+/** pushes the ended monitor into the records stream while a reader has it open, dropping it if the reader falls behind */
+static void record_monitor(struct sock *sk, struct monitor *mon, int index)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_sock *inet = inet_sk(sk);
+	struct pcc_mi_record rec;
+	unsigned long flags;
+
+	//nothing reads the records, or the monitor started before the reader came
+	if (!mon->start_real_ns || !atomic_read(&mi_records_readers)) {
+		return;
+	}
+	memset(&rec, 0, sizeof(rec));
+	rec.start_time_ns = mon->start_real_ns;
+	rec.end_time_ns = ktime_get_real_ns();
+	rec.rate = mon->rate;
+	rec.actual_rate = mon->actual_rate;
+	rec.utility = mon->utility;
+	rec.send_duration_us = mon->end_time;
+	rec.snd_start_seq = mon->snd_start_seq;
+	rec.snd_end_seq = mon->snd_end_seq;
+	rec.segments_sent = mon->segments_sent;
+	rec.bytes_lost = mon->bytes_lost;
+	rec.rtt_us = mon->rtt;
+	rec.mss = tp->advmss;
+	rec.state = mon->state;
+	rec.decision_making_id = mon->decision_making_id;
+	rec.index = index;
+	rec.family = sk->sk_family;
+	rec.sport = inet->inet_sport;
+	rec.dport = inet->inet_dport;
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6) {
+		memcpy(rec.saddr, &sk->sk_v6_rcv_saddr, sizeof(struct in6_addr));
+		memcpy(rec.daddr, &sk->sk_v6_daddr, sizeof(struct in6_addr));
+	} else
+#endif
+	{
+		memcpy(rec.saddr, &inet->inet_saddr, sizeof(inet->inet_saddr));
+		memcpy(rec.daddr, &inet->inet_daddr, sizeof(inet->inet_daddr));
+	}
+
+	spin_lock_irqsave(&mi_records_lock, flags);
+	if (!kfifo_put(&mi_records_fifo, rec)) {
+		mi_records_dropped++;
+		PCC_INC_STATS(((struct pcctcp *)inet_csk_ca(sk))->pcc->net, PCC_MIB_MI_RECORDS_DROPPED);
+	}
+	spin_unlock_irqrestore(&mi_records_lock, flags);
+	wake_up_interruptible(&mi_records_wait);
+}
+
+/**
+ * compares a monitor sent in equilibrium with the conditions equilibrium was
+ * reached in, and goes back to probing if rtt, delivery rate or loss moved
+ */
+static void check_equilibrium(struct pccdata *pcc, struct monitor *mon, u32 mss)
+{
+	u64 sent = (u64)mon->segments_sent * mss;
+	//the smallest sample of the monitor, so a delayed ack or jitter does not count as queueing
+	u32 rtt = mon->rtt_min ? mon->rtt_min : mon->rtt;
+	u64 delivered, change;
+	u32 loss_ppm;
+
+	if (pcc->state != PCC_STATE_EQUILIBRIUM || mon->state != PCC_STATE_EQUILIBRIUM || sent == 0 ||
+		sent < mon->bytes_lost) {
+		return;
+	}
+	delivered = div64_u64((sent - mon->bytes_lost) * USEC_PER_SEC, mon->end_time + 1);
+	loss_ppm = div64_u64((u64)mon->bytes_lost * 1000000, sent);
+	if (pcc->equilibrium_rtt == 0) {
+		pcc->equilibrium_rtt = max_t(u32, rtt, 1);
+		pcc->equilibrium_delivered = delivered;
+		pcc->equilibrium_loss_ppm = loss_ppm;
+		return;
+	}
+
+	change = rtt > pcc->equilibrium_rtt ? rtt - pcc->equilibrium_rtt : pcc->equilibrium_rtt - rtt;
+	if (change * 100 > (u64)pcc->equilibrium_rtt * pcc->params->equilibrium_change_percent) {
+		goto changed;
+	}
+	change = delivered > pcc->equilibrium_delivered ? delivered - pcc->equilibrium_delivered : pcc->equilibrium_delivered - delivered;
+	if (change * 100 > pcc->equilibrium_delivered * pcc->params->equilibrium_change_percent) {
+		goto changed;
+	}
+	if (loss_ppm > pcc->equilibrium_loss_ppm + pcc->params->equilibrium_loss_ppm) {
+		goto changed;
+	}
+	return;
+
+changed:
+	PCC_TRACE(pcc, "leaving equilibrium: rtt %u (was %u) delivered %llu (was %llu) loss %u ppm (was %u)\n",
+		rtt, pcc->equilibrium_rtt, delivered, pcc->equilibrium_delivered, loss_ppm, pcc->equilibrium_loss_ppm);
+	PCC_INC_STATS(pcc->net, PCC_MIB_EQUILIBRIUM_LEFT);
+	telemetry_diverged(pcc);
+	pcc->state = PCC_STATE_DECISION_MAKING_1;
+	pcc->decision_making_attempts = 1;
+	pcc->equilibrium_votes = 0;
+	pcc->last_decision = 0;
+}
+
 /** called when a monitor's send period has ended and received ack for the last sent sequence */
 static void on_monitor_end(struct sock *sk, int index)
 {
@@ -353,9 +1382,25 @@ static void on_monitor_end(struct sock *sk, int index)
 	struct monitor * mon = ca->pcc->monitor_intervals + index;
 	struct monitor * prev_mon = ca->pcc->monitor_intervals + PREV_MONITOR(index);
 
+	deadline_claim(sk, ca->pcc);
+	deadline_update(sk, ca->pcc);
 	if (mon->segments_sent != 0 && mon->snd_end_seq != 0) {
 		mon->utility = calc_utility(mon, sk);
-		DBG_PRINT("got utility %lld for monitor interval %d\n", mon->utility, index);
+		PCC_TRACE(ca->pcc, "got utility %lld for monitor interval %d\n", mon->utility, index);
+		PCC_INC_STATS(ca->pcc->net, PCC_MIB_MONITORS);
+		ca->pcc->monitors++;
+		if (mon->bytes_lost) {
+			PCC_INC_STATS(ca->pcc->net, PCC_MIB_MONITORS_LOSSY);
+		}
+		record_monitor(sk, mon, index);
+		if (ca->pcc->converged) {
+			if (!ca->pcc->osc_max_rate || mon->actual_rate < ca->pcc->osc_min_rate) {
+				ca->pcc->osc_min_rate = mon->actual_rate;
+			}
+			ca->pcc->osc_max_rate = max_t(u64, ca->pcc->osc_max_rate, mon->actual_rate);
+		}
+		coupling_update(ca->pcc, mon);
+		check_equilibrium(ca->pcc, mon, tcp_sk(sk)->advmss);
 	}
 
 	/* first monitor interval in the connection */
@@ -363,13 +1408,14 @@ static void on_monitor_end(struct sock *sk, int index)
 		return;
 	}
 	// if in start state or in rate adjustment state, and utility is worse than last monitor, go to decision making and restor last good rate
-	if (mon->state != PCC_STATE_WAIT_FOR_DECISION && ca->pcc->snd_count > 3 && mon->utility < prev_mon->utility && ((ca->pcc->state == PCC_STATE_START) || ca->pcc->state == PCC_STATE_RATE_ADJUSTMENT)) {
+	if (mon->state != PCC_STATE_WAIT_FOR_DECISION && ca->pcc->snd_count > 3 && mon->utility < prev_mon->utility && ((ca->pcc->state == PCC_STATE_START && !ca->pcc->chirp_start_ns) || ca->pcc->state == PCC_STATE_RATE_ADJUSTMENT)) {
 		ca->pcc->state = PCC_STATE_DECISION_MAKING_1;
 		ca->pcc->decision_making_attempts = 1;
 		ca->pcc->next_rate = prev_mon->rate;
 		if (mon->state == PCC_STATE_START) {
-			ca->pcc->next_rate = prev_mon->actual_rate;
-			DBG_PRINT("[PCC] end of start state, setting rate to %u\n", ca->pcc->next_rate);
+			ca->pcc->next_rate = pcc_max_bw(ca->pcc) ? pcc_max_bw(ca->pcc) : prev_mon->actual_rate;
+			PCC_INC_STATS(ca->pcc->net, PCC_MIB_STARTUP_EXITS);
+			PCC_TRACE(ca->pcc, "end of start state, setting rate to %llu\n", ca->pcc->next_rate);
 		}
 	}
 
@@ -390,10 +1436,54 @@ static void on_interval_graceful_end(struct sock *sk, int index)
 {
 	struct pcctcp *ca = inet_csk_ca(sk);
 	struct monitor * mon = ca->pcc->monitor_intervals + index;
-	DBG_PRINT("[PCC] graceful end for monitor interval with seqs %u-%u and segments_sent %d and %u loss\n", mon->snd_start_seq, mon->snd_end_seq, mon->segments_sent, mon->bytes_lost);
+	PCC_TRACE(ca->pcc, "graceful end for monitor interval with seqs %u-%u and segments_sent %d and %u loss\n", mon->snd_start_seq, mon->snd_end_seq, mon->segments_sent, mon->bytes_lost);
 	on_monitor_end(sk, index);
 }
 
+/** fires pcc_rate_change when the base rate moved rate_notify_percent from the last event */
+static void rate_notify(struct sock *sk, struct pccdata *pcc)
+{
+	u64 change = pcc->next_rate > pcc->notified_rate ? pcc->next_rate - pcc->notified_rate :
+		pcc->notified_rate - pcc->next_rate;
+
+	if (!pcc->params->rate_notify_percent || change * 100 < pcc->notified_rate * pcc->params->rate_notify_percent) {
+		return;
+	}
+	trace_pcc_rate_change(sk, pcc->trace_id, pcc->notified_rate, pcc->next_rate, pcc->last_actual_rate, pcc->state);
+	PCC_INC_STATS(pcc->net, PCC_MIB_RATE_CHANGES);
+	pcc->notified_rate = pcc->next_rate;
+	pcc->rate_changes++;
+}
+
+/**
+ * drops a monitor whose acks stopped coming for monitor_expiry_rtts srtts
+ * after it stopped sending: an RTO rewound snd_nxt under it, the data is gone
+ * with the connection, or it never sent. It gives no utility, and the decision round it
+ * was part of starts again as it cannot end without it.
+ */
+static void expire_monitor(struct sock *sk, int index)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+	struct monitor *mon = ca->pcc->monitor_intervals + index;
+	int i;
+
+	PCC_TRACE(ca->pcc, "monitor %d expired with seqs %u-%u, last acked %u\n", index, mon->snd_start_seq,
+		mon->snd_end_seq, mon->last_acked_seq);
+	PCC_INC_STATS(ca->pcc->net, PCC_MIB_MONITORS_EXPIRED);
+	ca->pcc->expired++;
+	mon->valid = 0;
+	if (mon->decision_making_id != 0 && ca->pcc->state >= PCC_STATE_DECISION_MAKING_2 &&
+		ca->pcc->state <= PCC_STATE_WAIT_FOR_DECISION) {
+		ca->pcc->state = PCC_STATE_DECISION_MAKING_1;
+		//the rest of the round must not make a decision when it ends
+		for (i = 0; i < NUMBER_OF_INTERVALS; i++) {
+			if (ca->pcc->monitor_intervals[i].valid) {
+				ca->pcc->monitor_intervals[i].decision_making_id = 0;
+			}
+		}
+	}
+}
+
 /** checks if current interval finished sending, and start a new if it did
 	checks if any active intervals finished receiving acks and ends them if they did
 **/
@@ -403,8 +1493,9 @@ static void check_end_of_monitor_interval(struct sock *sk)
 	struct pcctcp *ca = inet_csk_ca(sk);
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct monitor * mon = ca->pcc->monitor_intervals + ca->pcc->current_interval;
-	struct timespec length = timespec_sub(current_kernel_time(), mon->start_time);
-	u32 length_us = length.tv_sec * 1000000 + length.tv_nsec / 1000;
+	u64 now = ktime_get_ns();
+	u32 length_us = div_u64(now - mon->start_ns, NSEC_PER_USEC);
+	u32 expiry_us = (tp->srtt_us >> 3) * ca->pcc->params->monitor_expiry_rtts;
 
 	//make sure monitor has sent at least 20 segments
 	if (mon->segments_sent < 20) {
@@ -413,13 +1504,32 @@ static void check_end_of_monitor_interval(struct sock *sk)
 		}
 	} else if ((mon->snd_start_seq != mon->snd_end_seq) && ((length_us > mon->end_time) )) {
 		//current interval finished sending, start a new one
-		DBG_PRINT("current monitor %d finished sending. end time should have been %u and was %u\n",ca->pcc->current_interval, mon->end_time, length_us);
-		mon->end_time = length_us;
+		u64 end_ns = mon->start_ns + (u64)mon->end_time * NSEC_PER_USEC;
+
+		PCC_TRACE(ca->pcc, "current monitor %d finished sending. end time should have been %u and was %u\n",ca->pcc->current_interval, mon->end_time, length_us);
+		telemetry_add(PCC_HIST_MONITOR_OVERSHOOT_US, length_us - mon->end_time);
+		//the end is only noticed on an ack, so an ack gap would stretch the monitor.
+		//cut it at its planned length instead, splitting what was sent since the last check
+		//as if it went out evenly; the rest belongs to no monitor
+		if (ca->pcc->check_ns >= mon->start_ns && ca->pcc->check_ns < end_ns) {
+			u64 part = end_ns - ca->pcc->check_ns;
+			u64 whole = now - ca->pcc->check_ns;
+			s32 seq_sent = mon->snd_end_seq - ca->pcc->check_seq;
+
+			mon->segments_sent = ca->pcc->check_segments +
+				div64_u64((u64)(mon->segments_sent - ca->pcc->check_segments) * part, whole);
+			if (seq_sent > 0) {
+				mon->snd_end_seq = ca->pcc->check_seq + (u32)div64_u64((u64)seq_sent * part, whole);
+			}
+		} else {
+			mon->end_time = length_us;
+		}
 		ca->pcc->current_interval = (ca->pcc->current_interval + 1) % NUMBER_OF_INTERVALS;
 		mon = ca->pcc->monitor_intervals + ca->pcc->current_interval;
 
 		if (mon->valid) {
 			DBG_PRINT(KERN_ERR "BUG: overrunning interval\n");
+			PCC_INC_STATS(ca->pcc->net, PCC_MIB_MONITOR_OVERRUNS);
 			mon->valid = 0;
 		}
 	}
@@ -430,13 +1540,21 @@ static void check_end_of_monitor_interval(struct sock *sk)
 		if (!loop_mon->valid) {
 			continue;
 		}
-		length = timespec_sub(current_kernel_time(), loop_mon->start_time);
-		length_us = length.tv_sec * 1000000 + length.tv_nsec / 1000;
+		length_us = div_u64(now - loop_mon->start_ns, NSEC_PER_USEC);
 		if (loop_mon->snd_start_seq != loop_mon->snd_end_seq && ((length_us > loop_mon->end_time)) && 
 			!after(loop_mon->snd_end_seq, loop_mon->last_acked_seq)) {
 			on_interval_graceful_end(sk, i);
 			loop_mon->valid = 0;
-		} 
+		} else if (i != ca->pcc->current_interval && expiry_us) {
+			//a recovery that still acks its data keeps it alive
+			if (loop_mon->progress_seq != loop_mon->last_acked_seq) {
+				loop_mon->progress_seq = loop_mon->last_acked_seq;
+				loop_mon->progress_us = length_us;
+			}
+			if (length_us > max_t(u32, loop_mon->end_time, loop_mon->progress_us) + expiry_us) {
+				expire_monitor(sk, i);
+			}
+		}
 	}
 
 	//current monitor is invalid (started a new one probably) init it
@@ -444,16 +1562,23 @@ static void check_end_of_monitor_interval(struct sock *sk)
 		init_monitor(mon, sk);
 		if (ca->pcc->next_rate == 0) {
 			if (tp->advmss == 0 || ca->pcc->last_rtt == 0) {
-				DBG_PRINT(KERN_INFO "[PCC] did not set rate as there is no mss or rtt");
+				PCC_TRACE(ca->pcc, "did not set rate as there is no mss or rtt\n");
 			} else {
 				//ca->pcc->next_rate = (2 * (tp->advmss)) / ca->pcc->last_rtt;
 			}
 		} 
 		on_monitor_start(sk, ca->pcc->current_interval);
-		DBG_PRINT(KERN_INFO "[PCC] setting rate:%u (%u Kbps) was %u, max is %u\n", pcc_get_rate(sk), (pcc_get_rate(sk) * 8) / 1000, sk->sk_pacing_rate, sk->sk_max_pacing_rate);
-		sk->sk_pacing_rate = pcc_get_rate(sk);
+		//a chirp that is still sending paces its own steps
+		if (!ca->pcc->chirp_start_ns || ca->pcc->chirp_end_ns) {
+			PCC_TRACE(ca->pcc, "setting rate:%u (%u Kbps) was %u, max is %u\n", pcc_get_rate(sk), (pcc_get_rate(sk) * 8) / 1000, sk->sk_pacing_rate, sk->sk_max_pacing_rate);
+			sk->sk_pacing_rate = pcc_get_rate(sk);
+		}
 		mon->valid = 1;
+		rate_notify(sk, ca->pcc);
 	}
+	ca->pcc->check_ns = now;
+	ca->pcc->check_segments = mon->segments_sent;
+	ca->pcc->check_seq = mon->snd_end_seq ? mon->snd_end_seq : mon->snd_start_seq;
 }
 
 /** check if something sent and if anny monitors ended */
@@ -522,11 +1647,11 @@ static void update_interval_with_received_acks(struct sock *sk)
 						if (before(sack_cache[j].start_seq, loop_mon->snd_end_seq)) {
 							s32 lost = sack_cache[j].start_seq - loop_mon->last_acked_seq;
 							loop_mon->bytes_lost += lost;
-							DBG_PRINT("monitor %d lost from start sack (%u-%u) to last acked (%u), lost :%d\n", i, sack_cache[j].start_seq, sack_cache[j].end_seq, loop_mon->last_acked_seq, lost);
+							PCC_TRACE(ca->pcc, "monitor %d lost from start sack (%u-%u) to last acked (%u), lost :%d\n", i, sack_cache[j].start_seq, sack_cache[j].end_seq, loop_mon->last_acked_seq, lost);
 						} else {
 							s32 lost = loop_mon->snd_end_seq - loop_mon->last_acked_seq;
 							loop_mon->bytes_lost += lost;
-							DBG_PRINT("monitor %d lost from last acked (%u) to end of monitor (%u), lost: %d\n", i, loop_mon->last_acked_seq, loop_mon->snd_end_seq, lost);
+							PCC_TRACE(ca->pcc, "monitor %d lost from last acked (%u) to end of monitor (%u), lost: %d\n", i, loop_mon->last_acked_seq, loop_mon->snd_end_seq, lost);
 						}
 
 					}
@@ -542,6 +1667,26 @@ static void update_interval_with_received_acks(struct sock *sk)
 }
 
 
+/** the sample times the newest segment the ack covers, it counts for the monitor that sent it */
+static void monitor_rtt_sample(struct sock *sk, u32 rtt_us)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	int i;
+
+	for (i = 0; i < NUMBER_OF_INTERVALS; i++) {
+		struct monitor *loop_mon = ca->pcc->monitor_intervals + i;
+
+		if (!loop_mon->valid || !loop_mon->snd_end_seq || !after(tp->snd_una, loop_mon->snd_start_seq) ||
+			after(tp->snd_una, loop_mon->snd_end_seq)) {
+			continue;
+		}
+		if (!loop_mon->rtt_min || rtt_us < loop_mon->rtt_min) {
+			loop_mon->rtt_min = rtt_us;
+		}
+	}
+}
+
 static void pcctcp_init(struct sock *sk)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
@@ -569,10 +1714,17 @@ static void pkts_acked(struct sock *sk, const struct ack_sample * sample)
 
 	if (sample->rtt_us > 0) {
 		ca->pcc->last_rtt = (sample->rtt_us);
+		monitor_rtt_sample(sk, sample->rtt_us);
 	}
+	PCC_TRACE(ca->pcc, "ack: una %u nxt %u rtt %d acked %u sacked %u lost %u pacing rate %lu\n",
+		tp->snd_una, tp->snd_nxt, sample->rtt_us, sample->pkts_acked, tp->sacked_out, tp->lost_out,
+		sk->sk_pacing_rate);
 
 	update_interval_with_received_acks(sk);
 	do_checks(sk);
+	if (ca->pcc->state == PCC_STATE_START) {
+		chirp_update(sk, ca->pcc, sample->rtt_us);
+	}
 
 	//set the congestion window to a very large size so it wouldn't matter
 	tp->snd_cwnd = LARGE_CWND;
@@ -586,22 +1738,104 @@ static void in_ack_event(struct sock *sk, u32 flags)
 	update_interval_with_received_acks(sk);
 }
 
+/**
+ * adds the time since the last ack to the TSQ throttling of the sending
+ * monitor if the socket is throttled, or has as much below it as TSQ allows
+ * (the flag is cleared at every transmit completion, so acks, which the
+ * completions clock, rarely find it set), and keeps the send queue memory
+ */
+static void sample_local_signals(struct sock *sk, struct pccdata *pcc)
+{
+	struct monitor *mon = pcc->monitor_intervals + pcc->current_interval;
+	int wmem = sk_wmem_alloc_get(sk);
+	u64 now = ktime_get_ns();
+	u64 tsq_limit = max_t(u64, sk->sk_pacing_rate >> 10, 2 * tcp_sk(sk)->advmss);
+
+	if (mon->valid) {
+		if (pcc->local_sample_ns && (test_bit(TSQ_THROTTLED, &tcp_sk(sk)->tsq_flags) || wmem >= tsq_limit)) {
+			mon->tsq_throttled_us += div_u64(now - pcc->local_sample_ns, NSEC_PER_USEC);
+		}
+		mon->wmem_end = wmem;
+	}
+	pcc->local_sample_ns = now;
+}
+
 static void cong_control(struct sock *sk, const struct rate_sample *rs)
 {
-	//struct pcctcp *ca = inet_csk_ca(sk);
+	struct pcctcp *ca = inet_csk_ca(sk);
 	//struct monitor * mon = ca->pcc->monitor_intervals + ca->pcc->current_interval;
 	//	update_interval_with_received_acks(sk);
 
-	return;
+	if (ca->pcc == NULL) {
+		return;
+	}
+	if (ca->pcc->params->bw_model) {
+		update_max_bw(sk, ca->pcc, rs);
+	}
+	if (ca->pcc->params->local_penalty_percent > 0) {
+		sample_local_signals(sk, ca->pcc);
+	}
+}
+
+/**
+ * a transmit the qdisc or device refused (NET_XMIT_DROP/CN, -ENOBUFS) puts
+ * the socket in CWR, and so do ECN echoes, as good a reason to slow down.
+ * Only entries from Open or Disorder are seen, tcp_enter_cwr leaves Recovery
+ * and Loss alone, and an entry stands for however many refusals or echoes
+ * came while in CWR.
+ */
+static void pcc_set_state(struct sock *sk, u8 new_state)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+	struct monitor *mon;
+
+	if (new_state != TCP_CA_CWR || ca->pcc == NULL) {
+		return;
+	}
+	mon = ca->pcc->monitor_intervals + ca->pcc->current_interval;
+	if (mon->valid) {
+		mon->cwr_entries++;
+	}
+	PCC_INC_STATS(ca->pcc->net, PCC_MIB_CWR_ENTRIES);
+}
+
+/** fills the PCC info for TCP_CC_INFO and inet_diag */
+static size_t pcc_get_info(struct sock *sk, u32 ext, int *attr, union tcp_cc_info *info)
+{
+	struct pcctcp *ca = inet_csk_ca(sk);
+	struct tcp_pcc_info *pinfo = (struct tcp_pcc_info *)info;
+
+	if (!(ext & (1 << (INET_DIAG_BBRINFO - 1))) || ca->pcc == NULL) {
+		return 0;
+	}
+
+	memset(pinfo, 0, sizeof(*pinfo));
+	pinfo->pcc_rate_lo = (u32)ca->pcc->next_rate;
+	pinfo->pcc_rate_hi = (u32)(ca->pcc->next_rate >> 32);
+	pinfo->pcc_actual_rate_lo = (u32)ca->pcc->last_actual_rate;
+	pinfo->pcc_actual_rate_hi = (u32)(ca->pcc->last_actual_rate >> 32);
+	pinfo->pcc_state = ca->pcc->state;
+	pinfo->pcc_direction = ca->pcc->direction;
+	pinfo->pcc_decision_attempts = min_t(int, ca->pcc->decision_making_attempts, U8_MAX);
+	pinfo->pcc_rate_changes = ca->pcc->rate_changes;
+	*attr = INET_DIAG_BBRINFO;
+	return sizeof(*pinfo);
 }
 
 static void pcc_release(struct sock *sk)
 {
 	struct pcctcp *ca = inet_csk_ca(sk);
 
-	DBG_PRINT(KERN_INFO "[PCC] in release routine\n");
-	
 	if (ca->pcc != NULL) {
+		//one line for every traced socket, and for the others as the log allows
+		if (ca->pcc->trace || net_ratelimit()) {
+			DBG_PRINT(KERN_INFO "[PCC %08x] released: state %d rate %llu actual rate %llu rtt %u monitors %u "
+				"decisions %u expired %u\n", ca->pcc->trace_id, ca->pcc->state, ca->pcc->next_rate,
+				ca->pcc->last_actual_rate, ca->pcc->last_rtt, ca->pcc->monitors, ca->pcc->decisions,
+				ca->pcc->expired);
+		}
+		telemetry_diverged(ca->pcc);
+		coupling_leave(ca->pcc);
 		kfree(ca->pcc);
 	}
 	ca->pcc = NULL;
@@ -613,22 +1847,385 @@ static struct tcp_congestion_ops pcctcp_ops __read_mostly = {
 	.pkts_acked     = pkts_acked,
 	.release 	= pcc_release,
 	.cong_control	= cong_control,
+	.set_state	= pcc_set_state,
 	.owner		= THIS_MODULE,
 	.name		= "pcc",
 	.in_ack_event = in_ack_event,
+	.get_info	= pcc_get_info,
+};
+
+
+
+#ifndef PCC_BENCH
+
+/** reads whole monitor records, blocking until there is at least one */
+static ssize_t mi_records_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct pcc_mi_record rec;
+	size_t copied = 0;
+	int err;
+
+	if (count < sizeof(rec)) {
+		return -EINVAL;
+	}
+
+	if (kfifo_is_empty(&mi_records_fifo)) {
+		if (file->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		err = wait_event_interruptible(mi_records_wait, !kfifo_is_empty(&mi_records_fifo));
+		if (err) {
+			return err;
+		}
+	}
+
+	while (copied + sizeof(rec) <= count &&
+		kfifo_out_spinlocked(&mi_records_fifo, &rec, 1, &mi_records_lock)) {
+		if (copy_to_user(buf + copied, &rec, sizeof(rec))) {
+			return copied ? copied : -EFAULT;
+		}
+		copied += sizeof(rec);
+	}
+	return copied;
+}
+
+/** the monitors only make records while a reader has the file open */
+static int mi_records_open(struct inode *inode, struct file *file)
+{
+	atomic_inc(&mi_records_readers);
+	return 0;
+}
+
+static int mi_records_release(struct inode *inode, struct file *file)
+{
+	atomic_dec(&mi_records_readers);
+	return 0;
+}
+
+static const struct file_operations mi_records_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mi_records_open,
+	.read		= mi_records_read,
+	.release	= mi_records_release,
+	.llseek		= noop_llseek,
 };
 
+/** every histogram of pcc_telemetry as "name bucket_low count", summed over the cpus, empty buckets left out */
+static int telemetry_show(struct seq_file *seq, void *v)
+{
+	unsigned long sum;
+	int h, b, cpu;
+
+	for (h = 0; h < PCC_HIST_MAX; h++) {
+		for (b = 0; b < TELEMETRY_BUCKETS; b++) {
+			sum = 0;
+			for_each_possible_cpu(cpu) {
+				sum += per_cpu(pcc_telemetry, cpu).hist[h][b];
+			}
+			if (sum) {
+				seq_printf(seq, "%s %llu %lu\n", pcc_hist_names[h], b ? 1ULL << (b - 1) : 0ULL, sum);
+			}
+		}
+	}
+	return 0;
+}
+
+static int telemetry_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, telemetry_show, NULL);
+}
 
+static const struct file_operations telemetry_fops = {
+	.owner		= THIS_MODULE,
+	.open		= telemetry_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void pcc_debugfs_init(void)
+{
+	pcc_debugfs_dir = debugfs_create_dir("pcc", NULL);
+	if (IS_ERR_OR_NULL(pcc_debugfs_dir)) {
+		DBG_PRINT(KERN_INFO "[PCC] debugfs is not available\n");
+		pcc_debugfs_dir = NULL;
+		return;
+	}
+	debugfs_create_file("mi_records", 0400, pcc_debugfs_dir, NULL, &mi_records_fops);
+	debugfs_create_u32("mi_records_dropped", 0400, pcc_debugfs_dir, &mi_records_dropped);
+	debugfs_create_file("telemetry", 0400, pcc_debugfs_dir, NULL, &telemetry_fops);
+}
+
+#define PCC_PARAM(name) { #name, offsetof(struct pcc_params, name) }
+
+/* the tunables /proc/net/pcc shows and takes */
+static const struct {
+	const char *name;
+	size_t offset;
+} pcc_params_table[] = {
+	PCC_PARAM(minimum_rate),
+	PCC_PARAM(step_percent),
+	PCC_PARAM(monitor_rtt_mult),
+	PCC_PARAM(monitor_rtt_div),
+	PCC_PARAM(monitor_expiry_rtts),
+	PCC_PARAM(loss_threshold_ppm),
+	PCC_PARAM(loss_slope),
+	PCC_PARAM(coupling),
+	PCC_PARAM(bw_model),
+	PCC_PARAM(bw_window_rtts),
+	PCC_PARAM(bw_bound_percent),
+	PCC_PARAM(equilibrium_decisions),
+	PCC_PARAM(equilibrium_probe_mis),
+	PCC_PARAM(equilibrium_change_percent),
+	PCC_PARAM(equilibrium_loss_ppm),
+	PCC_PARAM(deadline_margin_percent),
+	PCC_PARAM(deadline_max_gain),
+	PCC_PARAM(deadline_yield_percent),
+	PCC_PARAM(local_penalty_percent),
+	PCC_PARAM(startup_chirp),
+	PCC_PARAM(chirp_step_percent),
+	PCC_PARAM(chirp_segments),
+	PCC_PARAM(chirp_queue_percent),
+	PCC_PARAM(trace_sample),
+	PCC_PARAM(trace_port),
+	PCC_PARAM(trace_cgroup),
+	PCC_PARAM(rate_notify_percent),
+};
+
+static int *pcc_param_ptr(struct pcc_params *params, int i)
+{
+	return (int *)((char *)params + pcc_params_table[i].offset);
+}
+
+/** the tunables of the namespace as "name value", then its counters summed over the cpus */
+static int pcc_proc_show(struct seq_file *seq, void *v)
+{
+	//single_open_net() keeps the namespace in the private data
+	struct pcc_net *pn = net_generic(seq->private, pcc_net_id);
+	unsigned long sum;
+	int i, cpu;
+
+	for (i = 0; i < ARRAY_SIZE(pcc_params_table); i++) {
+		seq_printf(seq, "%s %d\n", pcc_params_table[i].name, *pcc_param_ptr(pn->params, i));
+	}
+	for (i = 0; i < PCC_MIB_MAX; i++) {
+		sum = 0;
+		for_each_possible_cpu(cpu) {
+			sum += per_cpu_ptr(pn->mib, cpu)->mibs[i];
+		}
+		seq_printf(seq, "%s %lu\n", pcc_mib_names[i], sum);
+	}
+	return 0;
+}
+
+static int pcc_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, pcc_proc_show);
+}
+
+/** takes "name value" for a tunable of the namespace, its sockets use the value from then on */
+static ssize_t pcc_proc_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct net *net = ((struct seq_file *)file->private_data)->private;
+	struct pcc_net *pn = net_generic(net, pcc_net_id);
+	char line[64], name[32];
+	size_t len = min_t(size_t, count, sizeof(line) - 1);
+	int i, value;
+
+	if (!ns_capable(net->user_ns, CAP_NET_ADMIN)) {
+		return -EPERM;
+	}
+	if (copy_from_user(line, buf, len)) {
+		return -EFAULT;
+	}
+	line[len] = '\0';
+	if (sscanf(line, "%31s %d", name, &value) != 2) {
+		return -EINVAL;
+	}
+	for (i = 0; i < ARRAY_SIZE(pcc_params_table); i++) {
+		if (strcmp(name, pcc_params_table[i].name) == 0) {
+			*pcc_param_ptr(pn->params, i) = value;
+			return count;
+		}
+	}
+	return -EINVAL;
+}
+
+static const struct file_operations pcc_proc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= pcc_proc_open,
+	.read		= seq_read,
+	.write		= pcc_proc_write,
+	.llseek		= seq_lseek,
+	.release	= single_release_net,
+};
+
+/** the deadlines of the namespace no socket took yet, as "saddr sport daddr dport bytes ms_left" */
+static int pcc_deadlines_show(struct seq_file *seq, void *v)
+{
+	struct pcc_net *pn = net_generic(seq->private, pcc_net_id);
+	u64 now = ktime_get_ns();
+	int i;
+
+	spin_lock_bh(&pn->deadlines_lock);
+	for (i = 0; i < DEADLINES_NUMBER; i++) {
+		struct pcc_deadline *e = pn->deadlines + i;
+
+		if (!e->used || now >= e->deadline_ns) {
+			continue;
+		}
+		if (e->family == AF_INET) {
+			seq_printf(seq, "%pI4 %u %pI4 %u", e->saddr, ntohs(e->sport), e->daddr, ntohs(e->dport));
+		} else {
+			seq_printf(seq, "%pI6c %u %pI6c %u", e->saddr, ntohs(e->sport), e->daddr, ntohs(e->dport));
+		}
+		seq_printf(seq, " %llu %llu\n", e->bytes, div_u64(e->deadline_ns - now, NSEC_PER_MSEC));
+	}
+	spin_unlock_bh(&pn->deadlines_lock);
+	return 0;
+}
+
+static int pcc_deadlines_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, pcc_deadlines_show);
+}
+
+/**
+ * takes a deadline as "saddr sport daddr dport bytes deadline_ms", the
+ * 4-tuple as the sender sees it and the deadline from now. The file is
+ * the one of the socket's namespace, /proc/net/pcc_deadlines from inside it
+ */
+static ssize_t pcc_deadlines_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct net *net = ((struct seq_file *)file->private_data)->private;
+	char line[160], saddr[INET6_ADDRSTRLEN], daddr[INET6_ADDRSTRLEN];
+	size_t len = min_t(size_t, count, sizeof(line) - 1);
+	struct pcc_deadline d;
+	u16 sport, dport;
+	u64 bytes;
+	u32 deadline_ms;
+	int err;
+
+	if (!ns_capable(net->user_ns, CAP_NET_ADMIN)) {
+		return -EPERM;
+	}
+	if (copy_from_user(line, buf, len)) {
+		return -EFAULT;
+	}
+	line[len] = '\0';
+	if (sscanf(line, "%45s %hu %45s %hu %llu %u", saddr, &sport, daddr, &dport, &bytes, &deadline_ms) != 6) {
+		return -EINVAL;
+	}
+
+	memset(&d, 0, sizeof(d));
+	if (in4_pton(saddr, -1, d.saddr, -1, NULL) && in4_pton(daddr, -1, d.daddr, -1, NULL)) {
+		d.family = AF_INET;
+	} else if (in6_pton(saddr, -1, d.saddr, -1, NULL) && in6_pton(daddr, -1, d.daddr, -1, NULL)) {
+		d.family = AF_INET6;
+	} else {
+		return -EINVAL;
+	}
+	d.sport = htons(sport);
+	d.dport = htons(dport);
+	d.bytes = bytes;
+	d.deadline_ns = ktime_get_ns() + (u64)deadline_ms * NSEC_PER_MSEC;
+	err = deadline_add(net_generic(net, pcc_net_id), &d);
+	return err ? err : count;
+}
+
+static const struct file_operations pcc_deadlines_fops = {
+	.owner		= THIS_MODULE,
+	.open		= pcc_deadlines_open,
+	.read		= seq_read,
+	.write		= pcc_deadlines_write,
+	.llseek		= seq_lseek,
+	.release	= single_release_net,
+};
+
+#endif
+
+static int __net_init pcc_net_init(struct net *net)
+{
+	struct pcc_net *pn = net_generic(net, pcc_net_id);
+
+	pn->mib = alloc_percpu(struct pcc_mib);
+	if (!pn->mib) {
+		return -ENOMEM;
+	}
+	pn->coupling_groups = vzalloc(COUPLING_GROUPS * sizeof(struct coupling_group));
+	if (!pn->coupling_groups) {
+		goto free_mib;
+	}
+	pn->own = pcc_defaults;
+	pn->params = net_eq(net, &init_net) ? &pcc_defaults : &pn->own;
+	spin_lock_init(&pn->deadlines_lock);
+	spin_lock_init(&pn->coupling_lock);
+#ifndef PCC_BENCH
+	if (!proc_create_data("pcc", 0644, net->proc_net, &pcc_proc_fops, NULL)) {
+		goto free_groups;
+	}
+	if (!proc_create_data("pcc_deadlines", 0600, net->proc_net, &pcc_deadlines_fops, NULL)) {
+		remove_proc_entry("pcc", net->proc_net);
+		goto free_groups;
+	}
+#endif
+	return 0;
+
+#ifndef PCC_BENCH
+free_groups:
+	vfree(pn->coupling_groups);
+#endif
+free_mib:
+	free_percpu(pn->mib);
+	return -ENOMEM;
+}
+
+static void __net_exit pcc_net_exit(struct net *net)
+{
+	struct pcc_net *pn = net_generic(net, pcc_net_id);
+
+#ifndef PCC_BENCH
+	remove_proc_entry("pcc_deadlines", net->proc_net);
+	remove_proc_entry("pcc", net->proc_net);
+#endif
+	vfree(pn->coupling_groups);
+	free_percpu(pn->mib);
+}
+
+static struct pernet_operations pcc_net_ops = {
+	.init = pcc_net_init,
+	.exit = pcc_net_exit,
+	.id = &pcc_net_id,
+	.size = sizeof(struct pcc_net),
+};
+
+#ifndef PCC_BENCH
 
 static int __init pcctcp_ops_register(void)
 {
+	int ret;
+
 	BUILD_BUG_ON(sizeof(struct pcctcp) > ICSK_CA_PRIV_SIZE);
-	return tcp_register_congestion_control(&pcctcp_ops);
+	BUILD_BUG_ON(sizeof(struct tcp_pcc_info) > sizeof(union tcp_cc_info));
+	//the namespaces have their counters before any socket can count in them
+	ret = register_pernet_subsys(&pcc_net_ops);
+	if (ret) {
+		return ret;
+	}
+	ret = tcp_register_congestion_control(&pcctcp_ops);
+	if (ret) {
+		unregister_pernet_subsys(&pcc_net_ops);
+		return ret;
+	}
+	pcc_debugfs_init();
+	return 0;
 }
 
 static void __exit pcctcp_ops_unregister(void)
 {
 	tcp_unregister_congestion_control(&pcctcp_ops);
+	unregister_pernet_subsys(&pcc_net_ops);
+	debugfs_remove_recursive(pcc_debugfs_dir);
 }
 
 module_init(pcctcp_ops_register);
@@ -639,3 +2236,5 @@ MODULE_AUTHOR("Tomer Gilad");
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("PCC TCP");
 MODULE_VERSION("1.0");
+
+#endif
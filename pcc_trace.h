@@ -0,0 +1,60 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pcc
+
+#if !defined(_PCC_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _PCC_TRACE_H_
+
+/*
+ * Tracepoints of the PCC module, under events/pcc in tracefs. A BPF program
+ * attached to one (perf_event_open on its id) can pick the sockets it wants
+ * by skaddr or ports and pass the events on to the application.
+ */
+
+#include <linux/tracepoint.h>
+
+/*
+ * the base rate moved rate_notify_percent or more from the rate of the last
+ * event of the socket. TCP_CC_INFO reads the same rates at any time.
+ */
+TRACE_EVENT(pcc_rate_change,
+
+	TP_PROTO(const struct sock *sk, u32 trace_id, u64 old_rate, u64 rate, u64 actual_rate, int state),
+
+	TP_ARGS(sk, trace_id, old_rate, rate, actual_rate, state),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u32, trace_id)
+		__field(u16, sport)
+		__field(u16, dport)
+		__field(u64, old_rate)
+		__field(u64, rate)
+		__field(u64, actual_rate)
+		__field(int, state)
+	),
+
+	TP_fast_assign(
+		const struct inet_sock *inet = inet_sk(sk);
+
+		__entry->skaddr = sk;
+		__entry->trace_id = trace_id;
+		__entry->sport = ntohs(inet->inet_sport);
+		__entry->dport = ntohs(inet->inet_dport);
+		__entry->old_rate = old_rate;
+		__entry->rate = rate;
+		__entry->actual_rate = actual_rate;
+		__entry->state = state;
+	),
+
+	TP_printk("skaddr=%p id=%08x sport=%u dport=%u old_rate=%llu rate=%llu actual_rate=%llu state=%d",
+		__entry->skaddr, __entry->trace_id, __entry->sport, __entry->dport, __entry->old_rate,
+		__entry->rate, __entry->actual_rate, __entry->state)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pcc_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,404 @@
+/*
+ * The shim side of the QUIC adapter: keeps the packets of a connection in a
+ * virtual sequence space, maps them to the shim socket the module keeps its
+ * state in, and makes the callbacks the kernel makes, in the order pccsim
+ * makes them.
+ */
+
+#include "kshim/kshim.h"
+#include "linux/inet_diag.h"
+#include "pcc_quic.h"
+
+//the module treats sequence 0 as unset
+#define PCC_QUIC_ISN (1)
+#define PCC_QUIC_INITIAL_CWND (10)
+#define PCC_QUIC_MAX_SACKS (4)
+
+typedef enum {
+	PKT_NONE = 0,					//not ack-eliciting, or never told about
+	PKT_SENT,
+	PKT_ACKED,
+	PKT_LOST,
+} pkt_state_t;
+
+struct pcc_quic_pkt {
+	uint64_t pn;
+	u32 seq;						//virtual sequence of the first byte
+	u32 bytes;
+	pkt_state_t state;
+	uint64_t sent_ns;
+	//delivery rate state when it was sent, as the kernel's skb has it
+	uint64_t delivered;
+	uint64_t delivered_ns;
+	uint64_t first_sent_ns;
+};
+
+struct pcc_quic {
+	struct tcp_sock tp;
+	struct pcc_quic_pkt pkts[PCC_QUIC_WINDOW];
+	uint64_t una_pn;				//lowest packet number still in the scoreboard
+	uint64_t next_pn;				//one above the last packet sent
+	u32 nxt;						//virtual sequence of the next packet
+	u32 out;						//packets in the scoreboard, packets_out
+	u32 sacked;
+	u32 lost;
+	uint64_t inflight_bytes;
+	uint64_t sent;					//ack-eliciting packets sent, data_segs_out
+	uint64_t lost_total;			//packets declared lost, their data was resent
+	uint64_t bytes_acked;
+	uint64_t delivered;
+	uint64_t delivered_ns;
+	uint64_t first_sent_ns;
+	int losses;						//declared lost since the last ack
+	u32 srtt_us;
+	int in_recovery;
+	u32 recovery_point;
+	u32 cwr_point;
+};
+
+struct tcp_congestion_ops *pcc_module_ops(void);
+
+static struct sock *sk_of(struct pcc_quic *pq)
+{
+	return (struct sock *)&pq->tp;
+}
+
+static struct pcc_quic_pkt *pkt_of(struct pcc_quic *pq, uint64_t pn)
+{
+	struct pcc_quic_pkt *p = pq->pkts + (pn & (PCC_QUIC_WINDOW - 1));
+
+	if (pn < pq->una_pn || pn >= pq->next_pn || p->pn != pn) {
+		return NULL;
+	}
+	return p;
+}
+
+/** moves the lowest outstanding packet up over the acked ones, and over the lost ones if lost is set */
+static void advance_una(struct pcc_quic *pq, int lost)
+{
+	while (pq->una_pn < pq->next_pn) {
+		struct pcc_quic_pkt *p = pq->pkts + (pq->una_pn & (PCC_QUIC_WINDOW - 1));
+
+		if (p->pn == pq->una_pn && p->state != PKT_NONE) {
+			if (p->state == PKT_SENT || (p->state == PKT_LOST && !lost)) {
+				break;
+			}
+			pq->out--;
+			if (p->state == PKT_ACKED) {
+				pq->sacked--;
+			} else {
+				pq->lost--;
+			}
+		}
+		pq->una_pn++;
+	}
+}
+
+static u32 snd_una(struct pcc_quic *pq)
+{
+	struct pcc_quic_pkt *p = pkt_of(pq, pq->una_pn);
+
+	return p ? p->seq : pq->nxt;
+}
+
+/** the acked ranges above the lowest outstanding packet, the highest last, as sack blocks */
+static int sack_blocks(struct pcc_quic *pq, struct tcp_sack_block *blocks)
+{
+	struct tcp_sack_block ranges[PCC_QUIC_MAX_SACKS];
+	uint64_t pn;
+	int n = 0, open = 0;
+
+	if (!pq->sacked) {
+		return 0;
+	}
+	//keeps the last PCC_QUIC_MAX_SACKS ranges in a ring
+	for (pn = pq->una_pn; pn < pq->next_pn; pn++) {
+		struct pcc_quic_pkt *p = pkt_of(pq, pn);
+		struct tcp_sack_block *r;
+
+		if (!p || p->state == PKT_NONE) {
+			continue;
+		}
+		if (p->state != PKT_ACKED) {
+			open = 0;
+			continue;
+		}
+		if (open) {
+			ranges[(n - 1) % PCC_QUIC_MAX_SACKS].end_seq = p->seq + p->bytes;
+			continue;
+		}
+		r = ranges + n % PCC_QUIC_MAX_SACKS;
+		r->start_seq = p->seq;
+		r->end_seq = p->seq + p->bytes;
+		n++;
+		open = 1;
+	}
+	if (n > PCC_QUIC_MAX_SACKS) {
+		int i;
+
+		for (i = 0; i < PCC_QUIC_MAX_SACKS; i++) {
+			blocks[i] = ranges[(n + i) % PCC_QUIC_MAX_SACKS];
+		}
+		return PCC_QUIC_MAX_SACKS;
+	}
+	memcpy(blocks, ranges, n * sizeof(*blocks));
+	return n;
+}
+
+static void sync_tcp_sock(struct pcc_quic *pq, uint64_t now_ns)
+{
+	struct tcp_sock *tp = &pq->tp;
+	struct tcp_sack_block blocks[PCC_QUIC_MAX_SACKS];
+
+	kshim_now_ns = now_ns;
+	tp->snd_una = snd_una(pq);
+	tp->snd_nxt = pq->nxt;
+	tp->srtt_us = pq->srtt_us << 3;
+	tp->packets_out = pq->out;
+	tp->sacked_out = pq->sacked;
+	tp->lost_out = pq->lost;
+	tp->data_segs_out = pq->sent;
+	tp->total_retrans = pq->lost_total;
+	tp->bytes_acked = pq->bytes_acked;
+	//the blocks come out in sequence order, as the kernel keeps them
+	memset(blocks, 0, sizeof(blocks));
+	sack_blocks(pq, blocks);
+	memcpy(tp->recv_sack_cache, blocks, sizeof(blocks));
+}
+
+static void set_addr(__be32 *addr, __be16 *port, const struct sockaddr *sa)
+{
+	const struct sockaddr_in *sin = (const struct sockaddr_in *)sa;
+
+	if (sa && sa->sa_family == AF_INET) {
+		*addr = sin->sin_addr.s_addr;
+		*port = sin->sin_port;
+	}
+}
+
+struct pcc_quic *pcc_quic_new(uint64_t now_ns, uint32_t max_datagram, const struct sockaddr *local,
+	const struct sockaddr *peer)
+{
+	struct pcc_quic *pq = calloc(1, sizeof(*pq));
+	struct inet_sock *inet;
+
+	if (!pq) {
+		return NULL;
+	}
+	inet = &pq->tp.inet_conn.icsk_inet;
+	inet->sk.sk_family = AF_INET;
+	set_addr(&inet->inet_saddr, &inet->inet_sport, local);
+	set_addr(&inet->inet_daddr, &inet->inet_dport, peer);
+	pq->tp.snd_cwnd = PCC_QUIC_INITIAL_CWND;
+	pq->tp.advmss = max_datagram;
+	pq->tp.mss_cache = max_datagram;
+	pq->nxt = PCC_QUIC_ISN;
+	sync_tcp_sock(pq, now_ns);
+	pcc_module_ops()->init(sk_of(pq));
+	return pq;
+}
+
+void pcc_quic_free(struct pcc_quic *pq)
+{
+	if (!pq) {
+		return;
+	}
+	pcc_module_ops()->release(sk_of(pq));
+	free(pq);
+}
+
+int pcc_quic_on_packet_sent(struct pcc_quic *pq, uint64_t now_ns, uint64_t pn, uint32_t bytes)
+{
+	struct pcc_quic_pkt *p;
+
+	if (!pq->next_pn) {
+		pq->una_pn = pn;
+		pq->next_pn = pn;
+	}
+	if (pn < pq->next_pn || pn - pq->una_pn >= PCC_QUIC_WINDOW) {
+		return -1;
+	}
+	//the delivery rate sample starts over after an idle period
+	if (!pq->inflight_bytes) {
+		pq->first_sent_ns = now_ns;
+		pq->delivered_ns = now_ns;
+	}
+	p = pq->pkts + (pn & (PCC_QUIC_WINDOW - 1));
+	p->pn = pn;
+	p->seq = pq->nxt;
+	p->bytes = bytes;
+	p->state = PKT_SENT;
+	p->sent_ns = now_ns;
+	p->delivered = pq->delivered;
+	p->delivered_ns = pq->delivered_ns;
+	p->first_sent_ns = pq->first_sent_ns;
+	pq->next_pn = pn + 1;
+	pq->nxt += bytes;
+	pq->out++;
+	pq->sent++;
+	pq->inflight_bytes += bytes;
+	return 0;
+}
+
+void pcc_quic_on_loss(struct pcc_quic *pq, uint64_t now_ns, const uint64_t *lost, int n)
+{
+	int i, losses = 0;
+
+	for (i = 0; i < n; i++) {
+		struct pcc_quic_pkt *p = pkt_of(pq, lost[i]);
+
+		if (!p || p->state != PKT_SENT) {
+			continue;
+		}
+		p->state = PKT_LOST;
+		pq->lost++;
+		pq->lost_total++;
+		pq->inflight_bytes -= p->bytes;
+		losses++;
+	}
+	pq->losses += losses;
+	if (losses && !pq->in_recovery) {
+		sync_tcp_sock(pq, now_ns);
+		pq->in_recovery = 1;
+		pq->recovery_point = pq->nxt;
+		pcc_module_ops()->ssthresh(sk_of(pq));
+	}
+}
+
+void pcc_quic_on_ack(struct pcc_quic *pq, uint64_t now_ns, const uint64_t *acked, int n, int32_t rtt_us,
+	uint32_t srtt_us)
+{
+	struct tcp_congestion_ops *ops = pcc_module_ops();
+	struct pcc_quic_pkt *latest = NULL;
+	u32 prior_in_flight = pq->out - pq->sacked - pq->lost;
+	struct ack_sample as;
+	struct rate_sample rs;
+	int i, newly = 0;
+
+	for (i = 0; i < n; i++) {
+		struct pcc_quic_pkt *p = pkt_of(pq, acked[i]);
+
+		if (!p || p->state == PKT_ACKED || p->state == PKT_NONE) {
+			continue;
+		}
+		//a packet declared lost can still be acked, the loss was spurious
+		if (p->state == PKT_LOST) {
+			pq->lost--;
+		} else {
+			pq->inflight_bytes -= p->bytes;
+		}
+		p->state = PKT_ACKED;
+		pq->sacked++;
+		pq->bytes_acked += p->bytes;
+		pq->delivered++;
+		pq->delivered_ns = now_ns;
+		newly++;
+		if (!latest || p->sent_ns > latest->sent_ns || (p->sent_ns == latest->sent_ns && p->pn > latest->pn)) {
+			latest = p;
+		}
+	}
+	if (srtt_us) {
+		pq->srtt_us = srtt_us;
+	}
+
+	memset(&rs, 0, sizeof(rs));
+	rs.rtt_us = rtt_us;
+	rs.losses = pq->losses;
+	rs.acked_sacked = newly;
+	rs.prior_in_flight = prior_in_flight;
+	if (latest) {
+		uint64_t send_elapsed = latest->sent_ns - latest->first_sent_ns;
+		uint64_t ack_elapsed = now_ns - latest->delivered_ns;
+
+		rs.prior_mstamp = latest->delivered_ns / NSEC_PER_USEC;
+		rs.prior_delivered = latest->delivered;
+		rs.delivered = pq->delivered - latest->delivered;
+		rs.interval_us = (send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed) / NSEC_PER_USEC;
+		pq->first_sent_ns = latest->sent_ns;
+	}
+	pq->losses = 0;
+
+	//the holes of lost packets stay below the sacks until the module saw them
+	advance_una(pq, 0);
+	sync_tcp_sock(pq, now_ns);
+	if (pq->in_recovery && !before(pq->tp.snd_una, pq->recovery_point)) {
+		pq->in_recovery = 0;
+	}
+	if (pq->tp.inet_conn.icsk_ca_state == TCP_CA_CWR && !before(pq->tp.snd_una, pq->cwr_point)) {
+		pq->tp.inet_conn.icsk_ca_state = TCP_CA_Open;
+		if (ops->set_state) {
+			ops->set_state(sk_of(pq), TCP_CA_Open);
+		}
+	}
+
+	memset(&as, 0, sizeof(as));
+	as.pkts_acked = newly;
+	as.rtt_us = rtt_us;
+	as.in_flight = prior_in_flight;
+	if (ops->in_ack_event) {
+		ops->in_ack_event(sk_of(pq), 0);
+	}
+	if (newly && ops->pkts_acked) {
+		ops->pkts_acked(sk_of(pq), &as);
+	}
+	if (ops->cong_control) {
+		ops->cong_control(sk_of(pq), &rs);
+	}
+	advance_una(pq, 1);
+}
+
+void pcc_quic_on_local_drop(struct pcc_quic *pq, uint64_t now_ns)
+{
+	struct tcp_congestion_ops *ops = pcc_module_ops();
+
+	if (pq->tp.inet_conn.icsk_ca_state >= TCP_CA_CWR) {
+		return;
+	}
+	sync_tcp_sock(pq, now_ns);
+	pq->tp.inet_conn.icsk_ca_state = TCP_CA_CWR;
+	pq->cwr_point = pq->nxt;
+	if (ops->set_state) {
+		ops->set_state(sk_of(pq), TCP_CA_CWR);
+	}
+}
+
+uint64_t pcc_quic_pacing_rate(const struct pcc_quic *pq)
+{
+	return pq->tp.inet_conn.icsk_inet.sk.sk_pacing_rate;
+}
+
+uint64_t pcc_quic_cwnd(const struct pcc_quic *pq)
+{
+	uint64_t cwnd = (uint64_t)pq->tp.snd_cwnd * pq->tp.mss_cache;
+	//the scoreboard must not wrap, every packet in it can be a full datagram
+	uint64_t room = (uint64_t)(PCC_QUIC_WINDOW - (pq->next_pn - pq->una_pn)) * pq->tp.mss_cache;
+
+	return pq->inflight_bytes + room < cwnd ? pq->inflight_bytes + room : cwnd;
+}
+
+uint64_t pcc_quic_bytes_in_flight(const struct pcc_quic *pq)
+{
+	return pq->inflight_bytes;
+}
+
+void pcc_quic_get_info(struct pcc_quic *pq, struct tcp_pcc_info *info)
+{
+	union tcp_cc_info cc_info;
+	int attr;
+
+	memset(&cc_info, 0, sizeof(cc_info));
+	memset(info, 0, sizeof(*info));
+	if (pcc_module_ops()->get_info(sk_of(pq), 1 << (INET_DIAG_BBRINFO - 1), &attr, &cc_info)) {
+		memcpy(info, &cc_info, sizeof(*info));
+	}
+}
+
+int pcc_quic_param_set(const char *name, const char *value)
+{
+	return kshim_param_set(name, value);
+}
+
+void pcc_quic_seed(uint64_t seed)
+{
+	kshim_seed(seed);
+}
@@ -0,0 +1,64 @@
+#ifndef _PCC_QUIC_H_
+#define _PCC_QUIC_H_
+
+/*
+ * The PCC module built against the kernel shim, behind the pluggable
+ * congestion control interface userspace QUIC stacks have: packet sent,
+ * packets acked, packets lost and the pacing rate. The adapter keeps the
+ * packets it was told about in a virtual TCP sequence space, so the module
+ * sees QUIC packets the way it sees segments: acked packets above the lowest
+ * outstanding one are sack blocks, and the holes a loss leaves are the holes
+ * of a TCP sack scoreboard.
+ *
+ * Only ack-eliciting packets go through the adapter, packet numbers must
+ * grow, and the stack must keep the bytes in flight under pcc_quic_cwnd().
+ * Calls are not thread safe, every connection must be driven by one thread.
+ */
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "../pcc_info.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* packets the adapter tracks between the lowest outstanding and the next one */
+#define PCC_QUIC_WINDOW (1 << 16)
+
+struct pcc_quic;
+
+/** a new connection with the module's init called, the addresses only pick the trace and coupling of the socket */
+struct pcc_quic *pcc_quic_new(uint64_t now_ns, uint32_t max_datagram, const struct sockaddr *local,
+	const struct sockaddr *peer);
+void pcc_quic_free(struct pcc_quic *pq);
+/** an ack-eliciting packet of bytes bytes left, returns -1 if pn is not above the last or is past the window */
+int pcc_quic_on_packet_sent(struct pcc_quic *pq, uint64_t now_ns, uint64_t pn, uint32_t bytes);
+/**
+ * an ack frame newly acked the packets acked, with the latest rtt sample of
+ * the ack (-1 if it gave none) and the smoothed rtt. Losses the ack revealed
+ * are given to pcc_quic_on_loss before, as RFC 9002 orders them.
+ */
+void pcc_quic_on_ack(struct pcc_quic *pq, uint64_t now_ns, const uint64_t *acked, int n, int32_t rtt_us,
+	uint32_t srtt_us);
+/** the loss detection declared the packets lost lost, their data goes out again in new packets */
+void pcc_quic_on_loss(struct pcc_quic *pq, uint64_t now_ns, const uint64_t *lost, int n);
+/** the socket refused a datagram (EAGAIN, ENOBUFS), a local drop like a qdisc drop of the kernel */
+void pcc_quic_on_local_drop(struct pcc_quic *pq, uint64_t now_ns);
+/** pacing rate the module set, bytes per second */
+uint64_t pcc_quic_pacing_rate(const struct pcc_quic *pq);
+/** bytes the stack may have in flight, the module's window bounded by the adapter's */
+uint64_t pcc_quic_cwnd(const struct pcc_quic *pq);
+uint64_t pcc_quic_bytes_in_flight(const struct pcc_quic *pq);
+/** what TCP_CC_INFO gives for a kernel socket */
+void pcc_quic_get_info(struct pcc_quic *pq, struct tcp_pcc_info *info);
+/** sets a module parameter, returns -1 if it is unknown or bad */
+int pcc_quic_param_set(const char *name, const char *value);
+void pcc_quic_seed(uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
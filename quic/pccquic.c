@@ -0,0 +1,1014 @@
+/*
+ * pccquic: a QUIC test pair, the sender's congestion control being the PCC
+ * module through the QUIC adapter, so QUIC flows run the controller the
+ * kernel runs for TCP, over loopback or the netns test bed.
+ *
+ * The wire format is QUIC's (RFC 9000): short header packets with a
+ * connection id, STREAM frames carrying the data, ACK frames with ranges and
+ * CONNECTION_CLOSE. There is no handshake and no packet protection, so the
+ * packet number goes out in full as a varint. The sender does the RFC 9002
+ * loss detection (packet and time thresholds, PTO probes) and resends the
+ * stream data of lost packets in new ones. The receiver acks every second
+ * ack-eliciting packet, at once on a gap, and at most max_ack_delay later.
+ * Output lines are pccperf's, so its tools read them.
+ *
+ * receiver: pccquic -s [-p port]
+ * sender:   pccquic -c host [-p port] [-P flows] [-t seconds] [-i interval_ms]
+ *                   [-m datagram_bytes] [-o param=value]... [-v]
+ * -o sets a module parameter of the sender, -v prints the module's debug output.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "pcc_quic.h"
+
+#define DEFAULT_PORT "4433"
+#define MAX_FLOWS (64)
+#define MAX_CONNS (256)
+#define CID_LEN (8)
+#define MAX_DATAGRAM (1472)
+#define DEFAULT_DATAGRAM (1200)
+#define HEADER_FORM_SHORT (0x40)
+#define FRAME_PADDING (0x00)
+#define FRAME_PING (0x01)
+#define FRAME_ACK (0x02)
+#define FRAME_STREAM (0x0e)					//with the offset and length fields
+#define FRAME_CONNECTION_CLOSE (0x1c)
+#define MAX_ACK_RANGES (32)
+#define ACK_EVERY (2)
+#define MAX_ACK_DELAY_US (25000)
+#define ACK_DELAY_EXPONENT (3)
+#define PACKET_THRESHOLD (3)
+#define GRANULARITY_NS (1000000ULL)
+#define INITIAL_RTT_US (333000)
+//the pacing credit a late timer can leave, fq gives a flow about as much
+#define PACING_SLACK_NS (500000ULL)
+#define MAX_SENDS_PER_LOOP (64)
+#define CONN_IDLE_NS (10000000000ULL)
+#define CLOSE_REPEAT (3)
+
+typedef enum {
+	PKT_FREE = 0,
+	PKT_IN_FLIGHT,
+	PKT_ACKED,
+	PKT_LOST,
+} pkt_state_t;
+
+struct sent_pkt {
+	uint64_t pn;
+	uint64_t sent_ns;
+	uint64_t offset;					//stream data the packet carried
+	uint32_t len;
+	uint32_t bytes;						//datagram size
+	pkt_state_t state;
+};
+
+struct chunk {
+	uint64_t offset;
+	uint32_t len;
+};
+
+struct flow {
+	int fd;
+	uint8_t cid[CID_LEN];
+	struct pcc_quic *cc;
+	struct sent_pkt *sent;				//ring of PCC_QUIC_WINDOW packets
+	uint64_t *acked;					//newly acked packet numbers of an ack
+	uint64_t *lost;						//newly lost packet numbers
+	uint64_t next_pn;
+	uint64_t lowest_in_flight;			//where the loss detection starts
+	uint64_t largest_acked;
+	int has_acked;
+	uint64_t next_offset;
+	struct chunk *retransmit;			//stream data of lost packets, to send again
+	uint64_t retransmit_head;
+	uint64_t retransmit_tail;
+	uint32_t latest_rtt_us;
+	uint32_t min_rtt_us;
+	uint32_t srtt_us;
+	uint32_t rttvar_us;
+	int has_rtt;
+	uint64_t loss_time_ns;				//when the time threshold declares the next packet lost, 0 for none
+	uint64_t last_eliciting_ns;			//last ack-eliciting packet sent, the PTO runs from it
+	int pto_count;
+	uint64_t next_send_ns;
+	int blocked;						//the socket refused a packet, sending waits for POLLOUT
+	uint64_t bytes_acked;				//stream bytes
+	uint64_t last_bytes_acked;
+	uint64_t packets_lost;
+	uint64_t acks;
+	uint64_t local_drops;
+};
+
+struct ack_range {
+	uint64_t lo;
+	uint64_t hi;
+};
+
+struct conn {
+	int used;
+	int id;
+	uint8_t cid[CID_LEN];
+	struct sockaddr_storage peer;
+	socklen_t peer_len;
+	struct ack_range ranges[MAX_ACK_RANGES];	//received packet numbers, highest first
+	int nranges;
+	uint64_t largest_recv_ns;
+	uint64_t next_pn;
+	int unacked;						//ack-eliciting packets since the last ack
+	uint64_t ack_deadline_ns;			//0 if no ack is pending
+	uint64_t start_ns;
+	uint64_t last_ns;
+	uint64_t received;
+	uint64_t last_received;
+	uint64_t last_report_ns;
+};
+
+static const char *host;
+static const char *port = DEFAULT_PORT;
+static int flows_number = 1;
+static int duration_sec = 10;
+static int interval_ms = 1000;
+static uint32_t datagram = DEFAULT_DATAGRAM;
+static volatile sig_atomic_t stop;
+
+static struct flow flows[MAX_FLOWS];
+static struct conn conns[MAX_CONNS];
+static const uint8_t zeros[MAX_DATAGRAM];
+
+extern int kshim_verbose;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s -s [-p port]\n"
+		"       %s -c host [-p port] [-P flows] [-t seconds] [-i interval_ms]\n"
+		"          [-m datagram_bytes] [-o param=value]... [-v]\n", name, name);
+	exit(1);
+}
+
+static double cpu_seconds(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static int varint_len(uint64_t v)
+{
+	return v < (1ULL << 6) ? 1 : v < (1ULL << 14) ? 2 : v < (1ULL << 30) ? 4 : 8;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+	int len = varint_len(v), i;
+	static const uint8_t prefix[9] = { 0, 0x00, 0x40, 0, 0x80, 0, 0, 0, 0xc0 };
+
+	for (i = len - 1; i >= 0; i--) {
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+	p[0] |= prefix[len];
+	return p + len;
+}
+
+/** reads a varint, NULL if the packet ends before it does */
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	int len, i;
+
+	if (p >= end) {
+		return NULL;
+	}
+	len = 1 << (p[0] >> 6);
+	if (end - p < len) {
+		return NULL;
+	}
+	*v = p[0] & 0x3f;
+	for (i = 1; i < len; i++) {
+		*v = (*v << 8) | p[i];
+	}
+	return p + len;
+}
+
+static uint8_t *put_header(uint8_t *p, const uint8_t *cid, uint64_t pn)
+{
+	*p++ = HEADER_FORM_SHORT;
+	memcpy(p, cid, CID_LEN);
+	return put_varint(p + CID_LEN, pn);
+}
+
+static const uint8_t *get_header(const uint8_t *p, const uint8_t *end, uint8_t *cid, uint64_t *pn)
+{
+	if (end - p < 1 + CID_LEN || p[0] != HEADER_FORM_SHORT) {
+		return NULL;
+	}
+	memcpy(cid, p + 1, CID_LEN);
+	return get_varint(p + 1 + CID_LEN, end, pn);
+}
+
+static struct sent_pkt *sent_of(struct flow *f, uint64_t pn)
+{
+	struct sent_pkt *s = f->sent + (pn & (PCC_QUIC_WINDOW - 1));
+
+	return s->state != PKT_FREE && s->pn == pn ? s : NULL;
+}
+
+static void retransmit_push(struct flow *f, uint64_t offset, uint32_t len)
+{
+	struct chunk *c = f->retransmit + (f->retransmit_tail++ & (2 * PCC_QUIC_WINDOW - 1));
+
+	c->offset = offset;
+	c->len = len;
+}
+
+static uint64_t pto_ns(struct flow *f)
+{
+	uint64_t rttvar4 = (uint64_t)f->rttvar_us * 4 * 1000;
+
+	return ((uint64_t)f->srtt_us * 1000 + (rttvar4 > GRANULARITY_NS ? rttvar4 : GRANULARITY_NS) +
+		MAX_ACK_DELAY_US * 1000ULL) << f->pto_count;
+}
+
+/** sends one packet of stream data, retransmissions first, returns -1 if the socket refused it */
+static int send_packet(struct flow *f, uint64_t now)
+{
+	uint8_t buf[MAX_DATAGRAM], *p;
+	struct sent_pkt *s;
+	uint64_t offset;
+	uint32_t len, room;
+	ssize_t ret;
+
+	p = put_header(buf, f->cid, f->next_pn);
+	if (f->retransmit_head != f->retransmit_tail) {
+		struct chunk *c = f->retransmit + (f->retransmit_head & (2 * PCC_QUIC_WINDOW - 1));
+
+		offset = c->offset;
+		room = datagram - (p - buf) - 1 - 1 - varint_len(offset) - 2;
+		len = c->len < room ? c->len : room;
+		c->offset += len;
+		c->len -= len;
+		if (!c->len) {
+			f->retransmit_head++;
+		}
+	} else {
+		offset = f->next_offset;
+		room = datagram - (p - buf) - 1 - 1 - varint_len(offset) - 2;
+		len = room;
+		f->next_offset += len;
+	}
+	*p++ = FRAME_STREAM;
+	p = put_varint(p, 0);
+	p = put_varint(p, offset);
+	//the length always takes two bytes, so the room above is right
+	*p++ = 0x40 | (len >> 8);
+	*p++ = len & 0xff;
+	memcpy(p, zeros, len);
+	p += len;
+
+	ret = send(f->fd, buf, p - buf, MSG_DONTWAIT);
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == ENOBUFS) {
+			f->local_drops++;
+			f->blocked = 1;
+			pcc_quic_on_local_drop(f->cc, now);
+		}
+		retransmit_push(f, offset, len);
+		return -1;
+	}
+
+	s = f->sent + (f->next_pn & (PCC_QUIC_WINDOW - 1));
+	s->pn = f->next_pn;
+	s->sent_ns = now;
+	s->offset = offset;
+	s->len = len;
+	s->bytes = p - buf;
+	s->state = PKT_IN_FLIGHT;
+	pcc_quic_on_packet_sent(f->cc, now, f->next_pn, s->bytes);
+	f->next_pn++;
+	f->last_eliciting_ns = now;
+	return 0;
+}
+
+static void update_rtt(struct flow *f, uint32_t latest_us, uint32_t ack_delay_us)
+{
+	uint32_t adjusted = latest_us;
+
+	f->latest_rtt_us = latest_us;
+	if (!f->has_rtt) {
+		f->has_rtt = 1;
+		f->min_rtt_us = latest_us;
+		f->srtt_us = latest_us;
+		f->rttvar_us = latest_us / 2;
+		return;
+	}
+	if (latest_us < f->min_rtt_us) {
+		f->min_rtt_us = latest_us;
+	}
+	if (ack_delay_us > MAX_ACK_DELAY_US) {
+		ack_delay_us = MAX_ACK_DELAY_US;
+	}
+	if (latest_us >= f->min_rtt_us + ack_delay_us) {
+		adjusted = latest_us - ack_delay_us;
+	}
+	f->rttvar_us = (3 * (uint64_t)f->rttvar_us + (f->srtt_us > adjusted ? f->srtt_us - adjusted : adjusted - f->srtt_us)) / 4;
+	f->srtt_us = (7 * (uint64_t)f->srtt_us + adjusted) / 8;
+}
+
+/** the packet and time thresholds of RFC 9002, tells the adapter of the packets lost */
+static void detect_losses(struct flow *f, uint64_t now)
+{
+	uint32_t rtt_us = f->latest_rtt_us > f->srtt_us ? f->latest_rtt_us : f->srtt_us;
+	uint64_t loss_delay = (uint64_t)rtt_us * 1000 * 9 / 8;
+	uint64_t pn;
+	int n = 0;
+
+	if (loss_delay < GRANULARITY_NS) {
+		loss_delay = GRANULARITY_NS;
+	}
+	f->loss_time_ns = 0;
+	if (!f->has_acked) {
+		return;
+	}
+	for (pn = f->lowest_in_flight; pn < f->largest_acked; pn++) {
+		struct sent_pkt *s = sent_of(f, pn);
+
+		if (!s || s->state != PKT_IN_FLIGHT) {
+			continue;
+		}
+		if (s->sent_ns + loss_delay <= now || f->largest_acked >= pn + PACKET_THRESHOLD) {
+			s->state = PKT_LOST;
+			retransmit_push(f, s->offset, s->len);
+			f->lost[n++] = pn;
+			f->packets_lost++;
+		} else if (!f->loss_time_ns || s->sent_ns + loss_delay < f->loss_time_ns) {
+			f->loss_time_ns = s->sent_ns + loss_delay;
+		}
+	}
+	while (f->lowest_in_flight < f->next_pn &&
+		(!sent_of(f, f->lowest_in_flight) || sent_of(f, f->lowest_in_flight)->state != PKT_IN_FLIGHT)) {
+		f->lowest_in_flight++;
+	}
+	if (n) {
+		pcc_quic_on_loss(f->cc, now, f->lost, n);
+	}
+}
+
+static void on_ack_frame(struct flow *f, uint64_t now, uint64_t largest, uint64_t ack_delay,
+	const struct ack_range *ranges, int nranges)
+{
+	struct sent_pkt *largest_sent = sent_of(f, largest);
+	int32_t rtt_us = -1;
+	uint64_t pn;
+	int i, n = 0;
+
+	if (largest >= f->next_pn) {
+		return;
+	}
+	f->acks++;
+	if (largest_sent && largest_sent->state == PKT_IN_FLIGHT) {
+		rtt_us = (now - largest_sent->sent_ns) / 1000;
+		update_rtt(f, rtt_us, ack_delay << ACK_DELAY_EXPONENT);
+	}
+	if (!f->has_acked || largest > f->largest_acked) {
+		f->largest_acked = largest;
+		f->has_acked = 1;
+	}
+	for (i = 0; i < nranges; i++) {
+		pn = ranges[i].lo > f->lowest_in_flight ? ranges[i].lo : f->lowest_in_flight;
+		for (; pn <= ranges[i].hi; pn++) {
+			struct sent_pkt *s = sent_of(f, pn);
+
+			if (!s || s->state == PKT_ACKED) {
+				continue;
+			}
+			//acked after it was declared lost, its data went out twice
+			s->state = PKT_ACKED;
+			f->bytes_acked += s->len;
+			f->acked[n++] = pn;
+		}
+	}
+	if (!n) {
+		return;
+	}
+	f->pto_count = 0;
+	detect_losses(f, now);
+	pcc_quic_on_ack(f->cc, now, f->acked, n, rtt_us, f->srtt_us);
+}
+
+static void on_sender_packet(struct flow *f, const uint8_t *p, const uint8_t *end, uint64_t now)
+{
+	uint8_t cid[CID_LEN];
+	uint64_t pn, type;
+
+	p = get_header(p, end, cid, &pn);
+	if (!p || memcmp(cid, f->cid, CID_LEN)) {
+		return;
+	}
+	while (p && p < end) {
+		p = get_varint(p, end, &type);
+		if (!p) {
+			return;
+		}
+		if (type == FRAME_PADDING || type == FRAME_PING) {
+			continue;
+		}
+		if (type == FRAME_ACK) {
+			struct ack_range ranges[MAX_ACK_RANGES];
+			uint64_t largest, delay, count, first, gap, len, lo;
+			int nranges = 0;
+
+			if (!(p = get_varint(p, end, &largest)) || !(p = get_varint(p, end, &delay)) ||
+				!(p = get_varint(p, end, &count)) || !(p = get_varint(p, end, &first)) || first > largest) {
+				return;
+			}
+			lo = largest - first;
+			ranges[nranges].lo = lo;
+			ranges[nranges++].hi = largest;
+			while (count-- > 0) {
+				if (!(p = get_varint(p, end, &gap)) || !(p = get_varint(p, end, &len)) || gap + len + 2 > lo) {
+					return;
+				}
+				if (nranges < MAX_ACK_RANGES) {
+					ranges[nranges].hi = lo - gap - 2;
+					ranges[nranges].lo = ranges[nranges].hi - len;
+					lo = ranges[nranges++].lo;
+				}
+			}
+			on_ack_frame(f, now, largest, delay, ranges, nranges);
+			continue;
+		}
+		//the receiver sends nothing else
+		return;
+	}
+}
+
+static int connect_flow(struct flow *f, int i)
+{
+	struct addrinfo hints, *res, *ai;
+	struct sockaddr_storage local;
+	socklen_t local_len = sizeof(local);
+	int err, j;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	err = getaddrinfo(host, port, &hints, &res);
+	if (err != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+		return -1;
+	}
+	f->fd = -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		f->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (f->fd < 0) {
+			continue;
+		}
+		if (connect(f->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(f->fd);
+		f->fd = -1;
+	}
+	if (f->fd < 0) {
+		fprintf(stderr, "could not connect to %s:%s\n", host, port);
+		freeaddrinfo(res);
+		return -1;
+	}
+	getsockname(f->fd, (struct sockaddr *)&local, &local_len);
+
+	for (j = 0; j < CID_LEN; j++) {
+		f->cid[j] = rand();
+	}
+	f->cid[0] = i;
+	f->sent = calloc(PCC_QUIC_WINDOW, sizeof(*f->sent));
+	f->acked = calloc(PCC_QUIC_WINDOW, sizeof(*f->acked));
+	f->lost = calloc(PCC_QUIC_WINDOW, sizeof(*f->lost));
+	f->retransmit = calloc(2 * PCC_QUIC_WINDOW, sizeof(*f->retransmit));
+	f->srtt_us = INITIAL_RTT_US;
+	f->rttvar_us = INITIAL_RTT_US / 2;
+	f->cc = pcc_quic_new(now_ns(), datagram, (struct sockaddr *)&local, ai->ai_addr);
+	freeaddrinfo(res);
+	if (!f->sent || !f->acked || !f->lost || !f->retransmit || !f->cc) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+	return 0;
+}
+
+/** sends as the pacing rate and the window allow, and a probe when the PTO fired */
+static void flow_send(struct flow *f, uint64_t now)
+{
+	uint64_t rate = pcc_quic_pacing_rate(f->cc);
+	int i;
+
+	if (f->loss_time_ns && now >= f->loss_time_ns) {
+		detect_losses(f, now);
+	}
+	if (pcc_quic_bytes_in_flight(f->cc) && now >= f->last_eliciting_ns + pto_ns(f)) {
+		f->pto_count++;
+		send_packet(f, now);
+	}
+	for (i = 0; i < MAX_SENDS_PER_LOOP && !f->blocked && now >= f->next_send_ns; i++) {
+		uint64_t gap;
+
+		if (pcc_quic_bytes_in_flight(f->cc) + datagram > pcc_quic_cwnd(f->cc) || send_packet(f, now) < 0) {
+			break;
+		}
+		gap = rate ? (uint64_t)datagram * 1000000000ULL / rate : GRANULARITY_NS;
+		if (f->next_send_ns + PACING_SLACK_NS < now) {
+			f->next_send_ns = now - PACING_SLACK_NS;
+		}
+		f->next_send_ns += gap;
+	}
+}
+
+/** when the flow has something to do next */
+static uint64_t flow_next_event(struct flow *f, uint64_t now)
+{
+	uint64_t next = UINT64_MAX;
+
+	if (!f->blocked && pcc_quic_bytes_in_flight(f->cc) + datagram <= pcc_quic_cwnd(f->cc)) {
+		next = f->next_send_ns;
+	}
+	if (f->loss_time_ns && f->loss_time_ns < next) {
+		next = f->loss_time_ns;
+	}
+	if (pcc_quic_bytes_in_flight(f->cc) && f->last_eliciting_ns + pto_ns(f) < next) {
+		next = f->last_eliciting_ns + pto_ns(f);
+	}
+	return next;
+}
+
+static void report_flows(double elapsed, uint64_t interval_us)
+{
+	struct tcp_pcc_info pi;
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < flows_number; i++) {
+		struct flow *f = flows + i;
+		uint64_t acked = f->bytes_acked - f->last_bytes_acked;
+
+		f->last_bytes_acked = f->bytes_acked;
+		total += acked;
+		pcc_quic_get_info(f->cc, &pi);
+		printf("%8.3f flow %3d goodput %10.3f Mbit/s rtt %7u us rttvar %7u us retrans %6llu "
+			"pacing %10.3f Mbit/s pcc_rate %10.3f Mbit/s pcc_actual %10.3f Mbit/s pcc_state %d\n",
+			elapsed, i, acked * 8.0 / interval_us, f->srtt_us, f->rttvar_us, (unsigned long long)f->packets_lost,
+			pcc_quic_pacing_rate(f->cc) * 8.0 / 1e6,
+			(((uint64_t)pi.pcc_rate_hi << 32) | pi.pcc_rate_lo) * 8.0 / 1e6,
+			(((uint64_t)pi.pcc_actual_rate_hi << 32) | pi.pcc_actual_rate_lo) * 8.0 / 1e6, pi.pcc_state);
+	}
+	if (flows_number > 1) {
+		printf("%8.3f total    goodput %10.3f Mbit/s\n", elapsed, total * 8.0 / interval_us);
+	}
+	fflush(stdout);
+}
+
+static void report_summary(double elapsed, double cpu)
+{
+	uint64_t acks = 0;
+	int i;
+
+	for (i = 0; i < flows_number; i++) {
+		struct flow *f = flows + i;
+
+		acks += f->acks;
+		printf("summary flow %3d goodput %10.3f Mbit/s rtt %7u us retrans %6llu acks %10llu local_drops %llu\n",
+			i, f->bytes_acked * 8.0 / (elapsed * 1e6), f->srtt_us, (unsigned long long)f->packets_lost,
+			(unsigned long long)f->acks, (unsigned long long)f->local_drops);
+	}
+	printf("summary cpu %.3f s acks %llu cpu_per_ack %.3f us\n", cpu, (unsigned long long)acks,
+		acks ? cpu * 1e6 / acks : 0.0);
+	fflush(stdout);
+}
+
+static void send_close(struct flow *f)
+{
+	uint8_t buf[64], *p;
+	int i;
+
+	p = put_header(buf, f->cid, f->next_pn++);
+	*p++ = FRAME_CONNECTION_CLOSE;
+	p = put_varint(p, 0);
+	p = put_varint(p, 0);
+	p = put_varint(p, 0);
+	//nothing acks it, a few copies make its loss unlikely
+	for (i = 0; i < CLOSE_REPEAT; i++) {
+		send(f->fd, buf, p - buf, 0);
+	}
+}
+
+static int run_sender(void)
+{
+	struct pollfd pfds[MAX_FLOWS];
+	uint8_t buf[MAX_DATAGRAM];
+	uint64_t start, last, now, next;
+	double cpu_start;
+	int i;
+
+	srand(now_ns());
+	for (i = 0; i < flows_number; i++) {
+		if (connect_flow(flows + i, i) < 0) {
+			return 1;
+		}
+		pfds[i].fd = flows[i].fd;
+		pfds[i].events = POLLIN;
+	}
+
+	start = last = now_ns();
+	cpu_start = cpu_seconds();
+	while (!stop) {
+		struct timespec timeout;
+
+		now = now_ns();
+		next = last + (uint64_t)interval_ms * 1000000;
+		for (i = 0; i < flows_number; i++) {
+			uint64_t event;
+
+			flow_send(flows + i, now);
+			event = flow_next_event(flows + i, now);
+			if (event < next) {
+				next = event;
+			}
+			pfds[i].events = POLLIN | (flows[i].blocked ? POLLOUT : 0);
+		}
+		next = next > now ? next - now : 0;
+		timeout.tv_sec = next / 1000000000ULL;
+		timeout.tv_nsec = next % 1000000000ULL;
+		if (ppoll(pfds, flows_number, &timeout, NULL) < 0 && errno != EINTR) {
+			perror("ppoll");
+			return 1;
+		}
+
+		now = now_ns();
+		for (i = 0; i < flows_number; i++) {
+			ssize_t ret;
+
+			if (pfds[i].revents & POLLOUT) {
+				flows[i].blocked = 0;
+			}
+			if (!(pfds[i].revents & POLLIN)) {
+				continue;
+			}
+			while ((ret = recv(flows[i].fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+				on_sender_packet(flows + i, buf, buf + ret, now);
+			}
+		}
+		if (now - last >= (uint64_t)interval_ms * 1000000) {
+			report_flows((now - start) / 1e9, (now - last) / 1000);
+			last = now;
+		}
+		if (duration_sec > 0 && now - start >= (uint64_t)duration_sec * 1000000000ULL) {
+			stop = 1;
+		}
+	}
+
+	report_summary((now_ns() - start) / 1e9, cpu_seconds() - cpu_start);
+	for (i = 0; i < flows_number; i++) {
+		send_close(flows + i);
+		pcc_quic_free(flows[i].cc);
+		close(flows[i].fd);
+	}
+	return 0;
+}
+
+static void conn_finish(struct conn *c, uint64_t now)
+{
+	printf("sink %d received %llu bytes in %.3f s\n", c->id, (unsigned long long)c->received,
+		(now - c->start_ns) / 1e9);
+	fflush(stdout);
+	c->used = 0;
+}
+
+/** the connection of the cid, a new one if create is set and there is none */
+static struct conn *conn_find(const uint8_t *cid, const struct sockaddr_storage *from, socklen_t from_len,
+	uint64_t now, int create)
+{
+	static int next_id;
+	struct conn *free_conn = NULL;
+	int i;
+
+	for (i = 0; i < MAX_CONNS; i++) {
+		if (conns[i].used && !memcmp(conns[i].cid, cid, CID_LEN)) {
+			return conns + i;
+		}
+		if (!conns[i].used && !free_conn) {
+			free_conn = conns + i;
+		}
+	}
+	if (!free_conn || !create) {
+		return NULL;
+	}
+	memset(free_conn, 0, sizeof(*free_conn));
+	free_conn->used = 1;
+	free_conn->id = next_id++;
+	memcpy(free_conn->cid, cid, CID_LEN);
+	memcpy(&free_conn->peer, from, from_len);
+	free_conn->peer_len = from_len;
+	free_conn->start_ns = free_conn->last_report_ns = now;
+	return free_conn;
+}
+
+/** adds the packet number to the received ranges, returns 0 if it was there already */
+static int conn_record(struct conn *c, uint64_t pn)
+{
+	int i, j;
+
+	for (i = 0; i < c->nranges && c->ranges[i].hi + 1 >= pn; i++) {
+		if (pn >= c->ranges[i].lo && pn <= c->ranges[i].hi) {
+			return 0;
+		}
+		if (c->ranges[i].hi + 1 == pn) {
+			c->ranges[i].hi = pn;
+			//it may close the gap to the range above
+			if (i > 0 && c->ranges[i - 1].lo == pn + 1) {
+				c->ranges[i - 1].lo = c->ranges[i].lo;
+				memmove(c->ranges + i, c->ranges + i + 1, (c->nranges - i - 1) * sizeof(*c->ranges));
+				c->nranges--;
+			}
+			return 1;
+		}
+	}
+	//i is the first range below pn, pn may extend the one above down
+	if (i > 0 && c->ranges[i - 1].lo == pn + 1) {
+		c->ranges[i - 1].lo = pn;
+		return 1;
+	}
+	//the lowest range goes when there is no room, its packets are acked by now
+	if (c->nranges == MAX_ACK_RANGES) {
+		if (i == MAX_ACK_RANGES) {
+			return 1;
+		}
+		c->nranges--;
+	}
+	for (j = c->nranges; j > i; j--) {
+		c->ranges[j] = c->ranges[j - 1];
+	}
+	c->ranges[i].lo = c->ranges[i].hi = pn;
+	c->nranges++;
+	return 1;
+}
+
+static void conn_send_ack(int fd, struct conn *c, uint64_t now)
+{
+	uint8_t buf[MAX_DATAGRAM], *p;
+	int i;
+
+	if (!c->nranges) {
+		return;
+	}
+	p = put_header(buf, c->cid, c->next_pn++);
+	*p++ = FRAME_ACK;
+	p = put_varint(p, c->ranges[0].hi);
+	p = put_varint(p, (now - c->largest_recv_ns) / 1000 >> ACK_DELAY_EXPONENT);
+	p = put_varint(p, c->nranges - 1);
+	p = put_varint(p, c->ranges[0].hi - c->ranges[0].lo);
+	for (i = 1; i < c->nranges; i++) {
+		p = put_varint(p, c->ranges[i - 1].lo - c->ranges[i].hi - 2);
+		p = put_varint(p, c->ranges[i].hi - c->ranges[i].lo);
+	}
+	sendto(fd, buf, p - buf, MSG_DONTWAIT, (struct sockaddr *)&c->peer, c->peer_len);
+	c->unacked = 0;
+	c->ack_deadline_ns = 0;
+}
+
+static void on_receiver_packet(int fd, const uint8_t *p, const uint8_t *end, const struct sockaddr_storage *from,
+	socklen_t from_len, uint64_t now)
+{
+	uint8_t cid[CID_LEN];
+	struct conn *c;
+	uint64_t pn, type, v, len;
+	uint64_t prev_largest;
+	int eliciting = 0, fresh, closed = 0;
+	uint32_t payload = 0;
+
+	p = get_header(p, end, cid, &pn);
+	if (!p) {
+		return;
+	}
+	while (p < end) {
+		if (!(p = get_varint(p, end, &type))) {
+			return;
+		}
+		if (type == FRAME_PADDING) {
+			continue;
+		} else if (type == FRAME_PING) {
+			eliciting = 1;
+		} else if (type == FRAME_STREAM) {
+			if (!(p = get_varint(p, end, &v)) || !(p = get_varint(p, end, &v)) ||
+				!(p = get_varint(p, end, &len)) || len > (uint64_t)(end - p)) {
+				return;
+			}
+			p += len;
+			payload += len;
+			eliciting = 1;
+		} else if (type == FRAME_CONNECTION_CLOSE) {
+			closed = 1;
+			break;
+		} else {
+			return;
+		}
+	}
+	//the sender repeats the close, the copies find no connection
+	if (!(c = conn_find(cid, from, from_len, now, !closed))) {
+		return;
+	}
+	if (closed) {
+		conn_finish(c, now);
+		return;
+	}
+
+	prev_largest = c->nranges ? c->ranges[0].hi : 0;
+	fresh = conn_record(c, pn);
+	c->last_ns = now;
+	if (fresh) {
+		c->received += payload;
+	}
+	if (pn == c->ranges[0].hi) {
+		c->largest_recv_ns = now;
+	}
+	if (!eliciting) {
+		return;
+	}
+	//a gap or a packet out of order is acked at once, so the sender sees it early
+	if (!fresh || (c->nranges > 1 && pn != prev_largest + 1) || ++c->unacked >= ACK_EVERY) {
+		conn_send_ack(fd, c, now);
+	} else if (!c->ack_deadline_ns) {
+		c->ack_deadline_ns = now + MAX_ACK_DELAY_US * 1000ULL;
+	}
+}
+
+static int run_receiver(void)
+{
+	struct addrinfo hints, *res;
+	uint8_t buf[MAX_DATAGRAM];
+	struct pollfd pfd;
+	int fd, err, i;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET6;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+	err = getaddrinfo(NULL, port, &hints, &res);
+	if (err != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+		return 1;
+	}
+	fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	if (bind(fd, res->ai_addr, res->ai_addrlen) < 0) {
+		perror("bind");
+		return 1;
+	}
+	freeaddrinfo(res);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (!stop) {
+		uint64_t now = now_ns(), next = now + (uint64_t)interval_ms * 1000000;
+		struct timespec timeout;
+		ssize_t ret;
+
+		//delayed acks, progress and idle connections
+		for (i = 0; i < MAX_CONNS; i++) {
+			struct conn *c = conns + i;
+
+			if (!c->used) {
+				continue;
+			}
+			if (c->ack_deadline_ns && now >= c->ack_deadline_ns) {
+				conn_send_ack(fd, c, now);
+			}
+			if (now - c->last_report_ns >= (uint64_t)interval_ms * 1000000) {
+				printf("%8.3f sink %3d goodput %10.3f Mbit/s\n", (now - c->start_ns) / 1e9, c->id,
+					(c->received - c->last_received) * 8.0 / ((now - c->last_report_ns) / 1000));
+				fflush(stdout);
+				c->last_received = c->received;
+				c->last_report_ns = now;
+			}
+			if (now - c->last_ns >= CONN_IDLE_NS) {
+				conn_finish(c, now);
+				continue;
+			}
+			if (c->ack_deadline_ns && c->ack_deadline_ns < next) {
+				next = c->ack_deadline_ns;
+			}
+		}
+		next = next > now ? next - now : 0;
+		timeout.tv_sec = next / 1000000000ULL;
+		timeout.tv_nsec = next % 1000000000ULL;
+		if (ppoll(&pfd, 1, &timeout, NULL) < 0 && errno != EINTR) {
+			perror("ppoll");
+			return 1;
+		}
+		now = now_ns();
+		for (;;) {
+			struct sockaddr_storage from;
+			socklen_t from_len = sizeof(from);
+
+			ret = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+			if (ret <= 0) {
+				break;
+			}
+			on_receiver_packet(fd, buf, buf + ret, &from, from_len, now);
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sigaction sa;
+	int server = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "sc:p:P:t:i:m:o:v")) != -1) {
+		switch (opt) {
+			case 's':
+				server = 1;
+				break;
+			case 'c':
+				host = optarg;
+				break;
+			case 'p':
+				port = optarg;
+				break;
+			case 'P':
+				flows_number = atoi(optarg);
+				break;
+			case 't':
+				duration_sec = atoi(optarg);
+				break;
+			case 'i':
+				interval_ms = atoi(optarg);
+				break;
+			case 'm':
+				datagram = atoi(optarg);
+				break;
+			case 'o': {
+				char *eq = strchr(optarg, '=');
+
+				if (!eq) {
+					usage(argv[0]);
+				}
+				*eq = '\0';
+				if (pcc_quic_param_set(optarg, eq + 1) < 0) {
+					fprintf(stderr, "unknown or bad parameter %s\n", optarg);
+					return 1;
+				}
+				break;
+			}
+			case 'v':
+				kshim_verbose = 1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if ((!server && host == NULL) || flows_number < 1 || flows_number > MAX_FLOWS || interval_ms <= 0 ||
+		datagram < 64 || datagram > MAX_DATAGRAM) {
+		usage(argv[0]);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	return server ? run_receiver() : run_sender();
+}
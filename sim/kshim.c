@@ -0,0 +1,160 @@
+/*
+ * Runtime support for the kernel shim: the simulated clock, randomness and
+ * module parameters.
+ */
+
+#include "kshim/kshim.h"
+
+__thread u64 kshim_now_ns;
+int kshim_verbose;
+static __thread u64 kshim_random_state = 0x2545f4914f6cdd1dULL;
+
+void kshim_seed(u64 seed)
+{
+	kshim_random_state = seed ? seed : 0x2545f4914f6cdd1dULL;
+}
+
+/** xorshift64*, deterministic per thread so runs can be repeated */
+u64 kshim_random(void)
+{
+	u64 x = kshim_random_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	kshim_random_state = x;
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+void get_random_bytes(void *buf, int nbytes)
+{
+	u8 *p = buf;
+
+	while (nbytes > 0) {
+		u64 r = kshim_random();
+		int n = nbytes < (int)sizeof(r) ? nbytes : (int)sizeof(r);
+
+		memcpy(p, &r, n);
+		p += n;
+		nbytes -= n;
+	}
+}
+
+/** as the kernel's minmax_subwin_update(): ages out the best samples when they leave the window */
+static u32 minmax_subwin_update(struct minmax *m, u32 win, const struct minmax_sample *val)
+{
+	u32 dt = val->t - m->s[0].t;
+
+	if (dt > win) {
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = *val;
+		if (val->t - m->s[0].t > win) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = *val;
+		}
+	} else if (m->s[1].t == m->s[0].t && dt > win / 4) {
+		m->s[2] = m->s[1] = *val;
+	} else if (m->s[2].t == m->s[1].t && dt > win / 2) {
+		m->s[2] = *val;
+	}
+	return m->s[0].v;
+}
+
+u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (val.v >= m->s[0].v || val.t - m->s[2].t > win) {
+		return minmax_reset(m, t, meas);
+	}
+	if (val.v >= m->s[1].v) {
+		m->s[2] = m->s[1] = val;
+	} else if (val.v >= m->s[2].v) {
+		m->s[2] = val;
+	}
+	return minmax_subwin_update(m, win, &val);
+}
+
+struct net init_net;
+static unsigned int kshim_net_generic_next;
+
+int register_pernet_subsys(struct pernet_operations *ops)
+{
+	int err;
+
+	if (kshim_net_generic_next == KSHIM_NET_GENERIC) {
+		return -ENOSPC;
+	}
+	*ops->id = kshim_net_generic_next++;
+	init_net.gen[*ops->id] = calloc(1, ops->size);
+	if (!init_net.gen[*ops->id]) {
+		return -ENOMEM;
+	}
+	err = ops->init ? ops->init(&init_net) : 0;
+	if (err) {
+		free(init_net.gen[*ops->id]);
+		init_net.gen[*ops->id] = NULL;
+	}
+	return err;
+}
+
+void unregister_pernet_subsys(struct pernet_operations *ops)
+{
+	if (ops->exit) {
+		ops->exit(&init_net);
+	}
+	free(init_net.gen[*ops->id]);
+	init_net.gen[*ops->id] = NULL;
+}
+
+extern struct kshim_param __start_kshim_params[] __attribute__((weak));
+extern struct kshim_param __stop_kshim_params[] __attribute__((weak));
+
+int kshim_param_set(const char *name, const char *value)
+{
+	struct kshim_param *p;
+	char *end;
+	long long v;
+
+	for (p = __start_kshim_params; p < __stop_kshim_params; p++) {
+		if (strcmp(p->name, name) != 0) {
+			continue;
+		}
+		v = strtoll(value, &end, 0);
+		if (*value == '\0' || *end != '\0') {
+			return -1;
+		}
+		if (strcmp(p->type, "int") == 0) {
+			*(int *)p->value = v;
+		} else if (strcmp(p->type, "uint") == 0) {
+			*(unsigned int *)p->value = v;
+		} else if (strcmp(p->type, "ulong") == 0) {
+			*(unsigned long *)p->value = v;
+		} else if (strcmp(p->type, "bool") == 0) {
+			*(bool *)p->value = v != 0;
+		} else {
+			return -1;
+		}
+		return 0;
+	}
+	return -1;
+}
+
+void kshim_param_print(FILE *fp)
+{
+	struct kshim_param *p;
+
+	for (p = __start_kshim_params; p < __stop_kshim_params; p++) {
+		if (strcmp(p->type, "int") == 0) {
+			fprintf(fp, " %s=%d", p->name, *(int *)p->value);
+		} else if (strcmp(p->type, "uint") == 0) {
+			fprintf(fp, " %s=%u", p->name, *(unsigned int *)p->value);
+		} else if (strcmp(p->type, "ulong") == 0) {
+			fprintf(fp, " %s=%lu", p->name, *(unsigned long *)p->value);
+		} else if (strcmp(p->type, "bool") == 0) {
+			fprintf(fp, " %s=%d", p->name, *(bool *)p->value);
+		}
+	}
+}
@@ -0,0 +1,610 @@
+#ifndef _KSHIM_H_
+#define _KSHIM_H_
+
+/*
+ * Minimal userspace stand-ins for the kernel APIs used by pcc_pacing.c.
+ * Lets the simulator compile the module source as is, with the time taken
+ * from the simulated clock instead of the kernel.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint8_t __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef int8_t __s8;
+typedef int16_t __s16;
+typedef int32_t __s32;
+typedef int64_t __s64;
+
+/* simulated time, set by the simulator before every call into the module */
+extern __thread u64 kshim_now_ns;
+/* printk is silent unless set */
+extern int kshim_verbose;
+
+#define KERN_ERR ""
+#define KERN_INFO ""
+#define KERN_WARNING ""
+#define KERN_DEBUG ""
+#define printk(...) do { if (kshim_verbose) fprintf(stderr, __VA_ARGS__); } while (0)
+//nothing to flood in a simulation
+#define net_ratelimit() 1
+#define __force
+
+#define __init
+#define __user
+#define IS_ENABLED(option) 0
+#define IS_ERR_OR_NULL(ptr) ((ptr) == NULL)
+#define __exit
+#define __read_mostly
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *)&(x) = (val))
+#define THIS_MODULE NULL
+//the module registers itself before the simulator starts, it is never unloaded
+#define module_init(fn) static void __attribute__((constructor)) kshim_module_init(void) { fn(); }
+#define module_exit(fn)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define MODULE_PARM_DESC(name, desc)
+
+/* module parameters are collected in a section, so the simulator can set them by name */
+struct kshim_param {
+	const char *name;
+	const char *type;
+	void *value;
+};
+#define module_param(name, type, perm) \
+	static struct kshim_param kshim_param_##name \
+	__attribute__((used, section("kshim_params"), aligned(sizeof(void *)))) = { #name, #type, &name }
+#define module_param_named(name, value, type, perm) \
+	static struct kshim_param kshim_param_##name \
+	__attribute__((used, section("kshim_params"), aligned(sizeof(void *)))) = { #name, #type, &(value) }
+
+/** sets the module parameter name from its text value, returns -1 if it is unknown or bad */
+int kshim_param_set(const char *name, const char *value);
+/** prints all module parameters as name=value */
+void kshim_param_print(FILE *fp);
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+
+#define max_t(type, a, b) ((type)(a) > (type)(b) ? (type)(a) : (type)(b))
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+#define clamp_t(type, val, lo, hi) min_t(type, max_t(type, val, lo), hi)
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define U8_MAX ((u8)~0U)
+#define U32_MAX ((u32)~0U)
+#define S32_MAX ((s32)(U32_MAX >> 1))
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 0
+#define kmalloc(size, flags) malloc(size)
+#define kzalloc(size, flags) calloc(1, size)
+#define kfree(ptr) free(ptr)
+#define vzalloc(size) calloc(1, size)
+#define vfree(ptr) free(ptr)
+
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define USEC_PER_MSEC 1000L
+#define USEC_PER_SEC 1000000L
+
+static inline struct timespec current_kernel_time(void)
+{
+	struct timespec ts;
+
+	ts.tv_sec = kshim_now_ns / NSEC_PER_SEC;
+	ts.tv_nsec = kshim_now_ns % NSEC_PER_SEC;
+	return ts;
+}
+
+static inline struct timespec timespec_sub(struct timespec a, struct timespec b)
+{
+	struct timespec ts;
+
+	ts.tv_sec = a.tv_sec - b.tv_sec;
+	ts.tv_nsec = a.tv_nsec - b.tv_nsec;
+	if (ts.tv_nsec < 0) {
+		ts.tv_sec--;
+		ts.tv_nsec += NSEC_PER_SEC;
+	}
+	return ts;
+}
+
+static inline s64 timespec_to_ns(const struct timespec *ts)
+{
+	return (s64)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static inline u64 ktime_get_real_ns(void)
+{
+	return kshim_now_ns;
+}
+
+static inline u64 ktime_get_ns(void)
+{
+	return kshim_now_ns;
+}
+
+void kshim_seed(u64 seed);
+u64 kshim_random(void);
+void get_random_bytes(void *buf, int nbytes);
+
+/* windowed running max or min of a measurement, as in lib/win_minmax.c */
+
+struct minmax_sample {
+	u32 t;
+	u32 v;
+};
+
+struct minmax {
+	struct minmax_sample s[3];
+};
+
+static inline u32 minmax_get(const struct minmax *m)
+{
+	return m->s[0].v;
+}
+
+static inline u32 minmax_reset(struct minmax *m, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	m->s[2] = m->s[1] = m->s[0] = val;
+	return m->s[0].v;
+}
+
+u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas);
+
+/* locking and waiting, a socket is only used by one thread but the module's
+ * globals are shared by the simulator threads */
+
+typedef pthread_mutex_t spinlock_t;
+#define DEFINE_SPINLOCK(name) spinlock_t name = PTHREAD_MUTEX_INITIALIZER
+#define spin_lock_init(lock) pthread_mutex_init(lock, NULL)
+#define spin_lock_irqsave(lock, flags) do { pthread_mutex_lock(lock); (flags) = 0; } while (0)
+#define spin_unlock_irqrestore(lock, flags) do { pthread_mutex_unlock(lock); (void)(flags); } while (0)
+#define spin_lock_bh(lock) pthread_mutex_lock(lock)
+#define spin_unlock_bh(lock) pthread_mutex_unlock(lock)
+
+typedef struct { int unused; } wait_queue_head_t;
+#define DECLARE_WAIT_QUEUE_HEAD(name) wait_queue_head_t name
+#define wake_up_interruptible(wq) do { (void)(wq); } while (0)
+#define wait_event_interruptible(wq, cond) ((cond) ? 0 : -EINTR)
+
+/* a fixed size ring of records, size must be a power of 2 */
+#define DEFINE_KFIFO(name, type, size) \
+	struct { type buf[size]; unsigned int in; unsigned int out; } name
+#define kfifo_size(fifo) (sizeof((fifo)->buf) / sizeof((fifo)->buf[0]))
+#define kfifo_is_empty(fifo) ((fifo)->in == (fifo)->out)
+#define kfifo_is_full(fifo) ((fifo)->in - (fifo)->out >= kfifo_size(fifo))
+#define kfifo_put(fifo, val) ({ \
+	int __ret = !kfifo_is_full(fifo); \
+	if (__ret) { \
+		(fifo)->buf[(fifo)->in & (kfifo_size(fifo) - 1)] = (val); \
+		(fifo)->in++; \
+	} \
+	__ret; })
+#define kfifo_get(fifo, ptr) ({ \
+	int __ret = !kfifo_is_empty(fifo); \
+	if (__ret) { \
+		*(ptr) = (fifo)->buf[(fifo)->out & (kfifo_size(fifo) - 1)]; \
+		(fifo)->out++; \
+	} \
+	__ret; })
+#define kfifo_out_spinlocked(fifo, ptr, n, lock) ({ \
+	int __ret; \
+	pthread_mutex_lock(lock); \
+	__ret = kfifo_get(fifo, ptr); \
+	pthread_mutex_unlock(lock); \
+	__ret; })
+
+/* debugfs is not available, files are never created */
+
+struct dentry;
+struct file {
+	unsigned int f_flags;
+	void *private_data;
+};
+struct inode;
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char *buf, size_t count, loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char *buf, size_t count, loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t offset, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+#define noop_llseek NULL
+
+static inline struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	(void)name;
+	(void)parent;
+	return NULL;
+}
+static inline struct dentry *debugfs_create_file(const char *name, int mode, struct dentry *parent,
+	void *data, const struct file_operations *fops)
+{
+	return NULL;
+}
+
+static inline struct dentry *debugfs_create_u32(const char *name, int mode, struct dentry *parent, u32 *value)
+{
+	return NULL;
+}
+
+static inline struct dentry *debugfs_create_u64(const char *name, int mode, struct dentry *parent, u64 *value)
+{
+	return NULL;
+}
+
+static inline void debugfs_remove_recursive(struct dentry *dentry)
+{
+}
+
+/* proc files are not created either, a seq_file prints to a stdio stream */
+
+struct proc_dir_entry {
+	int unused;
+};
+struct seq_file {
+	FILE *fp;
+	void *private;
+};
+#define seq_printf(seq, ...) fprintf((seq)->fp, __VA_ARGS__)
+#define seq_read NULL
+#define seq_lseek NULL
+#define single_release_net NULL
+#define single_release NULL
+
+static inline int single_open_net(struct inode *inode, struct file *file, int (*show)(struct seq_file *, void *))
+{
+	return -ENOENT;
+}
+
+static inline int single_open(struct file *file, int (*show)(struct seq_file *, void *), void *data)
+{
+	return -ENOENT;
+}
+
+static inline struct proc_dir_entry *proc_create_data(const char *name, int mode, struct proc_dir_entry *parent,
+	const struct file_operations *fops, void *data)
+{
+	static struct proc_dir_entry entry;
+
+	return &entry;
+}
+
+static inline void remove_proc_entry(const char *name, struct proc_dir_entry *parent)
+{
+}
+
+static inline unsigned long copy_to_user(void *to, const void *from, unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from, unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline s64 div64_s64(s64 dividend, s64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline int fls64(u64 x)
+{
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+static inline int before(u32 seq1, u32 seq2)
+{
+	return (s32)(seq1 - seq2) < 0;
+}
+#define after(seq2, seq1) before(seq1, seq2)
+
+/* per cpu data, the simulator threads share one copy */
+
+#define __percpu
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(ptr) free(ptr)
+#define per_cpu_ptr(ptr, cpu) ((void)(cpu), (ptr))
+#define DEFINE_PER_CPU(type, name) type name
+#define per_cpu(var, cpu) (*((void)(cpu), &(var)))
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define this_cpu_inc(var) __atomic_fetch_add(&(var), 1, __ATOMIC_RELAXED)
+
+/* network namespaces: all sockets are in the initial one */
+
+#define KSHIM_NET_GENERIC (8)
+#define __net_init
+#define __net_exit
+#define CAP_NET_ADMIN 12
+
+struct user_namespace;
+struct net {
+	struct proc_dir_entry *proc_net;
+	struct user_namespace *user_ns;
+	void *gen[KSHIM_NET_GENERIC];
+};
+extern struct net init_net;
+
+struct pernet_operations {
+	int (*init)(struct net *net);
+	void (*exit)(struct net *net);
+	unsigned int *id;
+	size_t size;
+};
+
+/** gives the subsystem its id and data in init_net, and inits it */
+int register_pernet_subsys(struct pernet_operations *ops);
+void unregister_pernet_subsys(struct pernet_operations *ops);
+
+static inline void *net_generic(const struct net *net, unsigned int id)
+{
+	return net->gen[id];
+}
+
+static inline int net_eq(const struct net *a, const struct net *b)
+{
+	return a == b;
+}
+
+static inline bool ns_capable(struct user_namespace *ns, int cap)
+{
+	return true;
+}
+
+/* networking */
+
+#define TCP_INFINITE_SSTHRESH 0x7fffffff
+#define ICSK_CA_PRIV_SIZE (13 * sizeof(u64))
+#define INET_DIAG_VEGASINFO 5
+#define INET_DIAG_BBRINFO 16
+
+struct tcp_sack_block {
+	u32 start_seq;
+	u32 end_seq;
+};
+
+typedef u16 __be16;
+typedef u32 __be32;
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+static inline int atomic_read(const atomic_t *v)
+{
+	return v->counter;
+}
+
+static inline void atomic_inc(atomic_t *v)
+{
+	__sync_fetch_and_add(&v->counter, 1);
+}
+
+static inline void atomic_dec(atomic_t *v)
+{
+	__sync_fetch_and_sub(&v->counter, 1);
+}
+
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return (*addr >> nr) & 1;
+}
+
+enum tsq_flags {
+	TSQ_THROTTLED,
+	TSQ_QUEUED,
+};
+
+enum tcp_ca_state {
+	TCP_CA_Open = 0,
+	TCP_CA_Disorder = 1,
+	TCP_CA_CWR = 2,
+	TCP_CA_Recovery = 3,
+	TCP_CA_Loss = 4,
+};
+
+static inline int in4_pton(const char *src, int srclen, u8 *dst, int delim, const char **end)
+{
+	return inet_pton(AF_INET, src, dst) == 1;
+}
+
+static inline int in6_pton(const char *src, int srclen, u8 *dst, int delim, const char **end)
+{
+	return inet_pton(AF_INET6, src, dst) == 1;
+}
+
+struct sock {
+	unsigned short sk_family;
+	u32 sk_mark;
+	unsigned long sk_pacing_rate;
+	unsigned long sk_max_pacing_rate;
+	atomic_t sk_wmem_alloc;
+};
+
+struct inet_sock {
+	struct sock sk;
+	__be32 inet_saddr;
+	__be32 inet_daddr;
+	__be16 inet_sport;
+	__be16 inet_dport;
+};
+
+struct inet_connection_sock {
+	struct inet_sock icsk_inet;
+	u8 icsk_ca_state;
+	u64 icsk_ca_priv[ICSK_CA_PRIV_SIZE / sizeof(u64)];
+};
+
+struct tcp_sock {
+	struct inet_connection_sock inet_conn;
+	u64 bytes_acked;
+	u32 srtt_us;
+	u32 snd_nxt;
+	u32 snd_una;
+	u32 data_segs_out;
+	u16 advmss;
+	u32 mss_cache;
+	u32 sacked_out;
+	u32 lost_out;
+	u32 packets_out;
+	u32 total_retrans;
+	u32 snd_cwnd;
+	u32 snd_wnd;
+	unsigned long tsq_flags;
+	struct tcp_sack_block recv_sack_cache[4];
+};
+
+static inline struct net *sock_net(const struct sock *sk)
+{
+	return &init_net;
+}
+
+static inline int sk_wmem_alloc_get(const struct sock *sk)
+{
+	return atomic_read(&sk->sk_wmem_alloc);
+}
+
+static inline struct tcp_sock *tcp_sk(const struct sock *sk)
+{
+	return (struct tcp_sock *)sk;
+}
+
+static inline struct inet_sock *inet_sk(const struct sock *sk)
+{
+	return (struct inet_sock *)sk;
+}
+
+static inline struct inet_connection_sock *inet_csk(const struct sock *sk)
+{
+	return (struct inet_connection_sock *)sk;
+}
+
+static inline void *inet_csk_ca(const struct sock *sk)
+{
+	return (void *)inet_csk(sk)->icsk_ca_priv;
+}
+
+struct ack_sample {
+	u32 pkts_acked;
+	s32 rtt_us;
+	u32 in_flight;
+};
+
+struct rate_sample {
+	u64 prior_mstamp;
+	u32 prior_delivered;
+	s32 delivered;
+	long interval_us;
+	long rtt_us;
+	int losses;
+	u32 acked_sacked;
+	u32 prior_in_flight;
+	int is_app_limited;
+	int is_retrans;
+};
+
+struct tcp_bbr_info {
+	__u32 bbr_bw_lo;
+	__u32 bbr_bw_hi;
+	__u32 bbr_min_rtt;
+	__u32 bbr_pacing_gain;
+	__u32 bbr_cwnd_gain;
+};
+
+union tcp_cc_info {
+	struct tcp_bbr_info bbr;
+};
+
+struct tcp_congestion_ops {
+	void (*init)(struct sock *sk);
+	void (*release)(struct sock *sk);
+	u32 (*ssthresh)(struct sock *sk);
+	void (*cong_avoid)(struct sock *sk, u32 ack, u32 acked);
+	void (*set_state)(struct sock *sk, u8 new_state);
+	void (*cwnd_event)(struct sock *sk, int ev);
+	void (*in_ack_event)(struct sock *sk, u32 flags);
+	u32 (*undo_cwnd)(struct sock *sk);
+	void (*pkts_acked)(struct sock *sk, const struct ack_sample *sample);
+	void (*cong_control)(struct sock *sk, const struct rate_sample *rs);
+	size_t (*get_info)(struct sock *sk, u32 ext, int *attr, union tcp_cc_info *info);
+	const char *name;
+	void *owner;
+};
+
+static inline int tcp_register_congestion_control(struct tcp_congestion_ops *ops)
+{
+	(void)ops;
+	return 0;
+}
+
+static inline void tcp_unregister_congestion_control(struct tcp_congestion_ops *ops)
+{
+	(void)ops;
+}
+
+/* the kernel's jhash_3words, so the trace ids match the kernel's for the same 4-tuple */
+#define JHASH_INITVAL 0xdeadbeef
+
+static inline u32 rol32(u32 word, unsigned int shift)
+{
+	return (word << shift) | (word >> ((-shift) & 31));
+}
+
+static inline u32 jhash_3words(u32 a, u32 b, u32 c, u32 initval)
+{
+	initval += JHASH_INITVAL + (3 << 2);
+	a += initval;
+	b += initval;
+	c += initval;
+	c ^= b; c -= rol32(b, 14);
+	a ^= c; a -= rol32(c, 11);
+	b ^= a; b -= rol32(a, 25);
+	c ^= b; c -= rol32(b, 16);
+	a ^= c; a -= rol32(c, 4);
+	b ^= a; b -= rol32(a, 14);
+	c ^= b; c -= rol32(b, 24);
+	return c;
+}
+
+#endif
@@ -0,0 +1,6 @@
+#include "../kshim.h"
+
+/* tracepoints compile to functions that do nothing */
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) static inline void trace_##name(proto) { }
@@ -0,0 +1 @@
+/* nothing to define, linux/tracepoint.h made the trace functions */
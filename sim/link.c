@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link.h"
+
+#define NSEC_PER_SEC (1000000000ULL)
+#define NSEC_PER_MSEC (1000000ULL)
+
+static int parse_steps(struct link *l, const char *spec)
+{
+	const char *p = spec;
+
+	while (*p && l->steps_len < LINK_MAX_STEPS) {
+		double mbit, sec;
+		int n;
+
+		if (sscanf(p, "%lf@%lf%n", &mbit, &sec, &n) != 2) {
+			return -1;
+		}
+		l->steps[l->steps_len].rate_bps = mbit * 1e6;
+		l->steps[l->steps_len].time_ns = sec * NSEC_PER_SEC;
+		if (l->steps_len > 0 && l->steps[l->steps_len].time_ns < l->steps[l->steps_len - 1].time_ns) {
+			return -1;
+		}
+		l->steps_len++;
+		p += n;
+		if (*p == ',') {
+			p++;
+		}
+	}
+	return l->steps_len > 0 ? 0 : -1;
+}
+
+static int parse_trace(struct link *l, const char *path)
+{
+	uint64_t cap = 0;
+	unsigned long long ms;
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fscanf(fp, "%llu", &ms) == 1) {
+		if (l->trace_len == cap) {
+			cap = cap ? cap * 2 : 4096;
+			l->trace_ns = realloc(l->trace_ns, cap * sizeof(*l->trace_ns));
+		}
+		l->trace_ns[l->trace_len++] = ms * NSEC_PER_MSEC;
+	}
+	fclose(fp);
+	if (l->trace_len == 0) {
+		fprintf(stderr, "%s: empty trace\n", path);
+		return -1;
+	}
+	//like mahimahi, the trace repeats after its last timestamp
+	l->trace_period_ns = l->trace_ns[l->trace_len - 1];
+	if (l->trace_period_ns == 0) {
+		l->trace_period_ns = NSEC_PER_MSEC;
+	}
+	return 0;
+}
+
+int link_init(struct link *l, const char *spec, uint64_t default_rate_bps)
+{
+	double min_mbit, max_mbit, period;
+
+	memset(l, 0, sizeof(*l));
+	l->rate_bps = default_rate_bps;
+	if (spec == NULL || strcmp(spec, "const") == 0) {
+		l->type = LINK_CONSTANT;
+		return 0;
+	}
+	if (strncmp(spec, "step:", 5) == 0) {
+		l->type = LINK_STEPS;
+		return parse_steps(l, spec + 5);
+	}
+	if (strncmp(spec, "sine:", 5) == 0) {
+		l->type = LINK_SINE;
+		if (sscanf(spec + 5, "%lf:%lf:%lf", &min_mbit, &max_mbit, &period) != 3 || period <= 0) {
+			return -1;
+		}
+		l->sine_min_bps = min_mbit * 1e6;
+		l->sine_max_bps = max_mbit * 1e6;
+		l->sine_period_ns = period * NSEC_PER_SEC;
+		return 0;
+	}
+	l->type = LINK_TRACE;
+	return parse_trace(l, spec);
+}
+
+uint64_t link_rate_at(const struct link *l, uint64_t t_ns)
+{
+	int i;
+
+	switch (l->type) {
+		case LINK_CONSTANT:
+			return l->rate_bps;
+		case LINK_STEPS:
+			for (i = l->steps_len - 1; i > 0; i--) {
+				if (l->steps[i].time_ns <= t_ns) {
+					break;
+				}
+			}
+			return l->steps[i].rate_bps;
+		case LINK_SINE: {
+			double phase = 2 * M_PI * (double)(t_ns % l->sine_period_ns) / l->sine_period_ns;
+			return l->sine_min_bps + (l->sine_max_bps - l->sine_min_bps) * (1 + sin(phase)) / 2;
+		}
+		case LINK_TRACE:
+			return l->trace_len * (uint64_t)LINK_MTU * 8 * NSEC_PER_SEC / l->trace_period_ns;
+	}
+	return 0;
+}
+
+/** index of the first trace opportunity at or after t_ns, counted over all periods */
+static uint64_t trace_position(const struct link *l, uint64_t t_ns)
+{
+	uint64_t period = t_ns / l->trace_period_ns;
+	uint64_t offset = t_ns % l->trace_period_ns;
+	uint64_t lo = 0, hi = l->trace_len;
+
+	while (lo < hi) {
+		uint64_t mid = (lo + hi) / 2;
+		if (l->trace_ns[mid] < offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return period * l->trace_len + lo;
+}
+
+static uint64_t trace_time(const struct link *l, uint64_t pos)
+{
+	return (pos / l->trace_len) * l->trace_period_ns + l->trace_ns[pos % l->trace_len];
+}
+
+uint64_t link_capacity(const struct link *l, uint64_t from_ns, uint64_t to_ns)
+{
+	if (l->type == LINK_TRACE) {
+		return (trace_position(l, to_ns) - trace_position(l, from_ns)) * LINK_MTU;
+	}
+	//rates change slowly compared to a bin, sample in the middle
+	return link_rate_at(l, from_ns + (to_ns - from_ns) / 2) * (to_ns - from_ns) / 8 / NSEC_PER_SEC;
+}
+
+uint64_t link_enqueue(struct link *l, uint64_t arrival_ns, uint32_t len)
+{
+	uint64_t start = arrival_ns > l->free_ns ? arrival_ns : l->free_ns;
+	uint64_t rate;
+	int i;
+
+	if (l->type == LINK_TRACE) {
+		//unused opportunities are lost, and each packet uses a whole opportunity
+		uint64_t pos = trace_position(l, start);
+		if (pos < l->trace_pos) {
+			pos = l->trace_pos;
+		}
+		l->trace_pos = pos + 1;
+		l->free_ns = trace_time(l, pos);
+		return l->free_ns;
+	}
+
+	rate = link_rate_at(l, start);
+	if (rate == 0 && l->type == LINK_STEPS) {
+		//outage, wait for the next step with capacity
+		for (i = 0; i < l->steps_len; i++) {
+			if (l->steps[i].time_ns > start && l->steps[i].rate_bps > 0) {
+				start = l->steps[i].time_ns;
+				rate = l->steps[i].rate_bps;
+				break;
+			}
+		}
+	}
+	if (rate == 0) {
+		rate = 1;
+	}
+	l->free_ns = start + (uint64_t)len * 8 * NSEC_PER_SEC / rate;
+	return l->free_ns;
+}
+
+void link_free(struct link *l)
+{
+	free(l->trace_ns);
+	l->trace_ns = NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef _LINK_H_
+#define _LINK_H_
+
+/*
+ * Bottleneck capacity models for the simulator:
+ *  - constant rate
+ *  - steps: "step:<mbit>@<sec>,<mbit>@<sec>,..." the rate from each time on
+ *  - sine:  "sine:<min_mbit>:<max_mbit>:<period_sec>"
+ *  - Mahimahi packet-delivery traces: one line per 1500 byte delivery
+ *    opportunity, holding its millisecond timestamp. The trace repeats.
+ */
+
+#include <stdint.h>
+
+#define LINK_MTU (1500)
+#define LINK_MAX_STEPS (1024)
+
+typedef enum {
+	LINK_CONSTANT = 0,
+	LINK_STEPS,
+	LINK_SINE,
+	LINK_TRACE,
+} link_type_t;
+
+struct link_step {
+	uint64_t time_ns;
+	uint64_t rate_bps;
+};
+
+struct link {
+	link_type_t type;
+	uint64_t rate_bps;					//constant rate
+	struct link_step steps[LINK_MAX_STEPS];
+	int steps_len;
+	uint64_t sine_min_bps;
+	uint64_t sine_max_bps;
+	uint64_t sine_period_ns;
+	uint64_t *trace_ns;					//delivery opportunities of one trace period
+	uint64_t trace_len;
+	uint64_t trace_period_ns;
+
+	uint64_t free_ns;					//time the link finishes the last queued packet
+	uint64_t trace_pos;					//next unused delivery opportunity, over all periods
+};
+
+/** parses a schedule spec, or a trace file when spec is not a known schedule */
+int link_init(struct link *l, const char *spec, uint64_t default_rate_bps);
+
+/** rate of a rate based link at time t, for traces the mean rate of the trace */
+uint64_t link_rate_at(const struct link *l, uint64_t t_ns);
+
+/** bytes the link can deliver in [from_ns, to_ns) */
+uint64_t link_capacity(const struct link *l, uint64_t from_ns, uint64_t to_ns);
+
+/** departure time of a packet of len bytes arriving at arrival_ns, FIFO after the queued ones */
+uint64_t link_enqueue(struct link *l, uint64_t arrival_ns, uint32_t len);
+
+void link_free(struct link *l);
+
+#endif
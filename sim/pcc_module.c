@@ -0,0 +1,41 @@
+/*
+ * The PCC module source, built against the kernel shim so the simulator runs
+ * the same controller as the kernel.
+ */
+
+#include "../pcc_pacing.c"
+
+struct tcp_congestion_ops *pcc_module_ops(void)
+{
+	return &pcctcp_ops;
+}
+
+/** what a write of the socket's 4-tuple to /proc/net/pcc_deadlines does */
+int pcc_module_deadline_add(struct sock *sk, u64 bytes, u64 deadline_ms)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	struct pcc_deadline d;
+
+	memset(&d, 0, sizeof(d));
+	d.family = sk->sk_family;
+	memcpy(d.saddr, &inet->inet_saddr, sizeof(inet->inet_saddr));
+	memcpy(d.daddr, &inet->inet_daddr, sizeof(inet->inet_daddr));
+	d.sport = inet->inet_sport;
+	d.dport = inet->inet_dport;
+	d.bytes = bytes;
+	d.deadline_ns = ktime_get_ns() + deadline_ms * NSEC_PER_MSEC;
+	return deadline_add(pcc_net(sk), &d);
+}
+
+/** prints the counters /proc/net/pcc shows, as "pcc_<counter> value", then what pcc/telemetry shows */
+void pcc_module_print_counters(FILE *fp)
+{
+	struct pcc_net *pn = net_generic(&init_net, pcc_net_id);
+	struct seq_file seq = { .fp = fp };
+	int i;
+
+	for (i = 0; i < PCC_MIB_MAX; i++) {
+		fprintf(fp, "pcc_%s %lu\n", pcc_mib_names[i], pn->mib->mibs[i]);
+	}
+	telemetry_show(&seq, NULL);
+}
@@ -0,0 +1,1735 @@
+/*
+ * pccsim: packet level simulator of PCC flows sharing one bottleneck.
+ * The flows run the controller of pcc_pacing.c (built against the kernel shim)
+ * and get the same callbacks the kernel makes: pkts_acked, in_ack_event and
+ * cong_control on every ack, ssthresh on entering recovery.
+ *
+ * Sender: paced at sk_pacing_rate, SACK scoreboard, RACK loss detection and
+ * an RTO. Bottleneck: FIFO with a byte limit over a constant, stepped, sine
+ * or trace driven (Mahimahi) capacity, plus optional random loss. The
+ * receiver acks every segment with up to 4 SACK blocks. The reverse path is
+ * uncongested unless -a drops acks at random or -R gives every flow a reverse
+ * link of its own: a FIFO of that rate and buffer the acks share with
+ * Poisson cross traffic of full sized packets, which delays, bunches and
+ * drops them as reverse bulk traffic would.
+ *
+ * Reports utilization, queueing delay, loss and fairness over time, and how
+ * fast the flows react to capacity changes: the time from a change until the
+ * total sending rate is within 15% of the new capacity. Startup is measured
+ * the same way from the start, with the queue and drops until 5 rtts after.
+ * The summary ends with the module's counters, as /proc/net/pcc shows them.
+ *
+ * With -N every sender has a NIC of its own that rate, behind a qdisc of -q kB
+ * and TSQ (-Q turns it off): the socket is throttled while more than 1 ms of
+ * data (2 packets at least) waits in the qdisc, and a full qdisc refuses the
+ * packet, which puts the socket in CWR as a refused transmit does in Linux.
+ *
+ * Deadlines (-D flow:bytes:deadline_ms) are given to the module as a write to
+ * /proc/net/pcc_deadlines would when the flow starts, and the summary tells
+ * which flows got their bytes to the receiver in time.
+ *
+ * Scale: events are kept in a timing wheel with 10us slots (an overflow heap
+ * holds the far ones, like RTOs), and the flows can be split over threads
+ * (-T). The threads run in windows of one one-way delay: nothing a flow sends
+ * in a window can reach anyone before the window ends, so each thread runs
+ * its flows through the window alone and only the packets offered to the
+ * bottleneck are merged, in time order, between windows.
+ *
+ * usage: pccsim [-f flows] [-t seconds] [-r rate_mbit] [-d rtt_ms] [-b buffer_kb]
+ *               [-B buffer_bdp] [-l loss] [-c schedule|trace_file] [-i interval_ms]
+ *               [-S start_spacing_ms] [-w change_window_ms] [-s seed] [-T threads]
+ *               [-p param=value]... [-D flow:bytes:deadline_ms]... [-N nic_mbit]
+ *               [-q qdisc_kb] [-Q] [-a ack_loss] [-R rev_mbit[:cross_mbit[:rev_buffer_kb]]] [-v]
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "kshim/kshim.h"
+#include "link.h"
+
+#define SIM_EPOCH_NS (1600000000ULL * NSEC_PER_SEC)
+#define SIM_MSS (1448)
+#define SIM_WIRE_LEN (SIM_MSS + 52)
+#define SIM_ACK_WIRE_LEN (52)
+#define SIM_INITIAL_CWND (10)
+#define SIM_MIN_RTO_NS (200 * NSEC_PER_MSEC)
+#define SIM_BIN_NS (10 * NSEC_PER_MSEC)
+#define SIM_QDELAY_BUCKET_NS (100000ULL)
+#define SIM_QDELAY_BUCKETS (100000)
+#define SIM_MAX_SACKS (4)
+#define SIM_PRINTED_FLOWS (8)
+#define SIM_REACT_MARGIN (0.15)
+#define SIM_STARTUP_TAIL_RTTS (5)
+#define SIM_SEGS_INITIAL (64)
+#define SIM_WHEEL_SLOT_NS (10000ULL)
+#define SIM_WHEEL_SLOTS (8192)
+
+struct tcp_congestion_ops *pcc_module_ops(void);
+int pcc_module_deadline_add(struct sock *sk, u64 bytes, u64 deadline_ms);
+void pcc_module_print_counters(FILE *fp);
+
+typedef enum {
+	EVENT_SEND = 0,
+	EVENT_RECV,
+	EVENT_ACK,
+	EVENT_RTO,
+	EVENT_NIC,
+} event_type_t;
+
+struct event {
+	uint64_t time_ns;
+	uint32_t type;
+	uint32_t flow;
+	uint32_t packet;
+};
+
+struct event_heap {
+	struct event *events;
+	size_t len;
+	size_t cap;
+};
+
+/* events of the current slot in a heap, the next slots unsorted, the rest in the overflow heap */
+struct wheel {
+	struct event_heap current;
+	struct event_heap *slots;
+	uint64_t slot_start_ns;				//start of the current slot
+	uint64_t slotted;					//events in slots
+	struct event_heap overflow;
+};
+
+typedef enum {
+	SEG_SENT = 0,
+	SEG_SACKED,
+	SEG_LOST,
+} seg_state_t;
+
+struct seg {
+	uint64_t xmit_ns;					//last transmission
+	uint64_t first_tx_ns;				//flow's first_tx_ns when sent, for rate samples
+	uint64_t delivered_ns;				//flow's delivered_ns when sent
+	uint64_t delivered;					//flow's delivered when sent
+	uint8_t state;
+	uint8_t retrans;					//was ever retransmitted
+	uint8_t retrans_in_flight;			//a retransmission is in flight
+};
+
+struct range {
+	uint64_t start;
+	uint64_t end;
+};
+
+/* a data packet on its way to the receiver, then its ack on the way back */
+struct packet {
+	uint32_t flow;
+	uint32_t next_free;
+	uint64_t seg;
+	uint64_t xmit_ns;
+	uint8_t retrans;
+	uint8_t nsacks;
+	uint64_t cum_ack;
+	struct range sacks[SIM_MAX_SACKS];
+};
+
+/* a packet waiting in the sender's qdisc */
+struct local_packet {
+	uint64_t seg;
+	uint8_t retrans;
+};
+
+/* a packet a flow gave to the bottleneck in the current window */
+struct sent {
+	uint64_t time_ns;
+	uint32_t flow;
+	uint8_t retrans;
+	uint64_t seg;
+};
+
+/* the flows one thread runs, with their events and packets */
+struct shard {
+	struct wheel events;
+	struct packet *packets;
+	uint32_t packets_cap;
+	uint32_t packets_free;
+	struct sent *outbox;
+	size_t outbox_len;
+	size_t outbox_cap;
+	size_t outbox_pos;
+	uint32_t index;
+	pthread_t thread;
+};
+
+struct flow {
+	struct tcp_sock tp;					//the socket the module sees, must stay first
+	struct shard *shard;
+	uint32_t id;
+	uint32_t isn;
+	uint64_t start_ns;
+	uint64_t una;						//segment indices
+	uint64_t nxt;
+	struct seg *segs;					//ring indexed by segment, from una to nxt
+	uint64_t segs_cap;
+	uint64_t next_send_ns;
+	int send_pending;
+	int rto_pending;
+	uint64_t retrans_hint;				//no lost segments below it
+	uint32_t sacked;
+	uint32_t lost;
+	uint32_t retrans_out;
+	int in_recovery;
+	uint64_t recovery_point;
+	struct range last_sacks[SIM_MAX_SACKS];	//sack blocks of the last ack, already marked
+	int last_sacks_len;
+	uint64_t rack_xmit_ns;				//latest xmit time of a delivered segment
+	uint64_t srtt_us;
+	uint64_t rttvar_us;
+	uint64_t min_rtt_us;
+	uint64_t last_progress_ns;
+	uint64_t delivered;
+	uint64_t delivered_ns;
+	uint64_t first_tx_ns;
+
+	//receiver
+	uint64_t rcv_nxt;
+	struct range *ooo;					//out of order ranges, sorted
+	int ooo_len;
+	int ooo_cap;
+
+	//stats, the reports read goodput and interval bytes of all flows from flow_stats
+	uint64_t sent_bytes;
+	uint64_t retrans_segs;
+
+	uint64_t deadline_bytes;			//0 if the flow has no deadline
+	uint64_t deadline_ms;
+	uint64_t completed_ns;				//when deadline_bytes reached the receiver
+
+	//sender's qdisc and NIC (-N)
+	struct local_packet *local;			//ring of the packets in the qdisc
+	uint32_t local_cap;
+	uint32_t local_head;
+	uint32_t local_len;
+	int nic_pending;
+	uint64_t nic_free_ns;				//the NIC is done with the last packet
+	uint64_t cwr_point;					//CWR ends when una reaches it
+	uint64_t local_drops;
+	uint64_t throttled_ns;
+	uint64_t throttled_since_ns;		//0 if not throttled
+	uint64_t local_qdelay_max_ns;
+
+	//reverse path (-a, -R)
+	uint64_t rev_free_ns;				//the reverse link is done with its last packet
+	uint64_t rev_cross_ns;				//arrival of the next cross traffic packet
+	uint64_t acks_sent;
+	uint64_t acks_lost;					//dropped at random or by a full reverse link
+	uint64_t ack_qdelay_sum_ns;
+	uint64_t ack_qdelay_max_ns;
+};
+
+struct flow_stats {
+	uint64_t *goodput_bytes;
+	uint64_t *interval_bytes;
+};
+
+struct bin {
+	uint64_t capacity;					//bytes the link could deliver
+	uint64_t sent;						//bytes offered to the bottleneck
+	uint64_t delivered;					//bytes leaving the bottleneck
+	uint64_t qdelay_sum_ns;
+	uint64_t qdelay_max_ns;
+	uint64_t qdelay_count;
+	uint64_t drops;
+};
+
+struct queued {
+	uint64_t departure_ns;
+	uint32_t len;
+};
+
+struct deadline {
+	int flow;
+	uint64_t bytes;
+	uint64_t ms;
+};
+
+struct config {
+	int flows;
+	uint64_t duration_ns;
+	uint64_t rate_bps;
+	uint64_t rtt_ns;
+	uint64_t buffer_bytes;
+	double buffer_bdp;
+	double loss;
+	const char *schedule;
+	uint64_t interval_ns;
+	uint64_t start_spacing_ns;
+	uint64_t change_window_ns;
+	double change_threshold;
+	uint64_t seed;
+	int threads;
+	struct deadline *deadlines;
+	int deadlines_len;
+	uint64_t nic_rate_bps;				//0 sends straight to the bottleneck
+	uint64_t qdisc_bytes;
+	int no_tsq;
+	double ack_loss;
+	uint64_t rev_rate_bps;				//0 for an uncongested reverse path
+	uint64_t rev_cross_bps;
+	uint64_t rev_buffer_bytes;
+};
+
+static struct config cfg = {
+	.flows = 1,
+	.duration_ns = 30 * NSEC_PER_SEC,
+	.rate_bps = 100000000,
+	.rtt_ns = 30 * NSEC_PER_MSEC,
+	.buffer_bdp = 1,
+	.interval_ns = 1000 * NSEC_PER_MSEC,
+	.change_window_ns = 100 * NSEC_PER_MSEC,
+	.change_threshold = 0.3,
+	.seed = 1,
+	.threads = 1,
+	.qdisc_bytes = 1000 * SIM_WIRE_LEN,
+	.rev_buffer_bytes = 64000,
+};
+
+static struct tcp_congestion_ops *ops;
+static struct flow *flows;
+static struct flow_stats stats;
+static struct link bottleneck;
+static __thread uint64_t now_ns;
+
+static struct shard *shards;
+static uint64_t window_end_ns;				//the threads run events before it
+static int stopping;
+static pthread_barrier_t window_start, window_done;
+
+static struct queued *queue;				//bottleneck queue, ring
+static uint64_t queue_head, queue_tail, queue_cap;
+static uint64_t queue_bytes;
+
+static struct bin *bins;
+static uint64_t bins_len;
+static uint64_t *qdelay_hist;
+static uint64_t total_sent_pkts, total_drops;
+
+/* event heap */
+
+static void heap_push(struct event_heap *h, const struct event *ev)
+{
+	size_t i;
+
+	if (h->len == h->cap) {
+		h->cap = h->cap ? h->cap * 2 : 64;
+		h->events = realloc(h->events, h->cap * sizeof(*h->events));
+	}
+	i = h->len++;
+	while (i > 0 && h->events[(i - 1) / 2].time_ns > ev->time_ns) {
+		h->events[i] = h->events[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	h->events[i] = *ev;
+}
+
+static struct event heap_pop(struct event_heap *h)
+{
+	struct event top = h->events[0];
+	struct event last = h->events[--h->len];
+	size_t i = 0;
+
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= h->len) {
+			break;
+		}
+		if (child + 1 < h->len && h->events[child + 1].time_ns < h->events[child].time_ns) {
+			child++;
+		}
+		if (h->events[child].time_ns >= last.time_ns) {
+			break;
+		}
+		h->events[i] = h->events[child];
+		i = child;
+	}
+	h->events[i] = last;
+	return top;
+}
+
+/* timing wheel */
+
+static void wheel_push(struct wheel *w, uint64_t time_ns, event_type_t type, uint32_t flow, uint32_t packet)
+{
+	struct event ev = { time_ns, type, flow, packet };
+	struct event_heap *slot;
+
+	if (time_ns < w->slot_start_ns + SIM_WHEEL_SLOT_NS) {
+		heap_push(&w->current, &ev);
+		return;
+	}
+	if (time_ns >= w->slot_start_ns + SIM_WHEEL_SLOTS * SIM_WHEEL_SLOT_NS) {
+		heap_push(&w->overflow, &ev);
+		return;
+	}
+	//slots are unsorted, they are only heapified when they become current
+	slot = w->slots + (time_ns / SIM_WHEEL_SLOT_NS) % SIM_WHEEL_SLOTS;
+	if (slot->len == slot->cap) {
+		slot->cap = slot->cap ? slot->cap * 2 : 16;
+		slot->events = realloc(slot->events, slot->cap * sizeof(*slot->events));
+	}
+	slot->events[slot->len++] = ev;
+	w->slotted++;
+}
+
+/** pops the next event if it is before end_ns, returns 0 if there is none */
+static int wheel_pop_before(struct wheel *w, uint64_t end_ns, struct event *ev)
+{
+	while (w->current.len == 0) {
+		struct event_heap *slot;
+		size_t i;
+
+		if (w->slotted == 0 && w->overflow.len > 0 &&
+			w->overflow.events[0].time_ns >= w->slot_start_ns + SIM_WHEEL_SLOT_NS) {
+			//nothing in the wheel, jump to the slot before the first overflow event
+			uint64_t start = w->overflow.events[0].time_ns / SIM_WHEEL_SLOT_NS * SIM_WHEEL_SLOT_NS;
+			w->slot_start_ns = start - SIM_WHEEL_SLOT_NS;
+		} else if (w->slotted == 0 && w->overflow.len == 0) {
+			return 0;
+		}
+		if (w->slot_start_ns + SIM_WHEEL_SLOT_NS >= end_ns) {
+			return 0;
+		}
+		w->slot_start_ns += SIM_WHEEL_SLOT_NS;
+		slot = w->slots + (w->slot_start_ns / SIM_WHEEL_SLOT_NS) % SIM_WHEEL_SLOTS;
+		for (i = 0; i < slot->len; i++) {
+			heap_push(&w->current, slot->events + i);
+		}
+		w->slotted -= slot->len;
+		slot->len = 0;
+		while (w->overflow.len > 0 && w->overflow.events[0].time_ns < w->slot_start_ns + SIM_WHEEL_SLOT_NS) {
+			struct event e = heap_pop(&w->overflow);
+			heap_push(&w->current, &e);
+		}
+	}
+	if (w->current.events[0].time_ns >= end_ns) {
+		return 0;
+	}
+	*ev = heap_pop(&w->current);
+	return 1;
+}
+
+/* packet pool */
+
+static uint32_t packet_alloc(struct shard *sh)
+{
+	uint32_t idx, i;
+
+	if (sh->packets_free == UINT32_MAX) {
+		uint32_t old = sh->packets_cap;
+		sh->packets_cap = sh->packets_cap ? sh->packets_cap * 2 : 4096;
+		sh->packets = realloc(sh->packets, sh->packets_cap * sizeof(*sh->packets));
+		for (i = old; i < sh->packets_cap; i++) {
+			sh->packets[i].next_free = i + 1 < sh->packets_cap ? i + 1 : UINT32_MAX;
+		}
+		sh->packets_free = old;
+	}
+	idx = sh->packets_free;
+	sh->packets_free = sh->packets[idx].next_free;
+	return idx;
+}
+
+static void packet_release(struct shard *sh, uint32_t idx)
+{
+	sh->packets[idx].next_free = sh->packets_free;
+	sh->packets_free = idx;
+}
+
+/* segments */
+
+static struct seg *seg_of(struct flow *f, uint64_t idx)
+{
+	return f->segs + (idx & (f->segs_cap - 1));
+}
+
+static void segs_reserve(struct flow *f)
+{
+	struct seg *segs;
+	uint64_t i, cap;
+
+	if (f->nxt - f->una < f->segs_cap) {
+		return;
+	}
+	cap = f->segs_cap ? f->segs_cap * 2 : SIM_SEGS_INITIAL;
+	segs = calloc(cap, sizeof(*segs));
+	for (i = f->una; i < f->nxt; i++) {
+		segs[i & (cap - 1)] = *seg_of(f, i);
+	}
+	free(f->segs);
+	f->segs = segs;
+	f->segs_cap = cap;
+}
+
+static uint32_t seq_of(struct flow *f, uint64_t idx)
+{
+	return f->isn + (uint32_t)(idx * SIM_MSS);
+}
+
+static struct sock *sk_of(struct flow *f)
+{
+	return (struct sock *)&f->tp;
+}
+
+static struct bin *bin_at(uint64_t t_ns)
+{
+	uint64_t i = t_ns / SIM_BIN_NS;
+
+	return bins + (i < bins_len ? i : bins_len - 1);
+}
+
+static uint64_t rto_ns(struct flow *f)
+{
+	uint64_t rto = (f->srtt_us + 4 * f->rttvar_us) * NSEC_PER_USEC;
+
+	if (f->srtt_us == 0) {
+		rto = NSEC_PER_SEC;
+	}
+	return rto > SIM_MIN_RTO_NS ? rto : SIM_MIN_RTO_NS;
+}
+
+static void schedule_send(struct flow *f)
+{
+	if (f->send_pending) {
+		return;
+	}
+	f->send_pending = 1;
+	wheel_push(&f->shard->events, f->next_send_ns > now_ns ? f->next_send_ns : now_ns, EVENT_SEND, f->id, 0);
+}
+
+static void schedule_rto(struct flow *f)
+{
+	if (f->rto_pending) {
+		return;
+	}
+	f->rto_pending = 1;
+	wheel_push(&f->shard->events, f->last_progress_ns + rto_ns(f), EVENT_RTO, f->id, 0);
+}
+
+/* bottleneck */
+
+/** offers a packet sent at time_ns to the bottleneck, returns its arrival time at the receiver or 0 if dropped */
+static uint64_t bottleneck_enqueue(uint64_t time_ns, uint32_t len)
+{
+	struct bin *b = bin_at(time_ns);
+	uint64_t departure, qdelay;
+
+	b->sent += len;
+	total_sent_pkts++;
+
+	while (queue_head != queue_tail && queue[queue_head % queue_cap].departure_ns <= time_ns) {
+		queue_bytes -= queue[queue_head % queue_cap].len;
+		queue_head++;
+	}
+	if ((cfg.loss > 0 && (double)(kshim_random() >> 11) / (1ULL << 53) < cfg.loss) ||
+		queue_bytes + len > cfg.buffer_bytes) {
+		b->drops++;
+		total_drops++;
+		return 0;
+	}
+
+	if (queue_tail - queue_head == queue_cap) {
+		uint64_t i, cap = queue_cap ? queue_cap * 2 : 4096;
+		struct queued *q = malloc(cap * sizeof(*q));
+		for (i = queue_head; i < queue_tail; i++) {
+			q[i % cap] = queue[i % queue_cap];
+		}
+		free(queue);
+		queue = q;
+		queue_cap = cap;
+	}
+	departure = link_enqueue(&bottleneck, time_ns, len);
+	queue[queue_tail % queue_cap].departure_ns = departure;
+	queue[queue_tail % queue_cap].len = len;
+	queue_tail++;
+	queue_bytes += len;
+
+	//the queueing delay is everything before the packet's own serialization
+	b = bin_at(departure);
+	qdelay = departure - time_ns;
+	b->delivered += len;
+	b->qdelay_sum_ns += qdelay;
+	b->qdelay_count++;
+	if (qdelay > b->qdelay_max_ns) {
+		b->qdelay_max_ns = qdelay;
+	}
+	qdelay_hist[qdelay / SIM_QDELAY_BUCKET_NS < SIM_QDELAY_BUCKETS ? qdelay / SIM_QDELAY_BUCKET_NS : SIM_QDELAY_BUCKETS - 1]++;
+	return departure + cfg.rtt_ns / 2;
+}
+
+/* sender */
+
+static uint32_t in_flight(struct flow *f)
+{
+	return (f->nxt - f->una) - f->sacked - f->lost + f->retrans_out;
+}
+
+static void sync_tcp_sock(struct flow *f)
+{
+	f->tp.snd_una = seq_of(f, f->una);
+	f->tp.snd_nxt = seq_of(f, f->nxt);
+	f->tp.sacked_out = f->sacked;
+	f->tp.lost_out = f->lost;
+	f->tp.packets_out = f->nxt - f->una;
+	f->tp.total_retrans = f->retrans_segs;
+	f->tp.srtt_us = f->srtt_us << 3;
+	f->tp.bytes_acked = f->una * SIM_MSS;
+}
+
+static uint32_t local_bytes(struct flow *f)
+{
+	return f->local_len * SIM_WIRE_LEN;
+}
+
+/** TSQ: at most 1 ms of data at the pacing rate, and 2 packets, wait below the socket */
+static int tsq_throttled(struct flow *f)
+{
+	uint64_t limit = sk_of(f)->sk_pacing_rate >> 10;
+
+	if (!cfg.nic_rate_bps || cfg.no_tsq) {
+		return 0;
+	}
+	if (limit < 2 * SIM_WIRE_LEN) {
+		limit = 2 * SIM_WIRE_LEN;
+	}
+	return local_bytes(f) >= limit;
+}
+
+static void set_throttled(struct flow *f, int throttled)
+{
+	if (throttled) {
+		f->tp.tsq_flags |= 1UL << TSQ_THROTTLED;
+		if (!f->throttled_since_ns) {
+			f->throttled_since_ns = now_ns;
+		}
+	} else {
+		f->tp.tsq_flags &= ~(1UL << TSQ_THROTTLED);
+		if (f->throttled_since_ns) {
+			f->throttled_ns += now_ns - f->throttled_since_ns;
+			f->throttled_since_ns = 0;
+		}
+	}
+}
+
+/** a transmit the qdisc refuses puts the socket in CWR, the segment stays unsent */
+static void local_drop(struct flow *f)
+{
+	f->local_drops++;
+	if (f->tp.inet_conn.icsk_ca_state < TCP_CA_CWR) {
+		f->tp.inet_conn.icsk_ca_state = TCP_CA_CWR;
+		f->cwr_point = f->nxt;
+		if (ops->set_state) {
+			ops->set_state(sk_of(f), TCP_CA_CWR);
+		}
+	}
+}
+
+static void outbox_push(struct flow *f, uint64_t seg, int retrans)
+{
+	struct shard *sh = f->shard;
+	struct sent *out;
+
+	//the bottleneck takes the packets of all threads in order at the end of the window
+	if (sh->outbox_len == sh->outbox_cap) {
+		sh->outbox_cap = sh->outbox_cap ? sh->outbox_cap * 2 : 1024;
+		sh->outbox = realloc(sh->outbox, sh->outbox_cap * sizeof(*sh->outbox));
+	}
+	out = sh->outbox + sh->outbox_len++;
+	out->time_ns = now_ns;
+	out->flow = f->id;
+	out->seg = seg;
+	out->retrans = retrans;
+}
+
+static void schedule_nic(struct flow *f)
+{
+	if (f->nic_pending) {
+		return;
+	}
+	f->nic_pending = 1;
+	wheel_push(&f->shard->events, f->nic_free_ns > now_ns ? f->nic_free_ns : now_ns, EVENT_NIC, f->id, 0);
+}
+
+/** queues the packet in the qdisc, or gives it to the bottleneck if there is no NIC */
+static void host_send(struct flow *f, uint64_t seg, int retrans)
+{
+	struct local_packet *lp;
+	uint64_t qdelay;
+
+	if (!cfg.nic_rate_bps) {
+		outbox_push(f, seg, retrans);
+		return;
+	}
+	if (f->local_len == f->local_cap) {
+		//grow the ring, unwrapping it
+		struct local_packet *ring = malloc((f->local_cap ? f->local_cap * 2 : 64) * sizeof(*ring));
+		uint32_t i;
+
+		for (i = 0; i < f->local_len; i++) {
+			ring[i] = f->local[(f->local_head + i) % f->local_cap];
+		}
+		free(f->local);
+		f->local = ring;
+		f->local_head = 0;
+		f->local_cap = f->local_cap ? f->local_cap * 2 : 64;
+	}
+	lp = f->local + (f->local_head + f->local_len++) % f->local_cap;
+	lp->seg = seg;
+	lp->retrans = retrans;
+	f->tp.inet_conn.icsk_inet.sk.sk_wmem_alloc.counter = local_bytes(f);
+	qdelay = (f->nic_free_ns > now_ns ? f->nic_free_ns - now_ns : 0) +
+		(uint64_t)(f->local_len - 1) * SIM_WIRE_LEN * 8 * NSEC_PER_SEC / cfg.nic_rate_bps;
+	if (qdelay > f->local_qdelay_max_ns) {
+		f->local_qdelay_max_ns = qdelay;
+	}
+	schedule_nic(f);
+}
+
+/** the NIC puts the head of the qdisc on the wire */
+static void on_nic(struct flow *f)
+{
+	struct local_packet *lp = f->local + f->local_head;
+
+	f->nic_pending = 0;
+	if (f->local_len == 0) {
+		return;
+	}
+	outbox_push(f, lp->seg, lp->retrans);
+	f->local_head = (f->local_head + 1) % f->local_cap;
+	f->local_len--;
+	f->tp.inet_conn.icsk_inet.sk.sk_wmem_alloc.counter = local_bytes(f);
+	f->nic_free_ns = now_ns + (uint64_t)SIM_WIRE_LEN * 8 * NSEC_PER_SEC / cfg.nic_rate_bps;
+	if (f->local_len > 0) {
+		schedule_nic(f);
+	}
+	//the completion lets a throttled socket send again
+	if (f->throttled_since_ns && !tsq_throttled(f)) {
+		set_throttled(f, 0);
+		schedule_send(f);
+	}
+}
+
+static void on_send(struct flow *f)
+{
+	struct sock *sk = sk_of(f);
+	uint64_t idx, pacing_gap;
+	struct seg *s;
+	int retrans = 0, idle;
+
+	f->send_pending = 0;
+	if (now_ns < f->start_ns) {
+		f->next_send_ns = f->start_ns;
+		schedule_send(f);
+		return;
+	}
+	if (in_flight(f) >= f->tp.snd_cwnd) {
+		//cwnd limited, the next ack restarts sending
+		return;
+	}
+	if (tsq_throttled(f)) {
+		//the NIC restarts sending when the qdisc drains
+		set_throttled(f, 1);
+		return;
+	}
+	if (cfg.nic_rate_bps && local_bytes(f) + SIM_WIRE_LEN > cfg.qdisc_bytes) {
+		local_drop(f);
+		pacing_gap = sk->sk_pacing_rate ? (uint64_t)SIM_WIRE_LEN * NSEC_PER_SEC / sk->sk_pacing_rate : 0;
+		f->next_send_ns = now_ns + pacing_gap;
+		schedule_send(f);
+		return;
+	}
+
+	//retransmissions first
+	for (idx = f->retrans_hint > f->una ? f->retrans_hint : f->una; idx < f->nxt; idx++) {
+		s = seg_of(f, idx);
+		if (s->state == SEG_LOST && !s->retrans_in_flight) {
+			retrans = 1;
+			break;
+		}
+	}
+	f->retrans_hint = idx;
+	idle = in_flight(f) == 0;
+	if (!retrans) {
+		idx = f->nxt;
+		segs_reserve(f);
+		f->nxt++;
+		s = seg_of(f, idx);
+		memset(s, 0, sizeof(*s));
+	}
+
+	if (idle) {
+		f->first_tx_ns = now_ns;
+		f->delivered_ns = now_ns;
+	}
+	s->xmit_ns = now_ns;
+	s->first_tx_ns = f->first_tx_ns;
+	s->delivered_ns = f->delivered_ns;
+	s->delivered = f->delivered;
+	if (retrans) {
+		s->retrans = 1;
+		s->retrans_in_flight = 1;
+		f->retrans_out++;
+		f->retrans_segs++;
+	}
+	f->tp.data_segs_out++;
+	f->sent_bytes += SIM_MSS;
+	sync_tcp_sock(f);
+
+	host_send(f, idx, retrans);
+	schedule_rto(f);
+
+	pacing_gap = sk->sk_pacing_rate ? (uint64_t)SIM_WIRE_LEN * NSEC_PER_SEC / sk->sk_pacing_rate : 0;
+	f->next_send_ns = now_ns + pacing_gap;
+	schedule_send(f);
+}
+
+/** marks a segment delivered (cumulatively acked or sacked), returns 1 if it is newly delivered */
+static int deliver_seg(struct flow *f, uint64_t idx, const struct seg **latest)
+{
+	struct seg *s = seg_of(f, idx);
+
+	if (s->state == SEG_SACKED) {
+		return 0;
+	}
+	if (s->state == SEG_LOST) {
+		f->lost--;
+	}
+	if (s->retrans_in_flight) {
+		s->retrans_in_flight = 0;
+		f->retrans_out--;
+	}
+	s->state = SEG_SACKED;
+	f->delivered++;
+	if (s->xmit_ns > f->rack_xmit_ns) {
+		f->rack_xmit_ns = s->xmit_ns;
+	}
+	if (*latest == NULL || s->xmit_ns > (*latest)->xmit_ns) {
+		*latest = s;
+	}
+	return 1;
+}
+
+/** RACK: a segment sent sufficiently before a delivered one is lost */
+static int detect_losses(struct flow *f)
+{
+	uint64_t reo_ns = f->min_rtt_us * NSEC_PER_USEC / 4;
+	uint64_t idx;
+	int losses = 0;
+
+	for (idx = f->una; idx < f->nxt; idx++) {
+		struct seg *s = seg_of(f, idx);
+		if (s->xmit_ns + reo_ns >= f->rack_xmit_ns) {
+			if (!s->retrans) {
+				break;
+			}
+			continue;
+		}
+		if (s->state != SEG_SENT && !(s->state == SEG_LOST && s->retrans_in_flight)) {
+			continue;
+		}
+		if (s->retrans_in_flight) {
+			s->retrans_in_flight = 0;
+			f->retrans_out--;
+		} else {
+			f->lost++;
+		}
+		s->state = SEG_LOST;
+		if (idx < f->retrans_hint) {
+			f->retrans_hint = idx;
+		}
+		losses++;
+	}
+	return losses;
+}
+
+static void update_rtt(struct flow *f, uint64_t rtt_us)
+{
+	if (f->srtt_us == 0) {
+		f->srtt_us = rtt_us;
+		f->rttvar_us = rtt_us / 2;
+	} else {
+		uint64_t diff = rtt_us > f->srtt_us ? rtt_us - f->srtt_us : f->srtt_us - rtt_us;
+		f->rttvar_us = (3 * f->rttvar_us + diff) / 4;
+		f->srtt_us = (7 * f->srtt_us + rtt_us) / 8;
+	}
+	if (f->min_rtt_us == 0 || rtt_us < f->min_rtt_us) {
+		f->min_rtt_us = rtt_us;
+	}
+}
+
+static void on_ack(struct flow *f, struct packet *pkt)
+{
+	struct sock *sk = sk_of(f);
+	struct ack_sample sample;
+	struct rate_sample rs;
+	const struct seg *latest = NULL;
+	uint32_t prior_in_flight = in_flight(f);
+	uint32_t newly = 0;
+	uint64_t idx;
+	int i, losses;
+	//the segment that triggered the ack gives an rtt sample if this ack delivers it
+	int fresh = !pkt->retrans && pkt->seg >= f->una && pkt->seg < f->nxt &&
+		seg_of(f, pkt->seg)->state != SEG_SACKED && seg_of(f, pkt->seg)->xmit_ns == pkt->xmit_ns;
+
+	//cumulative ack
+	if (pkt->cum_ack > f->una) {
+		for (idx = f->una; idx < pkt->cum_ack; idx++) {
+			if (seg_of(f, idx)->state == SEG_SACKED) {
+				f->sacked--;
+			} else {
+				deliver_seg(f, idx, &latest);
+				newly++;
+			}
+		}
+		f->una = pkt->cum_ack;
+		f->last_progress_ns = now_ns;
+		if (f->in_recovery && f->una >= f->recovery_point) {
+			f->in_recovery = 0;
+		}
+		if (f->tp.inet_conn.icsk_ca_state == TCP_CA_CWR && f->una >= f->cwr_point) {
+			f->tp.inet_conn.icsk_ca_state = TCP_CA_Open;
+			if (ops->set_state) {
+				ops->set_state(sk, TCP_CA_Open);
+			}
+		}
+	}
+
+	//sacks, what the blocks of the last ack covered is already marked
+	for (i = 0; i < pkt->nsacks; i++) {
+		idx = pkt->sacks[i].start > f->una ? pkt->sacks[i].start : f->una;
+		while (idx < pkt->sacks[i].end && idx < f->nxt) {
+			int j, skipped = 0;
+			for (j = 0; j < f->last_sacks_len; j++) {
+				if (idx >= f->last_sacks[j].start && idx < f->last_sacks[j].end) {
+					idx = f->last_sacks[j].end;
+					skipped = 1;
+				}
+			}
+			if (skipped) {
+				continue;
+			}
+			if (deliver_seg(f, idx, &latest)) {
+				f->sacked++;
+				newly++;
+			}
+			idx++;
+		}
+	}
+	memcpy(f->last_sacks, pkt->sacks, pkt->nsacks * sizeof(*pkt->sacks));
+	f->last_sacks_len = pkt->nsacks;
+	if (pkt->nsacks > 0) {
+		struct tcp_sack_block blocks[SIM_MAX_SACKS];
+		int j, n = 0;
+
+		memset(blocks, 0, sizeof(blocks));
+		for (i = 0; i < pkt->nsacks; i++) {
+			blocks[n].start_seq = seq_of(f, pkt->sacks[i].start);
+			blocks[n].end_seq = seq_of(f, pkt->sacks[i].end);
+			n++;
+		}
+		//the kernel keeps the received sack blocks sorted by sequence
+		for (i = 0; i < n; i++) {
+			for (j = i + 1; j < n; j++) {
+				if (before(blocks[j].start_seq, blocks[i].start_seq)) {
+					struct tcp_sack_block tmp = blocks[i];
+					blocks[i] = blocks[j];
+					blocks[j] = tmp;
+				}
+			}
+		}
+		memcpy(f->tp.recv_sack_cache, blocks, sizeof(blocks));
+	}
+
+	if (fresh) {
+		update_rtt(f, (now_ns - pkt->xmit_ns) / NSEC_PER_USEC);
+	}
+
+	losses = detect_losses(f);
+	sync_tcp_sock(f);
+	if (losses && !f->in_recovery) {
+		f->in_recovery = 1;
+		f->recovery_point = f->nxt;
+		ops->ssthresh(sk);
+	}
+
+	memset(&rs, 0, sizeof(rs));
+	rs.rtt_us = -1;
+	rs.losses = losses;
+	rs.acked_sacked = newly;
+	rs.prior_in_flight = prior_in_flight;
+	if (latest != NULL) {
+		uint64_t send_elapsed = latest->xmit_ns - latest->first_tx_ns;
+		uint64_t ack_elapsed = now_ns - latest->delivered_ns;
+
+		rs.prior_mstamp = latest->delivered_ns / NSEC_PER_USEC;
+		rs.prior_delivered = latest->delivered;
+		rs.delivered = f->delivered - latest->delivered;
+		rs.interval_us = (send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed) / NSEC_PER_USEC;
+		rs.rtt_us = (now_ns - latest->xmit_ns) / NSEC_PER_USEC;
+		rs.is_retrans = latest->retrans;
+		f->first_tx_ns = latest->xmit_ns;
+		f->delivered_ns = now_ns;
+	}
+
+	memset(&sample, 0, sizeof(sample));
+	sample.pkts_acked = newly;
+	sample.rtt_us = pkt->retrans ? -1 : (s32)((now_ns - pkt->xmit_ns) / NSEC_PER_USEC);
+	sample.in_flight = prior_in_flight;
+
+	if (ops->in_ack_event) {
+		ops->in_ack_event(sk, 0);
+	}
+	if (newly && ops->pkts_acked) {
+		ops->pkts_acked(sk, &sample);
+	}
+	if (ops->cong_control) {
+		ops->cong_control(sk, &rs);
+	}
+	schedule_send(f);
+}
+
+static void on_rto(struct flow *f)
+{
+	uint64_t idx;
+
+	f->rto_pending = 0;
+	if (f->una == f->nxt) {
+		return;
+	}
+	if (now_ns < f->last_progress_ns + rto_ns(f)) {
+		schedule_rto(f);
+		return;
+	}
+
+	//everything not sacked is lost
+	for (idx = f->una; idx < f->nxt; idx++) {
+		struct seg *s = seg_of(f, idx);
+		if (s->state == SEG_SACKED) {
+			continue;
+		}
+		if (s->retrans_in_flight) {
+			s->retrans_in_flight = 0;
+			f->retrans_out--;
+		}
+		if (s->state != SEG_LOST) {
+			s->state = SEG_LOST;
+			f->lost++;
+		}
+	}
+	f->retrans_hint = f->una;
+	f->in_recovery = 1;
+	f->recovery_point = f->nxt;
+	f->last_progress_ns = now_ns;
+	sync_tcp_sock(f);
+	ops->ssthresh(sk_of(f));
+	schedule_send(f);
+	schedule_rto(f);
+}
+
+/* receiver */
+
+static void ooo_add(struct flow *f, uint64_t idx)
+{
+	int i, j;
+
+	for (i = 0; i < f->ooo_len; i++) {
+		if (idx >= f->ooo[i].start && idx < f->ooo[i].end) {
+			return;
+		}
+		if (idx + 1 == f->ooo[i].start) {
+			f->ooo[i].start = idx;
+			return;
+		}
+		if (idx == f->ooo[i].end) {
+			f->ooo[i].end++;
+			//merge with the next range
+			if (i + 1 < f->ooo_len && f->ooo[i + 1].start == f->ooo[i].end) {
+				f->ooo[i].end = f->ooo[i + 1].end;
+				for (j = i + 1; j + 1 < f->ooo_len; j++) {
+					f->ooo[j] = f->ooo[j + 1];
+				}
+				f->ooo_len--;
+			}
+			return;
+		}
+		if (idx < f->ooo[i].start) {
+			break;
+		}
+	}
+	if (f->ooo_len == f->ooo_cap) {
+		f->ooo_cap = f->ooo_cap ? f->ooo_cap * 2 : 16;
+		f->ooo = realloc(f->ooo, f->ooo_cap * sizeof(*f->ooo));
+	}
+	for (j = f->ooo_len; j > i; j--) {
+		f->ooo[j] = f->ooo[j - 1];
+	}
+	f->ooo[i].start = idx;
+	f->ooo[i].end = idx + 1;
+	f->ooo_len++;
+}
+
+static double random_unit(void)
+{
+	return (double)(kshim_random() >> 11) / (1ULL << 53);
+}
+
+/** offers len bytes to the flow's reverse link at time_ns, returns 0 if its buffer has no room */
+static int rev_enqueue(struct flow *f, uint64_t time_ns, uint32_t len)
+{
+	uint64_t backlog_ns = f->rev_free_ns > time_ns ? f->rev_free_ns - time_ns : 0;
+
+	if (backlog_ns * cfg.rev_rate_bps / 8 / NSEC_PER_SEC + len > cfg.rev_buffer_bytes) {
+		return 0;
+	}
+	f->rev_free_ns = (f->rev_free_ns > time_ns ? f->rev_free_ns : time_ns) +
+		(uint64_t)len * 8 * NSEC_PER_SEC / cfg.rev_rate_bps;
+	return 1;
+}
+
+/** sends the ack in packet p back over the reverse path, which may drop or delay it */
+static void send_ack(struct flow *f, uint32_t p)
+{
+	struct packet *pkt = f->shard->packets + p;
+	uint64_t departure = now_ns, qdelay;
+
+	f->acks_sent++;
+	if (cfg.ack_loss > 0 && random_unit() < cfg.ack_loss) {
+		f->acks_lost++;
+		packet_release(f->shard, p);
+		return;
+	}
+	if (cfg.rev_rate_bps) {
+		//the cross traffic that came before the ack is ahead of it
+		while (cfg.rev_cross_bps && f->rev_cross_ns <= now_ns) {
+			rev_enqueue(f, f->rev_cross_ns, SIM_WIRE_LEN);
+			f->rev_cross_ns += -log(1 - random_unit()) * SIM_WIRE_LEN * 8 * NSEC_PER_SEC / cfg.rev_cross_bps;
+		}
+		if (!rev_enqueue(f, now_ns, SIM_ACK_WIRE_LEN + (pkt->nsacks ? 4 + 8 * pkt->nsacks : 0))) {
+			f->acks_lost++;
+			packet_release(f->shard, p);
+			return;
+		}
+		departure = f->rev_free_ns;
+		qdelay = departure - now_ns;
+		f->ack_qdelay_sum_ns += qdelay;
+		if (qdelay > f->ack_qdelay_max_ns) {
+			f->ack_qdelay_max_ns = qdelay;
+		}
+	}
+	wheel_push(&f->shard->events, departure + cfg.rtt_ns / 2, EVENT_ACK, f->id, p);
+}
+
+static void on_recv(struct flow *f, uint32_t p)
+{
+	struct packet *pkt = f->shard->packets + p;
+	uint64_t idx = pkt->seg;
+	int i, n = 0, newest = -1;
+
+	if (idx == f->rcv_nxt) {
+		f->rcv_nxt++;
+		stats.goodput_bytes[f->id] += SIM_MSS;
+		stats.interval_bytes[f->id] += SIM_MSS;
+		//pull in the out of order data that is now in order
+		if (f->ooo_len > 0 && f->ooo[0].start == f->rcv_nxt) {
+			f->rcv_nxt = f->ooo[0].end;
+			memmove(f->ooo, f->ooo + 1, (f->ooo_len - 1) * sizeof(*f->ooo));
+			f->ooo_len--;
+		}
+		if (f->deadline_bytes && !f->completed_ns && f->rcv_nxt * SIM_MSS >= f->deadline_bytes) {
+			f->completed_ns = now_ns;
+		}
+	} else if (idx > f->rcv_nxt) {
+		int before_len = f->ooo_len;
+		uint64_t covered = 0;
+
+		for (i = 0; i < before_len; i++) {
+			covered += idx >= f->ooo[i].start && idx < f->ooo[i].end;
+		}
+		ooo_add(f, idx);
+		if (!covered) {
+			stats.goodput_bytes[f->id] += SIM_MSS;
+			stats.interval_bytes[f->id] += SIM_MSS;
+		}
+	}
+
+	//the first sack block holds the latest segment, then the highest ones
+	pkt->cum_ack = f->rcv_nxt;
+	for (i = 0; i < f->ooo_len; i++) {
+		if (idx >= f->ooo[i].start && idx < f->ooo[i].end) {
+			newest = i;
+			pkt->sacks[n++] = f->ooo[i];
+		}
+	}
+	for (i = f->ooo_len - 1; i >= 0 && n < SIM_MAX_SACKS; i--) {
+		if (i != newest) {
+			pkt->sacks[n++] = f->ooo[i];
+		}
+	}
+	pkt->nsacks = n;
+	send_ack(f, p);
+}
+
+/* reporting */
+
+static double qdelay_percentile(double pct)
+{
+	uint64_t total = 0, seen = 0;
+	int i;
+
+	for (i = 0; i < SIM_QDELAY_BUCKETS; i++) {
+		total += qdelay_hist[i];
+	}
+	for (i = 0; i < SIM_QDELAY_BUCKETS; i++) {
+		seen += qdelay_hist[i];
+		if (seen > 0 && seen >= total * pct / 100) {
+			return (i + 0.5) * SIM_QDELAY_BUCKET_NS / 1e6;
+		}
+	}
+	return 0;
+}
+
+static void report_interval(uint64_t from_ns, uint64_t to_ns)
+{
+	uint64_t capacity = 0, delivered = 0, qsum = 0, qcount = 0, qmax = 0, drops = 0, t;
+	double secs = (double)(to_ns - from_ns) / NSEC_PER_SEC;
+	double sum = 0, sum_sq = 0;
+	int i;
+
+	for (t = from_ns; t < to_ns; t += SIM_BIN_NS) {
+		struct bin *b = bin_at(t);
+		capacity += b->capacity;
+		delivered += b->delivered;
+		qsum += b->qdelay_sum_ns;
+		qcount += b->qdelay_count;
+		qmax = b->qdelay_max_ns > qmax ? b->qdelay_max_ns : qmax;
+		drops += b->drops;
+	}
+	for (i = 0; i < cfg.flows; i++) {
+		double g = stats.interval_bytes[i];
+		sum += g;
+		sum_sq += g * g;
+	}
+	printf("%8.3f capacity %9.3f throughput %9.3f util %5.3f qdelay %8.3f max %8.3f drops %6llu jain %5.3f",
+		to_ns / 1e9, capacity * 8 / secs / 1e6, delivered * 8 / secs / 1e6,
+		capacity ? (double)delivered / capacity : 0, qcount ? qsum / 1e6 / qcount : 0, qmax / 1e6,
+		(unsigned long long)drops, sum_sq > 0 ? sum * sum / (cfg.flows * sum_sq) : 0);
+	for (i = 0; i < cfg.flows && i < SIM_PRINTED_FLOWS; i++) {
+		printf(" f%d %9.3f", i, stats.interval_bytes[i] * 8 / secs / 1e6);
+	}
+	printf("\n");
+	memset(stats.interval_bytes, 0, cfg.flows * sizeof(*stats.interval_bytes));
+}
+
+/** finds capacity changes between windows and measures how long the flows take to follow them */
+static void report_reactions(void)
+{
+	uint64_t windows = cfg.duration_ns / cfg.change_window_ns;
+	uint64_t bins_per_window = cfg.change_window_ns / SIM_BIN_NS;
+	double react_sum[2] = { 0, 0 };
+	int reacted[2] = { 0, 0 }, events[2] = { 0, 0 };
+	uint64_t w, next;
+
+	if (bins_per_window == 0) {
+		bins_per_window = 1;
+	}
+	for (w = 1; w < windows; w++) {
+		uint64_t prev_cap = link_capacity(&bottleneck, (w - 1) * cfg.change_window_ns, w * cfg.change_window_ns);
+		uint64_t cap = link_capacity(&bottleneck, w * cfg.change_window_ns, (w + 1) * cfg.change_window_ns);
+		uint64_t b, first, last;
+		int up, found = 0;
+		double target;
+
+		if (prev_cap == 0 || fabs((double)cap - prev_cap) / prev_cap < cfg.change_threshold) {
+			continue;
+		}
+		up = cap > prev_cap;
+		//the reaction is measured until the next change
+		for (next = w + 1; next < windows; next++) {
+			uint64_t c = link_capacity(&bottleneck, next * cfg.change_window_ns, (next + 1) * cfg.change_window_ns);
+			if (fabs((double)c - cap) / cap >= cfg.change_threshold) {
+				break;
+			}
+		}
+		target = (double)cap / bins_per_window;
+		first = w * bins_per_window;
+		last = next * bins_per_window;
+		for (b = first; b + 2 < last && b + 2 < bins_len; b++) {
+			//sending rate over 3 bins
+			double sent = (bins[b].sent + bins[b + 1].sent + bins[b + 2].sent) / 3.0;
+			if ((up && sent >= target * (1 - SIM_REACT_MARGIN)) || (!up && sent <= target * (1 + SIM_REACT_MARGIN))) {
+				found = 1;
+				break;
+			}
+		}
+		events[up]++;
+		printf("# change at %.3f s: %.3f -> %.3f Mbit/s, ", (double)w * cfg.change_window_ns / 1e9,
+			prev_cap * 8e3 / cfg.change_window_ns, cap * 8e3 / cfg.change_window_ns);
+		if (found) {
+			double react_ms = (double)(b - first) * SIM_BIN_NS / 1e6;
+			reacted[up]++;
+			react_sum[up] += react_ms;
+			printf("reacted in %.1f ms\n", react_ms);
+		} else {
+			printf("did not react within %.1f ms\n", (double)(last - first) * SIM_BIN_NS / 1e6);
+		}
+		w = next - 1;
+	}
+	printf("react_down_events %d\nreact_down_reacted %d\nreact_down_ms %.1f\n", events[0], reacted[0],
+		reacted[0] ? react_sum[0] / reacted[0] : 0);
+	printf("react_up_events %d\nreact_up_reacted %d\nreact_up_ms %.1f\n", events[1], reacted[1],
+		reacted[1] ? react_sum[1] / reacted[1] : 0);
+}
+
+/**
+ * how long the flows take from the start to deliver within 15% of the
+ * capacity, and the queue and drops they cause on the way, until 5 rtts
+ * after they got there
+ */
+static void report_startup(void)
+{
+	uint64_t tail = SIM_STARTUP_TAIL_RTTS * cfg.rtt_ns / SIM_BIN_NS;
+	uint64_t b, end, qmax = 0, drops = 0;
+	int found = 0;
+
+	for (b = 0; b + 2 < bins_len; b++) {
+		double delivered = bins[b].delivered + bins[b + 1].delivered + bins[b + 2].delivered;
+		double capacity = bins[b].capacity + bins[b + 1].capacity + bins[b + 2].capacity;
+
+		if (capacity > 0 && delivered >= capacity * (1 - SIM_REACT_MARGIN)) {
+			found = 1;
+			break;
+		}
+	}
+	end = (found ? b : bins_len) + tail;
+	for (b = 0; b < end && b < bins_len; b++) {
+		qmax = bins[b].qdelay_max_ns > qmax ? bins[b].qdelay_max_ns : qmax;
+		drops += bins[b].drops;
+	}
+	printf("startup_ms %.1f\nstartup_qdelay_max_ms %.3f\nstartup_drops %llu\n",
+		found ? (double)(end - tail) * SIM_BIN_NS / 1e6 : -1, qmax / 1e6,
+		(unsigned long long)drops);
+}
+
+/** which flows with a deadline got their bytes to the receiver in time */
+static void report_deadlines(void)
+{
+	int j, met = 0, total = 0;
+
+	for (j = 0; j < cfg.flows; j++) {
+		struct flow *f = flows + j;
+		double completed_ms = f->completed_ns ? (f->completed_ns - f->start_ns) / 1e6 : -1;
+		int ok = f->completed_ns && completed_ms <= f->deadline_ms;
+
+		if (!f->deadline_bytes) {
+			continue;
+		}
+		printf("deadline flow %d bytes %llu deadline_ms %llu completed_ms %.1f met %d\n", j,
+			(unsigned long long)f->deadline_bytes, (unsigned long long)f->deadline_ms, completed_ms, ok);
+		met += ok;
+		total++;
+	}
+	if (total) {
+		printf("deadline_met_rate %.4f\n", (double)met / total);
+	}
+}
+
+/** how much the senders' own qdiscs held them back */
+static void report_local(void)
+{
+	uint64_t drops = 0, throttled_ns = 0, qdelay_max_ns = 0;
+	int j;
+
+	if (!cfg.nic_rate_bps) {
+		return;
+	}
+	for (j = 0; j < cfg.flows; j++) {
+		struct flow *f = flows + j;
+
+		if (f->throttled_since_ns) {
+			f->throttled_ns += cfg.duration_ns - f->throttled_since_ns;
+		}
+		if (j < SIM_PRINTED_FLOWS) {
+			printf("local flow %d drops %llu throttled_ms %.1f qdelay_max_ms %.3f\n", j,
+				(unsigned long long)f->local_drops, f->throttled_ns / 1e6, f->local_qdelay_max_ns / 1e6);
+		}
+		drops += f->local_drops;
+		throttled_ns += f->throttled_ns;
+		if (f->local_qdelay_max_ns > qdelay_max_ns) {
+			qdelay_max_ns = f->local_qdelay_max_ns;
+		}
+	}
+	printf("local_drops %llu\nlocal_throttled_ms %.1f\nlocal_qdelay_max_ms %.3f\n", (unsigned long long)drops,
+		throttled_ns / 1e6, qdelay_max_ns / 1e6);
+}
+
+static void report_reverse(void)
+{
+	uint64_t sent = 0, lost = 0, qsum = 0, qdelay_max_ns = 0;
+	int j;
+
+	if (cfg.ack_loss == 0 && !cfg.rev_rate_bps) {
+		return;
+	}
+	for (j = 0; j < cfg.flows; j++) {
+		struct flow *f = flows + j;
+		uint64_t delivered = f->acks_sent - f->acks_lost;
+
+		if (j < SIM_PRINTED_FLOWS) {
+			printf("reverse flow %d acks %llu lost %llu qdelay_mean_ms %.3f qdelay_max_ms %.3f\n", j,
+				(unsigned long long)f->acks_sent, (unsigned long long)f->acks_lost,
+				delivered ? f->ack_qdelay_sum_ns / 1e6 / delivered : 0, f->ack_qdelay_max_ns / 1e6);
+		}
+		sent += f->acks_sent;
+		lost += f->acks_lost;
+		qsum += f->ack_qdelay_sum_ns;
+		if (f->ack_qdelay_max_ns > qdelay_max_ns) {
+			qdelay_max_ns = f->ack_qdelay_max_ns;
+		}
+	}
+	printf("ack_loss_rate %.5f\nack_qdelay_mean_ms %.3f\nack_qdelay_max_ms %.3f\n", sent ? (double)lost / sent : 0,
+		sent > lost ? qsum / 1e6 / (sent - lost) : 0, qdelay_max_ns / 1e6);
+}
+
+static void report_summary(void)
+{
+	uint64_t capacity = 0, delivered = 0, qsum = 0, qcount = 0, i;
+	double sum = 0, sum_sq = 0;
+	int j;
+
+	for (i = 0; i < bins_len; i++) {
+		capacity += bins[i].capacity;
+		delivered += bins[i].delivered;
+		qsum += bins[i].qdelay_sum_ns;
+		qcount += bins[i].qdelay_count;
+	}
+	for (j = 0; j < cfg.flows; j++) {
+		double g = stats.goodput_bytes[j];
+		sum += g;
+		sum_sq += g * g;
+	}
+
+	printf("utilization %.4f\n", capacity ? (double)delivered / capacity : 0);
+	printf("goodput_mbit %.3f\n", sum * 8 / (cfg.duration_ns / 1e9) / 1e6);
+	printf("qdelay_mean_ms %.3f\n", qcount ? qsum / 1e6 / qcount : 0);
+	printf("qdelay_p50_ms %.3f\nqdelay_p95_ms %.3f\nqdelay_p99_ms %.3f\n",
+		qdelay_percentile(50), qdelay_percentile(95), qdelay_percentile(99));
+	printf("loss_rate %.5f\n", total_sent_pkts ? (double)total_drops / total_sent_pkts : 0);
+	printf("jain_fairness %.4f\n", sum_sq > 0 ? sum * sum / (cfg.flows * sum_sq) : 0);
+	report_startup();
+	report_deadlines();
+	report_local();
+	report_reverse();
+	report_reactions();
+}
+
+/* windows */
+
+/** runs the events of the shard's flows before the end of the window */
+static void run_shard(struct shard *sh)
+{
+	struct event ev;
+
+	while (wheel_pop_before(&sh->events, window_end_ns, &ev)) {
+		struct flow *f = flows + ev.flow;
+
+		now_ns = ev.time_ns;
+		kshim_now_ns = SIM_EPOCH_NS + now_ns;
+		switch (ev.type) {
+			case EVENT_SEND:
+				on_send(f);
+				break;
+			case EVENT_RECV:
+				on_recv(f, ev.packet);
+				break;
+			case EVENT_ACK:
+				on_ack(f, sh->packets + ev.packet);
+				packet_release(sh, ev.packet);
+				break;
+			case EVENT_RTO:
+				on_rto(f);
+				break;
+			case EVENT_NIC:
+				on_nic(f);
+				break;
+		}
+	}
+}
+
+static void *shard_thread(void *arg)
+{
+	struct shard *sh = arg;
+
+	kshim_seed(cfg.seed + sh->index);
+	for (;;) {
+		pthread_barrier_wait(&window_start);
+		if (stopping) {
+			return NULL;
+		}
+		run_shard(sh);
+		pthread_barrier_wait(&window_done);
+	}
+}
+
+/** gives the packets all threads sent in the window to the bottleneck, in time order */
+static void flush_outboxes(void)
+{
+	struct shard *first;
+	struct packet *pkt;
+	struct sent *out;
+	uint64_t arrival;
+	uint32_t p;
+	int i;
+
+	for (;;) {
+		first = NULL;
+		for (i = 0; i < cfg.threads; i++) {
+			struct shard *sh = shards + i;
+			struct sent *o = sh->outbox + sh->outbox_pos;
+
+			if (sh->outbox_pos == sh->outbox_len) {
+				continue;
+			}
+			if (first == NULL || o->time_ns < first->outbox[first->outbox_pos].time_ns ||
+				(o->time_ns == first->outbox[first->outbox_pos].time_ns && o->flow < first->outbox[first->outbox_pos].flow)) {
+				first = sh;
+			}
+		}
+		if (first == NULL) {
+			break;
+		}
+		out = first->outbox + first->outbox_pos++;
+		arrival = bottleneck_enqueue(out->time_ns, SIM_WIRE_LEN);
+		if (arrival) {
+			p = packet_alloc(first);
+			pkt = first->packets + p;
+			pkt->flow = out->flow;
+			pkt->seg = out->seg;
+			pkt->xmit_ns = out->time_ns;
+			pkt->retrans = out->retrans;
+			wheel_push(&first->events, arrival, EVENT_RECV, out->flow, p);
+		}
+	}
+	for (i = 0; i < cfg.threads; i++) {
+		shards[i].outbox_len = 0;
+		shards[i].outbox_pos = 0;
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f flows] [-t seconds] [-r rate_mbit] [-d rtt_ms] [-b buffer_kb]\n"
+		"       [-B buffer_bdp] [-l loss] [-c schedule|trace_file] [-i interval_ms]\n"
+		"       [-S start_spacing_ms] [-w change_window_ms] [-s seed] [-T threads]\n"
+		"       [-p param=value]... [-D flow:bytes:deadline_ms]... [-N nic_mbit]\n"
+		"       [-q qdisc_kb] [-Q] [-a ack_loss] [-R rev_mbit[:cross_mbit[:rev_buffer_kb]]] [-v]\n"
+		"schedules: const, step:<mbit>@<sec>,..., sine:<min_mbit>:<max_mbit>:<period_sec>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t next_report, last_report = 0, lookahead_ns, t, i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:t:r:d:b:B:l:c:i:S:w:s:T:p:D:N:q:Qa:R:v")) != -1) {
+		switch (opt) {
+			case 'f': cfg.flows = atoi(optarg); break;
+			case 't': cfg.duration_ns = atof(optarg) * NSEC_PER_SEC; break;
+			case 'r': cfg.rate_bps = atof(optarg) * 1e6; break;
+			case 'd': cfg.rtt_ns = atof(optarg) * NSEC_PER_MSEC; break;
+			case 'b': cfg.buffer_bytes = atof(optarg) * 1000; break;
+			case 'B': cfg.buffer_bdp = atof(optarg); break;
+			case 'l': cfg.loss = atof(optarg); break;
+			case 'c': cfg.schedule = optarg; break;
+			case 'i': cfg.interval_ns = atof(optarg) * NSEC_PER_MSEC; break;
+			case 'S': cfg.start_spacing_ns = atof(optarg) * NSEC_PER_MSEC; break;
+			case 'w': cfg.change_window_ns = atof(optarg) * NSEC_PER_MSEC; break;
+			case 's': cfg.seed = strtoull(optarg, NULL, 0); break;
+			case 'T': cfg.threads = atoi(optarg); break;
+			case 'p': {
+				//module parameters, as modprobe would set them
+				char *value = strchr(optarg, '=');
+				if (value == NULL) {
+					usage(argv[0]);
+				}
+				*value++ = '\0';
+				if (kshim_param_set(optarg, value) < 0) {
+					fprintf(stderr, "bad module parameter %s=%s\n", optarg, value);
+					return 1;
+				}
+				break;
+			}
+			case 'D': {
+				struct deadline *d;
+
+				cfg.deadlines = realloc(cfg.deadlines, (cfg.deadlines_len + 1) * sizeof(*cfg.deadlines));
+				d = cfg.deadlines + cfg.deadlines_len++;
+				if (sscanf(optarg, "%d:%llu:%llu", &d->flow, (unsigned long long *)&d->bytes,
+					(unsigned long long *)&d->ms) != 3 || d->bytes == 0) {
+					usage(argv[0]);
+				}
+				break;
+			}
+			case 'N': cfg.nic_rate_bps = atof(optarg) * 1e6; break;
+			case 'q': cfg.qdisc_bytes = atof(optarg) * 1000; break;
+			case 'Q': cfg.no_tsq = 1; break;
+			case 'a': cfg.ack_loss = atof(optarg); break;
+			case 'R': {
+				double rev = 0, cross = 0, buffer = cfg.rev_buffer_bytes / 1000.0;
+
+				if (sscanf(optarg, "%lf:%lf:%lf", &rev, &cross, &buffer) < 1 || rev <= 0 || buffer <= 0) {
+					usage(argv[0]);
+				}
+				cfg.rev_rate_bps = rev * 1e6;
+				cfg.rev_cross_bps = cross * 1e6;
+				cfg.rev_buffer_bytes = buffer * 1000;
+				break;
+			}
+			case 'v': kshim_verbose = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (cfg.flows < 1 || cfg.duration_ns == 0 || cfg.interval_ns == 0 || cfg.change_window_ns == 0 ||
+		cfg.threads < 1) {
+		usage(argv[0]);
+	}
+	for (i = 0; i < (uint64_t)cfg.deadlines_len; i++) {
+		if (cfg.deadlines[i].flow < 0 || cfg.deadlines[i].flow >= cfg.flows) {
+			usage(argv[0]);
+		}
+	}
+	if (cfg.threads > cfg.flows) {
+		cfg.threads = cfg.flows;
+	}
+	if (link_init(&bottleneck, cfg.schedule, cfg.rate_bps) < 0) {
+		fprintf(stderr, "bad schedule %s\n", cfg.schedule);
+		return 1;
+	}
+	if (cfg.buffer_bytes == 0) {
+		cfg.buffer_bytes = cfg.buffer_bdp * link_rate_at(&bottleneck, 0) / 8 * cfg.rtt_ns / NSEC_PER_SEC;
+		if (cfg.buffer_bytes < 2 * SIM_WIRE_LEN) {
+			cfg.buffer_bytes = 2 * SIM_WIRE_LEN;
+		}
+	}
+	kshim_seed(cfg.seed);
+	ops = pcc_module_ops();
+
+	bins_len = cfg.duration_ns / SIM_BIN_NS + 1;
+	bins = calloc(bins_len, sizeof(*bins));
+	qdelay_hist = calloc(SIM_QDELAY_BUCKETS, sizeof(*qdelay_hist));
+	for (i = 0; i < bins_len; i++) {
+		bins[i].capacity = link_capacity(&bottleneck, i * SIM_BIN_NS, (i + 1) * SIM_BIN_NS);
+	}
+
+	shards = calloc(cfg.threads, sizeof(*shards));
+	for (i = 0; i < (uint64_t)cfg.threads; i++) {
+		shards[i].index = i;
+		shards[i].packets_free = UINT32_MAX;
+		shards[i].events.slots = calloc(SIM_WHEEL_SLOTS, sizeof(*shards[i].events.slots));
+	}
+	flows = calloc(cfg.flows, sizeof(*flows));
+	stats.goodput_bytes = calloc(cfg.flows, sizeof(*stats.goodput_bytes));
+	stats.interval_bytes = calloc(cfg.flows, sizeof(*stats.interval_bytes));
+	for (i = 0; i < (uint64_t)cfg.flows; i++) {
+		struct flow *f = flows + i;
+		f->id = i;
+		f->shard = shards + i * cfg.threads / cfg.flows;
+		f->isn = (uint32_t)kshim_random();
+		f->start_ns = i * cfg.start_spacing_ns;
+		f->last_progress_ns = f->start_ns;
+		f->rev_cross_ns = f->start_ns;
+		f->tp.advmss = SIM_MSS;
+		f->tp.mss_cache = SIM_MSS;
+		f->tp.snd_cwnd = SIM_INITIAL_CWND;
+		f->tp.inet_conn.icsk_inet.sk.sk_family = AF_INET;
+		//10.0.0.1:(10000 + id) -> 10.0.1.1:5001, for the module to find the flow of a deadline
+		f->tp.inet_conn.icsk_inet.inet_saddr = htonl(0x0a000001);
+		f->tp.inet_conn.icsk_inet.inet_daddr = htonl(0x0a000101);
+		f->tp.inet_conn.icsk_inet.inet_sport = htons(10000 + i);
+		f->tp.inet_conn.icsk_inet.inet_dport = htons(5001);
+		sync_tcp_sock(f);
+		kshim_now_ns = SIM_EPOCH_NS + f->start_ns;
+		ops->init(sk_of(f));
+		f->next_send_ns = f->start_ns;
+		schedule_send(f);
+	}
+	for (i = 0; i < (uint64_t)cfg.deadlines_len; i++) {
+		struct deadline *d = cfg.deadlines + i;
+		struct flow *f = flows + d->flow;
+
+		f->deadline_bytes = d->bytes;
+		f->deadline_ms = d->ms;
+		kshim_now_ns = SIM_EPOCH_NS + f->start_ns;
+		pcc_module_deadline_add(sk_of(f), d->bytes, d->ms);
+	}
+
+	printf("# flows %d rate %.3f Mbit/s rtt %.3f ms buffer %llu bytes loss %g schedule %s threads %d\n",
+		cfg.flows, cfg.rate_bps / 1e6, cfg.rtt_ns / 1e6, (unsigned long long)cfg.buffer_bytes,
+		cfg.loss, cfg.schedule ? cfg.schedule : "const", cfg.threads);
+	printf("# params");
+	kshim_param_print(stdout);
+	printf("\n");
+	//a packet sent in a window reaches the receiver after the window ends
+	lookahead_ns = cfg.rtt_ns / 2 > 0 ? cfg.rtt_ns / 2 : 1;
+	if (cfg.threads > 1) {
+		pthread_barrier_init(&window_start, NULL, cfg.threads);
+		pthread_barrier_init(&window_done, NULL, cfg.threads);
+		for (i = 1; i < (uint64_t)cfg.threads; i++) {
+			pthread_create(&shards[i].thread, NULL, shard_thread, shards + i);
+		}
+	}
+	next_report = cfg.interval_ns;
+	for (t = 0; t < cfg.duration_ns; t = window_end_ns) {
+		window_end_ns = t + lookahead_ns;
+		if (window_end_ns > next_report) {
+			window_end_ns = next_report;
+		}
+		if (window_end_ns > cfg.duration_ns) {
+			window_end_ns = cfg.duration_ns;
+		}
+		if (cfg.threads > 1) {
+			pthread_barrier_wait(&window_start);
+		}
+		run_shard(shards);
+		if (cfg.threads > 1) {
+			pthread_barrier_wait(&window_done);
+		}
+		flush_outboxes();
+		if (window_end_ns == next_report) {
+			report_interval(last_report, next_report);
+			last_report = next_report;
+			next_report += cfg.interval_ns;
+		}
+	}
+	if (cfg.threads > 1) {
+		stopping = 1;
+		pthread_barrier_wait(&window_start);
+		for (i = 1; i < (uint64_t)cfg.threads; i++) {
+			pthread_join(shards[i].thread, NULL);
+		}
+	}
+	while (next_report <= cfg.duration_ns) {
+		report_interval(last_report, next_report);
+		last_report = next_report;
+		next_report += cfg.interval_ns;
+	}
+	report_summary();
+
+	for (i = 0; i < (uint64_t)cfg.flows; i++) {
+		ops->release(sk_of(flows + i));
+	}
+	pcc_module_print_counters(stdout);
+	link_free(&bottleneck);
+	return 0;
+}
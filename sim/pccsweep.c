@@ -0,0 +1,462 @@
+/*
+ * pccsweep: runs pccsim over a catalog of link profiles and a grid of module
+ * parameters, on all cores, and prints the results as one table.
+ *
+ * The catalog has one profile per line, a name and the pccsim options of the
+ * link ('#' starts a comment):
+ *     wifi    -r 50 -d 20 -B 1 -l 0.001
+ *     lte     -c traces/lte.down -d 60 -B 2
+ * Every profile runs with every combination of the -g values, seeds times.
+ * Instead of a grid, -P reads the parameter points from a file, one point
+ * per line as name=value pairs, the same names on every line (pcctune uses
+ * it for the points it picks).
+ *
+ * Runs are independent processes. Each worker thread owns a deque of runs,
+ * takes from its own tail and, when empty, steals from the head of another
+ * worker, so a few slow profiles (long traces, many flows) don't leave
+ * cores idle at the end of the sweep.
+ */
+
+#include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_PROFILES (1024)
+#define MAX_GRID (16)
+#define MAX_GRID_VALUES (64)
+#define MAX_ARGS (128)
+#define MAX_POINTS (65536)
+
+/* the summary lines of pccsim that go into the table */
+static const char *metrics[] = {
+	"utilization", "goodput_mbit", "qdelay_mean_ms", "qdelay_p95_ms", "qdelay_p99_ms",
+	"loss_rate", "jain_fairness", "react_down_ms", "react_up_ms",
+};
+#define METRICS_NUMBER (sizeof(metrics) / sizeof(metrics[0]))
+
+struct profile {
+	char *name;
+	char *args;
+};
+
+struct grid_param {
+	char *name;
+	char *values[MAX_GRID_VALUES];
+	int values_number;
+};
+
+struct run {
+	int profile;
+	int point;							//index into the grid, mixed radix over the parameters
+	int seed;
+	int ok;
+	double results[METRICS_NUMBER];
+};
+
+struct worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int *runs;							//indexes into the runs array
+	int head;
+	int tail;
+};
+
+static struct profile profiles[MAX_PROFILES];
+static int profiles_number;
+static struct grid_param grid[MAX_GRID];
+static int grid_number;
+static int grid_points = 1;
+static char **point_values[MAX_POINTS];		//the values of each point with -P, NULL for a grid
+static struct run *runs;
+static int runs_number;
+static struct worker *workers;
+static int workers_number;
+static int seeds = 1;
+static const char *sim_path;
+static const char *extra_args = "";
+static int raw_rows;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-j jobs] [-n seeds] [-g param=v1,v2,...]... [-P points_file]\n"
+		"       [-a pccsim_args] [-x pccsim] [-r] catalog\n"
+		"  -g  module parameter values to sweep, the grid is all their combinations\n"
+		"  -P  parameter points to run, one per line as name=value pairs\n"
+		"  -a  pccsim options added to every profile, e.g. \"-t 30 -f 4\"\n"
+		"  -r  print every run instead of the mean over the seeds\n", name);
+	exit(1);
+}
+
+static void load_catalog(const char *path)
+{
+	char line[4096];
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL && profiles_number < MAX_PROFILES) {
+		char *comment = strchr(line, '#');
+		char *name, *args;
+
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		name = strtok(line, " \t\n");
+		if (name == NULL) {
+			continue;
+		}
+		args = strtok(NULL, "\n");
+		profiles[profiles_number].name = strdup(name);
+		profiles[profiles_number].args = strdup(args ? args : "");
+		profiles_number++;
+	}
+	fclose(fp);
+	if (profiles_number == 0) {
+		fprintf(stderr, "%s: no profiles\n", path);
+		exit(1);
+	}
+}
+
+static void add_grid(char *spec)
+{
+	char *values = strchr(spec, '=');
+	struct grid_param *g = grid + grid_number;
+	char *value;
+
+	if (values == NULL || grid_number == MAX_GRID) {
+		fprintf(stderr, "bad grid %s\n", spec);
+		exit(1);
+	}
+	*values++ = '\0';
+	g->name = spec;
+	for (value = strtok(values, ","); value != NULL && g->values_number < MAX_GRID_VALUES;
+		value = strtok(NULL, ",")) {
+		g->values[g->values_number++] = value;
+	}
+	if (g->values_number == 0) {
+		fprintf(stderr, "no values for %s\n", spec);
+		exit(1);
+	}
+	grid_points *= g->values_number;
+	grid_number++;
+}
+
+static void load_points(const char *path)
+{
+	char line[4096];
+	FILE *fp = fopen(path, "r");
+	int points = 0;
+
+	if (fp == NULL) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL && points < MAX_POINTS) {
+		char *pair, *save, *value;
+		int n = 0;
+
+		point_values[points] = calloc(MAX_GRID, sizeof(char *));
+		for (pair = strtok_r(line, " \t\n", &save); pair != NULL; pair = strtok_r(NULL, " \t\n", &save)) {
+			value = strchr(pair, '=');
+			if (value == NULL || n == MAX_GRID) {
+				fprintf(stderr, "%s: bad point %s\n", path, pair);
+				exit(1);
+			}
+			*value++ = '\0';
+			if (points == 0) {
+				grid[n].name = strdup(pair);
+			} else if (n >= grid_number || strcmp(grid[n].name, pair) != 0) {
+				fprintf(stderr, "%s: line %d has other parameters than the first\n", path, points + 1);
+				exit(1);
+			}
+			point_values[points][n++] = strdup(value);
+		}
+		if (n == 0) {
+			free(point_values[points]);
+			continue;
+		}
+		if (points == 0) {
+			grid_number = n;
+		} else if (n != grid_number) {
+			fprintf(stderr, "%s: line %d has other parameters than the first\n", path, points + 1);
+			exit(1);
+		}
+		points++;
+	}
+	fclose(fp);
+	if (points == 0) {
+		fprintf(stderr, "%s: no points\n", path);
+		exit(1);
+	}
+	grid_points = points;
+}
+
+/** value of grid parameter p at grid point point */
+static const char *grid_value(int point, int p)
+{
+	int i;
+
+	if (point_values[0] != NULL) {
+		return point_values[point][p];
+	}
+	for (i = grid_number - 1; i > p; i--) {
+		point /= grid[i].values_number;
+	}
+	return grid[p].values[point % grid[p].values_number];
+}
+
+/** splits s on blanks into argv, s is modified */
+static int split_args(char *s, char **argv, int max)
+{
+	int argc = 0;
+	char *arg, *save;
+
+	//workers split concurrently, so no strtok
+	for (arg = strtok_r(s, " \t", &save); arg != NULL && argc < max; arg = strtok_r(NULL, " \t", &save)) {
+		argv[argc++] = arg;
+	}
+	return argc;
+}
+
+/** runs pccsim for one run and reads the summary metrics from its output */
+static void execute(struct run *r)
+{
+	char *argv[MAX_ARGS + 2 * MAX_GRID + 8];
+	char params[MAX_GRID][256];
+	char seed[32];
+	char *profile_args = strdup(profiles[r->profile].args);
+	char *extra = strdup(extra_args);
+	char line[512];
+	int argc = 0, i, pipefd[2], status, found = 0;
+	pid_t pid;
+	FILE *out;
+
+	argv[argc++] = (char *)sim_path;
+	argc += split_args(extra, argv + argc, MAX_ARGS / 2);
+	argc += split_args(profile_args, argv + argc, MAX_ARGS / 2);
+	for (i = 0; i < grid_number; i++) {
+		snprintf(params[i], sizeof(params[i]), "%s=%s", grid[i].name, grid_value(r->point, i));
+		argv[argc++] = "-p";
+		argv[argc++] = params[i];
+	}
+	snprintf(seed, sizeof(seed), "%d", r->seed + 1);
+	argv[argc++] = "-s";
+	argv[argc++] = seed;
+	argv[argc] = NULL;
+
+	if (pipe(pipefd) < 0) {
+		perror("pipe");
+		goto out;
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(pipefd[0]);
+		close(pipefd[1]);
+		goto out;
+	}
+	if (pid == 0) {
+		dup2(pipefd[1], STDOUT_FILENO);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		execv(sim_path, argv);
+		perror(sim_path);
+		_exit(127);
+	}
+	close(pipefd[1]);
+	out = fdopen(pipefd[0], "r");
+	while (fgets(line, sizeof(line), out) != NULL) {
+		char key[64];
+		double value;
+
+		if (sscanf(line, "%63s %lf", key, &value) != 2) {
+			continue;
+		}
+		for (i = 0; i < (int)METRICS_NUMBER; i++) {
+			if (strcmp(key, metrics[i]) == 0) {
+				r->results[i] = value;
+				found++;
+			}
+		}
+	}
+	fclose(out);
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	r->ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && found >= (int)METRICS_NUMBER;
+out:
+	free(profile_args);
+	free(extra);
+}
+
+/** next run of worker w: its own newest, or the oldest of another worker */
+static int take_run(int w)
+{
+	int i, run = -1;
+
+	pthread_mutex_lock(&workers[w].lock);
+	if (workers[w].tail > workers[w].head) {
+		run = workers[w].runs[--workers[w].tail];
+	}
+	pthread_mutex_unlock(&workers[w].lock);
+	for (i = 1; run < 0 && i < workers_number; i++) {
+		struct worker *victim = workers + (w + i) % workers_number;
+
+		pthread_mutex_lock(&victim->lock);
+		if (victim->tail > victim->head) {
+			run = victim->runs[victim->head++];
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return run;
+}
+
+static void *worker_main(void *arg)
+{
+	int w = (int)(long)arg;
+	int run;
+
+	//no run is ever added, so once all deques are empty the sweep is done
+	while ((run = take_run(w)) >= 0) {
+		execute(runs + run);
+	}
+	return NULL;
+}
+
+static void print_header(void)
+{
+	int i;
+
+	printf("%-16s", "profile");
+	for (i = 0; i < grid_number; i++) {
+		printf(" %14s", grid[i].name);
+	}
+	printf(" %5s", raw_rows ? "seed" : "runs");
+	for (i = 0; i < (int)METRICS_NUMBER; i++) {
+		printf(" %14s", metrics[i]);
+	}
+	printf("\n");
+}
+
+static void print_row(int profile, int point, int count, const double *results)
+{
+	int i;
+
+	printf("%-16s", profiles[profile].name);
+	for (i = 0; i < grid_number; i++) {
+		printf(" %14s", grid_value(point, i));
+	}
+	printf(" %5d", count);
+	for (i = 0; i < (int)METRICS_NUMBER; i++) {
+		printf(" %14.4f", results[i]);
+	}
+	printf("\n");
+}
+
+static void print_table(void)
+{
+	double mean[METRICS_NUMBER];
+	int i, j, s, ok;
+
+	print_header();
+	//runs are ordered by profile, grid point and seed
+	for (i = 0; i < runs_number; i += seeds) {
+		memset(mean, 0, sizeof(mean));
+		ok = 0;
+		for (s = 0; s < seeds; s++) {
+			struct run *r = runs + i + s;
+
+			if (!r->ok) {
+				fprintf(stderr, "run failed: %s grid point %d seed %d\n", profiles[r->profile].name,
+					r->point, r->seed + 1);
+				continue;
+			}
+			if (raw_rows) {
+				print_row(r->profile, r->point, r->seed + 1, r->results);
+			}
+			for (j = 0; j < (int)METRICS_NUMBER; j++) {
+				mean[j] += r->results[j];
+			}
+			ok++;
+		}
+		if (!raw_rows && ok > 0) {
+			for (j = 0; j < (int)METRICS_NUMBER; j++) {
+				mean[j] /= ok;
+			}
+			print_row(runs[i].profile, runs[i].point, ok, mean);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char *default_sim;
+	const char *points_path = NULL;
+	int opt, i, w;
+
+	workers_number = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "j:n:g:P:a:x:r")) != -1) {
+		switch (opt) {
+			case 'j': workers_number = atoi(optarg); break;
+			case 'n': seeds = atoi(optarg); break;
+			case 'g': add_grid(optarg); break;
+			case 'P': points_path = optarg; break;
+			case 'a': extra_args = optarg; break;
+			case 'x': sim_path = optarg; break;
+			case 'r': raw_rows = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || workers_number < 1 || seeds < 1 || (points_path && grid_number > 0)) {
+		usage(argv[0]);
+	}
+	if (points_path != NULL) {
+		load_points(points_path);
+	}
+	if (sim_path == NULL) {
+		//pccsim next to pccsweep
+		default_sim = malloc(strlen(argv[0]) + 16);
+		sprintf(default_sim, "%s/pccsim", dirname(strdup(argv[0])));
+		sim_path = default_sim;
+	}
+	load_catalog(argv[optind]);
+
+	runs_number = profiles_number * grid_points * seeds;
+	runs = calloc(runs_number, sizeof(*runs));
+	for (i = 0; i < runs_number; i++) {
+		runs[i].profile = i / (grid_points * seeds);
+		runs[i].point = (i / seeds) % grid_points;
+		runs[i].seed = i % seeds;
+	}
+
+	if (workers_number > runs_number) {
+		workers_number = runs_number;
+	}
+	workers = calloc(workers_number, sizeof(*workers));
+	for (w = 0; w < workers_number; w++) {
+		pthread_mutex_init(&workers[w].lock, NULL);
+		workers[w].runs = malloc(runs_number * sizeof(int));
+	}
+	//deal the runs round robin, so every worker starts with a mix of profiles
+	for (i = 0; i < runs_number; i++) {
+		struct worker *wk = workers + i % workers_number;
+		wk->runs[wk->tail++] = i;
+	}
+	fprintf(stderr, "# %d profiles, %d grid points, %d seeds: %d runs on %d workers\n",
+		profiles_number, grid_points, seeds, runs_number, workers_number);
+	for (w = 0; w < workers_number; w++) {
+		pthread_create(&workers[w].thread, NULL, worker_main, (void *)(long)w);
+	}
+	for (w = 0; w < workers_number; w++) {
+		pthread_join(workers[w].thread, NULL);
+	}
+
+	print_table();
+	return 0;
+}
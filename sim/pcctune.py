@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""Offline tuning of the pcc_pacing module parameters on the simulator.
+
+Searches the parameter space over the link profiles of a catalog (see
+pccsweep), scores every point with a weighted objective and writes the best
+point as a modprobe options file:
+
+    pcctune.py links.catalog --search bayes --budget 64 \\
+        --space loss_slope=20:400,loss_threshold_ppm=5000:200000,step_percent=1:5 \\
+        --weights throughput=1,delay=0.5,loss=1,fairness=0.5 --out pcc.conf
+    cp pcc.conf /etc/modprobe.d/
+
+The score of a point is its mean over the profiles of
+    throughput * utilization + fairness * jain_fairness
+    - delay * qdelay_p99_ms / delay_ref_ms - loss * loss_rate / loss_ref
+so with the default references 100 ms of p99 queueing delay, or 1% loss,
+cost as much as the whole link.
+
+Searches: grid (evenly spaced levels per parameter), random (uniform, log
+uniform for ranges over a decade) and bayes (a Gaussian process over the
+normalized space, picking batches by expected improvement with the
+pending points believed at the predicted mean).
+"""
+
+import argparse
+import math
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+MODULE = 'pcc_pacing'
+DEFAULT_SPACE = ('minimum_rate=100000:1600000,step_percent=1:5,monitor_rtt_mult=2:8,'
+                 'loss_threshold_ppm=5000:200000,loss_slope=20:400')
+SIM_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+class Space(object):
+    def __init__(self, spec):
+        self.names, self.lo, self.hi = [], [], []
+        for part in spec.split(','):
+            name, rng = part.split('=')
+            lo, hi = [int(x) for x in rng.split(':')]
+            if hi < lo:
+                lo, hi = hi, lo
+            self.names.append(name)
+            self.lo.append(lo)
+            self.hi.append(hi)
+
+    def log_scale(self, i):
+        return self.lo[i] > 0 and self.hi[i] >= 10 * self.lo[i]
+
+    def value(self, i, u):
+        """parameter i at u in [0, 1]"""
+        if self.log_scale(i):
+            v = math.exp(math.log(self.lo[i]) + u * (math.log(self.hi[i]) - math.log(self.lo[i])))
+        else:
+            v = self.lo[i] + u * (self.hi[i] - self.lo[i])
+        return int(round(v))
+
+    def unit(self, i, v):
+        if self.hi[i] == self.lo[i]:
+            return 0.0
+        if self.log_scale(i):
+            return (math.log(v) - math.log(self.lo[i])) / (math.log(self.hi[i]) - math.log(self.lo[i]))
+        return float(v - self.lo[i]) / (self.hi[i] - self.lo[i])
+
+    def point(self, units):
+        return tuple(self.value(i, u) for i, u in enumerate(units))
+
+    def units(self, point):
+        return [self.unit(i, v) for i, v in enumerate(point)]
+
+
+def parse_weights(spec):
+    weights = {'throughput': 1.0, 'delay': 0.0, 'loss': 0.0, 'fairness': 0.0}
+    for part in spec.split(','):
+        name, value = part.split('=')
+        if name not in weights:
+            sys.exit('unknown objective %s, use %s' % (name, ', '.join(sorted(weights))))
+        weights[name] = float(value)
+    return weights
+
+
+def evaluate(points, space, args):
+    """runs the points on all profiles with pccsweep, returns the score of each point"""
+    with tempfile.NamedTemporaryFile('w', suffix='.points') as f:
+        for p in points:
+            f.write(' '.join('%s=%d' % (n, v) for n, v in zip(space.names, p)) + '\n')
+        f.flush()
+        cmd = [os.path.join(SIM_DIR, 'pccsweep'), '-n', str(args.seeds), '-P', f.name, '-a', args.sim_args]
+        if args.jobs:
+            cmd += ['-j', str(args.jobs)]
+        out = subprocess.check_output(cmd + [args.catalog]).decode()
+
+    lines = out.splitlines()
+    header = lines[0].split()
+    col = dict((name, i) for i, name in enumerate(header))
+    scores = dict((p, []) for p in points)
+    for line in lines[1:]:
+        fields = line.split()
+        p = tuple(int(fields[col[n]]) for n in space.names)
+        m = lambda name: float(fields[col[name]])
+        w = args.weights
+        scores[p].append(w['throughput'] * m('utilization') + w['fairness'] * m('jain_fairness') -
+                         w['delay'] * m('qdelay_p99_ms') / args.delay_ref_ms -
+                         w['loss'] * m('loss_rate') / args.loss_ref)
+    # a point failing on a profile scores as if it had no throughput there
+    profiles = max(len(s) for s in scores.values())
+    return [sum(scores[p]) / profiles if scores[p] else float('-inf') for p in points]
+
+
+def grid_points(space, budget):
+    dims = len(space.names)
+    levels = max(2, int(math.floor(budget ** (1.0 / dims))))
+    points = [()]
+    for i in range(dims):
+        points = [p + (space.value(i, float(l) / (levels - 1)),) for p in points for l in range(levels)]
+    return sorted(set(points))
+
+
+def cholesky(a):
+    n = len(a)
+    l = [[0.0] * n for _ in range(n)]
+    for i in range(n):
+        for j in range(i + 1):
+            s = a[i][j] - sum(l[i][k] * l[j][k] for k in range(j))
+            l[i][j] = math.sqrt(max(s, 1e-12)) if i == j else s / l[j][j]
+    return l
+
+
+def solve_lower(l, b):
+    x = []
+    for i in range(len(b)):
+        x.append((b[i] - sum(l[i][k] * x[k] for k in range(i))) / l[i][i])
+    return x
+
+
+def solve_upper_t(l, b):
+    n = len(b)
+    x = [0.0] * n
+    for i in reversed(range(n)):
+        x[i] = (b[i] - sum(l[k][i] * x[k] for k in range(i + 1, n))) / l[i][i]
+    return x
+
+
+class GaussianProcess(object):
+    """zero mean GP with an RBF kernel over normalized inputs and standardized outputs"""
+
+    def __init__(self, xs, ys, length=0.3, noise=1e-3):
+        self.xs, self.length = xs, length
+        self.mean = sum(ys) / len(ys)
+        self.std = math.sqrt(sum((y - self.mean) ** 2 for y in ys) / len(ys)) or 1.0
+        zs = [(y - self.mean) / self.std for y in ys]
+        k = [[self.kernel(a, b) + (noise if i == j else 0) for j, b in enumerate(xs)] for i, a in enumerate(xs)]
+        self.l = cholesky(k)
+        self.alpha = solve_upper_t(self.l, solve_lower(self.l, zs))
+
+    def kernel(self, a, b):
+        return math.exp(-sum((x - y) ** 2 for x, y in zip(a, b)) / (2 * self.length ** 2))
+
+    def predict(self, x):
+        ks = [self.kernel(x, b) for b in self.xs]
+        mu = sum(k * a for k, a in zip(ks, self.alpha))
+        v = solve_lower(self.l, ks)
+        var = max(1.0 - sum(t * t for t in v), 1e-12)
+        return self.mean + self.std * mu, self.std * math.sqrt(var)
+
+
+def expected_improvement(mu, sigma, best):
+    z = (mu - best) / sigma
+    cdf = 0.5 * (1 + math.erf(z / math.sqrt(2)))
+    pdf = math.exp(-z * z / 2) / math.sqrt(2 * math.pi)
+    return (mu - best) * cdf + sigma * pdf
+
+
+def bayes_batch(space, results, batch, rng, candidates=2000):
+    xs = [space.units(p) for p in results]
+    ys = list(results.values())
+    best = max(ys)
+    chosen = []
+    for _ in range(batch):
+        gp = GaussianProcess(xs, ys)
+        pool = [[rng.random() for _ in space.names] for _ in range(candidates)]
+        x = max(pool, key=lambda u: expected_improvement(*(gp.predict(u) + (best,))))
+        p = space.point(x)
+        if p in results or p in chosen:
+            continue
+        chosen.append(p)
+        # believe the pending point scores what the model predicts
+        believed = gp.predict(space.units(p))[0]
+        xs = xs + [space.units(p)]
+        ys = ys + [believed]
+    return chosen
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('catalog')
+    parser.add_argument('--space', default=DEFAULT_SPACE, help='name=lo:hi,... integer ranges')
+    parser.add_argument('--search', choices=['grid', 'random', 'bayes'], default='bayes')
+    parser.add_argument('--budget', type=int, default=64, help='parameter points to evaluate')
+    parser.add_argument('--batch', type=int, default=8, help='points evaluated together (random, bayes)')
+    parser.add_argument('--weights', default='throughput=1,delay=0.5,loss=1,fairness=0.5')
+    parser.add_argument('--delay-ref-ms', type=float, default=100.0)
+    parser.add_argument('--loss-ref', type=float, default=0.01)
+    parser.add_argument('--seeds', type=int, default=1)
+    parser.add_argument('--sim-args', default='-t 20 -f 2', help='pccsim options for every run')
+    parser.add_argument('--jobs', type=int, default=0, help='pccsweep workers, all cores by default')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--out', default='pcc.conf', help='modprobe options file of the best point')
+    parser.add_argument('--log', help='file to write every evaluated point and its score to')
+    args = parser.parse_args()
+    args.weights = parse_weights(args.weights)
+
+    space = Space(args.space)
+    rng = random.Random(args.seed)
+    results = {}
+
+    def run(points):
+        points = [p for p in dict.fromkeys(points) if p not in results]
+        if not points:
+            return
+        for p, score in zip(points, evaluate(points, space, args)):
+            results[p] = score
+        best = max(results, key=results.get)
+        print('# %d points, best %.4f at %s' % (len(results), results[best],
+              ' '.join('%s=%d' % nv for nv in zip(space.names, best))), file=sys.stderr)
+
+    if args.search == 'grid':
+        run(grid_points(space, args.budget))
+    else:
+        # random points first, bayes keeps a quarter of the budget for them
+        initial = args.budget if args.search == 'random' else max(args.batch, args.budget // 4)
+        while len(results) < initial:
+            run([space.point([rng.random() for _ in space.names])
+                 for _ in range(min(args.batch, initial - len(results)))])
+        stale = 0
+        while len(results) < args.budget and stale < 3:
+            before = len(results)
+            run(bayes_batch(space, results, min(args.batch, args.budget - len(results)), rng))
+            stale = stale + 1 if len(results) == before else 0
+
+    ranked = sorted(results.items(), key=lambda kv: -kv[1])
+    if args.log:
+        with open(args.log, 'w') as f:
+            f.write('\t'.join(space.names + ['score']) + '\n')
+            for p, score in ranked:
+                f.write('\t'.join([str(v) for v in p] + ['%.6f' % score]) + '\n')
+    best, score = ranked[0]
+    with open(args.out, 'w') as f:
+        f.write('# tuned by pcctune on %s, score %.4f, weights %s, sim %s\n' % (
+            os.path.basename(args.catalog), score,
+            ','.join('%s=%g' % kv for kv in sorted(args.weights.items())), args.sim_args))
+        f.write('options %s %s\n' % (MODULE, ' '.join('%s=%d' % nv for nv in zip(space.names, best))))
+    print(open(args.out).read(), end='')
+
+
+if __name__ == '__main__':
+    main()
@@ -1,6 +1,7 @@
 #!/bin/sh
 make M=$PWD
+make -C tools
 sudo rmmod pcc_pacing
 sudo insmod pcc_pacing.ko
 sudo dmesg -C
-sudo python test.py
+tools/pccperf -c 10.1.1.4 -p 9999 -t 60
@@ -0,0 +1,672 @@
+/*
+ * pcc_mi_check: validates the per-monitor accounting of the PCC module.
+ * Takes a sender side capture and the records read from <debugfs>/pcc/mi_records
+ * during the same run, reconstructs every monitor from the packets and reports
+ * where the module's numbers differ:
+ *  - sent: bytes transmitted (including retransmissions) from the first
+ *    transmission of snd_start_seq until snd_end_seq was sent, against
+ *    segments_sent * mss.
+ *  - lost: bytes of the monitor's sequence range that were retransmitted,
+ *    against bytes_lost.
+ *  - rate: sent bytes over the capture's sending period, against actual_rate.
+ *  - delivery: time from the first transmission until snd_end_seq was
+ *    cumulatively acked, against the record's end_time_ns - start_time_ns.
+ * Monitors are matched to the capture by sequence.
+ *
+ * capture with: tcpdump -i <dev> -s 128 -w capture.pcap tcp
+ * records with: cat /sys/kernel/debug/pcc/mi_records > records.bin
+ * started before the flows, the module only records monitors that start
+ * while the file is open.
+ * usage: pcc_mi_check [-v] [-e max_error_percent] capture.pcap records.bin
+ */
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../pcc_info.h"
+
+#define PCAP_MAGIC_US (0xa1b2c3d4)
+#define PCAP_MAGIC_NS (0xa1b23c4d)
+#define LINKTYPE_NULL (0)
+#define LINKTYPE_ETHERNET (1)
+#define LINKTYPE_RAW (101)
+#define LINKTYPE_LINUX_SLL (113)
+#define LINKTYPE_LINUX_SLL2 (276)
+#define ETHERTYPE_IPV4 (0x0800)
+#define ETHERTYPE_IPV6 (0x86dd)
+#define ETHERTYPE_VLAN (0x8100)
+#define IPPROTO_TCP_NUM (6)
+#define TCP_FLAG_ACK (0x10)
+
+struct data_packet {
+	uint64_t ts_ns;
+	uint64_t start;					//unwrapped sequence of the first byte
+	uint32_t len;
+	uint8_t retrans;
+};
+
+struct ack_packet {
+	uint64_t ts_ns;
+	uint64_t ack;					//unwrapped cumulative ack
+};
+
+struct range {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct flow {
+	uint8_t family;
+	uint8_t saddr[16];
+	uint8_t daddr[16];
+	uint16_t sport;					//network order
+	uint16_t dport;
+	uint32_t isn;					//sequence all unwrapped values are relative to
+	int have_isn;
+	uint64_t last_seq;				//last unwrapped data sequence, reference for unwrapping
+	uint64_t last_ack;				//last unwrapped ack
+	uint64_t high;					//highest sequence sent
+
+	struct data_packet *data;
+	size_t data_len, data_cap;
+	uint64_t *data_high;			//highest sequence sent up to and including each packet
+	struct ack_packet *acks;
+	size_t acks_len, acks_cap;
+	struct range *lost;				//retransmitted sequence ranges, merged
+	size_t lost_len, lost_cap;
+};
+
+struct flow_stats {
+	int monitors;
+	int not_captured;
+	int flagged;
+	double sent_error_sum;
+	double rate_error_sum;
+	uint64_t module_lost;
+	uint64_t capture_lost;
+	int lost_only_module;
+	int lost_only_capture;
+	double delivery_diff_sum_us;
+	double delivery_diff_max_us;
+};
+
+static struct flow *flows;
+static size_t flows_len;
+static int verbose;
+static double max_error = 5.0;
+
+static void *grow(void *arr, size_t *cap, size_t len, size_t size)
+{
+	if (len < *cap) {
+		return arr;
+	}
+	*cap = *cap ? *cap * 2 : 1024;
+	arr = realloc(arr, *cap * size);
+	if (arr == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+	return arr;
+}
+
+/** unwraps a 32 bit sequence to the 64 bit value closest to ref */
+static uint64_t unwrap(uint32_t seq, uint32_t isn, uint64_t ref)
+{
+	uint32_t rel = seq - isn;
+	int32_t delta = (int32_t)(rel - (uint32_t)ref);
+
+	if (delta < 0 && (uint64_t)(-(int64_t)delta) > ref) {
+		return rel;
+	}
+	return ref + delta;
+}
+
+static int addr_len(uint8_t family)
+{
+	return family == AF_INET6 ? 16 : 4;
+}
+
+static struct flow *find_flow(uint8_t family, const uint8_t *src, const uint8_t *dst,
+	uint16_t sport, uint16_t dport, int *reverse)
+{
+	size_t i;
+	int len = addr_len(family);
+
+	for (i = 0; i < flows_len; i++) {
+		struct flow *f = flows + i;
+		if (f->family != family) {
+			continue;
+		}
+		if (f->sport == sport && f->dport == dport && !memcmp(f->saddr, src, len) && !memcmp(f->daddr, dst, len)) {
+			*reverse = 0;
+			return f;
+		}
+		if (f->sport == dport && f->dport == sport && !memcmp(f->saddr, dst, len) && !memcmp(f->daddr, src, len)) {
+			*reverse = 1;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+static void add_flow(const struct pcc_mi_record *rec)
+{
+	int reverse;
+	struct flow *f;
+
+	if (find_flow(rec->family, rec->saddr, rec->daddr, rec->sport, rec->dport, &reverse) != NULL) {
+		return;
+	}
+	flows = realloc(flows, (flows_len + 1) * sizeof(*flows));
+	f = flows + flows_len++;
+	memset(f, 0, sizeof(*f));
+	f->family = rec->family;
+	memcpy(f->saddr, rec->saddr, sizeof(f->saddr));
+	memcpy(f->daddr, rec->daddr, sizeof(f->daddr));
+	f->sport = rec->sport;
+	f->dport = rec->dport;
+}
+
+static void on_tcp_packet(uint64_t ts_ns, uint8_t family, const uint8_t *src, const uint8_t *dst,
+	const uint8_t *tcp, uint32_t tcp_len, uint32_t payload_len)
+{
+	uint16_t sport, dport;
+	uint32_t seq, ack;
+	int reverse;
+	struct flow *f;
+
+	if (tcp_len < 20) {
+		return;
+	}
+	memcpy(&sport, tcp, 2);
+	memcpy(&dport, tcp + 2, 2);
+	f = find_flow(family, src, dst, sport, dport, &reverse);
+	if (f == NULL) {
+		return;
+	}
+	seq = ntohl(*(const uint32_t *)(tcp + 4));
+	ack = ntohl(*(const uint32_t *)(tcp + 8));
+
+	if (!reverse) {
+		struct data_packet *p;
+		uint64_t start;
+
+		if (!f->have_isn) {
+			f->isn = seq;
+			f->have_isn = 1;
+		}
+		if (payload_len == 0) {
+			return;
+		}
+		start = unwrap(seq, f->isn, f->last_seq);
+		f->last_seq = start;
+
+		f->data = grow(f->data, &f->data_cap, f->data_len, sizeof(*f->data));
+		p = f->data + f->data_len++;
+		p->ts_ns = ts_ns;
+		p->start = start;
+		p->len = payload_len;
+		p->retrans = start < f->high;
+		if (p->retrans) {
+			struct range *r;
+			uint64_t end = start + payload_len < f->high ? start + payload_len : f->high;
+
+			f->lost = grow(f->lost, &f->lost_cap, f->lost_len, sizeof(*f->lost));
+			r = f->lost + f->lost_len++;
+			r->start = start;
+			r->end = end;
+		}
+		if (start + payload_len > f->high) {
+			f->high = start + payload_len;
+		}
+	} else if (tcp[13] & TCP_FLAG_ACK) {
+		struct ack_packet *a;
+		uint64_t unwrapped;
+
+		if (!f->have_isn) {
+			return;
+		}
+		unwrapped = unwrap(ack, f->isn, f->last_ack ? f->last_ack : f->last_seq);
+		//keep the acks cumulative, reordered acks don't move it back
+		if (unwrapped < f->last_ack) {
+			unwrapped = f->last_ack;
+		}
+		f->last_ack = unwrapped;
+		f->acks = grow(f->acks, &f->acks_cap, f->acks_len, sizeof(*f->acks));
+		a = f->acks + f->acks_len++;
+		a->ts_ns = ts_ns;
+		a->ack = unwrapped;
+	}
+}
+
+static void on_ip_packet(uint64_t ts_ns, const uint8_t *ip, uint32_t len)
+{
+	uint8_t src[16] = { 0 }, dst[16] = { 0 };
+	uint32_t ip_hdr_len, total_len, tcp_hdr_len;
+	uint8_t family;
+
+	if (len < 1) {
+		return;
+	}
+	if ((ip[0] >> 4) == 4) {
+		if (len < 20 || ip[9] != IPPROTO_TCP_NUM) {
+			return;
+		}
+		family = AF_INET;
+		ip_hdr_len = (ip[0] & 0xf) * 4;
+		total_len = ntohs(*(const uint16_t *)(ip + 2));
+		memcpy(src, ip + 12, 4);
+		memcpy(dst, ip + 16, 4);
+	} else if ((ip[0] >> 4) == 6) {
+		//extension headers are not followed
+		if (len < 40 || ip[6] != IPPROTO_TCP_NUM) {
+			return;
+		}
+		family = AF_INET6;
+		ip_hdr_len = 40;
+		total_len = 40 + ntohs(*(const uint16_t *)(ip + 4));
+		memcpy(src, ip + 8, 16);
+		memcpy(dst, ip + 24, 16);
+	} else {
+		return;
+	}
+	if (len < ip_hdr_len + 20 || total_len < ip_hdr_len + 20) {
+		return;
+	}
+	tcp_hdr_len = (ip[ip_hdr_len + 12] >> 4) * 4;
+	if (total_len < ip_hdr_len + tcp_hdr_len) {
+		return;
+	}
+	on_tcp_packet(ts_ns, family, src, dst, ip + ip_hdr_len, len - ip_hdr_len,
+		total_len - ip_hdr_len - tcp_hdr_len);
+}
+
+static void on_frame(uint64_t ts_ns, uint32_t linktype, const uint8_t *frame, uint32_t len)
+{
+	uint16_t ethertype;
+
+	switch (linktype) {
+		case LINKTYPE_ETHERNET:
+			if (len < 14) {
+				return;
+			}
+			ethertype = ntohs(*(const uint16_t *)(frame + 12));
+			frame += 14;
+			len -= 14;
+			if (ethertype == ETHERTYPE_VLAN && len >= 4) {
+				ethertype = ntohs(*(const uint16_t *)(frame + 2));
+				frame += 4;
+				len -= 4;
+			}
+			if (ethertype != ETHERTYPE_IPV4 && ethertype != ETHERTYPE_IPV6) {
+				return;
+			}
+			break;
+		case LINKTYPE_LINUX_SLL:
+			if (len < 16) {
+				return;
+			}
+			frame += 16;
+			len -= 16;
+			break;
+		case LINKTYPE_LINUX_SLL2:
+			if (len < 20) {
+				return;
+			}
+			frame += 20;
+			len -= 20;
+			break;
+		case LINKTYPE_NULL:
+			if (len < 4) {
+				return;
+			}
+			frame += 4;
+			len -= 4;
+			break;
+		case LINKTYPE_RAW:
+			break;
+		default:
+			return;
+	}
+	on_ip_packet(ts_ns, frame, len);
+}
+
+static int read_pcap(const char *path)
+{
+	uint32_t header[6], rec[4];
+	uint8_t *frame = NULL;
+	uint32_t frame_cap = 0;
+	int swapped = 0, nanos = 0;
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+	if (fread(header, sizeof(header), 1, fp) != 1) {
+		fprintf(stderr, "%s: short pcap header\n", path);
+		return -1;
+	}
+	if (header[0] == PCAP_MAGIC_NS || header[0] == __builtin_bswap32(PCAP_MAGIC_NS)) {
+		nanos = 1;
+	} else if (header[0] != PCAP_MAGIC_US && header[0] != __builtin_bswap32(PCAP_MAGIC_US)) {
+		fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", path);
+		return -1;
+	}
+	swapped = header[0] != PCAP_MAGIC_US && header[0] != PCAP_MAGIC_NS;
+	if (swapped) {
+		header[5] = __builtin_bswap32(header[5]);
+	}
+
+	while (fread(rec, sizeof(rec), 1, fp) == 1) {
+		uint64_t ts_ns;
+		int i;
+
+		if (swapped) {
+			for (i = 0; i < 4; i++) {
+				rec[i] = __builtin_bswap32(rec[i]);
+			}
+		}
+		if (rec[2] > frame_cap) {
+			frame_cap = rec[2];
+			frame = realloc(frame, frame_cap);
+		}
+		if (fread(frame, 1, rec[2], fp) != rec[2]) {
+			break;
+		}
+		ts_ns = (uint64_t)rec[0] * 1000000000ULL + (nanos ? rec[1] : (uint64_t)rec[1] * 1000);
+		on_frame(ts_ns, header[5], frame, rec[2]);
+	}
+	free(frame);
+	fclose(fp);
+	return 0;
+}
+
+static struct pcc_mi_record *read_records(const char *path, size_t *count)
+{
+	struct pcc_mi_record *recs = NULL;
+	size_t cap = 0, len = 0;
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		perror(path);
+		return NULL;
+	}
+	for (;;) {
+		recs = grow(recs, &cap, len, sizeof(*recs));
+		if (fread(recs + len, sizeof(*recs), 1, fp) != 1) {
+			break;
+		}
+		len++;
+	}
+	fclose(fp);
+	*count = len;
+	return recs;
+}
+
+static int cmp_range(const void *a, const void *b)
+{
+	const struct range *ra = a, *rb = b;
+
+	return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+/** sorts and merges the retransmitted ranges, and builds the highest sent sequence index */
+static void finish_flow(struct flow *f)
+{
+	size_t i, merged = 0;
+	uint64_t high = 0;
+
+	f->data_high = malloc((f->data_len + 1) * sizeof(*f->data_high));
+	for (i = 0; i < f->data_len; i++) {
+		if (f->data[i].start + f->data[i].len > high) {
+			high = f->data[i].start + f->data[i].len;
+		}
+		f->data_high[i] = high;
+	}
+
+	if (f->lost_len == 0) {
+		return;
+	}
+	qsort(f->lost, f->lost_len, sizeof(*f->lost), cmp_range);
+	for (i = 1; i < f->lost_len; i++) {
+		if (f->lost[i].start <= f->lost[merged].end) {
+			if (f->lost[i].end > f->lost[merged].end) {
+				f->lost[merged].end = f->lost[i].end;
+			}
+		} else {
+			f->lost[++merged] = f->lost[i];
+		}
+	}
+	f->lost_len = merged + 1;
+}
+
+/** first data packet whose highest sent sequence is above seq */
+static size_t data_above(const struct flow *f, uint64_t seq)
+{
+	size_t lo = 0, hi = f->data_len;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (f->data_high[mid] > seq) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+/** first data packet sent at or after ts_ns */
+static size_t data_at(const struct flow *f, uint64_t ts_ns)
+{
+	size_t lo = 0, hi = f->data_len;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (f->data[mid].ts_ns < ts_ns) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/** first ack covering seq */
+static size_t ack_covering(const struct flow *f, uint64_t seq)
+{
+	size_t lo = 0, hi = f->acks_len;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (f->acks[mid].ack >= seq) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+static uint64_t lost_in_range(const struct flow *f, uint64_t start, uint64_t end)
+{
+	uint64_t lost = 0;
+	size_t lo = 0, hi = f->lost_len;
+
+	//first range ending after start
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (f->lost[mid].end > start) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	for (; lo < f->lost_len && f->lost[lo].start < end; lo++) {
+		uint64_t s = f->lost[lo].start > start ? f->lost[lo].start : start;
+		uint64_t e = f->lost[lo].end < end ? f->lost[lo].end : end;
+		lost += e - s;
+	}
+	return lost;
+}
+
+static double rel_error(double module, double capture)
+{
+	if (capture == 0) {
+		return module == 0 ? 0 : 100;
+	}
+	return (module - capture) * 100 / capture;
+}
+
+static void check_monitor(struct flow *f, const struct pcc_mi_record *rec, struct flow_stats *st)
+{
+	uint64_t ref, start, end, capture_sent = 0, capture_lost, module_sent, capture_rate, duration_ns;
+	double sent_err, rate_err, delivery_diff_us = 0;
+	size_t first, last, ack, i;
+	int64_t capture_delivery_us = -1, module_delivery_us;
+	int flagged;
+
+	if (rec->snd_end_seq == rec->snd_start_seq || f->data_len == 0) {
+		return;
+	}
+	st->monitors++;
+
+	//the data sent when the monitor started is the reference for unwrapping its sequences
+	i = data_at(f, rec->start_time_ns);
+	ref = f->data[i < f->data_len ? i : f->data_len - 1].start;
+	start = unwrap(rec->snd_start_seq, f->isn, ref);
+	end = unwrap(rec->snd_end_seq, f->isn, start);
+
+	first = data_above(f, start);
+	last = data_above(f, end - 1);
+	if (first >= f->data_len || last >= f->data_len) {
+		st->not_captured++;
+		return;
+	}
+	for (i = first; i <= last; i++) {
+		capture_sent += f->data[i].len;
+	}
+	duration_ns = f->data[last].ts_ns - f->data[first].ts_ns;
+	capture_rate = duration_ns ? capture_sent * 1000000000ULL / duration_ns : 0;
+	capture_lost = lost_in_range(f, start, end);
+	ack = ack_covering(f, end);
+	if (ack < f->acks_len) {
+		capture_delivery_us = (int64_t)(f->acks[ack].ts_ns - f->data[first].ts_ns) / 1000;
+	}
+
+	module_sent = (uint64_t)rec->segments_sent * rec->mss;
+	module_delivery_us = (int64_t)(rec->end_time_ns - rec->start_time_ns) / 1000;
+	sent_err = rel_error(module_sent, capture_sent);
+	rate_err = rel_error(rec->actual_rate, capture_rate);
+	if (capture_delivery_us >= 0) {
+		delivery_diff_us = module_delivery_us - capture_delivery_us;
+	}
+
+	st->sent_error_sum += sent_err < 0 ? -sent_err : sent_err;
+	st->rate_error_sum += rate_err < 0 ? -rate_err : rate_err;
+	st->module_lost += rec->bytes_lost;
+	st->capture_lost += capture_lost;
+	st->lost_only_module += rec->bytes_lost != 0 && capture_lost == 0;
+	st->lost_only_capture += rec->bytes_lost == 0 && capture_lost != 0;
+	st->delivery_diff_sum_us += delivery_diff_us < 0 ? -delivery_diff_us : delivery_diff_us;
+	if ((delivery_diff_us < 0 ? -delivery_diff_us : delivery_diff_us) > st->delivery_diff_max_us) {
+		st->delivery_diff_max_us = delivery_diff_us < 0 ? -delivery_diff_us : delivery_diff_us;
+	}
+
+	flagged = sent_err > max_error || sent_err < -max_error || rate_err > max_error || rate_err < -max_error ||
+		(rec->bytes_lost == 0) != (capture_lost == 0);
+	st->flagged += flagged;
+	if (verbose || flagged) {
+		printf("  %s monitor %2u seq %u-%u state %u: sent %llu/%llu (%+.1f%%) lost %u/%llu "
+			"rate %llu/%llu (%+.1f%%) delivery %lld/%lld us\n",
+			flagged ? "!" : " ", rec->index, rec->snd_start_seq, rec->snd_end_seq, rec->state,
+			(unsigned long long)module_sent, (unsigned long long)capture_sent, sent_err,
+			rec->bytes_lost, (unsigned long long)capture_lost,
+			(unsigned long long)rec->actual_rate, (unsigned long long)capture_rate, rate_err,
+			(long long)module_delivery_us, (long long)capture_delivery_us);
+	}
+}
+
+static void print_flow(const struct flow *f)
+{
+	char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+
+	inet_ntop(f->family, f->saddr, src, sizeof(src));
+	inet_ntop(f->family, f->daddr, dst, sizeof(dst));
+	printf("flow %s:%u -> %s:%u (%zu data packets, %zu acks)\n", src, ntohs(f->sport), dst,
+		ntohs(f->dport), f->data_len, f->acks_len);
+}
+
+int main(int argc, char **argv)
+{
+	struct pcc_mi_record *recs;
+	size_t recs_len, i, j;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ve:")) != -1) {
+		switch (opt) {
+			case 'v':
+				verbose = 1;
+				break;
+			case 'e':
+				max_error = atof(optarg);
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (argc - optind != 2) {
+		goto usage;
+	}
+
+	recs = read_records(argv[optind + 1], &recs_len);
+	if (recs == NULL) {
+		return 1;
+	}
+	for (i = 0; i < recs_len; i++) {
+		add_flow(recs + i);
+	}
+	if (read_pcap(argv[optind]) < 0) {
+		return 1;
+	}
+
+	printf("sent/lost/rate/delivery are module/capture, ! marks monitors off by more than %.1f%%\n"
+		"or where only one side saw loss\n", max_error);
+	for (i = 0; i < flows_len; i++) {
+		struct flow *f = flows + i;
+		struct flow_stats st;
+		int checked;
+
+		memset(&st, 0, sizeof(st));
+		finish_flow(f);
+		print_flow(f);
+		for (j = 0; j < recs_len; j++) {
+			int reverse;
+			if (find_flow(recs[j].family, recs[j].saddr, recs[j].daddr, recs[j].sport, recs[j].dport, &reverse) == f) {
+				check_monitor(f, recs + j, &st);
+			}
+		}
+
+		checked = st.monitors - st.not_captured;
+		printf("  monitors %d (not in capture %d), flagged %d\n", st.monitors, st.not_captured, st.flagged);
+		if (checked > 0) {
+			printf("  mean |error|: sent %.2f%% rate %.2f%% delivery %.0f us (max %.0f us)\n",
+				st.sent_error_sum / checked, st.rate_error_sum / checked,
+				st.delivery_diff_sum_us / checked, st.delivery_diff_max_us);
+			printf("  lost bytes: module %llu capture %llu, loss seen only by module in %d monitors, "
+				"only in capture in %d\n", (unsigned long long)st.module_lost,
+				(unsigned long long)st.capture_lost, st.lost_only_module, st.lost_only_capture);
+		}
+	}
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-v] [-e max_error_percent] capture.pcap records.bin\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,688 @@
+/*
+ * pccperf: a load generator and sink for benchmarking the PCC module.
+ * The sender keeps the copies out of the measurement by using MSG_ZEROCOPY or
+ * sendfile(), the receiver drains with splice() into /dev/null.
+ * Every interval the sender prints goodput, RTT (from TCP_INFO) and the PCC
+ * info (from TCP_CC_INFO) of every flow. At the end it prints summary lines
+ * with the mean goodput, the peak send queue memory (SO_MEMINFO) of every
+ * flow and the CPU time of the sender per received ACK.
+ *
+ * receiver: pccperf -s [-p port] [-M]
+ * sender:   pccperf -c host [-p port] [-P flows] [-t seconds] [-i interval_ms]
+ *                   [-m zerocopy|sendfile|send] [-C congestion] [-M]
+ *                   [-d bytes:deadline_ms] [-k mark]
+ * -M uses MPTCP sockets, the congestion control applies to every subflow.
+ * -k sets SO_MARK on the flows, the module couples the rate increases of
+ * sockets with the same mark when it is loaded with coupling=1.
+ * -d gives every flow a deadline through /proc/net/pcc_deadlines, and the
+ * summary tells which flows had the bytes acked in time (to the interval).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/tcp.h>
+#include <linux/errqueue.h>
+#include <linux/sock_diag.h>
+
+#include "../pcc_info.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP 262
+#endif
+
+#define DEFAULT_PORT "9999"
+#define MAX_FLOWS (256)
+#define BUFFER_SIZE (1 << 20)
+#define FILE_SIZE (64 << 20)
+#define SPLICE_SIZE (1 << 20)
+#define DEADLINES_FILE "/proc/net/pcc_deadlines"
+
+typedef enum {
+	SEND_MODE_ZEROCOPY = 0,
+	SEND_MODE_SENDFILE,
+	SEND_MODE_SEND,
+} send_mode_t;
+
+struct flow {
+	int fd;							//connected socket
+	pthread_t thread;				//thread sending on the socket
+	uint64_t last_bytes_acked;		//bytes acked at the last report
+	uint64_t zerocopy_pending;		//zerocopy sends not yet completed
+	uint32_t mem_peak;				//largest send queue memory seen at a report
+	double completed;				//seconds until deadline_bytes were acked, 0 before
+};
+
+static const char *host;
+static const char *port = DEFAULT_PORT;
+static const char *congestion = "pcc";
+static int flows_number = 1;
+static int duration_sec = 10;
+static int interval_ms = 1000;
+static send_mode_t send_mode = SEND_MODE_ZEROCOPY;
+static int protocol;
+static unsigned int mark;
+static uint64_t deadline_bytes;
+static unsigned int deadline_ms;
+static volatile sig_atomic_t stop;
+
+static struct flow flows[MAX_FLOWS];
+static char *send_buffer;
+static int send_file = -1;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s -s [-p port] [-M]\n"
+		"       %s -c host [-p port] [-P flows] [-t seconds] [-i interval_ms]\n"
+		"          [-m zerocopy|sendfile|send] [-C congestion] [-M] [-d bytes:deadline_ms]\n"
+		"          [-k mark]\n", name, name);
+	exit(1);
+}
+
+/** reads the zerocopy completions so the kernel can release the pinned pages */
+static void reap_zerocopy(struct flow *f, int block)
+{
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *serr;
+
+	while (f->zerocopy_pending > 0) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(f->fd, &msg, MSG_ERRQUEUE | (block ? 0 : MSG_DONTWAIT)) < 0) {
+			if (errno == EAGAIN && block) {
+				usleep(100);
+				continue;
+			}
+			return;
+		}
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+				continue;
+			}
+			//completions are reported as a range of send calls
+			f->zerocopy_pending -= (uint64_t)(serr->ee_data - serr->ee_info + 1);
+		}
+		block = 0;
+	}
+}
+
+static void send_loop_zerocopy(struct flow *f)
+{
+	ssize_t ret;
+
+	while (!stop) {
+		ret = send(f->fd, send_buffer, BUFFER_SIZE, MSG_ZEROCOPY);
+		if (ret < 0) {
+			if (errno == ENOBUFS) {
+				//too many pinned pages, wait for completions
+				reap_zerocopy(f, 1);
+				continue;
+			}
+			if (errno != EINTR) {
+				perror("send");
+			}
+			return;
+		}
+		f->zerocopy_pending++;
+		reap_zerocopy(f, 0);
+	}
+}
+
+static void send_loop_sendfile(struct flow *f)
+{
+	off_t offset = 0;
+	ssize_t ret;
+
+	while (!stop) {
+		if (offset >= FILE_SIZE) {
+			offset = 0;
+		}
+		ret = sendfile(f->fd, send_file, &offset, FILE_SIZE - offset);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				perror("sendfile");
+			}
+			return;
+		}
+	}
+}
+
+static void send_loop_send(struct flow *f)
+{
+	ssize_t ret;
+
+	while (!stop) {
+		ret = send(f->fd, send_buffer, BUFFER_SIZE, 0);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				perror("send");
+			}
+			return;
+		}
+	}
+}
+
+static void *sender_thread(void *arg)
+{
+	struct flow *f = arg;
+
+	switch (send_mode) {
+		case SEND_MODE_ZEROCOPY:
+			send_loop_zerocopy(f);
+			break;
+		case SEND_MODE_SENDFILE:
+			send_loop_sendfile(f);
+			break;
+		case SEND_MODE_SEND:
+			send_loop_send(f);
+			break;
+	}
+	return NULL;
+}
+
+static int connect_flow(struct flow *f)
+{
+	struct addrinfo hints, *res, *ai;
+	int one = 1;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(host, port, &hints, &res);
+	if (err != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+		return -1;
+	}
+
+	f->fd = -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		f->fd = socket(ai->ai_family, ai->ai_socktype, protocol ? protocol : ai->ai_protocol);
+		if (f->fd < 0) {
+			continue;
+		}
+		//the congestion control must be set before connecting to be used from the first segment
+		if (setsockopt(f->fd, IPPROTO_TCP, TCP_CONGESTION, congestion, strlen(congestion)) < 0) {
+			perror("setsockopt(TCP_CONGESTION)");
+			close(f->fd);
+			f->fd = -1;
+			break;
+		}
+		if (mark && setsockopt(f->fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark)) < 0) {
+			perror("setsockopt(SO_MARK)");
+			close(f->fd);
+			f->fd = -1;
+			break;
+		}
+		if (send_mode == SEND_MODE_ZEROCOPY &&
+			setsockopt(f->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+			perror("setsockopt(SO_ZEROCOPY), falling back to send");
+			send_mode = SEND_MODE_SEND;
+		}
+		if (connect(f->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(f->fd);
+		f->fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (f->fd < 0) {
+		fprintf(stderr, "could not connect to %s:%s\n", host, port);
+		return -1;
+	}
+	return 0;
+}
+
+/** writes the deadline of the flow's 4-tuple for the module to pick up */
+static int set_deadline(struct flow *f)
+{
+	struct sockaddr_storage local, peer;
+	socklen_t len = sizeof(local);
+	char saddr[INET6_ADDRSTRLEN], daddr[INET6_ADDRSTRLEN];
+	uint16_t sport, dport;
+	FILE *fp;
+
+	if (getsockname(f->fd, (struct sockaddr *)&local, &len) < 0) {
+		perror("getsockname");
+		return -1;
+	}
+	len = sizeof(peer);
+	if (getpeername(f->fd, (struct sockaddr *)&peer, &len) < 0) {
+		perror("getpeername");
+		return -1;
+	}
+	if (local.ss_family == AF_INET6) {
+		struct sockaddr_in6 *l = (struct sockaddr_in6 *)&local, *p = (struct sockaddr_in6 *)&peer;
+		inet_ntop(AF_INET6, &l->sin6_addr, saddr, sizeof(saddr));
+		inet_ntop(AF_INET6, &p->sin6_addr, daddr, sizeof(daddr));
+		sport = ntohs(l->sin6_port);
+		dport = ntohs(p->sin6_port);
+	} else {
+		struct sockaddr_in *l = (struct sockaddr_in *)&local, *p = (struct sockaddr_in *)&peer;
+		inet_ntop(AF_INET, &l->sin_addr, saddr, sizeof(saddr));
+		inet_ntop(AF_INET, &p->sin_addr, daddr, sizeof(daddr));
+		sport = ntohs(l->sin_port);
+		dport = ntohs(p->sin_port);
+	}
+
+	fp = fopen(DEADLINES_FILE, "w");
+	if (fp == NULL) {
+		perror(DEADLINES_FILE);
+		return -1;
+	}
+	fprintf(fp, "%s %u %s %u %llu %u\n", saddr, sport, daddr, dport, (unsigned long long)deadline_bytes, deadline_ms);
+	if (fclose(fp) != 0) {
+		perror(DEADLINES_FILE);
+		return -1;
+	}
+	return 0;
+}
+
+static int prepare_send_source(void)
+{
+	size_t written = 0;
+
+	send_buffer = mmap(NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (send_buffer == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	memset(send_buffer, 'a', BUFFER_SIZE);
+
+	if (send_mode != SEND_MODE_SENDFILE) {
+		return 0;
+	}
+
+	send_file = memfd_create("pccperf", 0);
+	if (send_file < 0) {
+		perror("memfd_create");
+		return -1;
+	}
+	while (written < FILE_SIZE) {
+		ssize_t ret = write(send_file, send_buffer, BUFFER_SIZE);
+		if (ret <= 0) {
+			perror("write");
+			return -1;
+		}
+		written += ret;
+	}
+	return 0;
+}
+
+/** keeps the peak of the memory queued for sending and not yet freed by ACKs */
+static void sample_memory(struct flow *f)
+{
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof(meminfo);
+
+	memset(meminfo, 0, sizeof(meminfo));
+	if (getsockopt(f->fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) < 0) {
+		return;
+	}
+	if (meminfo[SK_MEMINFO_WMEM_QUEUED] > f->mem_peak) {
+		f->mem_peak = meminfo[SK_MEMINFO_WMEM_QUEUED];
+	}
+}
+
+/** prints one line per flow with the goodput, rtt and the pcc state of the last interval */
+static void report_flows(double elapsed, uint64_t interval_us)
+{
+	struct tcp_info ti;
+	struct tcp_pcc_info pi;
+	socklen_t len;
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < flows_number; i++) {
+		struct flow *f = flows + i;
+		uint64_t acked, rate = 0, actual_rate = 0;
+		int state = -1, rate_changes = -1;
+
+		memset(&ti, 0, sizeof(ti));
+		len = sizeof(ti);
+		if (getsockopt(f->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+			continue;
+		}
+		acked = ti.tcpi_bytes_acked - f->last_bytes_acked;
+		f->last_bytes_acked = ti.tcpi_bytes_acked;
+		if (deadline_bytes && !f->completed && ti.tcpi_bytes_acked >= deadline_bytes) {
+			f->completed = elapsed;
+		}
+		total += acked;
+		sample_memory(f);
+
+		memset(&pi, 0, sizeof(pi));
+		len = sizeof(pi);
+		if (getsockopt(f->fd, IPPROTO_TCP, TCP_CC_INFO, &pi, &len) == 0 && len >= sizeof(pi)) {
+			rate = ((uint64_t)pi.pcc_rate_hi << 32) | pi.pcc_rate_lo;
+			actual_rate = ((uint64_t)pi.pcc_actual_rate_hi << 32) | pi.pcc_actual_rate_lo;
+			state = pi.pcc_state;
+			rate_changes = pi.pcc_rate_changes;
+		}
+
+		printf("%8.3f flow %3d goodput %10.3f Mbit/s rtt %7u us rttvar %7u us retrans %6u "
+			"pacing %10.3f Mbit/s pcc_rate %10.3f Mbit/s pcc_actual %10.3f Mbit/s pcc_state %d pcc_rate_changes %d\n",
+			elapsed, i, acked * 8.0 / interval_us, ti.tcpi_rtt, ti.tcpi_rttvar, ti.tcpi_total_retrans,
+			ti.tcpi_pacing_rate * 8.0 / 1e6, rate * 8.0 / 1e6, actual_rate * 8.0 / 1e6, state, rate_changes);
+	}
+	if (flows_number > 1) {
+		printf("%8.3f total    goodput %10.3f Mbit/s\n", elapsed, total * 8.0 / interval_us);
+	}
+	fflush(stdout);
+}
+
+static double cpu_seconds(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * prints the mean goodput, rtt and peak memory of every flow over the whole run
+ * and the sender CPU time per ACK, the ACKs being the segments received
+ */
+static void report_summary(double elapsed, double cpu)
+{
+	struct tcp_info ti;
+	socklen_t len;
+	uint64_t acks = 0;
+	int i;
+
+	for (i = 0; i < flows_number; i++) {
+		struct flow *f = flows + i;
+
+		memset(&ti, 0, sizeof(ti));
+		len = sizeof(ti);
+		if (getsockopt(f->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+			continue;
+		}
+		sample_memory(f);
+		acks += ti.tcpi_segs_in;
+		printf("summary flow %3d goodput %10.3f Mbit/s rtt %7u us retrans %6u acks %10u mem_peak %10u bytes\n",
+			i, ti.tcpi_bytes_acked * 8.0 / (elapsed * 1e6), ti.tcpi_rtt, ti.tcpi_total_retrans,
+			ti.tcpi_segs_in, f->mem_peak);
+	}
+	printf("summary cpu %.3f s acks %llu cpu_per_ack %.3f us\n", cpu, (unsigned long long)acks,
+		acks ? cpu * 1e6 / acks : 0.0);
+	if (deadline_bytes) {
+		int met = 0;
+
+		for (i = 0; i < flows_number; i++) {
+			struct flow *f = flows + i;
+			int ok = f->completed > 0 && f->completed * 1000 <= deadline_ms;
+
+			printf("summary deadline flow %3d bytes %llu deadline_ms %u completed_ms %.1f met %d\n", i,
+				(unsigned long long)deadline_bytes, deadline_ms, f->completed > 0 ? f->completed * 1000 : -1.0, ok);
+			met += ok;
+		}
+		printf("summary deadline_met_rate %.4f\n", (double)met / flows_number);
+	}
+	fflush(stdout);
+}
+
+static int run_sender(void)
+{
+	uint64_t start, last, now;
+	double cpu_start;
+	int i;
+
+	if (prepare_send_source() < 0) {
+		return 1;
+	}
+
+	for (i = 0; i < flows_number; i++) {
+		if (connect_flow(flows + i) < 0) {
+			return 1;
+		}
+		if (deadline_bytes && set_deadline(flows + i) < 0) {
+			return 1;
+		}
+	}
+	for (i = 0; i < flows_number; i++) {
+		pthread_create(&flows[i].thread, NULL, sender_thread, flows + i);
+	}
+
+	start = last = now_us();
+	cpu_start = cpu_seconds();
+	while (!stop) {
+		usleep(interval_ms * 1000);
+		now = now_us();
+		report_flows((now - start) / 1e6, now - last);
+		last = now;
+		if (duration_sec > 0 && now - start >= (uint64_t)duration_sec * 1000000) {
+			stop = 1;
+		}
+	}
+
+	report_summary((now_us() - start) / 1e6, cpu_seconds() - cpu_start);
+	for (i = 0; i < flows_number; i++) {
+		//wake up senders blocked on a full socket
+		shutdown(flows[i].fd, SHUT_RDWR);
+		pthread_join(flows[i].thread, NULL);
+		close(flows[i].fd);
+	}
+	return 0;
+}
+
+struct sink {
+	int fd;
+	int id;
+};
+
+static void *sink_thread(void *arg)
+{
+	struct sink *s = arg;
+	uint64_t received = 0, last_received = 0, start, last, now;
+	int pipefd[2];
+	int devnull;
+	ssize_t ret;
+
+	devnull = open("/dev/null", O_WRONLY);
+	if (devnull < 0 || pipe(pipefd) < 0) {
+		perror("receiver setup");
+		goto out;
+	}
+
+	start = last = now_us();
+	for (;;) {
+		ret = splice(s->fd, NULL, pipefd[1], NULL, SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (ret <= 0) {
+			break;
+		}
+		received += ret;
+		while (ret > 0) {
+			ssize_t out = splice(pipefd[0], NULL, devnull, NULL, ret, SPLICE_F_MOVE);
+			if (out <= 0) {
+				goto done;
+			}
+			ret -= out;
+		}
+
+		now = now_us();
+		if (now - last >= (uint64_t)interval_ms * 1000) {
+			printf("%8.3f sink %3d goodput %10.3f Mbit/s\n", (now - start) / 1e6, s->id,
+				(received - last_received) * 8.0 / (now - last));
+			fflush(stdout);
+			last_received = received;
+			last = now;
+		}
+	}
+done:
+	now = now_us();
+	printf("sink %d received %llu bytes in %.3f s\n", s->id, (unsigned long long)received, (now - start) / 1e6);
+	fflush(stdout);
+	close(pipefd[0]);
+	close(pipefd[1]);
+out:
+	if (devnull >= 0) {
+		close(devnull);
+	}
+	close(s->fd);
+	free(s);
+	return NULL;
+}
+
+static int run_receiver(void)
+{
+	struct addrinfo hints, *res;
+	int listen_fd, one = 1, id = 0;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET6;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	err = getaddrinfo(NULL, port, &hints, &res);
+	if (err != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+		return 1;
+	}
+
+	listen_fd = socket(res->ai_family, res->ai_socktype, protocol ? protocol : res->ai_protocol);
+	if (listen_fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(listen_fd, res->ai_addr, res->ai_addrlen) < 0 || listen(listen_fd, MAX_FLOWS) < 0) {
+		perror("bind/listen");
+		return 1;
+	}
+	freeaddrinfo(res);
+
+	while (!stop) {
+		pthread_t thread;
+		struct sink *s;
+		int fd = accept(listen_fd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("accept");
+			break;
+		}
+		s = malloc(sizeof(*s));
+		s->fd = fd;
+		s->id = id++;
+		pthread_create(&thread, NULL, sink_thread, s);
+		pthread_detach(thread);
+	}
+	close(listen_fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sigaction sa;
+	int server = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "sc:p:P:t:i:m:C:Md:k:")) != -1) {
+		switch (opt) {
+			case 's':
+				server = 1;
+				break;
+			case 'c':
+				host = optarg;
+				break;
+			case 'p':
+				port = optarg;
+				break;
+			case 'P':
+				flows_number = atoi(optarg);
+				break;
+			case 't':
+				duration_sec = atoi(optarg);
+				break;
+			case 'i':
+				interval_ms = atoi(optarg);
+				break;
+			case 'm':
+				if (strcmp(optarg, "zerocopy") == 0) {
+					send_mode = SEND_MODE_ZEROCOPY;
+				} else if (strcmp(optarg, "sendfile") == 0) {
+					send_mode = SEND_MODE_SENDFILE;
+				} else if (strcmp(optarg, "send") == 0) {
+					send_mode = SEND_MODE_SEND;
+				} else {
+					usage(argv[0]);
+				}
+				break;
+			case 'C':
+				congestion = optarg;
+				break;
+			case 'M':
+				protocol = IPPROTO_MPTCP;
+				break;
+			case 'd':
+				if (sscanf(optarg, "%llu:%u", (unsigned long long *)&deadline_bytes, &deadline_ms) != 2 ||
+					deadline_bytes == 0) {
+					usage(argv[0]);
+				}
+				break;
+			case 'k':
+				mark = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if ((!server && host == NULL) || flows_number < 1 || flows_number > MAX_FLOWS || interval_ms <= 0) {
+		usage(argv[0]);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	return server ? run_receiver() : run_sender();
+}
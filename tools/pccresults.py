@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+"""Benchmark result store and regression check.
+
+record turns the output of a benchmark run into rows of
+suite, scenario, metric, trial, value and appends them to a results file,
+CSV when the file name ends in .csv and one JSON object per line otherwise:
+
+    pccperf -c 10.10.2.2 -t 30 > run.log
+    pccresults.py record -s pccperf -n bpf_100mbit -r 1 -o new.csv run.log
+    topology.sh report | pccresults.py record -s topology -n parking_lot -r 1 -o new.csv
+    pccsweep -r -n 5 links.catalog | pccresults.py record -s sweep -o new.csv
+    cat /sys/kernel/debug/pcc_bench/results | pccresults.py record -s bench -r 1 -o new.csv
+    pccresults.py record -s contention -n rps_off_softirq -r 1 -o new.csv rps_off_softirq.1.log
+
+compare matches the rows of two results files by suite, scenario and metric,
+and prints the mean of each side with its confidence interval over the
+trials and the change with the Welch confidence interval of the difference.
+A change is flagged as a regression when the interval of the difference
+excludes zero in the bad direction and the change is at least the threshold.
+Goodput, utilization, fairness and the decision rate are better higher,
+everything else (RTT, queueing delay, loss, retransmissions, CPU per ACK,
+memory per socket, ns/op, inconclusive decisions) lower. The exit status is 1 when there is a regression:
+
+    pccresults.py compare base.csv new.csv [--confidence 0.95] [--threshold 2]
+
+suites:
+  pccperf    a pccperf sender log: goodput_mbit (sum over the flows),
+             rtt_us (mean over the flows and intervals after the warmup),
+             retrans, mem_peak_bytes (largest socket), cpu_per_ack_us and
+             flowN_goodput_mbit
+  topology   a topology.sh report: flowN_goodput_mbit, flowN_retrans,
+             hopN_utilization, hopN_jain_fairness and jain_fairness
+  sweep      a pccsweep table, the scenario is the profile and the swept
+             parameters, the trial the seed column of pccsweep -r
+  bench      pcc_bench results: NAME_ns_per_op
+  contention a contention.sh run log: the pccperf metrics, decision_rate
+             (decisions per second per flow), inconclusive_ratio (of the
+             decisions), overrun_ratio (of the monitors) and
+             softirq_per_ack_us (softirq time of all CPUs per ACK, the
+             softirq load included)
+"""
+
+import argparse
+import csv
+import json
+import math
+import re
+import sys
+
+FIELDS = ['suite', 'scenario', 'metric', 'trial', 'value']
+HIGHER_IS_BETTER = re.compile(r'goodput|utilization|jain|throughput|decision_rate')
+
+
+def parse_pccperf(lines, args):
+    rows = []
+    goodput, rtt, summary = {}, [], {}
+    cpu_per_ack = None
+    for line in lines:
+        f = line.split()
+        if len(f) > 13 and f[:2] == ['summary', 'flow']:
+            summary.setdefault(int(f[2]), {}).update(goodput=float(f[4]), retrans=int(f[10]), mem=int(f[14]))
+        elif len(f) > 6 and f[:2] == ['summary', 'cpu']:
+            cpu_per_ack = float(f[7])
+        elif len(f) > 13 and f[1] == 'flow' and float(f[0]) > args.warmup:
+            goodput.setdefault(int(f[2]), []).append(float(f[4]))
+            rtt.append(float(f[7]))
+            summary.setdefault(int(f[2]), {})['retrans'] = int(f[13])
+    total = 0.0
+    for flow in sorted(set(goodput) | set(summary)):
+        # the interval lines leave the warmup out, the summary is the fallback
+        samples = goodput.get(flow)
+        mean = sum(samples) / len(samples) if samples else summary[flow].get('goodput', 0.0)
+        rows.append(('flow%d_goodput_mbit' % flow, mean))
+        total += mean
+    rows.append(('goodput_mbit', total))
+    if rtt:
+        rows.append(('rtt_us', sum(rtt) / len(rtt)))
+    rows.append(('retrans', sum(s.get('retrans', 0) for s in summary.values())))
+    mems = [s['mem'] for s in summary.values() if 'mem' in s]
+    if mems:
+        rows.append(('mem_peak_bytes', max(mems)))
+    if cpu_per_ack is not None:
+        rows.append(('cpu_per_ack_us', cpu_per_ack))
+    return [(args.scenario, metric, args.trial, value) for metric, value in rows]
+
+
+def parse_topology(lines, args):
+    rows = []
+    for line in lines:
+        f = line.split()
+        if len(f) >= 6 and f[0] == 'flow':
+            rows.append(('flow%s_goodput_mbit' % f[1], float(f[3])))
+            rows.append(('flow%s_retrans' % f[1], float(f[5])))
+        elif len(f) >= 6 and f[0] == 'hop':
+            rows.append(('hop%s_utilization' % f[1], float(f[3])))
+            rows.append(('hop%s_jain_fairness' % f[1], float(f[5])))
+        elif len(f) == 2 and f[0] == 'jain_fairness':
+            rows.append(('jain_fairness', float(f[1])))
+    return [(args.scenario, metric, args.trial, value) for metric, value in rows]
+
+
+def parse_sweep(lines, args):
+    rows = []
+    header = None
+    for line in lines:
+        f = line.split()
+        if not f or f[0].startswith('#'):
+            continue
+        if f[0] == 'profile':
+            header = f
+            metrics_from = header.index('utilization')
+            continue
+        if header is None:
+            continue
+        names = [args.scenario] if args.scenario else []
+        names += [f[0]] + ['%s=%s' % kv for kv in zip(header[1:metrics_from], f[1:metrics_from])
+                           if kv[0] not in ('seed', 'runs')]
+        trial = f[header.index('seed')] if 'seed' in header else args.trial
+        for metric, value in zip(header[metrics_from:], f[metrics_from:]):
+            rows.append((' '.join(names), metric, trial, float(value)))
+    return rows
+
+
+def parse_bench(lines, args):
+    rows = []
+    for line in lines:
+        m = re.match(r'(\S+) \d+ iterations ([0-9.]+) ns/op', line.strip())
+        if m:
+            rows.append((args.scenario, '%s_ns_per_op' % m.group(1), args.trial, float(m.group(2))))
+    return rows
+
+
+def parse_contention(lines, args):
+    rows = parse_pccperf(lines, args)
+    flows = len([line for line in lines if line.startswith('summary flow')]) or 1
+    acks = 0
+    for line in lines:
+        f = line.split()
+        if len(f) > 3 and f[:2] == ['summary', 'cpu']:
+            acks = int(f[5])
+        elif len(f) > 14 and f[0] == 'contention':
+            c = dict(zip(f[1::2], map(float, f[2::2])))
+            if c['duration_s'] > 0:
+                rows.append((args.scenario, 'decision_rate', args.trial, c['decisions'] / c['duration_s'] / flows))
+            if c['decisions']:
+                rows.append((args.scenario, 'inconclusive_ratio', args.trial, c['inconclusive'] / c['decisions']))
+            if c['monitors']:
+                rows.append((args.scenario, 'overrun_ratio', args.trial, c['overruns'] / c['monitors']))
+            if acks:
+                rows.append((args.scenario, 'softirq_per_ack_us', args.trial, c['softirq_s'] * 1e6 / acks))
+    return rows
+
+
+PARSERS = {'pccperf': parse_pccperf, 'topology': parse_topology, 'sweep': parse_sweep, 'bench': parse_bench,
+           'contention': parse_contention}
+
+
+def write_rows(path, rows):
+    if path.endswith('.csv'):
+        with open(path, 'a+') as f:
+            f.seek(0)
+            empty = not f.read(1)
+            f.seek(0, 2)
+            w = csv.writer(f)
+            if empty:
+                w.writerow(FIELDS)
+            w.writerows(rows)
+    else:
+        with open(path, 'a') as f:
+            for row in rows:
+                f.write(json.dumps(dict(zip(FIELDS, row))) + '\n')
+
+
+def read_rows(path):
+    with open(path) as f:
+        if path.endswith('.csv'):
+            records = list(csv.DictReader(f))
+        else:
+            records = [json.loads(line) for line in f if line.strip()]
+    groups = {}
+    for r in records:
+        groups.setdefault((r['suite'], r['scenario'], r['metric']), []).append(float(r['value']))
+    return groups
+
+
+def record(args):
+    lines = []
+    for path in args.input or ['-']:
+        lines += (sys.stdin if path == '-' else open(path)).read().splitlines()
+    rows = [(args.suite,) + row for row in PARSERS[args.suite](lines, args)]
+    if not rows:
+        sys.exit('no %s results found' % args.suite)
+    write_rows(args.out, rows)
+    print('%d rows appended to %s' % (len(rows), args.out), file=sys.stderr)
+
+
+def betacf(a, b, x):
+    """continued fraction of the incomplete beta function (modified Lentz)"""
+    tiny = 1e-300
+    c, d = 1.0, 1.0 - (a + b) * x / (a + 1)
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 300):
+        for num in (m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m)),
+                    -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1))):
+            d = 1.0 + num * d
+            d = 1.0 / (d if abs(d) > tiny else tiny)
+            c = 1.0 + num / c
+            c = c if abs(c) > tiny else tiny
+            h *= d * c
+        if abs(d * c - 1.0) < 1e-12:
+            break
+    return h
+
+
+def betainc(a, b, x):
+    if x <= 0 or x >= 1:
+        return max(0.0, min(1.0, x))
+    front = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) + a * math.log(x) + b * math.log(1 - x))
+    if x < (a + 1) / (a + b + 2):
+        return front * betacf(a, b, x) / a
+    return 1.0 - front * betacf(b, a, 1 - x) / b
+
+
+def t_quantile(p, df):
+    """the p quantile of Student's t with df degrees of freedom, p > 0.5"""
+    cdf = lambda t: 1.0 - 0.5 * betainc(df / 2.0, 0.5, df / (df + t * t))
+    lo, hi = 0.0, 1.0
+    while cdf(hi) < p:
+        hi *= 2
+    for _ in range(100):
+        mid = (lo + hi) / 2
+        lo, hi = (mid, hi) if cdf(mid) < p else (lo, mid)
+    return (lo + hi) / 2
+
+
+def summarize(values):
+    n = len(values)
+    mean = sum(values) / n
+    var = sum((v - mean) ** 2 for v in values) / (n - 1) if n > 1 else 0.0
+    return n, mean, var
+
+
+def compare(args):
+    base, new = read_rows(args.base), read_rows(args.new)
+    p = 1 - (1 - args.confidence) / 2
+    regressions = 0
+    print('%-10s %-32s %-24s %5s %14s %12s %5s %14s %12s %9s %19s  %s' % (
+        'suite', 'scenario', 'metric', 'n', 'base', '+-', 'n', 'new', '+-', 'change%', 'ci%', 'verdict'))
+    for key in sorted(set(base) & set(new)):
+        if args.metrics and not re.search(args.metrics, key[2]):
+            continue
+        n1, m1, v1 = summarize(base[key])
+        n2, m2, v2 = summarize(new[key])
+        ci1 = t_quantile(p, n1 - 1) * math.sqrt(v1 / n1) if n1 > 1 else float('nan')
+        ci2 = t_quantile(p, n2 - 1) * math.sqrt(v2 / n2) if n2 > 1 else float('nan')
+        diff = m2 - m1
+        verdict = ''
+        lo = hi = float('nan')
+        if n1 > 1 and n2 > 1:
+            se2 = v1 / n1 + v2 / n2
+            if se2 > 0:
+                # Welch-Satterthwaite degrees of freedom
+                df = se2 ** 2 / ((v1 / n1) ** 2 / (n1 - 1) + (v2 / n2) ** 2 / (n2 - 1))
+                half = t_quantile(p, df) * math.sqrt(se2)
+            else:
+                half = 0.0
+            lo, hi = diff - half, diff + half
+            worse = diff < 0 if HIGHER_IS_BETTER.search(key[2]) else diff > 0
+            significant = lo > 0 or hi < 0
+            large = abs(diff) >= args.threshold / 100.0 * abs(m1) if m1 else diff != 0
+            if significant and large:
+                verdict = 'REGRESSION' if worse else 'improvement'
+                regressions += worse
+        else:
+            verdict = 'too few trials'
+        pct = lambda v: 100.0 * v / abs(m1) if m1 else float('nan')
+        print('%-10s %-32s %-24s %5d %14.4f %12.4f %5d %14.4f %12.4f %9.2f [%8.2f,%8.2f]  %s' % (
+            key[0], key[1][:32], key[2][:24], n1, m1, ci1, n2, m2, ci2, pct(diff), pct(lo), pct(hi), verdict))
+    for key in sorted(set(base) ^ set(new)):
+        print('%-10s %-32s %-24s only in %s' % (key[0], key[1][:32], key[2][:24], 'base' if key in base else 'new'))
+    print('%d regressions at %g%% confidence and %g%% threshold' % (regressions, args.confidence * 100, args.threshold))
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='command')
+    rec = sub.add_parser('record', help='append the results of one run')
+    rec.add_argument('-s', '--suite', choices=sorted(PARSERS), required=True)
+    rec.add_argument('-n', '--scenario', default='', help='scenario name (a prefix for sweep)')
+    rec.add_argument('-r', '--trial', default='1', help='trial of the scenario (sweep -r rows carry their seed)')
+    rec.add_argument('-w', '--warmup', type=float, default=5.0, help='pccperf seconds to leave out')
+    rec.add_argument('-o', '--out', required=True, help='results file, .csv or JSON lines')
+    rec.add_argument('input', nargs='*', help='benchmark output, stdin by default')
+    cmp = sub.add_parser('compare', help='compare two results files')
+    cmp.add_argument('base')
+    cmp.add_argument('new')
+    cmp.add_argument('--confidence', type=float, default=0.95)
+    cmp.add_argument('--threshold', type=float, default=1.0, help='smallest change in percent to flag')
+    cmp.add_argument('--metrics', help='regular expression of the metrics to compare')
+    args = parser.parse_args()
+
+    if args.command == 'record':
+        record(args)
+    elif args.command == 'compare':
+        sys.exit(compare(args))
+    else:
+        parser.print_help()
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()